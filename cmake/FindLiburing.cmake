@@ -0,0 +1,37 @@
+# - Try to find Liburing
+# Once done, this will define
+#
+#  LIBURING_FOUND - system has Liburing installed
+#  LIBURING_INCLUDE_DIR - the Liburing include directories
+#  LIBURING_LIBRARIES - link these to use Liburing
+#
+# The user may wish to set, in the CMake GUI or otherwise, this variable:
+#  LIBURING_DIR - path to start searching for the module
+
+find_path(LIBURING_INCLUDE_DIR
+    liburing.h
+    HINTS
+    PATH_SUFFIXES
+    include
+    )
+
+find_library(LIBURING_LIBRARY
+    uring
+    HINTS
+    PATH_SUFFIXES
+    lib
+    )
+
+mark_as_advanced(LIBURING_INCLUDE_DIR LIBURING_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Liburing
+    DEFAULT_MSG
+    LIBURING_INCLUDE_DIR
+    LIBURING_LIBRARY)
+
+if(LIBURING_FOUND)
+    set(LIBURING_LIBRARIES "${LIBURING_LIBRARY}") # Add any dependencies here
+    set(HAS_LIBURING ON)
+    set(HAS_LIBURING ${HAS_LIBURING} PARENT_SCOPE)
+endif()
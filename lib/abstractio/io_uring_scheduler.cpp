@@ -0,0 +1,548 @@
+#include "configure.hpp"
+
+#ifdef HAS_LIBURING
+
+#include "io_uring_scheduler.hpp"
+#include "utils/utils.hpp"
+
+#include <sse/schemes/utils/logger.hpp>
+
+#include <cstring>
+#include <liburing.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace sse {
+namespace abstractio {
+
+// Size of the (sparse) registered files table
+static constexpr unsigned kRegisteredFilesCount = 64;
+// Idle time (in ms) after which the kernel's SQ polling thread goes to sleep
+static constexpr unsigned kSQPollIdleMs = 100;
+// Queue depth of the ring used to probe the kernel's io_uring support
+static constexpr unsigned kProbeQueueDepth = 4;
+
+// number of request objects allocated at once
+static constexpr size_t kRequestPoolSlabSize = 64;
+
+IoUringScheduler::IoUringScheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   const bool     use_sqpoll,
+                                   const bool     register_files)
+    : m_page_size(page_size), m_queue_depth(queue_depth),
+      m_use_sqpoll(use_sqpoll), m_register_files(register_files),
+      m_request_pool(sizeof(IoUringRequest),
+                     alignof(IoUringRequest),
+                     kRequestPoolSlabSize),
+      m_stop_flag(false), m_submitted_queries_count(0),
+      m_completed_queries_count(0), m_failed_queries_count(0)
+{
+    memset(&m_ring, 0, sizeof(m_ring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    if (m_use_sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = kSQPollIdleMs;
+    }
+
+    int res = io_uring_queue_init_params(m_queue_depth, &m_ring, &params);
+
+    if (res == -EPERM && m_use_sqpoll) {
+        // older kernels require privileges to use SQPOLL
+        logger::logger()->warn(
+            "Unable to setup the io_uring SQ polling thread (EPERM). Falling "
+            "back to regular submissions.");
+        memset(&params, 0, sizeof(params));
+        res = io_uring_queue_init_params(m_queue_depth, &m_ring, &params);
+    }
+
+    if (res < 0) {
+        throw std::runtime_error("Error initializing io_uring: "
+                                 + std::to_string(-res) + "(" + strerror(-res)
+                                 + ")\n");
+    }
+
+    // The completion thread waits on the completion queue with a timeout.
+    // Without IORING_FEAT_EXT_ARG, liburing implements the timeout with an
+    // additional SQE, which would race with the submitting threads.
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+        io_uring_queue_exit(&m_ring);
+        throw std::runtime_error(
+            "The kernel's io_uring interface does not support extended "
+            "arguments (Linux 5.11 or newer is required)");
+    }
+
+    m_cq_entries = params.cq_entries;
+
+    if (m_register_files) {
+        std::vector<int> files(kRegisteredFilesCount, -1);
+
+        res = io_uring_register_files(&m_ring, files.data(), files.size());
+        if (res < 0) {
+            logger::logger()->warn(
+                "Unable to register the io_uring files table: {}({}). Falling "
+                "back to unregistered files.",
+                -res,
+                strerror(-res));
+        } else {
+            m_files_registered = true;
+        }
+    }
+
+    m_notify_thread = std::thread(&IoUringScheduler::notify_loop, this);
+}
+
+IoUringScheduler::~IoUringScheduler()
+{
+    IoUringScheduler::wait_completions();
+
+    io_uring_queue_exit(&m_ring);
+
+#ifdef LOG_AIO_SCHEDULER_STATS
+    std::cerr << "io_uring_submit: " << m_submit_calls << " calls\n";
+    std::cerr << m_submit_EBUSY << " with full completion queue\n";
+    std::cerr << m_fixed_buffer_requests << " requests on fixed buffers\n";
+    std::cerr << m_completed_queries_count << " completed queries\n";
+    std::cerr << m_failed_queries_count.load() << " failed queries\n";
+#endif
+}
+
+bool IoUringScheduler::is_supported()
+{
+    static const bool supported = []() {
+        struct io_uring        ring;
+        struct io_uring_params params;
+        memset(&ring, 0, sizeof(ring));
+        memset(&params, 0, sizeof(params));
+
+        if (io_uring_queue_init_params(kProbeQueueDepth, &ring, &params) < 0) {
+            return false;
+        }
+        bool has_ext_arg = (params.features & IORING_FEAT_EXT_ARG) != 0;
+        io_uring_queue_exit(&ring);
+
+        return has_ext_arg;
+    }();
+
+    return supported;
+}
+
+void IoUringScheduler::notify_loop()
+{
+    struct __kernel_timespec timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_nsec = 100000000;
+
+    while (!m_stop_flag.load()
+           || finished_queries_count() < m_submitted_queries_count.load()) {
+        struct io_uring_cqe* cqe = nullptr;
+        int ret = io_uring_wait_cqe_timeout(&m_ring, &cqe, &timeout);
+
+        if (ret == -ETIME || ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            std::cerr << "Error in io_uring_wait_cqe_timeout: "
+                      << std::to_string(-ret) << "(" << strerror(-ret)
+                      << ")\n";
+            continue;
+        }
+
+        unsigned n_requests = 0;
+
+        // Retire every CQE before running its callback: the callbacks might
+        // submit new requests, and these submissions need room in the
+        // completion queue (which would otherwise only be made once the
+        // whole batch is processed, i.e. never if every callback submits).
+        while (io_uring_peek_cqe(&m_ring, &cqe) == 0 && cqe != nullptr) {
+            IoUringRequest* req
+                = static_cast<IoUringRequest*>(io_uring_cqe_get_data(cqe));
+            const int32_t res = cqe->res;
+
+            io_uring_cqe_seen(&m_ring, cqe);
+
+            if (req != nullptr) {
+                if (res < 0) {
+                    m_failed_queries_count++;
+                } else {
+                    m_completed_queries_count++;
+                }
+                req->notify(res);
+                req->~IoUringRequest();
+                m_request_pool.release(req);
+                n_requests++;
+            }
+        }
+
+        // wake up the threads waiting for room in the completion queue
+        if (n_requests > 0 && m_waiting_submissions.exchange(false)) {
+            std::lock_guard<std::mutex> guard(m_submission_lock);
+            m_cv_submission.notify_all();
+        }
+    }
+}
+
+int IoUringScheduler::check_args(void* buf, size_t len, off_t offset) const
+{
+    if (!utility::is_aligned(buf, m_page_size)) {
+        return -EINVAL_UNALIGNED_BUFFER;
+    }
+
+    if (len % 512 != 0) {
+        return -EINVAL_BUFFERSIZE;
+    }
+
+    if (offset % 512 != 0) {
+        return -EINVAL_UNALIGNED_ACCESS;
+    }
+
+    return 0;
+}
+
+void IoUringScheduler::wait_completions()
+{
+    {
+        // push the SQEs that might still be waiting in the submission queue
+        std::unique_lock<std::mutex> lock(m_submission_lock);
+        flush_submissions(lock);
+    }
+
+    m_stop_flag = true;
+
+    if (m_notify_thread.joinable()) {
+        m_notify_thread.join();
+    }
+}
+
+uint64_t IoUringScheduler::finished_queries_count() const
+{
+    return m_completed_queries_count.load() + m_failed_queries_count.load();
+}
+
+void IoUringScheduler::wait_for_completions(std::unique_lock<std::mutex>& lock)
+{
+    const uint64_t finished = finished_queries_count();
+
+    m_waiting_submissions = true;
+    m_cv_submission.wait_for(lock, std::chrono::milliseconds(100), [&] {
+        return finished_queries_count() != finished;
+    });
+}
+
+int IoUringScheduler::flush_submissions(std::unique_lock<std::mutex>& lock)
+{
+    while (m_pending_sqes > 0) {
+        int ret = io_uring_submit(&m_ring);
+#ifdef LOG_AIO_SCHEDULER_STATS
+        m_submit_calls++;
+#endif
+
+        if (ret > 0) {
+            m_pending_sqes -= std::min(static_cast<unsigned>(ret),
+                                       m_pending_sqes);
+        } else if (ret == 0) {
+            break;
+        } else if (ret == -EBUSY || ret == -EAGAIN) {
+#ifdef LOG_AIO_SCHEDULER_STATS
+            m_submit_EBUSY++;
+#endif
+            // the kernel is short of resources or the completion queue
+            // is full: wait for some requests to complete
+            wait_for_completions(lock);
+        } else {
+            // The SQEs are left in the submission queue. They will be
+            // submitted with the next flush.
+            std::cerr << "Submission error: " << std::to_string(-ret) << "("
+                      << strerror(-ret) << ")\n";
+            return ret;
+        }
+    }
+    return 0;
+}
+
+struct io_uring_sqe* IoUringScheduler::get_sqe(
+    std::unique_lock<std::mutex>& lock)
+{
+    while (true) {
+        const uint64_t in_flight
+            = m_submitted_queries_count.load() - finished_queries_count();
+
+        // Do not submit more requests than the completion queue can hold
+        if (in_flight < m_cq_entries) {
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+            if (sqe != nullptr) {
+                return sqe;
+            }
+        }
+
+        // Either the submission queue or the completion queue is full.
+        if (m_pending_sqes > 0) {
+            int ret = flush_submissions(lock);
+            if (ret < 0) {
+                return nullptr;
+            }
+        } else {
+            wait_for_completions(lock);
+        }
+    }
+}
+
+int IoUringScheduler::registered_file_index(int fd)
+{
+    if (!m_files_registered) {
+        return -1;
+    }
+
+    auto it = m_registered_files.find(fd);
+    if (it != m_registered_files.end()) {
+        return it->second;
+    }
+
+    if (m_registered_files.size() >= kRegisteredFilesCount) {
+        return -1;
+    }
+
+    unsigned slot    = m_registered_files.size();
+    int      fd_copy = fd;
+    int      ret     = io_uring_register_files_update(&m_ring, slot, &fd_copy, 1);
+    if (ret != 1) {
+        return -1;
+    }
+    m_registered_files.emplace(fd, slot);
+    return slot;
+}
+
+int IoUringScheduler::registered_buffer_index(const void* buf,
+                                              size_t      len) const
+{
+    if (m_registered_buffers.empty()) {
+        return -1;
+    }
+
+    const uint8_t* ptr = static_cast<const uint8_t*>(buf);
+
+    // find the last registered buffer starting at or before buf
+    auto it = std::upper_bound(
+        m_registered_buffers.begin(),
+        m_registered_buffers.end(),
+        ptr,
+        [](const uint8_t* p, const ReadBuffer& b) {
+            return p < static_cast<const uint8_t*>(b.buf);
+        });
+
+    if (it == m_registered_buffers.begin()) {
+        return -1;
+    }
+    --it;
+
+    const uint8_t* start = static_cast<const uint8_t*>(it->buf);
+    if (ptr + len > start + it->len) {
+        return -1;
+    }
+    return static_cast<int>(it - m_registered_buffers.begin());
+}
+
+void IoUringScheduler::prepare_sqe(struct io_uring_sqe* sqe,
+                                   bool                 is_write,
+                                   int                  fd,
+                                   void*                buf,
+                                   size_t               len,
+                                   off_t                offset,
+                                   IoUringRequest*      req)
+{
+    int file_index = registered_file_index(fd);
+    int buf_index  = registered_buffer_index(buf, len);
+
+    int target_fd = (file_index >= 0) ? file_index : fd;
+
+    if (buf_index >= 0) {
+#ifdef LOG_AIO_SCHEDULER_STATS
+        m_fixed_buffer_requests++;
+#endif
+        if (is_write) {
+            io_uring_prep_write_fixed(
+                sqe, target_fd, buf, len, offset, buf_index);
+        } else {
+            io_uring_prep_read_fixed(
+                sqe, target_fd, buf, len, offset, buf_index);
+        }
+    } else {
+        if (is_write) {
+            io_uring_prep_write(sqe, target_fd, buf, len, offset);
+        } else {
+            io_uring_prep_read(sqe, target_fd, buf, len, offset);
+        }
+    }
+
+    if (file_index >= 0) {
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+    }
+    io_uring_sqe_set_data(sqe, req);
+
+    m_submitted_queries_count.fetch_add(1);
+    m_pending_sqes++;
+}
+
+int IoUringScheduler::submit_pread(int                     fd,
+                                   void*                   buf,
+                                   size_t                  len,
+                                   off_t                   offset,
+                                   void*                   data,
+                                   scheduler_callback_type callback)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE; // the error code is negated, to be
+                                      // consistent with the libaio error
+                                      // code conventions
+    }
+
+    int ret = check_args(buf, len, offset);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::unique_lock<std::mutex> lock(m_submission_lock);
+
+    struct io_uring_sqe* sqe = get_sqe(lock);
+    if (sqe == nullptr) {
+        return -1;
+    }
+
+    IoUringRequest* req = new (m_request_pool.acquire())
+        IoUringRequest(data, std::move(callback));
+    prepare_sqe(sqe, false, fd, buf, len, offset, req);
+
+    // Once prepared, the SQE cannot be taken back: if the flush fails, it
+    // is submitted by the next one, and the request is still accepted.
+    flush_submissions(lock);
+
+    return 1;
+}
+
+int IoUringScheduler::submit_preads(const std::vector<PReadSumission>& subs)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE; // the error code is negated, to be
+                                      // consistent with the libaio error
+                                      // code conventions
+    }
+
+    std::unique_lock<std::mutex> lock(m_submission_lock);
+
+    int submitted_count = 0;
+    int ret             = 0;
+
+    // Fill in all the SQEs needed. get_sqe will flush the submission queue
+    // if it gets full. The batch is cut at the first request that cannot be
+    // prepared, so that the accepted requests are the first ones.
+    for (const auto& sub : subs) {
+        // check that the arguments are well-formed
+        ret = check_args(sub.buf, sub.len, sub.offset);
+        if (ret != 0) {
+            break;
+        }
+
+        struct io_uring_sqe* sqe = get_sqe(lock);
+        if (sqe == nullptr) {
+            ret = -1;
+            break;
+        }
+
+        IoUringRequest* req = new (m_request_pool.acquire())
+            IoUringRequest(sub.data, sub.callback);
+        prepare_sqe(sqe, false, sub.fd, sub.buf, sub.len, sub.offset, req);
+        submitted_count++;
+    }
+
+    // Now submit the whole batch at once. As in submit_pread, the prepared
+    // SQEs are accepted even if the flush fails.
+    flush_submissions(lock);
+
+    return (submitted_count > 0) ? submitted_count : ret;
+}
+
+int IoUringScheduler::submit_pwrite(int                     fd,
+                                    void*                   buf,
+                                    size_t                  len,
+                                    off_t                   offset,
+                                    void*                   data,
+                                    scheduler_callback_type callback)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE; // the error code is negated, to be
+                                      // consistent with the libaio error
+                                      // code conventions
+    }
+
+    int ret = check_args(buf, len, offset);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::unique_lock<std::mutex> lock(m_submission_lock);
+
+    struct io_uring_sqe* sqe = get_sqe(lock);
+    if (sqe == nullptr) {
+        return -1;
+    }
+
+    IoUringRequest* req = new (m_request_pool.acquire())
+        IoUringRequest(data, std::move(callback));
+    prepare_sqe(sqe, true, fd, buf, len, offset, req);
+
+    // see submit_pread
+    flush_submissions(lock);
+
+    return 1;
+}
+
+int IoUringScheduler::register_buffers(const std::vector<ReadBuffer>& buffers)
+{
+    std::unique_lock<std::mutex> lock(m_submission_lock);
+
+    if (!m_registered_buffers.empty()) {
+        // io_uring only allows one set of registered buffers per ring
+        return -EBUSY;
+    }
+
+    std::vector<ReadBuffer> sorted_buffers(buffers);
+    std::sort(sorted_buffers.begin(),
+              sorted_buffers.end(),
+              [](const ReadBuffer& a, const ReadBuffer& b) {
+                  return a.buf < b.buf;
+              });
+
+    std::vector<struct iovec> iovecs(sorted_buffers.size());
+    for (size_t i = 0; i < sorted_buffers.size(); i++) {
+        iovecs[i].iov_base = sorted_buffers[i].buf;
+        iovecs[i].iov_len  = sorted_buffers[i].len;
+    }
+
+    int ret = io_uring_register_buffers(&m_ring, iovecs.data(), iovecs.size());
+    if (ret < 0) {
+        logger::logger()->warn("Unable to register the io_uring buffers: {}({})",
+                               -ret,
+                               strerror(-ret));
+        return ret;
+    }
+
+    m_registered_buffers = std::move(sorted_buffers);
+    return 0;
+}
+
+Scheduler* IoUringScheduler::duplicate() const
+{
+    return make_io_uring_scheduler(
+        m_page_size, m_queue_depth, m_use_sqpoll, m_register_files);
+}
+
+} // namespace abstractio
+} // namespace sse
+
+#endif // HAS_LIBURING
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "configure.hpp"
+
+#ifdef HAS_LIBURING
+
+#include "abstractio/buffer_pool.hpp"
+#include "abstractio/scheduler.hpp"
+
+#include <liburing.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+/// Asynchronous IO scheduler based on Linux' io_uring interface.
+///
+/// Submissions are serialized on the submission queue (SQ) by a lock, and a
+/// batch of reads posted with `submit_preads` is flushed to the kernel with a
+/// single `io_uring_submit` call. Completions are reaped by a dedicated
+/// thread.
+///
+/// Optionally, the scheduler can
+/// - run with a kernel-side submission polling thread (SQPOLL), so that
+/// submissions do not require a system call;
+/// - register the file descriptors it is given (lazily, on first use), to
+/// avoid the per-request file lookup in the kernel. As a registered file is
+/// referenced by the ring, the file descriptors passed to the scheduler must
+/// not be closed and reused for another file while the scheduler is alive.
+/// - use buffers registered with `register_buffers` as fixed buffers.
+class IoUringScheduler : public Scheduler
+{
+public:
+    IoUringScheduler(const size_t   page_size,
+                     const unsigned queue_depth,
+                     const bool     use_sqpoll,
+                     const bool     register_files);
+    ~IoUringScheduler();
+
+    /// Check if the running kernel supports the io_uring features needed by
+    /// the scheduler.
+    static bool is_supported();
+
+    void wait_completions() override;
+
+    int submit_pread(int                     fd,
+                     void*                   buf,
+                     size_t                  len,
+                     off_t                   offset,
+                     void*                   data,
+                     scheduler_callback_type callback) override;
+
+    /// Submit the reads of subs, up to the first one that cannot be
+    /// submitted. Returns the number of reads submitted (the first ones of
+    /// subs), or a negative error code if none was. The reads that were not
+    /// submitted are never called back.
+    int submit_preads(const std::vector<PReadSumission>& subs) override;
+
+    int submit_pwrite(int                     fd,
+                      void*                   buf,
+                      size_t                  len,
+                      off_t                   offset,
+                      void*                   data,
+                      scheduler_callback_type callback) override;
+
+    int register_buffers(const std::vector<ReadBuffer>& buffers) override;
+
+    Scheduler* duplicate() const override;
+
+private:
+    struct IoUringRequest
+    {
+        void*                   m_user_data;
+        scheduler_callback_type m_callback;
+
+        IoUringRequest(void* user_data, scheduler_callback_type cb)
+            : m_user_data(user_data), m_callback(std::move(cb)){};
+
+        void notify(int64_t len)
+        {
+            m_callback(m_user_data, len);
+        }
+    };
+
+    void notify_loop();
+
+    // number of queries completed, with or without an error
+    uint64_t finished_queries_count() const;
+
+    int check_args(void* buf, size_t len, off_t offset) const;
+
+    // All the following functions must be called with m_submission_lock held
+    struct io_uring_sqe* get_sqe(std::unique_lock<std::mutex>& lock);
+    void                 prepare_sqe(struct io_uring_sqe* sqe,
+                                     bool                 is_write,
+                                     int                  fd,
+                                     void*                buf,
+                                     size_t               len,
+                                     off_t                offset,
+                                     IoUringRequest*      req);
+    int                  flush_submissions(std::unique_lock<std::mutex>& lock);
+    void wait_for_completions(std::unique_lock<std::mutex>& lock);
+    int  registered_file_index(int fd);
+    int  registered_buffer_index(const void* buf, size_t len) const;
+
+    struct io_uring m_ring;
+    const size_t    m_page_size;
+    const unsigned  m_queue_depth;
+    const bool      m_use_sqpoll;
+    const bool      m_register_files;
+    bool            m_files_registered{false};
+    unsigned        m_cq_entries{0};
+
+    // recycled memory for the requests
+    AlignedBufferPool m_request_pool;
+
+    std::thread       m_notify_thread;
+    std::atomic<bool> m_stop_flag;
+
+    std::mutex              m_submission_lock;
+    std::condition_variable m_cv_submission;
+    std::atomic<bool>       m_waiting_submissions{false};
+
+    // number of SQEs acquired but not yet passed to the kernel
+    unsigned m_pending_sqes{0};
+
+    std::atomic<uint64_t> m_submitted_queries_count;
+    std::atomic<uint64_t> m_completed_queries_count;
+    // queries completed with an error
+    std::atomic<uint64_t> m_failed_queries_count;
+
+    // registered files: maps a file descriptor to its index in the ring's
+    // file table
+    std::unordered_map<int, unsigned> m_registered_files;
+    // registered buffers, sorted by address
+    std::vector<ReadBuffer> m_registered_buffers;
+
+#ifdef LOG_AIO_SCHEDULER_STATS
+    std::atomic_size_t m_submit_calls{0};
+    std::atomic_size_t m_submit_EBUSY{0};
+    std::atomic_size_t m_fixed_buffer_requests{0};
+#endif
+};
+
+} // namespace abstractio
+} // namespace sse
+
+#endif // HAS_LIBURING
@@ -8,6 +8,8 @@
 #include <cassert>
 #include <climits>
 #include <libaio.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <iostream>
 
@@ -16,45 +18,94 @@ namespace abstractio {
 
 static constexpr size_t kMaxNr = 128;
 
-LinuxAIOScheduler::LinuxAIOScheduler(const size_t   page_size,
-                                     const unsigned nr_events)
-    : m_ioctx(nullptr), m_page_size(page_size), m_nr_events(nr_events),
-      m_stop_flag(false), m_submitted_queries_count(0),
-      m_completed_queries_count(0), m_failed_queries_count(0)
+// number of request objects allocated at once
+static constexpr size_t kRequestPoolSlabSize = 64;
+
+LinuxAIOScheduler::LinuxAIOScheduler(const size_t            page_size,
+                                     const unsigned          nr_events,
+                                     const unsigned          n_threads,
+                                     const std::vector<int>& cpu_affinity)
+    : m_page_size(page_size), m_nr_events(nr_events),
+      m_cpu_affinity(cpu_affinity),
+      m_request_pool(sizeof(LinuxAIORequest),
+                     alignof(LinuxAIORequest),
+                     kRequestPoolSlabSize),
+      m_stop_flag(false)
 {
-    // NOLINTNEXTLINE(bugprone-sizeof-expression)
-    memset(&m_ioctx, 0, sizeof(m_ioctx));
-
+    if (n_threads == 0) {
+        throw std::invalid_argument(
+            "The number of completion threads must be positive");
+    }
 
     // NOLINTNEXTLINE(bugprone-narrowing-conversions)
     int nevents = (m_nr_events > INT_MAX) ? INT_MAX : m_nr_events;
-    int res     = io_setup(nevents, &m_ioctx);
 
-    if (res != 0) {
-        throw std::runtime_error("Error initializing io context: "
-                                 + std::to_string(errno) + "(" + strerror(errno)
-                                 + ")\n");
+    m_shards.reserve(n_threads);
+    for (unsigned i = 0; i < n_threads; i++) {
+        std::unique_ptr<CompletionShard> shard(new CompletionShard());
+
+        int res = io_setup(nevents, &shard->ioctx);
+
+        if (res != 0) {
+            // stop the threads that were already started
+            m_stop_flag = true;
+            for (auto& s : m_shards) {
+                s->notify_thread.join();
+                io_destroy(s->ioctx);
+            }
+            throw std::runtime_error("Error initializing io context: "
+                                     + std::to_string(-res) + "("
+                                     + strerror(-res) + ")\n");
+        }
+
+        int cpu = m_cpu_affinity.empty()
+                      ? -1
+                      : m_cpu_affinity[i % m_cpu_affinity.size()];
+
+        shard->notify_thread = std::thread(
+            &LinuxAIOScheduler::notify_loop, this, std::ref(*shard), cpu);
+        m_shards.push_back(std::move(shard));
     }
-    m_notify_thread = std::thread(&LinuxAIOScheduler::notify_loop, this);
 }
 
 LinuxAIOScheduler::~LinuxAIOScheduler()
 {
     LinuxAIOScheduler::wait_completions();
 
-    io_destroy(m_ioctx);
+    for (auto& shard : m_shards) {
+        io_destroy(shard->ioctx);
+    }
 
 #ifdef LOG_AIO_SCHEDULER_STATS
+    uint64_t completed_count = 0;
+    uint64_t failed_count    = 0;
+    for (auto& shard : m_shards) {
+        completed_count += shard->completed_queries_count.load();
+        failed_count += shard->failed_queries_count.load();
+    }
     std::cerr << "io_submit: " << m_submit_calls << " calls\n";
     std::cerr << m_submit_partial << " partial submissions\n";
     std::cerr << m_submit_EAGAIN << " with full queue\n";
-    std::cerr << m_completed_queries_count << " completed queries\n";
-    std::cerr << m_failed_queries_count.load() << " failed queries\n";
+    std::cerr << completed_count << " completed queries\n";
+    std::cerr << failed_count << " failed queries\n";
 #endif
 }
 
-void LinuxAIOScheduler::notify_loop()
+void LinuxAIOScheduler::notify_loop(CompletionShard& shard, int cpu)
 {
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        int ret = pthread_setaffinity_np(
+            pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (ret != 0) {
+            std::cerr << "Unable to set the affinity of the completion "
+                         "thread to CPU "
+                      << cpu << ": " << strerror(ret) << "\n";
+        }
+    }
+
     struct io_event* events = new io_event[kMaxNr];
     struct timespec  timeout;
     timeout.tv_sec  = 0;
@@ -62,29 +113,33 @@ void LinuxAIOScheduler::notify_loop()
 
 
     while (!m_stop_flag.load()
-           || ((m_completed_queries_count + m_failed_queries_count.load())
-               < m_submitted_queries_count.load())) {
-        int num_events = io_getevents(m_ioctx, 1, kMaxNr, events, &timeout);
+           || ((shard.completed_queries_count.load()
+                + shard.failed_queries_count.load())
+               < shard.submitted_queries_count.load())) {
+        int num_events = io_getevents(shard.ioctx, 1, kMaxNr, events, &timeout);
 
         if (num_events < 0) {
-            std::cerr << "Error in io_getevents: " << std::to_string(errno)
-                      << "(" << strerror(errno) << ")\n";
+            std::cerr << "Error in io_getevents: " << std::to_string(-num_events)
+                      << "(" << strerror(-num_events) << ")\n";
         }
 
         if (num_events > 0) {
-            std::lock_guard<std::mutex> guard(m_cv_lock);
-            m_waiting_submissions = false;
+            std::lock_guard<std::mutex> guard(shard.cv_lock);
+            shard.waiting_submissions = false;
 
-            m_cv_submission.notify_all();
+            shard.cv_submission.notify_all();
         }
 
         for (int i = 0; i < num_events; i++) {
             struct io_event  event = events[i];
             LinuxAIORequest* req   = static_cast<LinuxAIORequest*>(event.data);
             req->notify(event.res);
-            delete req;
+            req->~LinuxAIORequest();
+            m_request_pool.release(req);
+        }
+        if (num_events > 0) {
+            shard.completed_queries_count += num_events;
         }
-        m_completed_queries_count += num_events;
     }
 
     delete[] events;
@@ -112,12 +167,21 @@ void LinuxAIOScheduler::wait_completions()
 {
     m_stop_flag = true;
 
-    if (m_notify_thread.joinable()) {
-        m_notify_thread.join();
+    for (auto& shard : m_shards) {
+        if (shard->notify_thread.joinable()) {
+            shard->notify_thread.join();
+        }
     }
 }
 
-size_t LinuxAIOScheduler::submit_iocbs(struct iocb** iocbs, size_t n_iocbs)
+LinuxAIOScheduler::CompletionShard& LinuxAIOScheduler::next_shard()
+{
+    return *m_shards[m_next_shard.fetch_add(1) % m_shards.size()];
+}
+
+int LinuxAIOScheduler::submit_iocbs(CompletionShard& shard,
+                                    struct iocb**    iocbs,
+                                    size_t           n_iocbs)
 {
     // cppcheck-suppress unreadVariable
     int           res            = -EAGAIN;
@@ -126,7 +190,7 @@ size_t LinuxAIOScheduler::submit_iocbs(struct iocb** iocbs, size_t n_iocbs)
 
 
     while (remaining_subs > 0) {
-        res = io_submit(m_ioctx, remaining_subs, iocbs_head);
+        res = io_submit(shard.ioctx, remaining_subs, iocbs_head);
 #ifdef LOG_AIO_SCHEDULER_STATS
         m_submit_calls++;
 #endif
@@ -145,21 +209,30 @@ size_t LinuxAIOScheduler::submit_iocbs(struct iocb** iocbs, size_t n_iocbs)
             m_submit_EAGAIN++;
 #endif
             // wait until the submission queue has some space
-            std::unique_lock<std::mutex> lock(m_cv_lock);
+            std::unique_lock<std::mutex> lock(shard.cv_lock);
 
-            m_waiting_submissions = true;
-            while (m_waiting_submissions) {
-                m_cv_submission.wait(lock);
+            shard.waiting_submissions = true;
+            while (shard.waiting_submissions) {
+                shard.cv_submission.wait(lock);
             }
         } else {
-            m_failed_queries_count.fetch_add(remaining_subs);
+            shard.failed_queries_count.fetch_add(remaining_subs);
             std::cerr << "Submission error: " << res << "\n";
             perror("io_submit");
-            return -1;
+
+            // the remaining requests will never complete
+            for (size_t i = 0; i < remaining_subs; i++) {
+                LinuxAIORequest* req
+                    = static_cast<LinuxAIORequest*>(iocbs_head[i]->data);
+                req->~LinuxAIORequest();
+                m_request_pool.release(req);
+            }
+            break;
         }
     }
 
-    return n_iocbs - remaining_subs;
+    const size_t submitted = n_iocbs - remaining_subs;
+    return (submitted > 0 || n_iocbs == 0) ? static_cast<int>(submitted) : -1;
 }
 
 int LinuxAIOScheduler::submit_pread(int                     fd,
@@ -183,9 +256,10 @@ int LinuxAIOScheduler::submit_pread(int                     fd,
     struct iocb  iocb;
     struct iocb* iocbs = &iocb;
 
-    uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
-    LinuxAIORequest* req
-        = new LinuxAIORequest(query_id, data, std::move(callback));
+    CompletionShard& shard    = next_shard();
+    uint64_t         query_id = shard.submitted_queries_count.fetch_add(1);
+    LinuxAIORequest* req = new (m_request_pool.acquire())
+        LinuxAIORequest(query_id, data, std::move(callback));
 
     // std::cerr << "Prep read\n";
 
@@ -193,7 +267,7 @@ int LinuxAIOScheduler::submit_pread(int                     fd,
     iocb.data = req;
 
     // std::cerr << "Submit IO\n";
-    return submit_iocbs(&iocbs, 1);
+    return submit_iocbs(shard, &iocbs, 1);
 }
 
 int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
@@ -213,16 +287,23 @@ int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
         = static_cast<struct iocb*>(calloc(subs.size(), sizeof(struct iocb)));
 
 
-    // fill in all the iocbs needed
+    // all the requests of the batch are submitted to the same io context
+    CompletionShard& shard = next_shard();
+
+    int ret = 0;
+
+    // Fill in all the iocbs needed. The batch is cut at the first
+    // ill-formed read, so that the accepted reads are the first ones.
     for (const auto& sub : subs) {
         // check that the arguments are well-formed
-        if (check_args(sub.buf, sub.len, sub.offset) != 0) {
-            continue;
+        ret = check_args(sub.buf, sub.len, sub.offset);
+        if (ret != 0) {
+            break;
         }
 
-        uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
-        LinuxAIORequest* req
-            = new LinuxAIORequest(query_id, sub.data, sub.callback);
+        uint64_t query_id = shard.submitted_queries_count.fetch_add(1);
+        LinuxAIORequest* req = new (m_request_pool.acquire())
+            LinuxAIORequest(query_id, sub.data, sub.callback);
 
         io_prep_pread(
             &flat_iocbs[iocbs_count], sub.fd, sub.buf, sub.len, sub.offset);
@@ -232,7 +313,9 @@ int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
     }
 
     // now we have to submit the iocbs
-    int ret = submit_iocbs(iocbs, iocbs_count);
+    if (iocbs_count > 0) {
+        ret = submit_iocbs(shard, iocbs, iocbs_count);
+    }
 
     // free the allocated memory
     free(iocbs);
@@ -270,19 +353,21 @@ int LinuxAIOScheduler::submit_pwrite(int                     fd,
     struct iocb  iocb;
     struct iocb* iocbs = &iocb;
 
-    uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
-    LinuxAIORequest* req
-        = new LinuxAIORequest(query_id, data, std::move(callback));
+    CompletionShard& shard    = next_shard();
+    uint64_t         query_id = shard.submitted_queries_count.fetch_add(1);
+    LinuxAIORequest* req = new (m_request_pool.acquire())
+        LinuxAIORequest(query_id, data, std::move(callback));
 
     io_prep_pwrite(&iocb, fd, buf, len, offset);
     iocb.data = req;
 
-    return submit_iocbs(&iocbs, 1);
+    return submit_iocbs(shard, &iocbs, 1);
 }
 
 Scheduler* LinuxAIOScheduler::duplicate() const
 {
-    return make_linux_aio_scheduler(m_page_size, m_nr_events);
+    return make_linux_aio_scheduler(
+        m_page_size, m_nr_events, m_shards.size(), m_cpu_affinity);
 }
 
 
@@ -4,11 +4,15 @@
 
 #ifdef HAS_LIBAIO
 
+#include "abstractio/buffer_pool.hpp"
 #include "abstractio/scheduler.hpp"
 
 #include <libaio.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -16,10 +20,22 @@ namespace sse {
 namespace abstractio {
 
 
+/// Asynchronous IO scheduler based on the Linux AIO interface.
+///
+/// The scheduler uses `n_threads` independent io contexts, each with its
+/// own completion thread. The submission calls are dispatched to the
+/// contexts in a round-robin fashion (all the reads of a `submit_preads`
+/// call go to the same context, so that they are submitted with a single
+/// `io_submit` call). Each context can hold `nr_events` in-flight requests.
+/// The completion threads can be pinned to a set of CPUs: the i-th thread is
+/// pinned to `cpu_affinity[i % cpu_affinity.size()]`.
 class LinuxAIOScheduler : public Scheduler
 {
 public:
-    LinuxAIOScheduler(const size_t page_size, const unsigned nr_events);
+    LinuxAIOScheduler(const size_t            page_size,
+                      const unsigned          nr_events,
+                      const unsigned          n_threads,
+                      const std::vector<int>& cpu_affinity);
     ~LinuxAIOScheduler();
 
     void wait_completions() override;
@@ -43,11 +59,32 @@ public:
     Scheduler* duplicate() const override;
 
 private:
-    void notify_loop();
+    // An io context, and the state of its completion thread
+    struct CompletionShard
+    {
+        io_context_t ioctx{nullptr};
+        std::thread  notify_thread;
+
+        std::atomic<uint64_t> submitted_queries_count{0};
+        std::atomic<uint64_t> completed_queries_count{0};
+        std::atomic<uint64_t> failed_queries_count{0};
+
+        std::mutex              cv_lock;
+        std::condition_variable cv_submission;
+        bool                    waiting_submissions{false};
+    };
+
+    void notify_loop(CompletionShard& shard, int cpu);
 
     int check_args(void* buf, size_t len, off_t offset) const;
 
-    size_t submit_iocbs(struct iocb** iocbs, size_t n_iocbs);
+    CompletionShard& next_shard();
+
+    // Returns the number of iocbs submitted (the first ones), or -1 if none
+    // was. The requests of the iocbs that were not submitted are released.
+    int submit_iocbs(CompletionShard& shard,
+                     struct iocb**    iocbs,
+                     size_t           n_iocbs);
 
 
     struct LinuxAIORequest
@@ -65,21 +102,17 @@ private:
         }
     };
 
-    io_context_t   m_ioctx;
-    const size_t   m_page_size;
-    const unsigned m_nr_events;
-    // std::vector<LinuxAIOSchedulerState> m_state;
+    const size_t           m_page_size;
+    const unsigned         m_nr_events;
+    const std::vector<int> m_cpu_affinity;
 
-    std::thread       m_notify_thread;
-    std::atomic<bool> m_stop_flag;
+    std::vector<std::unique_ptr<CompletionShard>> m_shards;
+    std::atomic<size_t>                           m_next_shard{0};
 
-    std::atomic<uint64_t> m_submitted_queries_count;
-    uint64_t              m_completed_queries_count;
-    std::atomic<uint64_t> m_failed_queries_count;
+    // recycled memory for the requests
+    AlignedBufferPool m_request_pool;
 
-    std::mutex              m_cv_lock;
-    std::condition_variable m_cv_submission;
-    bool                    m_waiting_submissions{false};
+    std::atomic<bool> m_stop_flag;
 
 #ifdef LOG_AIO_SCHEDULER_STATS
     std::atomic_size_t m_submit_calls{0};
@@ -1,3 +1,4 @@
+#include "abstractio/io_uring_scheduler.hpp"
 #include "abstractio/linux_aio_scheduler.hpp"
 #include "abstractio/thread_pool_aio_scheduler.hpp"
 #include "configure.hpp"
@@ -12,10 +13,28 @@ size_t Scheduler::async_io_page_size(int fd)
 }
 
 #ifdef HAS_LIBAIO
-Scheduler* make_linux_aio_scheduler(const size_t   page_size,
-                                    const unsigned n_events)
+Scheduler* make_linux_aio_scheduler(const size_t            page_size,
+                                    const unsigned          n_events,
+                                    const unsigned          n_threads,
+                                    const std::vector<int>& cpu_affinity)
 {
-    return new LinuxAIOScheduler(page_size, n_events);
+    return new LinuxAIOScheduler(page_size, n_events, n_threads, cpu_affinity);
+}
+#endif
+
+#ifdef HAS_LIBURING
+Scheduler* make_io_uring_scheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   const bool     use_sqpoll,
+                                   const bool     register_files)
+{
+    return new IoUringScheduler(
+        page_size, queue_depth, use_sqpoll, register_files);
+}
+
+bool io_uring_is_supported()
+{
+    return IoUringScheduler::is_supported();
 }
 #endif
 
@@ -27,6 +46,12 @@ Scheduler* make_thread_pool_aio_scheduler()
 
 Scheduler* make_default_aio_scheduler(const size_t page_size)
 {
+#ifdef HAS_LIBURING
+    constexpr unsigned kDefaultQueueDepth = 128;
+    if (IoUringScheduler::is_supported()) {
+        return make_io_uring_scheduler(page_size, kDefaultQueueDepth);
+    }
+#endif
 #ifdef HAS_LIBAIO
     constexpr size_t kDefaultNEvents = 128;
     return make_linux_aio_scheduler(page_size, kDefaultNEvents);
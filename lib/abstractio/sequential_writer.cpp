@@ -0,0 +1,213 @@
+#include "abstractio/sequential_writer.hpp"
+
+#include "utils/logger.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sse {
+namespace abstractio {
+
+constexpr size_t SequentialWriter::kDefaultBufferSize;
+
+static size_t round_up(size_t size, size_t alignment)
+{
+    return ((std::max<size_t>(size, 1) + alignment - 1) / alignment)
+           * alignment;
+}
+
+SequentialWriter::SequentialWriter(int    fd,
+                                   off_t  offset,
+                                   size_t buffer_size,
+                                   size_t alignment)
+    : m_fd(fd), m_buffer_size(round_up(buffer_size, alignment)),
+      m_buffer_offset(offset)
+{
+    for (auto& buf : m_buffers) {
+        void* ptr = nullptr;
+        int   ret = posix_memalign(&ptr, alignment, m_buffer_size);
+
+        if (ret != 0 || ptr == nullptr) {
+            free(m_buffers[0]);
+            close(m_fd);
+            throw std::runtime_error(
+                "Error when allocating aligned memory: errno "
+                + std::to_string(ret) + "(" + strerror(ret) + ")");
+        }
+        buf = static_cast<uint8_t*>(ptr);
+    }
+
+    m_flush_thread = std::thread(&SequentialWriter::flush_loop, this);
+}
+
+SequentialWriter::~SequentialWriter()
+{
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        logger::logger()->error("Unable to flush the sequential writer: {}",
+                                e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop_flag = true;
+    }
+    m_cv.notify_all();
+    m_flush_thread.join();
+
+    free(m_buffers[0]);
+    free(m_buffers[1]);
+    close(m_fd);
+}
+
+void SequentialWriter::append(const void* data, size_t length)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+
+    while (length > 0) {
+        size_t chunk = std::min(length, m_buffer_size - m_buffer_length);
+
+        memcpy(m_buffers[m_active_buffer] + m_buffer_length, src, chunk);
+        m_buffer_length += chunk;
+        src += chunk;
+        length -= chunk;
+
+        if (m_buffer_length == m_buffer_size) {
+            submit_active_buffer();
+        }
+    }
+}
+
+void SequentialWriter::flush()
+{
+    if (m_buffer_length > 0) {
+        submit_active_buffer();
+    }
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    wait_pending_write(lock);
+    lock.unlock();
+
+    rethrow_error();
+}
+
+void SequentialWriter::submit_active_buffer()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    // the other buffer must be written before it is reused
+    wait_pending_write(lock);
+
+    if (m_error) {
+        lock.unlock();
+        rethrow_error();
+    }
+
+    m_pending_buffer = m_buffers[m_active_buffer];
+    m_pending_length = m_buffer_length;
+    m_pending_offset = m_buffer_offset;
+    lock.unlock();
+    m_cv.notify_all();
+
+    m_active_buffer = 1 - m_active_buffer;
+    m_buffer_offset += m_buffer_length;
+    m_buffer_length = 0;
+}
+
+void SequentialWriter::wait_pending_write(std::unique_lock<std::mutex>& lock)
+{
+    m_cv.wait(lock, [this] { return m_pending_buffer == nullptr; });
+}
+
+void SequentialWriter::rethrow_error()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::swap(error, m_error);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SequentialWriter::flush_loop()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (true) {
+        m_cv.wait(lock,
+                  [this] { return m_stop_flag || m_pending_buffer != nullptr; });
+
+        if (m_pending_buffer == nullptr) {
+            // stop flag set, and nothing left to write
+            return;
+        }
+
+        const uint8_t* buffer = m_pending_buffer;
+        size_t         length = m_pending_length;
+        off_t          offset = m_pending_offset;
+
+        // do not hold the lock during the write: the other buffer is being
+        // filled in the meantime
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            write_buffer(buffer, length, offset);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error) {
+            m_error = error;
+        }
+        m_pending_buffer = nullptr;
+        m_cv.notify_all();
+    }
+}
+
+void SequentialWriter::write_buffer(const uint8_t* buffer,
+                                    size_t         length,
+                                    off_t          offset)
+{
+    while (length > 0) {
+        ssize_t res = pwrite(m_fd, buffer, length, offset);
+
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+
+#if defined(O_DIRECT)
+        if (res < 0 && errno == EINVAL) {
+            // most likely the unaligned tail of the file: disable direct IOs
+            int flags = fcntl(m_fd, F_GETFL);
+            if (flags != -1 && (flags & O_DIRECT) != 0
+                && fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+                continue;
+            }
+            errno = EINVAL;
+        }
+#endif
+
+        if (res <= 0) {
+            throw std::runtime_error("Error during pwrite: errno "
+                                     + std::to_string(errno) + "("
+                                     + strerror(errno) + ")");
+        }
+
+        buffer += res;
+        length -= res;
+        offset += res;
+    }
+}
+
+} // namespace abstractio
+} // namespace sse
@@ -67,7 +67,7 @@ int ThreadPoolAIOScheduler::submit_pread(int                     fd,
     };
 
     m_running_queries++;
-    get_shared_io_pool().enqueue(task);
+    get_shared_io_pool().post(std::move(task));
 
     return 1;
 }
@@ -92,7 +92,7 @@ int ThreadPoolAIOScheduler::submit_pwrite(int                     fd,
     };
 
     m_running_queries++;
-    get_shared_io_pool().enqueue(task);
+    get_shared_io_pool().post(std::move(task));
 
 
     return 1;
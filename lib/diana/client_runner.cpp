@@ -41,6 +41,7 @@
 #include <random>
 #include <string>
 #include <thread>
+#include <vector>
 
 #define MASTER_KEY_FILE "master_derivation.key"
 #define KW_TOKEN_MASTER_KEY_FILE "kw_token_master.key"
@@ -372,8 +373,8 @@ void DianaClientRunner::insert_in_session(
         throw std::runtime_error("Invalid state: the update session is not up");
     }
 
-    std::list<UpdateRequest<DianaClientRunner::index_type>> message_list
-        = client_->bulk_insertion_request(update_list);
+    std::vector<UpdateRequest<DianaClientRunner::index_type>> message_list;
+    client_->bulk_insertion_request(update_list, message_list);
 
     bulk_update_state_.mtx.lock();
 
@@ -23,6 +23,7 @@
 #include "diana/server_runner_private.hpp"
 
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/result_collector.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <sse/crypto/wrapper.hpp>
@@ -31,10 +32,12 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <thread>
 #include <utility>
+#include <vector>
 
 
 namespace sse {
@@ -44,7 +47,10 @@ const char* DianaImpl::pairs_map_file    = "pairs.dat";
 const char* DianaImpl::wrapping_key_file = "wrapping.key";
 
 DianaImpl::DianaImpl(std::string path)
-    : storage_path_(std::move(path)), async_search_(true)
+    : storage_path_(std::move(path)), async_search_(true),
+      search_threads_count_(kDefaultSearchThreadsCount),
+      bulk_insert_batch_size_(kDefaultBulkInsertBatchSize),
+      bulk_insert_wal_(true)
 {
     if (utility::is_directory(storage_path_)) {
         // try to initialize everything from this directory
@@ -189,20 +195,17 @@ grpc::Status DianaImpl::setup(__attribute__((unused))
     return grpc::Status::OK;
 }
 
-grpc::Status DianaImpl::search(grpc::ServerContext*             context,
-                               const SearchRequestMessage*      mes,
-                               grpc::ServerWriter<SearchReply>* writer)
+grpc::Status DianaImpl::run_search(const SearchRequestMessage* mes,
+                                   const results_writer_type&  write_results)
 {
     if (async_search_) {
-        return async_search(context, mes, writer);
+        return async_search(mes, write_results);
     }
-    return sync_search(context, mes, writer);
+    return sync_search(mes, write_results);
 }
 
-grpc::Status DianaImpl::sync_search(__attribute__((unused))
-                                    grpc::ServerContext*             context,
-                                    const SearchRequestMessage*      mes,
-                                    grpc::ServerWriter<SearchReply>* writer)
+grpc::Status DianaImpl::sync_search(const SearchRequestMessage* mes,
+                                    const results_writer_type&  write_results)
 {
     if (!server_) {
         // problem, the server is already set up
@@ -214,7 +217,8 @@ grpc::Status DianaImpl::sync_search(__attribute__((unused))
 
     SearchRequest req = message_to_request(token_wrapper_, mes);
 
-    std::vector<uint64_t> res_list(req.add_count);
+    // search_parallel fills the vector by leaf index, search appends to it
+    std::vector<uint64_t> res_list;
 
     logger::logger()->trace("{} expected matches", req.add_count);
 
@@ -223,15 +227,17 @@ grpc::Status DianaImpl::sync_search(__attribute__((unused))
     } else {
         {
             SearchBenchmark bench("Diana synchronous search");
-            server_->search_parallel(req, 8, res_list);
-            bench.set_count(res_list.size());
-        }
-        for (auto& i : res_list) {
-            SearchReply reply;
-            reply.set_result(static_cast<uint64_t>(i));
 
-            writer->Write(reply);
+            // as for the asynchronous searches, a search uses at most
+            // search_threads_count_ threads
+            if (req.add_count >= 2 && search_threads_count_ > 1) {
+                server_->search_parallel(req, search_threads_count_, res_list);
+            } else {
+                server_->search(req, res_list);
+            }
+            bench.set_count(res_list.size());
         }
+        write_results(res_list.data(), res_list.size());
     }
     logger::logger()->trace("Done searching");
 
@@ -240,10 +246,8 @@ grpc::Status DianaImpl::sync_search(__attribute__((unused))
 }
 
 
-grpc::Status DianaImpl::async_search(__attribute__((unused))
-                                     grpc::ServerContext*             context,
-                                     const SearchRequestMessage*      mes,
-                                     grpc::ServerWriter<SearchReply>* writer)
+grpc::Status DianaImpl::async_search(const SearchRequestMessage* mes,
+                                     const results_writer_type&  write_results)
 {
     if (!server_) {
         // problem, the server is already set up
@@ -253,20 +257,11 @@ grpc::Status DianaImpl::async_search(__attribute__((unused))
 
     logger::logger()->trace("Start searching keyword...");
 
-    std::atomic_uint res_size(0);
-
-    std::mutex writer_lock;
-
-    auto post_callback = [&writer, &res_size, &writer_lock](index_type i) {
-        SearchReply reply;
-        reply.set_result(static_cast<uint64_t>(i));
+    // the results are written by batches: the collector never calls
+    // write_results concurrently
+    ResultCollector<index_type> collector(write_results);
 
-        writer_lock.lock();
-        writer->Write(reply);
-        writer_lock.unlock();
-
-        res_size++;
-    };
+    auto post_callback = [&collector](index_type i) { collector.push(i); };
 
     auto req = message_to_request(token_wrapper_, mes);
 
@@ -274,16 +269,15 @@ grpc::Status DianaImpl::async_search(__attribute__((unused))
         SearchBenchmark bench("Diana asynchronous search");
 
 
-        if (mes->add_count() >= 2) { // run the search algorithm in parallel
-                                     // only if there are more than 2 results
-
-            server_->search_parallel(
-                req, post_callback, std::thread::hardware_concurrency());
-
+        // run the search algorithm in parallel only if there are more than
+        // 2 results, and several threads per search
+        if (mes->add_count() >= 2 && search_threads_count_ > 1) {
+            server_->search_parallel(req, post_callback, search_threads_count_);
         } else {
             server_->search(req, post_callback);
         }
-        bench.set_count(res_size);
+        collector.flush();
+        bench.set_count(collector.size());
     }
 
     logger::logger()->trace("Done searching");
@@ -331,9 +325,19 @@ grpc::Status DianaImpl::bulk_insert(
 
     UpdateRequestMessage mes;
 
+    std::vector<UpdateRequest<index_type>> batch;
+    batch.reserve(bulk_insert_batch_size_);
+
     while (reader->Read(&mes)) {
-        server_->insert(message_to_request(&mes));
+        batch.push_back(message_to_request(&mes));
+
+        if (batch.size() >= bulk_insert_batch_size_) {
+            server_->insert_batch(
+                batch.data(), batch.size(), !bulk_insert_wal_);
+            batch.clear();
+        }
     }
+    server_->insert_batch(batch.data(), batch.size(), !bulk_insert_wal_);
 
     logger::logger()->trace("Updating (bulk)... done");
 
@@ -353,6 +357,36 @@ void DianaImpl::set_search_asynchronously(bool flag)
     async_search_ = flag;
 }
 
+uint8_t DianaImpl::search_threads_count() const
+{
+    return search_threads_count_;
+}
+
+void DianaImpl::set_search_threads_count(uint8_t count)
+{
+    search_threads_count_ = std::max<uint8_t>(count, 1);
+}
+
+size_t DianaImpl::bulk_insert_batch_size() const
+{
+    return bulk_insert_batch_size_;
+}
+
+void DianaImpl::set_bulk_insert_batch_size(size_t size)
+{
+    bulk_insert_batch_size_ = std::max<size_t>(size, 1);
+}
+
+bool DianaImpl::bulk_insert_wal() const
+{
+    return bulk_insert_wal_;
+}
+
+void DianaImpl::set_bulk_insert_wal(bool flag)
+{
+    bulk_insert_wal_ = flag;
+}
+
 
 void DianaImpl::flush_server_storage()
 {
@@ -365,6 +399,15 @@ void DianaImpl::flush_server_storage()
     }
 }
 
+void DianaImpl::finish_bulk_load()
+{
+    std::lock_guard<std::mutex> lock(update_mtx_);
+
+    if (server_) {
+        server_->finish_bulk_load();
+    }
+}
+
 SearchRequest message_to_request(
     const std::unique_ptr<crypto::Wrapper>& wrapper,
     const SearchRequestMessage*             mes)
@@ -396,36 +439,78 @@ UpdateRequest<DianaImpl::index_type> message_to_request(
 }
 
 DianaServerRunner::DianaServerRunner(grpc::ServerBuilder& builder,
-                                     const std::string&   server_db_path)
+                                     const std::string&   server_db_path,
+                                     uint32_t             search_workers_count)
 {
-    service_.reset(new DianaImpl(server_db_path));
-
-    builder.RegisterService(service_.get());
-    server_ = builder.BuildAndStart();
+    build_and_start(builder, server_db_path, search_workers_count);
 }
 
 
 DianaServerRunner::DianaServerRunner(const std::string& server_address,
-                                     const std::string& server_db_path)
+                                     const std::string& server_db_path,
+                                     uint32_t           search_workers_count)
 {
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
 
+    build_and_start(builder, server_db_path, search_workers_count);
+}
+
+DianaServerRunner::~DianaServerRunner()
+{
+    // the calls in progress reference the service
+    shutdown();
+}
+
+void DianaServerRunner::build_and_start(grpc::ServerBuilder& builder,
+                                        const std::string&   server_db_path,
+                                        uint32_t search_workers_count)
+{
+    if (search_workers_count == 0) {
+        search_workers_count
+            = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+    }
+
     service_.reset(new DianaImpl(server_db_path));
 
     builder.RegisterService(service_.get());
+
+    DianaImpl* service = service_.get();
+    search_server_.reset(new DianaSearchServer(
+        builder,
+        [service](const SearchRequestMessage*           mes,
+                  const DianaImpl::results_writer_type& write_results) {
+            return service->run_search(mes, write_results);
+        },
+        search_workers_count));
+
     server_ = builder.BuildAndStart();
+    search_server_->start(service);
 }
 
-// as we forward-declare DianaImpl, we cannot use the default destructor
-// NOLINTNEXTLINE(modernize-use-equals-default)
-DianaServerRunner::~DianaServerRunner()
+void DianaServerRunner::set_async_search(bool flag)
 {
+    service_->set_search_asynchronously(flag);
 }
 
-void DianaServerRunner::set_async_search(bool flag)
+void DianaServerRunner::set_search_threads_count(uint8_t count)
 {
-    service_->set_search_asynchronously(flag);
+    service_->set_search_threads_count(count);
+}
+
+void DianaServerRunner::set_bulk_insert_batch_size(size_t size)
+{
+    service_->set_bulk_insert_batch_size(size);
+}
+
+void DianaServerRunner::set_bulk_insert_wal(bool flag)
+{
+    service_->set_bulk_insert_wal(flag);
+}
+
+void DianaServerRunner::finish_bulk_load()
+{
+    service_->finish_bulk_load();
 }
 
 void DianaServerRunner::wait()
@@ -435,7 +520,12 @@ void DianaServerRunner::wait()
 
 void DianaServerRunner::shutdown()
 {
-    server_->Shutdown();
+    if (server_) {
+        server_->Shutdown();
+    }
+    if (search_server_) {
+        search_server_->shutdown();
+    }
 }
 
 } // namespace diana
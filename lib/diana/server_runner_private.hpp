@@ -23,12 +23,14 @@
 
 #include "protos/diana.grpc.pb.h"
 
+#include <sse/runners/async_search_server.hpp>
 #include <sse/schemes/diana/diana_server.hpp>
 
 #include <sse/crypto/wrapper.hpp>
 
 #include <grpcpp/grpcpp.h>
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -42,11 +44,20 @@ class SearchRequestMessage;
 class SearchReplyMessage;
 class UpdateRequestMessage;
 
-class DianaImpl final : public diana::Diana::Service
+// The searches are served by a DianaSearchServer
+class DianaImpl final
+    : public diana::Diana::WithAsyncMethod_search<diana::Diana::Service>
 {
 public:
     typedef uint64_t index_type;
 
+    // Called with the results of a search, by batches
+    using results_writer_type
+        = std::function<void(const index_type* results, size_t count)>;
+
+    static constexpr size_t  kDefaultBulkInsertBatchSize = 4096;
+    static constexpr uint8_t kDefaultSearchThreadsCount  = 1;
+
     explicit DianaImpl(std::string path);
     ~DianaImpl();
 
@@ -54,17 +65,14 @@ public:
                        const SetupMessage*      message,
                        google::protobuf::Empty* e) override;
 
-    grpc::Status search(grpc::ServerContext*             context,
-                        const SearchRequestMessage*      mes,
-                        grpc::ServerWriter<SearchReply>* writer) override;
+    grpc::Status run_search(const SearchRequestMessage* mes,
+                            const results_writer_type&  write_results);
 
-    grpc::Status sync_search(grpc::ServerContext*             context,
-                             const SearchRequestMessage*      mes,
-                             grpc::ServerWriter<SearchReply>* writer);
+    grpc::Status sync_search(const SearchRequestMessage* mes,
+                             const results_writer_type&  write_results);
 
-    grpc::Status async_search(grpc::ServerContext*             context,
-                              const SearchRequestMessage*      mes,
-                              grpc::ServerWriter<SearchReply>* writer);
+    grpc::Status async_search(const SearchRequestMessage* mes,
+                              const results_writer_type&  write_results);
 
     grpc::Status insert(grpc::ServerContext*        context,
                         const UpdateRequestMessage* mes,
@@ -77,8 +85,31 @@ public:
     bool search_asynchronously() const;
     void set_search_asynchronously(bool flag);
 
+    // Number of threads used by every search. The searches already run
+    // concurrently on the workers of the search server: use more than one
+    // thread only for a few searches with many results. When it is larger
+    // than 1, a search creates that many threads, while its worker waits for
+    // them: up to search_workers_count * search_threads_count threads search
+    // the database at once.
+    uint8_t search_threads_count() const;
+    void    set_search_threads_count(uint8_t count);
+
+    // Number of updates inserted with a single database write by bulk_insert
+    size_t bulk_insert_batch_size() const;
+    void   set_bulk_insert_batch_size(size_t size);
+
+    // When the write-ahead log is disabled, the bulk insertions are only
+    // durable once the database has been flushed, at the end of the stream
+    bool bulk_insert_wal() const;
+    void set_bulk_insert_wal(bool flag);
+
     void flush_server_storage();
 
+    // Flush the database and, with the bulk-load RocksDB profile, compact
+    // it. Call this once, when all the bulk insertions are over: the
+    // compaction rewrites the whole database.
+    void finish_bulk_load();
+
 private:
     static const char* pairs_map_file;
     static const char* wrapping_key_file;
@@ -90,7 +121,18 @@ private:
 
     std::mutex update_mtx_;
 
-    bool async_search_;
+    bool    async_search_;
+    uint8_t search_threads_count_;
+
+    size_t bulk_insert_batch_size_;
+    bool   bulk_insert_wal_;
+};
+
+class DianaSearchServer
+    : public AsyncSearchServer<DianaImpl, SearchRequestMessage, SearchReply>
+{
+public:
+    using AsyncSearchServer::AsyncSearchServer;
 };
 
 SearchRequest message_to_request(
@@ -0,0 +1,486 @@
+//
+// Sophos - Forward Private Searchable Encryption
+// Copyright (C) 2016 Raphael Bost
+//
+// This file is part of Sophos.
+//
+// Sophos is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// Sophos is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Sophos.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
+
+#include <grpc/support/time.h>
+#include <grpcpp/alarm.h>
+#include <grpcpp/impl/codegen/async_stream.h>
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace sse {
+
+/// Completion queue based server of the search RPC of a service.
+///
+/// Service must be a generated service with an asynchronous search method
+/// (Service::WithAsyncMethod_search), streaming Reply messages with a result
+/// field. Every search is run by a task of a single bounded worker pool, and
+/// its results are written on the stream by a dedicated completion queue
+/// thread, one write at a time. The results waiting to be written are kept
+/// in a per-call buffer of at most kMaxPendingResults results: when it is
+/// full, the search blocks until the client has read some of them. Hence
+/// neither the number of threads nor the memory grows with the number of
+/// searches in flight.
+///
+/// When a call is cancelled (e.g. the client went away or its deadline
+/// expired), the search is no longer blocked: its remaining results are
+/// dropped. The searches still running when the server is shut down are
+/// completed, but their remaining results are dropped too.
+template<class Service, class Request, class Reply>
+class AsyncSearchServer
+{
+public:
+    using index_type = uint64_t;
+
+    /// Called with the results of the search, by batches. The calls must
+    /// not be concurrent.
+    using results_writer_type
+        = std::function<void(const index_type* results, size_t count)>;
+
+    using search_function_type = std::function<grpc::Status(
+        const Request* mes, const results_writer_type& write_results)>;
+
+    static constexpr size_t kMaxPendingResults = 1024;
+
+    /// Add the completion queue of the server to builder, which must not
+    /// have been built yet.
+    AsyncSearchServer(grpc::ServerBuilder& builder,
+                      search_function_type search,
+                      uint32_t             workers_count);
+
+    AsyncSearchServer(const AsyncSearchServer&) = delete;
+    AsyncSearchServer& operator=(const AsyncSearchServer&) = delete;
+
+    /// Shut down the server first
+    ~AsyncSearchServer();
+
+    /// Start serving the searches. service must have been registered by the
+    /// builder, and the server built.
+    void start(Service* service);
+
+    /// Wait for the calls in progress, and stop the completion queue. The
+    /// grpc::Server must have been shut down before.
+    void shutdown();
+
+private:
+    // tag of the operations on the completion queue
+    class Tag
+    {
+    public:
+        virtual void proceed(bool ok) = 0;
+
+    protected:
+        ~Tag() = default;
+    };
+
+    class SearchCall;
+
+    void call_created();
+    void call_deleted();
+    bool shutting_down();
+
+    void poll_completion_queue();
+
+    search_function_type                         search_;
+    std::unique_ptr<grpc::ServerCompletionQueue> cq_;
+    Service*                                     service_{nullptr};
+
+    std::thread cq_thread_;
+
+    // number of SearchCall objects alive, including the one waiting for the
+    // next request
+    std::mutex              calls_mtx_;
+    std::condition_variable calls_cv_;
+    size_t                  calls_count_{0};
+    bool                    shutting_down_{false};
+    bool                    stopped_{false};
+
+    // declared last: the workers are stopped first
+    ThreadPool pool_;
+};
+
+/// An RPC, from the request of the call to its completion. Only one
+/// operation is pending at a time on the completion queue, with the call as
+/// tag: the request, a write, an alarm (set when results are available and
+/// no write is pending), or the finish. Once the call started, the end of the
+/// RPC is also notified, with done_tag_ as tag: the call is deleted once both
+/// the finish and this notification were received.
+template<class Service, class Request, class Reply>
+class AsyncSearchServer<Service, Request, Reply>::SearchCall final : public Tag
+{
+public:
+    explicit SearchCall(AsyncSearchServer* server);
+
+    /// Called by the completion queue thread
+    void proceed(bool ok) override;
+
+private:
+    enum class State
+    {
+        Requested,
+        Streaming,
+        Finishing,
+        Finished
+    };
+
+    class DoneTag final : public Tag
+    {
+    public:
+        explicit DoneTag(SearchCall* call) : call_(call)
+        {
+        }
+
+        void proceed(bool /*ok*/) override
+        {
+            call_->on_done();
+        }
+
+    private:
+        SearchCall* call_;
+    };
+
+    void start_search();
+    void stream(bool ok);
+    // called by the completion queue thread when the RPC is over
+    void on_done();
+    // delete the call if both the finish and the done notification were
+    // received
+    void try_delete();
+
+    // called by the search task
+    void push(const index_type* results, size_t count);
+    void done(const grpc::Status& status);
+
+    // must be called with mtx_ held
+    void wake_up();
+
+    AsyncSearchServer* server_;
+    State              state_{State::Requested};
+    DoneTag            done_tag_{this};
+    bool               done_notified_{false};
+
+    grpc::ServerContext            context_;
+    Request                        request_;
+    Reply                          reply_;
+    grpc::ServerAsyncWriter<Reply> responder_;
+
+    std::mutex                   mtx_;
+    std::condition_variable      space_cv_;
+    std::deque<index_type>       pending_results_;
+    std::unique_ptr<grpc::Alarm> alarm_;
+
+    bool         op_pending_{false};
+    bool         writing_{false};
+    bool         search_done_{false};
+    bool         cancelled_{false};
+    grpc::Status status_;
+};
+
+template<class Service, class Request, class Reply>
+constexpr size_t AsyncSearchServer<Service, Request, Reply>::kMaxPendingResults;
+
+template<class Service, class Request, class Reply>
+AsyncSearchServer<Service, Request, Reply>::AsyncSearchServer(
+    grpc::ServerBuilder& builder,
+    search_function_type search,
+    uint32_t             workers_count)
+    : search_(std::move(search)), cq_(builder.AddCompletionQueue()),
+      pool_(std::max<uint32_t>(workers_count, 1))
+{
+}
+
+template<class Service, class Request, class Reply>
+AsyncSearchServer<Service, Request, Reply>::~AsyncSearchServer()
+{
+    shutdown();
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::start(Service* service)
+{
+    service_ = service;
+
+    // wait for the first request
+    new SearchCall(this);
+
+    cq_thread_ = std::thread(
+        &AsyncSearchServer<Service, Request, Reply>::poll_completion_queue,
+        this);
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::shutdown()
+{
+    {
+        std::unique_lock<std::mutex> lock(calls_mtx_);
+        if (stopped_) {
+            return;
+        }
+        shutting_down_ = true;
+
+        // once the server is shut down, the pending request fails, and the
+        // calls in progress complete
+        calls_cv_.wait(lock, [this]() { return calls_count_ == 0; });
+        stopped_ = true;
+    }
+
+    cq_->Shutdown();
+    if (cq_thread_.joinable()) {
+        cq_thread_.join();
+    } else {
+        // the server was never started: drain the queue
+        poll_completion_queue();
+    }
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::call_created()
+{
+    std::lock_guard<std::mutex> lock(calls_mtx_);
+    calls_count_++;
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::call_deleted()
+{
+    std::lock_guard<std::mutex> lock(calls_mtx_);
+    calls_count_--;
+    calls_cv_.notify_all();
+}
+
+template<class Service, class Request, class Reply>
+bool AsyncSearchServer<Service, Request, Reply>::shutting_down()
+{
+    std::lock_guard<std::mutex> lock(calls_mtx_);
+    return shutting_down_;
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::poll_completion_queue()
+{
+    void* tag;
+    bool  ok;
+    while (cq_->Next(&tag, &ok)) {
+        static_cast<Tag*>(tag)->proceed(ok);
+    }
+}
+
+template<class Service, class Request, class Reply>
+AsyncSearchServer<Service, Request, Reply>::SearchCall::SearchCall(
+    AsyncSearchServer* server)
+    : server_(server), responder_(&context_)
+{
+    server_->call_created();
+    // must be called before the request
+    context_.AsyncNotifyWhenDone(&done_tag_);
+    server_->service_->Requestsearch(&context_,
+                                     &request_,
+                                     &responder_,
+                                     server_->cq_.get(),
+                                     server_->cq_.get(),
+                                     this);
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::proceed(bool ok)
+{
+    switch (state_) {
+    case State::Requested:
+        if (!ok) {
+            // the server is shutting down. The call never started: the done
+            // notification is not delivered.
+            AsyncSearchServer* server = server_;
+            delete this;
+            server->call_deleted();
+            return;
+        }
+        start_search();
+        break;
+
+    case State::Streaming:
+        stream(ok);
+        break;
+
+    case State::Finishing:
+        state_ = State::Finished;
+        try_delete();
+        break;
+
+    case State::Finished:
+        break;
+    }
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::on_done()
+{
+    done_notified_ = true;
+
+    if (context_.IsCancelled()) {
+        // unblock the search: its remaining results are dropped
+        std::lock_guard<std::mutex> lock(mtx_);
+        cancelled_ = true;
+        pending_results_.clear();
+        space_cv_.notify_all();
+    }
+
+    try_delete();
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::try_delete()
+{
+    if (state_ != State::Finished || !done_notified_) {
+        return;
+    }
+
+    AsyncSearchServer* server = server_;
+    delete this;
+    server->call_deleted();
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::start_search()
+{
+    if (server_->shutting_down()) {
+        state_ = State::Finishing;
+        responder_.Finish(
+            grpc::Status(grpc::UNAVAILABLE, "The server is shutting down"),
+            this);
+        return;
+    }
+
+    // wait for the next request
+    new SearchCall(server_);
+
+    state_ = State::Streaming;
+
+    server_->pool_.post([this]() {
+        grpc::Status status;
+        try {
+            status = server_->search_(
+                &request_, [this](const index_type* results, size_t count) {
+                    push(results, count);
+                });
+        } catch (const std::exception& e) {
+            logger::logger()->error("Search failed: " + std::string(e.what()));
+            status = grpc::Status(grpc::INTERNAL, "Search failed");
+        }
+        done(status);
+    });
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::stream(bool ok)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    if (writing_ && !ok) {
+        // the stream is broken: the remaining results are dropped
+        cancelled_ = true;
+        pending_results_.clear();
+        space_cv_.notify_all();
+    }
+    writing_ = false;
+
+    if (!pending_results_.empty()) {
+        reply_.set_result(pending_results_.front());
+        pending_results_.pop_front();
+        space_cv_.notify_all();
+
+        // No buffer hint: a buffered write only completes once the transport
+        // is flushed, which the next write, issued on its completion, would
+        // do.
+        writing_ = true;
+        responder_.Write(reply_, this);
+    } else if (search_done_) {
+        state_ = State::Finishing;
+        responder_.Finish(status_, this);
+    } else {
+        op_pending_ = false;
+    }
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::push(
+    const index_type* results,
+    size_t            count)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+
+    while (count > 0) {
+        space_cv_.wait(lock, [this]() {
+            return cancelled_ || pending_results_.size() < kMaxPendingResults;
+        });
+        if (cancelled_) {
+            return;
+        }
+
+        const size_t n
+            = std::min(count, kMaxPendingResults - pending_results_.size());
+        pending_results_.insert(pending_results_.end(), results, results + n);
+        results += n;
+        count -= n;
+
+        wake_up();
+    }
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::done(
+    const grpc::Status& status)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    search_done_ = true;
+    status_      = status;
+    wake_up();
+}
+
+template<class Service, class Request, class Reply>
+void AsyncSearchServer<Service, Request, Reply>::SearchCall::wake_up()
+{
+    if (!op_pending_) {
+        op_pending_ = true;
+
+        // an alarm whose deadline has passed is a way to post the call on
+        // the completion queue
+        alarm_.reset(new grpc::Alarm());
+        alarm_->Set(server_->cq_.get(), gpr_now(GPR_CLOCK_MONOTONIC), this);
+    }
+}
+
+} // namespace sse
@@ -25,6 +25,8 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -32,6 +34,7 @@ namespace sse {
 namespace diana {
 
 class DianaImpl;
+class DianaSearchServer;
 
 class DianaServerRunner
 {
@@ -40,23 +43,38 @@ public:
     DianaServerRunner(const DianaServerRunner&) = delete;
     DianaServerRunner(DianaServerRunner&&)      = default;
 
+    // The searches are run by search_workers_count threads (0 for the
+    // number of hardware threads), shared by all the requests.
     DianaServerRunner(grpc::ServerBuilder& builder,
-                      const std::string&   server_db_path);
+                      const std::string&   server_db_path,
+                      uint32_t             search_workers_count = 0);
     DianaServerRunner(const std::string& server_address,
-                      const std::string& server_db_path);
+                      const std::string& server_db_path,
+                      uint32_t           search_workers_count = 0);
 
 
-    // as we forward-declare SophosImpl, we cannot use the default destructor
+    // as we forward-declare DianaImpl, we cannot use the default destructor
     ~DianaServerRunner();
 
     void set_async_search(bool flag);
 
+    // See DianaImpl
+    void set_search_threads_count(uint8_t count);
+    void set_bulk_insert_batch_size(size_t size);
+    void set_bulk_insert_wal(bool flag);
+    void finish_bulk_load();
+
     void wait();
     void shutdown();
 
 private:
-    std::unique_ptr<DianaImpl>    service_;
-    std::unique_ptr<grpc::Server> server_;
+    void build_and_start(grpc::ServerBuilder& builder,
+                         const std::string&   server_db_path,
+                         uint32_t             search_workers_count);
+
+    std::unique_ptr<DianaImpl>         service_;
+    std::unique_ptr<DianaSearchServer> search_server_;
+    std::unique_ptr<grpc::Server>      server_;
 };
 
 } // namespace diana
@@ -23,12 +23,15 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <cstdint>
+#include <memory>
 #include <string>
 
 namespace sse {
 namespace sophos {
 
 class SophosImpl;
+class SophosSearchServer;
 
 
 class SophosServerRunner
@@ -38,10 +41,14 @@ public:
     SophosServerRunner(const SophosServerRunner&) = delete;
     SophosServerRunner(SophosServerRunner&&)      = default;
 
+    // The searches are run by search_workers_count threads (0 for the
+    // number of hardware threads), shared by all the requests.
     SophosServerRunner(grpc::ServerBuilder& builder,
-                       const std::string&   server_db_path);
+                       const std::string&   server_db_path,
+                       uint32_t             search_workers_count = 0);
     SophosServerRunner(const std::string& server_address,
-                       const std::string& server_db_path);
+                       const std::string& server_db_path,
+                       uint32_t           search_workers_count = 0);
 
 
     // as we forward-declare SophosImpl, we cannot use the default destructor
@@ -49,12 +56,23 @@ public:
 
     void set_async_search(bool flag);
 
+    // See SophosImpl
+    void set_search_threads_count(uint8_t count);
+    void set_bulk_insert_batch_size(size_t size);
+    void set_bulk_insert_wal(bool flag);
+    void finish_bulk_load();
+
     void wait();
     void shutdown();
 
 private:
-    std::unique_ptr<SophosImpl>   service_;
-    std::unique_ptr<grpc::Server> server_;
+    void build_and_start(grpc::ServerBuilder& builder,
+                         const std::string&   server_db_path,
+                         uint32_t             search_workers_count);
+
+    std::unique_ptr<SophosImpl>         service_;
+    std::unique_ptr<SophosSearchServer> search_server_;
+    std::unique_ptr<grpc::Server>       server_;
 };
 
 } // namespace sophos
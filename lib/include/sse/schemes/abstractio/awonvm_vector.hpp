@@ -2,13 +2,17 @@
 
 #pragma once
 
+#include <sse/schemes/abstractio/buffer_pool.hpp>
+#include <sse/schemes/abstractio/page_cache.hpp>
 #include <sse/schemes/abstractio/scheduler.hpp>
+#include <sse/schemes/abstractio/sequential_writer.hpp>
 #include <sse/schemes/utils/logger.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <cassert>
 #include <cerrno>
 #include <cstring>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -21,6 +25,24 @@
 namespace sse {
 namespace abstractio {
 
+/// Access pattern hint given to the kernel for a memory mapped vector
+enum class MemoryMapAdvice
+{
+    Normal,
+    Random,  // MADV_RANDOM: disable readahead
+    WillNeed // MADV_WILLNEED: start reading the whole file in the background
+};
+
+struct MemoryMapOptions
+{
+    MemoryMapAdvice advice{MemoryMapAdvice::Random};
+    // pre-fault the whole mapping (MAP_POPULATE)
+    bool populate{false};
+    // ask for transparent huge pages (MADV_HUGEPAGE). This is only a hint,
+    // honored by the kernel if it supports huge pages for the file.
+    bool huge_pages{false};
+};
+
 template<typename T, size_t ALIGNMENT = alignof(T)>
 class awonvm_vector
 {
@@ -31,7 +53,14 @@ public:
     static_assert(kTypeAlignment <= kValueSize,
                   "Invalid alignment for the type size");
 
-    using get_callback_type = std::function<void(std::unique_ptr<T>)>;
+    // Number of buffers allocated at once by the buffer pools
+    static constexpr size_t kPoolSlabSize = 64;
+
+    /// Values read asynchronously are returned in buffers borrowed from the
+    /// vector's buffer pool, or in the read-only mapping of the file. The
+    /// leases must be destroyed before the vector.
+    using value_lease_type  = BufferLease<const T>;
+    using get_callback_type = std::function<void(value_lease_type)>;
 
     struct GetRequest
     {
@@ -56,6 +85,16 @@ public:
     size_t push_back(const T& val);
     size_t async_push_back(const T& val);
 
+    /// Stage the values added with push_back in large buffers, written
+    /// sequentially in the background, with direct IOs when the file system
+    /// supports them. Buffered writes cannot be mixed with async_push_back.
+    void enable_buffered_writes(
+        size_t buffer_size = SequentialWriter::kDefaultBufferSize);
+
+    /// Write the values staged by buffered writes to the file. Unlike
+    /// commit(), this reports the IO errors by throwing an exception.
+    void flush_writes();
+
     void reserve(size_t n);
 
     void commit() noexcept;
@@ -69,6 +108,11 @@ public:
     void async_get(size_t index, get_callback_type get_callback);
     void async_gets(const std::vector<GetRequest>& requests);
 
+    /// Return a reference to the value at position index. If the vector is
+    /// memory mapped, the reference points to the mapping and no copy is
+    /// made. Otherwise, the value is read in buffer.
+    const T& get(size_t index, T& buffer);
+
     bool is_committed() const noexcept
     {
         return m_is_committed.load();
@@ -81,9 +125,101 @@ public:
 
     void set_use_direct_access(bool flag);
 
+    /// Serve the reads of a committed vector from a read-only memory mapping
+    /// of the file, instead of pread calls or async IOs.
+    /// With a mapping, get() does not make any system call, and async_get()
+    /// runs the callback synchronously, with a lease pointing to the mapping
+    /// (zero copy). The leases must be released before the vector is
+    /// unmapped. An empty vector is mapped without any actual mapping.
+    void memory_map(const MemoryMapOptions& options = MemoryMapOptions());
+    void unmap() noexcept;
+
+    bool is_memory_mapped() const noexcept
+    {
+        return m_is_mapped;
+    }
+
+    /// Enable or disable the recycling of the buffers used by the async
+    /// calls. When disabled, every async call allocates its buffers.
+    /// Must not be called while value leases are still alive.
+    void set_buffer_pooling(bool flag);
+
+    /// Pre-allocate the buffers of `count` concurrent async reads: as long
+    /// as no more reads are in flight, the pools do not allocate memory.
+    void reserve_buffers(size_t count);
+
+    /// Number of memory allocations requested to the system for the
+    /// buffers of the async calls
+    size_t buffers_system_allocations() const noexcept
+    {
+        return m_buffer_pool->system_allocations()
+               + m_context_pool->system_allocations();
+    }
+
+    /// Cache up to byte_budget bytes of values in memory, in front of the
+    /// file (see PageCache). get() and the async calls first look up the
+    /// cache: a hit is served without any IO (and the async callbacks are
+    /// run synchronously), a miss reads the file and caches the value.
+    /// Memory mapped reads bypass the cache.
+    void enable_page_cache(size_t byte_budget);
+    void disable_page_cache();
+
+    /// The page cache, or nullptr if it is disabled
+    const PageCache* page_cache() const noexcept
+    {
+        return m_page_cache.get();
+    }
+
+    /// Read the values at the given positions and put them in the cache,
+    /// e.g. to load the most popular values at startup. Does not count as
+    /// cache misses.
+    void prewarm_page_cache(const std::vector<size_t>& indices);
+
 private:
     static size_t async_io_page_size(int fd);
 
+    // state of an async read, kept until its completion
+    struct ReadContext
+    {
+        get_callback_type callback;
+        void*             buffer;
+        size_t            index;
+        // cache in which the value is inserted, or nullptr
+        PageCache* cache;
+
+        ReadContext(get_callback_type cb,
+                    void*             buf,
+                    size_t            index,
+                    PageCache*        cache)
+            : callback(std::move(cb)), buffer(buf), index(index), cache(cache)
+        {
+        }
+    };
+
+    void reset_buffer_pools(bool pooling);
+    // wait for the in-flight IOs, and replace the scheduler by a new one
+    void restart_io_scheduler();
+
+    void check_index(size_t index) const;
+    // read the value directly from the file
+    void pread_value(size_t index, T& value) const;
+
+    // If the value is cached, run the callback synchronously, and return
+    // true
+    bool serve_from_cache(size_t index, const get_callback_type& callback);
+
+    // Callback passed to the scheduler for the reads. It only captures the
+    // pools (and not the vector), so that it fits in the std::function's
+    // small buffer, and remains valid if the vector is moved.
+    Scheduler::scheduler_callback_type read_completion_callback() const;
+    static void complete_read(AlignedBufferPool* buffer_pool,
+                              AlignedBufferPool* context_pool,
+                              void*              data,
+                              int64_t            res);
+
+    // pointer to the index-th value in the mapping
+    const T* mapped_value(size_t index) const;
+
 
     const std::string m_filename;
     bool              m_use_direct_io{false};
@@ -94,11 +230,32 @@ private:
 
     std::atomic<bool> m_is_committed{false};
 
+    // writer used by buffered writes, or nullptr
+    std::unique_ptr<SequentialWriter> m_writer;
+
+    // read-only mapping of the file, or nullptr (in particular if the mapped
+    // vector is empty)
+    bool   m_is_mapped{false};
+    T*     m_mapping{nullptr};
+    size_t m_mapping_length{0};
+
+    // the pools are declared before the scheduler so that they are destroyed
+    // after it: the completion of the in-flight IOs uses them
+
+    // pool of the value buffers
+    std::unique_ptr<AlignedBufferPool> m_buffer_pool;
+    // pool of the ReadContext objects
+    std::unique_ptr<AlignedBufferPool> m_context_pool;
+    // the page cache is also used by the completion of the reads
+    std::unique_ptr<PageCache> m_page_cache;
+
     std::unique_ptr<Scheduler> m_io_scheduler;
     bool                       m_io_warn_flag{false};
 };
 template<typename T, size_t ALIGNMENT>
 constexpr size_t awonvm_vector<T, ALIGNMENT>::kValueSize;
+template<typename T, size_t ALIGNMENT>
+constexpr size_t awonvm_vector<T, ALIGNMENT>::kPoolSlabSize;
 
 template<typename T, size_t ALIGNMENT>
 // cppcheck-suppress uninitMemberVar
@@ -112,6 +269,8 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(
       m_device_page_size(Scheduler::async_io_page_size(m_fd)),
       m_io_scheduler(std::move(scheduler))
 {
+    reset_buffer_pools(true);
+
     off_t file_size = utility::file_size(m_fd);
 
     if (m_device_page_size == 0) {
@@ -146,6 +305,8 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(const std::string& path,
       m_device_page_size(Scheduler::async_io_page_size(m_fd)),
       m_io_scheduler(make_default_aio_scheduler(m_device_page_size))
 {
+    reset_buffer_pools(true);
+
     off_t file_size = utility::file_size(m_fd);
 
     if (m_device_page_size == 0) {
@@ -173,9 +334,17 @@ template<typename T, size_t ALIGNMENT>
 awonvm_vector<T, ALIGNMENT>::awonvm_vector(awonvm_vector&& vec) noexcept
     : m_filename(vec.m_filename), m_use_direct_io(vec.m_use_direct_io),
       m_fd(vec.m_fd), m_device_page_size(vec.m_device_page_size),
+      m_writer(std::move(vec.m_writer)), m_is_mapped(vec.m_is_mapped),
+      m_mapping(vec.m_mapping), m_mapping_length(vec.m_mapping_length),
+      m_buffer_pool(std::move(vec.m_buffer_pool)),
+      m_context_pool(std::move(vec.m_context_pool)),
+      m_page_cache(std::move(vec.m_page_cache)),
       m_io_scheduler(std::move(vec.m_io_scheduler))
 {
-    vec.m_fd = 0;
+    vec.m_fd             = 0;
+    vec.m_is_mapped      = false;
+    vec.m_mapping        = nullptr;
+    vec.m_mapping_length = 0;
 }
 
 template<typename T, size_t ALIGNMENT>
@@ -188,6 +357,7 @@ awonvm_vector<T, ALIGNMENT>::~awonvm_vector()
             m_io_scheduler->wait_completions();
         }
     }
+    unmap();
     close(m_fd);
 }
 
@@ -215,10 +385,17 @@ size_t awonvm_vector<T, ALIGNMENT>::push_back(const T& val)
             "Invalid state during write: the vector is committed");
     }
 
-    if (m_use_direct_io && !utility::is_aligned(&val, kTypeAlignment)) {
+    if (m_use_direct_io && !m_writer
+        && !utility::is_aligned(&val, kTypeAlignment)) {
         throw std::invalid_argument("Input is not correctly aligned");
     }
 
+    if (m_writer) {
+        // the value is copied: no alignment constraint
+        m_writer->append(&val, sizeof(T));
+        return m_size.fetch_add(1);
+    }
+
     size_t pos = m_size.fetch_add(1);
     // off_t  off = pos * sizeof(T);
 
@@ -246,6 +423,11 @@ size_t awonvm_vector<T, ALIGNMENT>::async_push_back(const T& val)
         throw std::runtime_error("No IO Scheduler set");
     }
 
+    if (m_writer) {
+        throw std::runtime_error(
+            "async_push_back cannot be used with buffered writes");
+    }
+
     if (!m_use_direct_io && !m_io_warn_flag) {
         std::cerr << "awonvm_vector uses buffered IOs. Calls for async IOs "
                      "will be synchronous.\n";
@@ -253,32 +435,22 @@ size_t awonvm_vector<T, ALIGNMENT>::async_push_back(const T& val)
     }
 
     // we have to copy the data so it does not get destructed by the caller
-    void* buf;
-
-    int ret = posix_memalign((&buf), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
-
-    if (ret != 0 || buf == nullptr) {
-        throw std::runtime_error("Error when allocating aligned memory: errno "
-                                 + std::to_string(ret) + "(" + strerror(ret)
-                                 + ")");
-    }
+    void* buf = m_buffer_pool->acquire();
     memcpy(buf, &val, sizeof(T));
 
-    auto cb = [](void* b, size_t /*res*/) {
-        // std::cerr << (int)((uint8_t*)b)[0] << "\t" << res << "\n";
-        // if (buf != b) {
-        //     std::cerr << "Issue: inconsistent buffer\n";
-        // }
-        free(b);
-        // m_completed_writes.fetch_add(1);
-    };
+    // only capture a pointer, so that the scheduler callback fits in the
+    // std::function's small buffer
+    AlignedBufferPool* pool = m_buffer_pool.get();
+    auto cb = [pool](void* b, int64_t /*res*/) { pool->release(b); };
 
     size_t pos = m_size.fetch_add(1);
     off_t  off = pos * sizeof(T);
 
-    ret = m_io_scheduler->submit_pwrite(m_fd, buf, sizeof(T), off, buf, cb);
+    int ret = m_io_scheduler->submit_pwrite(m_fd, buf, sizeof(T), off, buf, cb);
 
     if (ret != 1) {
+        pool->release(buf);
+
         // we should have a specific exception type here to be able to return
         // which position was corrupted
         throw std::runtime_error("Error when submitting the read async IO: "
@@ -289,9 +461,66 @@ size_t awonvm_vector<T, ALIGNMENT>::async_push_back(const T& val)
 }
 
 
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::enable_buffered_writes(size_t buffer_size)
+{
+    if (m_is_committed) {
+        throw std::runtime_error(
+            "Invalid state during write: the vector is committed");
+    }
+    if (m_writer) {
+        return;
+    }
+
+    // wait for the completion of async writes
+    if (m_io_scheduler) {
+        m_io_scheduler->wait_completions();
+    }
+
+    // use a dedicated file descriptor for the writer, opened for direct IOs
+    // if possible
+    int fd = -1;
+    try {
+        fd = utility::open_fd(m_filename, true);
+    } catch (const std::runtime_error& e) {
+        sse::logger::logger()->warn("Unable to open {} for direct IOs ({}). "
+                                    "Buffered writes will use the page cache.",
+                                    m_filename,
+                                    e.what());
+        fd = utility::open_fd(m_filename, false);
+    }
+
+    const size_t alignment
+        = std::max<size_t>(m_device_page_size, utility::os_page_size());
+
+    m_writer.reset(new SequentialWriter(
+        fd, m_size.load() * sizeof(T), buffer_size, alignment));
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::flush_writes()
+{
+    if (m_writer) {
+        m_writer->flush();
+    }
+}
+
 template<typename T, size_t ALIGNMENT>
 void awonvm_vector<T, ALIGNMENT>::commit() noexcept
 {
+    if (!m_is_committed && m_writer) {
+        try {
+            m_writer->flush();
+        } catch (const std::exception& e) {
+            sse::logger::logger()->error(
+                "Error when writing the content of {}: {}",
+                m_filename,
+                e.what());
+        }
+        // close the writer's file descriptor
+        m_writer.reset();
+    }
+
     if (!m_is_committed) {
         if (m_io_scheduler) {
             m_io_scheduler->wait_completions();
@@ -331,83 +560,342 @@ void awonvm_vector<T, ALIGNMENT>::set_use_direct_access(bool flag)
 }
 
 template<typename T, size_t ALIGNMENT>
-T awonvm_vector<T, ALIGNMENT>::get(size_t index)
+void awonvm_vector<T, ALIGNMENT>::memory_map(const MemoryMapOptions& options)
+{
+    if (!m_is_committed) {
+        throw std::runtime_error(
+            "Invalid state during mapping: the vector is not committed");
+    }
+
+    // remap the file with the new options
+    unmap();
+
+    const size_t length = m_size.load() * sizeof(T);
+
+    if (length == 0) {
+        // mmap rejects empty mappings
+        m_is_mapped = true;
+        return;
+    }
+
+    int flags = MAP_SHARED;
+    if (options.populate) {
+        flags |= MAP_POPULATE;
+    }
+
+    void* mapping = mmap(nullptr, length, PROT_READ, flags, m_fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error when mapping the vector: errno "
+                                 + std::to_string(errno) + "("
+                                 + strerror(errno) + ")");
+    }
+
+    int advice = MADV_NORMAL;
+    switch (options.advice) {
+    case MemoryMapAdvice::Normal:
+        advice = MADV_NORMAL;
+        break;
+    case MemoryMapAdvice::Random:
+        advice = MADV_RANDOM;
+        break;
+    case MemoryMapAdvice::WillNeed:
+        advice = MADV_WILLNEED;
+        break;
+    }
+
+    // the hints are not critical: only warn if they are rejected
+    if (madvise(mapping, length, advice) != 0) {
+        sse::logger::logger()->warn("madvise failed on mapping of {}: {}",
+                                    m_filename,
+                                    strerror(errno));
+    }
+    if (options.huge_pages && madvise(mapping, length, MADV_HUGEPAGE) != 0) {
+        sse::logger::logger()->warn(
+            "Huge pages are not available for the mapping of {}: {}",
+            m_filename,
+            strerror(errno));
+    }
+
+    m_is_mapped      = true;
+    m_mapping        = static_cast<T*>(mapping);
+    m_mapping_length = length;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::unmap() noexcept
+{
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_mapping_length);
+    }
+    m_is_mapped      = false;
+    m_mapping        = nullptr;
+    m_mapping_length = 0;
+}
+
+template<typename T, size_t ALIGNMENT>
+const T* awonvm_vector<T, ALIGNMENT>::mapped_value(size_t index) const
+{
+    if (index >= m_mapping_length / sizeof(T)) {
+        throw std::invalid_argument(
+            "Index (" + std::to_string(index) + ") out of bounds (size="
+            + std::to_string(m_mapping_length / sizeof(T)) + ")");
+    }
+    return m_mapping + index;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::set_buffer_pooling(bool flag)
+{
+    if (flag != m_buffer_pool->is_pooling()) {
+        restart_io_scheduler();
+        reset_buffer_pools(flag);
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::restart_io_scheduler()
+{
+    if (m_io_scheduler) {
+        // wait for unfinished async IOs, and recreate a scheduler
+        m_io_scheduler->wait_completions();
+        Scheduler* new_sched = m_io_scheduler->duplicate();
+        m_io_scheduler.reset(new_sched);
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::enable_page_cache(size_t byte_budget)
+{
+    // the in-flight reads might insert their value in the previous cache
+    restart_io_scheduler();
+    m_page_cache.reset(new PageCache(sizeof(T), byte_budget));
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::disable_page_cache()
+{
+    if (m_page_cache) {
+        restart_io_scheduler();
+        m_page_cache.reset();
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::prewarm_page_cache(
+    const std::vector<size_t>& indices)
+{
+    if (!m_page_cache) {
+        throw std::runtime_error("The page cache is not enabled");
+    }
+    if (!m_is_committed) {
+        throw std::runtime_error(
+            "Invalid state during read: the vector is not committed");
+    }
+
+    alignas(kTypeAlignment) T v;
+
+    for (size_t index : indices) {
+        check_index(index);
+
+        if (!m_page_cache->contains(index)) {
+            pread_value(index, v);
+            m_page_cache->insert(index, &v);
+        }
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+bool awonvm_vector<T, ALIGNMENT>::serve_from_cache(
+    size_t                   index,
+    const get_callback_type& callback)
+{
+    if (!m_page_cache) {
+        return false;
+    }
+
+    void* buffer = m_buffer_pool->acquire();
+
+    if (!m_page_cache->lookup(index, buffer)) {
+        m_buffer_pool->release(buffer);
+        return false;
+    }
+
+    AlignedBufferPool::Recycler recycler{m_buffer_pool.get()};
+    callback(value_lease_type(reinterpret_cast<T*>(buffer), recycler));
+    return true;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::reset_buffer_pools(bool pooling)
+{
+    const size_t slab_size = pooling ? kPoolSlabSize : 0;
+
+    m_buffer_pool.reset(
+        new AlignedBufferPool(sizeof(T), ALIGNMENT, slab_size));
+    m_context_pool.reset(new AlignedBufferPool(
+        sizeof(ReadContext), alignof(ReadContext), slab_size));
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::reserve_buffers(size_t count)
+{
+    m_buffer_pool->reserve(count);
+    m_context_pool->reserve(count);
+}
+
+template<typename T, size_t ALIGNMENT>
+Scheduler::scheduler_callback_type awonvm_vector<
+    T,
+    ALIGNMENT>::read_completion_callback() const
+{
+    AlignedBufferPool* buffer_pool  = m_buffer_pool.get();
+    AlignedBufferPool* context_pool = m_context_pool.get();
+
+    return [buffer_pool, context_pool](void* data, int64_t res) {
+        complete_read(buffer_pool, context_pool, data, res);
+    };
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::complete_read(AlignedBufferPool* buffer_pool,
+                                                AlignedBufferPool* context_pool,
+                                                void*              data,
+                                                int64_t            res)
+{
+    ReadContext* context = static_cast<ReadContext*>(data);
+
+    get_callback_type callback = std::move(context->callback);
+    void*             buffer   = context->buffer;
+    const size_t      index    = context->index;
+    PageCache*        cache    = context->cache;
+
+    context->~ReadContext();
+    context_pool->release(context);
+
+    value_lease_type result(nullptr, AlignedBufferPool::Recycler{buffer_pool});
+
+    if (res == sizeof(T)) {
+        if (cache != nullptr) {
+            cache->insert(index, buffer);
+        }
+        result.reset(reinterpret_cast<T*>(buffer));
+    } else {
+        buffer_pool->release(buffer); // avoid memory leaks
+    }
+
+    callback(std::move(result));
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::check_index(size_t index) const
 {
     if (index > m_size.load()) {
         throw std::invalid_argument("Index (" + std::to_string(index)
                                     + ") out of bounds (size="
                                     + std::to_string(m_size.load()) + ")");
     }
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::pread_value(size_t index, T& value) const
+{
+    int res = pread(m_fd, &value, sizeof(T), index * sizeof(T));
+
+    if (res != sizeof(T)) {
+        std::cerr << "Error during pread: " << res << "\n";
+        throw std::runtime_error("Error during pread: " + std::to_string(res));
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+T awonvm_vector<T, ALIGNMENT>::get(size_t index)
+{
+    check_index(index);
 
     if (!m_is_committed) {
         throw std::runtime_error(
             "Invalid state during read: the vector is not committed");
     }
 
+    if (is_memory_mapped()) {
+        return *mapped_value(index);
+    }
+
     alignas(kTypeAlignment) T v;
 
-    int res = pread(m_fd, &v, sizeof(T), index * sizeof(T));
+    if (m_page_cache && m_page_cache->lookup(index, &v)) {
+        return v;
+    }
+
+    pread_value(index, v);
 
-    if (res != sizeof(T)) {
-        std::cerr << "Error during pread: " << res << "\n";
-        throw std::runtime_error("Error during pread: " + std::to_string(res));
+    if (m_page_cache) {
+        m_page_cache->insert(index, &v);
     }
 
     return v;
 }
 
 template<typename T, size_t ALIGNMENT>
-void awonvm_vector<T, ALIGNMENT>::async_get(size_t            index,
-                                            get_callback_type get_callback)
+const T& awonvm_vector<T, ALIGNMENT>::get(size_t index, T& buffer)
 {
-    if (!m_io_scheduler) {
-        throw std::runtime_error("No IO Scheduler set");
+    if (m_is_committed && is_memory_mapped()) {
+        return *mapped_value(index);
     }
 
+    buffer = get(index);
+    return buffer;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::async_get(size_t            index,
+                                            get_callback_type get_callback)
+{
     if (!m_is_committed) {
         throw std::runtime_error(
             "Invalid state during read: the vector is not committed");
     }
 
+    if (is_memory_mapped()) {
+        // the value is already in memory: no need to go through the
+        // scheduler, and the lease does not own the value
+        get_callback(value_lease_type(mapped_value(index),
+                                      AlignedBufferPool::Recycler{nullptr}));
+        return;
+    }
+
+    if (!m_io_scheduler) {
+        throw std::runtime_error("No IO Scheduler set");
+    }
+
     if (!m_use_direct_io && !m_io_warn_flag) {
         std::cerr << "awonvm_vector uses buffered IOs. Calls for async IOs "
                      "will be synchronous.\n";
         m_io_warn_flag = true;
     }
 
-    if (index > m_size.load()) {
-        throw std::invalid_argument("Index (" + std::to_string(index)
-                                    + ") out of bounds (size="
-                                    + std::to_string(m_size.load()) + ")");
-    }
-
-    void* buffer;
-    int   ret
-        = posix_memalign((&buffer), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
+    check_index(index);
 
-    if (ret != 0 || buffer == nullptr) {
-        throw std::runtime_error("Error when allocating aligned memory: errno "
-                                 + std::to_string(ret) + "(" + strerror(ret)
-                                 + ")");
+    if (serve_from_cache(index, get_callback)) {
+        return;
     }
 
-    auto inner_cb = [get_callback](void* buf, int64_t res) {
-        std::unique_ptr<T> result(nullptr);
-
-        if (res == sizeof(T)) {
-            result.reset(reinterpret_cast<T*>(buf));
-        } else {
-            free(buf); // avoid memory leaks
-        }
-
-        get_callback(std::move(result));
-    };
+    void*        buffer  = m_buffer_pool->acquire();
+    ReadContext* context = new (m_context_pool->acquire()) ReadContext(
+        std::move(get_callback), buffer, index, m_page_cache.get());
 
-    ret = m_io_scheduler->submit_pread(
-        m_fd, buffer, sizeof(T), index * sizeof(T), buffer, inner_cb);
+    int ret = m_io_scheduler->submit_pread(m_fd,
+                                           buffer,
+                                           sizeof(T),
+                                           index * sizeof(T),
+                                           context,
+                                           read_completion_callback());
 
     if (ret != 1) {
-        free(buffer);
+        context->~ReadContext();
+        m_context_pool->release(context);
+        m_buffer_pool->release(buffer);
 
         throw std::runtime_error(
             "Error when submitting the read async IO: errno "
@@ -419,15 +907,23 @@ template<typename T, size_t ALIGNMENT>
 void awonvm_vector<T, ALIGNMENT>::async_gets(
     const std::vector<GetRequest>& requests)
 {
-    if (!m_io_scheduler) {
-        throw std::runtime_error("No IO Scheduler set");
-    }
-
     if (!m_is_committed) {
         throw std::runtime_error(
             "Invalid state during read: the vector is not committed");
     }
 
+    if (is_memory_mapped()) {
+        for (const auto& req : requests) {
+            req.callback(value_lease_type(
+                mapped_value(req.index), AlignedBufferPool::Recycler{nullptr}));
+        }
+        return;
+    }
+
+    if (!m_io_scheduler) {
+        throw std::runtime_error("No IO Scheduler set");
+    }
+
     if (!m_use_direct_io && !m_io_warn_flag) {
         std::cerr << "awonvm_vector uses buffered IOs. Calls for async IOs "
                      "will be synchronous.\n";
@@ -437,49 +933,53 @@ void awonvm_vector<T, ALIGNMENT>::async_gets(
     std::vector<Scheduler::PReadSumission> submissions;
     submissions.reserve(requests.size());
 
-    for (const auto& req : requests) {
-        if (req.index > m_size.load()) {
-            throw std::invalid_argument("Index (" + std::to_string(req.index)
-                                        + ") out of bounds (size="
-                                        + std::to_string(m_size.load()) + ")");
-        }
-
+    const Scheduler::scheduler_callback_type inner_cb
+        = read_completion_callback();
 
-        void* buffer;
-        int   ret = posix_memalign(
-            (&buffer), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
+    for (const auto& req : requests) {
+        check_index(req.index);
 
-        if (ret != 0 || buffer == nullptr) {
-            throw std::runtime_error(
-                "Error when allocating aligned memory: errno "
-                + std::to_string(ret) + "(" + strerror(ret) + ")");
+        if (serve_from_cache(req.index, req.callback)) {
+            continue;
         }
 
-        auto get_callback = req.callback;
-        auto inner_cb     = [get_callback](void* buf, int64_t res) {
-            std::unique_ptr<T> result(nullptr);
-
-            if (res == sizeof(T)) {
-                result.reset(reinterpret_cast<T*>(buf));
-            }
+        void*        buffer  = m_buffer_pool->acquire();
+        ReadContext* context = new (m_context_pool->acquire())
+            ReadContext(req.callback, buffer, req.index, m_page_cache.get());
 
-            get_callback(std::move(result));
-        };
+        submissions.push_back(Scheduler::PReadSumission(m_fd,
+                                                        buffer,
+                                                        sizeof(T),
+                                                        req.index * sizeof(T),
+                                                        context,
+                                                        inner_cb));
+    }
 
-        submissions.push_back(Scheduler::PReadSumission(
-            m_fd, buffer, sizeof(T), req.index * sizeof(T), buffer, inner_cb));
+    if (submissions.empty()) {
+        return;
     }
 
     int ret = m_io_scheduler->submit_preads(submissions);
 
-    if (ret < 0 || static_cast<size_t>(ret) != submissions.size()) {
-        for (auto& sub : submissions) {
-            free(sub.buf);
+    const size_t accepted = (ret < 0) ? 0 : static_cast<size_t>(ret);
+
+    if (accepted != submissions.size()) {
+        // The accepted reads are the first ones of the batch: they are still
+        // in flight, and their completion releases their buffers. Only
+        // release the others.
+        for (size_t i = accepted; i < submissions.size(); i++) {
+            ReadContext* context
+                = static_cast<ReadContext*>(submissions[i].data);
+            context->~ReadContext();
+            m_context_pool->release(context);
+            m_buffer_pool->release(submissions[i].buf);
         }
 
         throw std::runtime_error(
-            "Error when submitting the read async IO: errno "
-            + std::to_string(ret) + "(" + strerror(ret) + ")");
+            "Error when submitting the read async IOs: "
+            + std::to_string(accepted) + " out of "
+            + std::to_string(submissions.size())
+            + " reads submitted (returned " + std::to_string(ret) + ")");
     }
 }
 
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+/// Pool of fixed-size, aligned memory buffers.
+///
+/// Buffers are carved out of slabs of `buffers_per_slab` buffers, and
+/// recycled through free lists instead of being given back to the system.
+/// The free lists are striped: each thread pushes and pops from its own
+/// stripe, and only steals from the other stripes when its own is empty. As
+/// a consequence, the threads posting IOs and the completion threads
+/// recycling the buffers rarely contend on the same lock.
+/// Free buffers are chained intrusively (the link is stored in the buffer
+/// itself), so recycling a buffer never allocates.
+///
+/// If `buffers_per_slab` is 0, pooling is disabled: every acquisition is a
+/// call to posix_memalign, and every release a call to free.
+///
+/// The memory of the slabs is only given back to the system when the pool is
+/// destroyed. All the buffers must be released before that.
+class AlignedBufferPool
+{
+public:
+    /// Deleter returning the buffer to its pool. A recycler with no pool does
+    /// nothing.
+    struct Recycler
+    {
+        AlignedBufferPool* pool{nullptr};
+
+        template<class T>
+        void operator()(T* buf) const
+        {
+            if (pool != nullptr) {
+                // a lease on a read-only value still owns its buffer
+                using value_type = typename std::remove_const<T>::type;
+                pool->release(const_cast<value_type*>(buf));
+            }
+        }
+    };
+
+    inline AlignedBufferPool(size_t buffer_size,
+                             size_t alignment,
+                             size_t buffers_per_slab);
+    inline ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    inline void* acquire();
+    inline void  release(void* buf);
+
+    /// Allocate slabs until the pool holds at least `count` buffers, so that
+    /// up to `count` buffers can be in use at the same time without any
+    /// other system allocation. Does nothing if pooling is disabled.
+    inline void reserve(size_t count);
+
+    bool is_pooling() const noexcept
+    {
+        return m_buffers_per_slab != 0;
+    }
+
+    size_t buffer_size() const noexcept
+    {
+        return m_buffer_size;
+    }
+
+    /// Number of memory allocations requested to the system so far
+    size_t system_allocations() const noexcept
+    {
+        return m_system_allocations.load();
+    }
+
+private:
+    static constexpr size_t kStripesCount = 16;
+
+    struct FreeBuffer
+    {
+        FreeBuffer* next;
+    };
+
+    struct Stripe
+    {
+        std::mutex  lock;
+        FreeBuffer* head{nullptr};
+        // avoid false sharing between stripes
+        char padding[64];
+    };
+
+    static inline size_t thread_stripe_index();
+    inline void*         allocate_aligned(size_t size);
+    inline void*         pop(Stripe& stripe);
+    inline uint8_t*      new_slab();
+    inline void          push_slab(Stripe& stripe, uint8_t* slab, size_t first);
+    inline void*         allocate_slab(Stripe& stripe);
+
+    const size_t m_alignment;
+    const size_t m_buffer_size;
+    const size_t m_buffers_per_slab;
+
+    std::array<Stripe, kStripesCount> m_stripes;
+
+    std::mutex         m_slabs_lock;
+    std::vector<void*> m_slabs;
+
+    std::atomic<size_t> m_system_allocations{0};
+};
+
+/// Smart pointer to a buffer borrowed from an AlignedBufferPool. The buffer
+/// goes back to the pool when the lease is destroyed.
+/// Note that T's destructor is not called: T must be trivially destructible.
+template<class T>
+using BufferLease = std::unique_ptr<T, AlignedBufferPool::Recycler>;
+
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size,
+                                     size_t alignment,
+                                     size_t buffers_per_slab)
+    : m_alignment(std::max(alignment, sizeof(void*))),
+      // the buffers must be large enough to hold the free list link, and
+      // consecutive buffers of a slab must be aligned
+      m_buffer_size(((std::max(buffer_size, sizeof(FreeBuffer))
+                      + m_alignment - 1)
+                     / m_alignment)
+                    * m_alignment),
+      m_buffers_per_slab(buffers_per_slab)
+{
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    for (void* slab : m_slabs) {
+        free(slab);
+    }
+}
+
+size_t AlignedBufferPool::thread_stripe_index()
+{
+    static std::atomic<size_t> next_index{0};
+    static thread_local size_t index = next_index.fetch_add(1);
+
+    return index % kStripesCount;
+}
+
+void* AlignedBufferPool::allocate_aligned(size_t size)
+{
+    void* buf = nullptr;
+    int   ret = posix_memalign(&buf, m_alignment, size);
+
+    if (ret != 0 || buf == nullptr) {
+        throw std::runtime_error("Error when allocating aligned memory: errno "
+                                 + std::to_string(ret) + "(" + strerror(ret)
+                                 + ")");
+    }
+    m_system_allocations.fetch_add(1);
+    return buf;
+}
+
+void* AlignedBufferPool::pop(Stripe& stripe)
+{
+    std::lock_guard<std::mutex> guard(stripe.lock);
+
+    FreeBuffer* buf = stripe.head;
+    if (buf != nullptr) {
+        stripe.head = buf->next;
+    }
+    return buf;
+}
+
+uint8_t* AlignedBufferPool::new_slab()
+{
+    uint8_t* slab = static_cast<uint8_t*>(
+        allocate_aligned(m_buffer_size * m_buffers_per_slab));
+
+    std::lock_guard<std::mutex> guard(m_slabs_lock);
+    m_slabs.push_back(slab);
+
+    return slab;
+}
+
+void AlignedBufferPool::push_slab(Stripe& stripe, uint8_t* slab, size_t first)
+{
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    for (size_t i = first; i < m_buffers_per_slab; i++) {
+        FreeBuffer* buf
+            = reinterpret_cast<FreeBuffer*>(slab + i * m_buffer_size);
+        buf->next   = stripe.head;
+        stripe.head = buf;
+    }
+}
+
+void* AlignedBufferPool::allocate_slab(Stripe& stripe)
+{
+    uint8_t* slab = new_slab();
+
+    // keep the first buffer, and put the others in the free list
+    push_slab(stripe, slab, 1);
+
+    return slab;
+}
+
+void AlignedBufferPool::reserve(size_t count)
+{
+    if (!is_pooling()) {
+        return;
+    }
+
+    Stripe& stripe = m_stripes[thread_stripe_index()];
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> guard(m_slabs_lock);
+            if (m_slabs.size() * m_buffers_per_slab >= count) {
+                return;
+            }
+        }
+        push_slab(stripe, new_slab(), 0);
+    }
+}
+
+void* AlignedBufferPool::acquire()
+{
+    if (!is_pooling()) {
+        return allocate_aligned(m_buffer_size);
+    }
+
+    const size_t stripe_index = thread_stripe_index();
+
+    // first look in the thread's stripe, and then steal from the other ones
+    for (size_t i = 0; i < kStripesCount; i++) {
+        void* buf = pop(m_stripes[(stripe_index + i) % kStripesCount]);
+        if (buf != nullptr) {
+            return buf;
+        }
+    }
+
+    return allocate_slab(m_stripes[stripe_index]);
+}
+
+void AlignedBufferPool::release(void* buf)
+{
+    if (buf == nullptr) {
+        return;
+    }
+
+    if (!is_pooling()) {
+        free(buf);
+        return;
+    }
+
+    Stripe&     stripe   = m_stripes[thread_stripe_index()];
+    FreeBuffer* free_buf = static_cast<FreeBuffer*>(buf);
+
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    free_buf->next = stripe.head;
+    stripe.head    = free_buf;
+}
+
+} // namespace abstractio
+} // namespace sse
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+/// Concurrent cache of fixed-size pages, keyed by page index.
+///
+/// The cache is split in shards (page i goes to shard i % shards_count),
+/// each protected by its own lock, and holding a fixed number of page slots:
+/// the memory of the cache is allocated once, at construction.
+/// Eviction follows the CLOCK policy: every page has a reference bit, set
+/// when the page is hit. When a slot is needed, the clock hand sweeps the
+/// slots, clearing the reference bits, until it finds an unreferenced page,
+/// which is evicted. Pages are inserted unreferenced, so that pages read only
+/// once (the tail of the distribution) are evicted before the popular ones.
+///
+/// Pages are copied in and out of the cache: a page can be evicted while
+/// a copy of it is still being used.
+class PageCache
+{
+public:
+    static constexpr size_t kDefaultShardsCount = 16;
+
+    /// Create a cache of at most byte_budget bytes of pages. Throws
+    /// std::invalid_argument if the budget is smaller than a page.
+    inline PageCache(size_t page_size,
+                     size_t byte_budget,
+                     size_t shards_count = kDefaultShardsCount);
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    /// Copy the page to dst and return true if it is cached. Counts a hit or
+    /// a miss.
+    inline bool lookup(size_t index, void* dst);
+
+    /// Insert (or overwrite) a page in the cache, evicting another page if
+    /// needed.
+    inline void insert(size_t index, const void* src);
+
+    /// Check if a page is cached, without counting a hit or a miss and
+    /// without updating the reference bit.
+    inline bool contains(size_t index);
+
+    inline void clear();
+
+    inline size_t hits() const;
+    inline size_t misses() const;
+    inline void   reset_stats();
+
+    /// Number of pages currently cached
+    inline size_t size() const;
+
+    /// Maximum number of pages in the cache
+    size_t capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    size_t page_size() const noexcept
+    {
+        return m_page_size;
+    }
+
+private:
+    struct Shard
+    {
+        // the lock is mutable so that the statistics can be read from a
+        // const cache
+        mutable std::mutex lock;
+
+        std::unordered_map<size_t, size_t> slots; // page index -> slot
+        std::vector<size_t>                indices;
+        std::vector<bool>                  referenced;
+        std::unique_ptr<uint8_t[]>         pages;
+
+        size_t used{0};
+        size_t hand{0};
+
+        size_t hits{0};
+        size_t misses{0};
+    };
+
+    Shard& shard(size_t index)
+    {
+        return m_shards[index % m_shards.size()];
+    }
+
+    // Must be called with the shard's lock held
+    inline size_t evict(Shard& s);
+
+    const size_t m_page_size;
+    size_t       m_capacity{0};
+
+    std::vector<Shard> m_shards;
+};
+
+PageCache::PageCache(size_t page_size,
+                     size_t byte_budget,
+                     size_t shards_count)
+    : m_page_size(page_size)
+{
+    if (page_size == 0 || byte_budget < page_size) {
+        throw std::invalid_argument(
+            "Invalid page cache budget (" + std::to_string(byte_budget)
+            + " bytes) for pages of " + std::to_string(page_size) + " bytes");
+    }
+
+    const size_t n_pages = byte_budget / page_size;
+
+    // every shard must be able to hold at least one page
+    shards_count = std::max<size_t>(1, std::min(shards_count, n_pages));
+
+    m_shards = std::vector<Shard>(shards_count);
+
+    for (size_t i = 0; i < shards_count; i++) {
+        Shard& s = m_shards[i];
+
+        // spread the remainder of the division over the first shards
+        const size_t shard_capacity
+            = n_pages / shards_count + ((i < n_pages % shards_count) ? 1 : 0);
+
+        s.slots.reserve(shard_capacity);
+        s.indices.resize(shard_capacity);
+        s.referenced.resize(shard_capacity, false);
+        s.pages.reset(new uint8_t[shard_capacity * m_page_size]);
+
+        m_capacity += shard_capacity;
+    }
+}
+
+bool PageCache::lookup(size_t index, void* dst)
+{
+    Shard&                      s = shard(index);
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    auto it = s.slots.find(index);
+    if (it == s.slots.end()) {
+        s.misses++;
+        return false;
+    }
+
+    s.hits++;
+    s.referenced[it->second] = true;
+    memcpy(dst, s.pages.get() + it->second * m_page_size, m_page_size);
+
+    return true;
+}
+
+void PageCache::insert(size_t index, const void* src)
+{
+    Shard&                      s = shard(index);
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    size_t slot;
+
+    auto it = s.slots.find(index);
+    if (it != s.slots.end()) {
+        slot = it->second;
+    } else {
+        slot = (s.used < s.indices.size()) ? s.used++ : evict(s);
+
+        s.slots.emplace(index, slot);
+        s.indices[slot]    = index;
+        s.referenced[slot] = false;
+    }
+
+    memcpy(s.pages.get() + slot * m_page_size, src, m_page_size);
+}
+
+size_t PageCache::evict(Shard& s)
+{
+    const size_t shard_capacity = s.indices.size();
+
+    // give a second chance to the referenced pages
+    while (s.referenced[s.hand]) {
+        s.referenced[s.hand] = false;
+        s.hand               = (s.hand + 1) % shard_capacity;
+    }
+
+    size_t slot = s.hand;
+    s.hand      = (s.hand + 1) % shard_capacity;
+
+    s.slots.erase(s.indices[slot]);
+
+    return slot;
+}
+
+bool PageCache::contains(size_t index)
+{
+    Shard&                      s = shard(index);
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    return s.slots.find(index) != s.slots.end();
+}
+
+void PageCache::clear()
+{
+    for (auto& s : m_shards) {
+        std::lock_guard<std::mutex> guard(s.lock);
+
+        s.slots.clear();
+        std::fill(s.referenced.begin(), s.referenced.end(), false);
+        s.used = 0;
+        s.hand = 0;
+    }
+}
+
+size_t PageCache::hits() const
+{
+    size_t count = 0;
+    for (const auto& s : m_shards) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        count += s.hits;
+    }
+    return count;
+}
+
+size_t PageCache::misses() const
+{
+    size_t count = 0;
+    for (const auto& s : m_shards) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        count += s.misses;
+    }
+    return count;
+}
+
+void PageCache::reset_stats()
+{
+    for (auto& s : m_shards) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.hits   = 0;
+        s.misses = 0;
+    }
+}
+
+size_t PageCache::size() const
+{
+    size_t count = 0;
+    for (const auto& s : m_shards) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        count += s.used;
+    }
+    return count;
+}
+
+} // namespace abstractio
+} // namespace sse
@@ -79,6 +79,11 @@ public:
                              scheduler_callback_type callback)
         = 0;
 
+    /// Submit a batch of reads. The reads are submitted in order, up to the
+    /// first one that cannot be: the function returns the number of reads
+    /// submitted (which are the first ones of subs), or a negative error
+    /// code if none was. The reads that were not submitted are never called
+    /// back, and their buffers can be freed right away.
     inline virtual int submit_preads(const std::vector<PReadSumission>& subs);
 
     virtual int submit_pwrite(int                     fd,
@@ -90,6 +95,15 @@ public:
         = 0;
 
 
+    /// Register memory buffers with the scheduler.
+    ///
+    /// Schedulers able to take advantage of pre-registered memory (e.g.
+    /// io_uring's fixed buffers) will use it for the requests whose buffer
+    /// lies in one of the registered buffers. The buffers must outlive the
+    /// scheduler. Returns 0 on success, and a negative error code otherwise.
+    /// The default implementation does nothing.
+    inline virtual int register_buffers(const std::vector<ReadBuffer>& buffers);
+
     virtual Scheduler* duplicate() const = 0;
 
     static size_t async_io_page_size(int fd);
@@ -102,25 +116,57 @@ int Scheduler::submit_preads(const std::vector<PReadSumission>& subs)
         int err = this->submit_pread(
             read.fd, read.buf, read.len, read.offset, read.data, read.callback);
 
-        if (err == 1) {
-            ret++;
+        if (err != 1) {
+            return (ret > 0) ? ret : err;
         }
+        ret++;
     }
     return ret;
 }
+
+int Scheduler::register_buffers(const std::vector<ReadBuffer>& buffers)
+{
+    (void)buffers;
+    return 0;
+}
+
 constexpr int EINVAL_UNALIGNED_BUFFER = 1024;
 constexpr int EINVAL_UNALIGNED_ACCESS = 1025;
 constexpr int EINVAL_BUFFERSIZE       = 1026;
 constexpr int EINVAL_INVALID_STATE    = 1027;
 
 #ifdef HAS_LIBAIO
-Scheduler* make_linux_aio_scheduler(const size_t   page_size,
-                                    const unsigned n_events);
+/// Create a Linux AIO-based scheduler.
+/// The scheduler uses `n_threads` io contexts, each of them having a queue
+/// depth of `n_events` and its own completion thread. If `cpu_affinity` is
+/// not empty, the completion threads are pinned to the listed CPUs, in a
+/// round-robin fashion.
+Scheduler* make_linux_aio_scheduler(const size_t            page_size,
+                                    const unsigned          n_events,
+                                    const unsigned          n_threads = 1,
+                                    const std::vector<int>& cpu_affinity = {});
+#endif
+
+#ifdef HAS_LIBURING
+/// Create an io_uring-based scheduler.
+/// If `use_sqpoll` is set, submissions are polled by a kernel thread.
+/// If `register_files` is set, the file descriptors are registered with the
+/// ring: they must then stay open while the scheduler is alive.
+Scheduler* make_io_uring_scheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   const bool     use_sqpoll     = false,
+                                   const bool     register_files = false);
+
+/// Check if the running kernel supports the io_uring scheduler
+bool io_uring_is_supported();
 #endif
 
 Scheduler* make_thread_pool_aio_scheduler();
 
 
+/// Create the best scheduler available: io_uring if supported by the build
+/// and the running kernel, then Linux AIO, and finally the thread pool-based
+/// scheduler.
 Scheduler* make_default_aio_scheduler(const size_t page_size);
 
 } // namespace abstractio
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sse {
+namespace abstractio {
+
+/// Append-only writer staging the data in large aligned buffers.
+///
+/// The data passed to `append` is copied in a staging buffer. When the
+/// buffer is full, it is handed to a background thread that writes it to the
+/// file with a single pwrite call, while the caller keeps filling a second
+/// buffer (double buffering). With a file descriptor opened with O_DIRECT,
+/// the file is written in large, aligned, chunks, at the sequential
+/// bandwidth of the device.
+///
+/// The last (partial) chunk, written by `flush`, might not have an aligned
+/// size. If the kernel rejects it, O_DIRECT is disabled on the file
+/// descriptor for this last write.
+///
+/// IO errors happening in the background thread are reported by the next
+/// call to `append` or `flush`.
+class SequentialWriter
+{
+public:
+    static constexpr size_t kDefaultBufferSize = 8 * 1024 * 1024; // 8 MiB
+
+    /// The writer takes the ownership of the file descriptor fd, and starts
+    /// writing at offset. buffer_size is rounded up to a multiple of
+    /// alignment.
+    SequentialWriter(int    fd,
+                     off_t  offset,
+                     size_t buffer_size,
+                     size_t alignment);
+    ~SequentialWriter();
+
+    SequentialWriter(const SequentialWriter&) = delete;
+    SequentialWriter& operator=(const SequentialWriter&) = delete;
+
+    void append(const void* data, size_t length);
+
+    /// Write all the staged data to the file, and wait for the completion of
+    /// the writes.
+    void flush();
+
+    /// Offset of the end of the appended data
+    off_t offset() const noexcept
+    {
+        return m_buffer_offset + m_buffer_length;
+    }
+
+    size_t buffer_size() const noexcept
+    {
+        return m_buffer_size;
+    }
+
+private:
+    // hand the active buffer to the flush thread, and switch to the other
+    // buffer
+    void submit_active_buffer();
+    void wait_pending_write(std::unique_lock<std::mutex>& lock);
+    void rethrow_error();
+
+    void flush_loop();
+    void write_buffer(const uint8_t* buffer, size_t length, off_t offset);
+
+    int          m_fd;
+    const size_t m_buffer_size;
+
+    std::array<uint8_t*, 2> m_buffers{{nullptr, nullptr}};
+
+    // state of the buffer being filled
+    size_t m_active_buffer{0};
+    size_t m_buffer_length{0};
+    off_t  m_buffer_offset;
+
+    // buffer waiting to be written, or nullptr
+    const uint8_t* m_pending_buffer{nullptr};
+    size_t         m_pending_length{0};
+    off_t          m_pending_offset{0};
+
+    bool               m_stop_flag{false};
+    std::exception_ptr m_error;
+
+    std::mutex              m_lock;
+    std::condition_variable m_cv;
+    std::thread             m_flush_thread;
+};
+
+} // namespace abstractio
+} // namespace sse
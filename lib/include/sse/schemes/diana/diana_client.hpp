@@ -72,6 +72,11 @@ public:
                                                   const index_type   index);
     std::list<UpdateRequest<T>> bulk_insertion_request(
         const std::list<std::pair<std::string, index_type>>& update_list);
+    // Append the requests to the vector. The std::list version is built on
+    // top of it.
+    void bulk_insertion_request(
+        const std::list<std::pair<std::string, index_type>>& update_list,
+        std::vector<UpdateRequest<T>>&                       requests);
 
     bool remove_keyword(const std::string& kw);
 
@@ -210,7 +215,18 @@ template<typename T>
 std::list<UpdateRequest<T>> DianaClient<T>::bulk_insertion_request(
     const std::list<std::pair<std::string, index_type>>& update_list)
 {
-    std::list<UpdateRequest<T>> req_list;
+    std::vector<UpdateRequest<T>> requests;
+    bulk_insertion_request(update_list, requests);
+
+    return std::list<UpdateRequest<T>>(requests.begin(), requests.end());
+}
+
+template<typename T>
+void DianaClient<T>::bulk_insertion_request(
+    const std::list<std::pair<std::string, index_type>>& update_list,
+    std::vector<UpdateRequest<T>>&                       requests)
+{
+    requests.reserve(requests.size() + update_list.size());
 
     std::list<std::tuple<std::string, T, uint32_t>> counter_list
         = get_counters_and_increment(update_list);
@@ -244,10 +260,8 @@ std::list<UpdateRequest<T>> DianaClient<T>::bulk_insertion_request(
 
         req.index = xor_mask(index, mask);
 
-        req_list.push_back(req);
+        requests.push_back(req);
     }
-
-    return req_list;
 }
 
 template<typename T>
@@ -23,16 +23,28 @@
 
 #include <sse/schemes/diana/diana_common.hpp>
 #include <sse/schemes/diana/types.hpp>
+#include <sse/schemes/utils/mmap_hash_table.hpp>
+#include <sse/schemes/utils/result_collector.hpp>
+#include <sse/schemes/utils/rocksdb_sst_builder.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 #include <sse/schemes/utils/thread_pool.hpp>
 
 #include <sse/crypto/prf.hpp>
 
+#include <array>
+#include <istream>
+#include <iterator>
+#include <list>
+#include <vector>
+
 namespace sse {
 namespace diana {
 
 
-template<typename T>
+/// Server of the Diana scheme. EDB is the store of the encrypted database:
+/// either sophos::RockDBWrapper, or sophos::MMapHashTable (see
+/// DianaMMapServer).
+template<typename T, class EDB = sophos::RockDBWrapper>
 class DianaServer
 {
 public:
@@ -47,11 +59,21 @@ public:
     // called by only one thread (hence the tl prefix for 'thread local')
     using tl_callback_type = std::function<void(size_t, index_type, uint8_t)>;
 
+    // Offline builder of the encrypted database. Its static write_record()
+    // function writes the (token, index) records of an update stream.
+    using edb_builder_type =
+        typename EDB::template builder_type<kUpdateTokenSize, index_type>;
+
 
     explicit DianaServer(const std::string& db_path);
 
     std::list<index_type> search(const SearchRequest& req,
                                  bool                 delete_results = false);
+    // Append the results to the vector, after having reserved room for
+    // req.add_count of them. The std::list version is built on top of it.
+    void search(const SearchRequest&     req,
+                std::vector<index_type>& results,
+                bool                     delete_results = false);
     void                  search(const SearchRequest&       req,
                                  const basic_callback_type& post_callback,
                                  bool                       delete_results = false);
@@ -75,92 +97,161 @@ public:
 
     void insert(const UpdateRequest<index_type>& req);
 
+    // Insert count update requests with a single database write. If
+    // disable_wal is true, the updates are only durable once flush_edb() has
+    // been called.
+    void insert_batch(const UpdateRequest<index_type>* reqs,
+                      size_t                           count,
+                      bool                             disable_wal = false);
+
     void flush_edb();
 
+    // Flush the database and, with the bulk-load RocksDB profile, compact
+    // it. To be called once, at the end of a bulk load: this can take a long
+    // time.
+    void finish_bulk_load();
+
+    // Build a new encrypted database in db_path, with the updates of
+    // [first, last) (e.g. the output of DianaClient::bulk_insertion_request)
+    // or of an update stream, with edb_builder_type. With RocksDB, the
+    // updates are sorted externally and ingested as SST files (see
+    // RockDBSSTBuilder), which is much faster than inserting them one by one.
+    // The database must then be opened by constructing a DianaServer.
+    template<class Iterator>
+    static void build_edb(const std::string& db_path,
+                          Iterator           first,
+                          Iterator           last);
+    static void build_edb(const std::string& db_path,
+                          std::istream&      update_stream);
+
 private:
-    bool get_unmask(uint8_t* key, index_type& index, bool delete_key);
-
-    inline bool retrieve_entry(const update_token_type& key,
-                               index_type&              index,
-                               bool                     delete_key)
-    {
-        bool found = edb_.get(key, index);
-        if (delete_key && found) {
-            edb_.remove(key);
-        }
+    // Number of leaf tokens derived before their entries are retrieved in a
+    // single batched lookup
+    static constexpr size_t kLookupBatchSize = 64;
 
-        return found;
-    }
+    // Callback taking the leaf index and the unmasked result as input
+    using leaf_callback_type = std::function<void(uint64_t, index_type)>;
 
+    // Derive the leaf tokens of [min_index, max_index] by chunks of
+    // kLookupBatchSize elements, and resolve each chunk with a single batched
+    // lookup in the database
+    void lookup_range(const SearchRequest&      req,
+                      uint64_t                  min_index,
+                      uint64_t                  max_index,
+                      bool                      delete_results,
+                      const leaf_callback_type& callback);
 
-    sophos::RockDBWrapper edb_;
+
+    EDB edb_;
 };
 
+// Diana server storing its encrypted database in a memory-mapped hash table
+template<typename T>
+using DianaMMapServer
+    = DianaServer<T, sophos::MMapHashTable<kUpdateTokenSize, T>>;
+
 } // namespace diana
 } // namespace sse
 
 namespace sse {
 namespace diana {
 
-template<typename T>
-DianaServer<T>::DianaServer(const std::string& db_path) : edb_(db_path)
+template<typename T, class EDB>
+DianaServer<T, EDB>::DianaServer(const std::string& db_path) : edb_(db_path)
 {
 }
 
-template<typename T>
-bool DianaServer<T>::get_unmask(uint8_t*    key,
-                                index_type& index,
-                                bool        delete_key)
-{
-    update_token_type ut;
-    index_type        mask;
+template<typename T, class EDB>
+constexpr size_t DianaServer<T, EDB>::kLookupBatchSize;
 
-    logger::logger()->debug(
-        "Derived leaf token: "
-        + utility::hex_string(std::string(reinterpret_cast<const char*>(key),
-                                          kSearchTokenKeySize)));
+template<typename T, class EDB>
+void DianaServer<T, EDB>::lookup_range(const SearchRequest&      req,
+                                       uint64_t                  min_index,
+                                       uint64_t                  max_index,
+                                       bool                      delete_results,
+                                       const leaf_callback_type& callback)
+{
+    std::array<update_token_type, kLookupBatchSize> tokens;
+    std::array<index_type, kLookupBatchSize>        masks;
+    std::array<uint64_t, kLookupBatchSize>          leaves;
+    std::array<index_type, kLookupBatchSize>        entries;
+    std::array<bool, kLookupBatchSize>              found;
 
-    gen_update_token_mask<T>(key, ut, mask);
+    size_t count = 0;
 
+    auto eval_callback
+        = [&tokens, &masks, &leaves, &count](uint64_t              leaf_index,
+                                             search_token_key_type st) {
+              logger::logger()->debug("Derived leaf token: "
+                                      + utility::hex_string(st));
 
-    logger::logger()->debug("Derived token : " + utility::hex_string(ut)
-                            + " Mask : " + utility::hex_string(mask));
+              gen_update_token_mask<T>(st.data(), tokens[count], masks[count]);
 
-    bool found = retrieve_entry(ut, index, delete_key);
+              logger::logger()->debug(
+                  "Derived token : " + utility::hex_string(tokens[count])
+                  + " Mask : " + utility::hex_string(masks[count]));
 
-    if (found) {
-        logger::logger()->debug("Found: " + utility::hex_string(index));
+              leaves[count] = leaf_index;
+              count++;
+          };
 
-        index = xor_mask(index, mask);
-    } else {
-        /* LCOV_EXCL_START */
-        logger::logger()->error(
-            "We were supposed to find an entry. Accessed key: "
-            + utility::hex_string(ut));
-        /* LCOV_EXCL_STOP */
+    for (uint64_t chunk_min = min_index; chunk_min <= max_index;
+         chunk_min += kLookupBatchSize) {
+        const uint64_t chunk_max
+            = std::min<uint64_t>(max_index, chunk_min + kLookupBatchSize - 1);
+
+        count = 0;
+        req.constrained_rcprf.eval_range(chunk_min, chunk_max, eval_callback);
+
+        edb_.multi_get(tokens.data(), count, entries.data(), found.data());
+
+        for (size_t i = 0; i < count; i++) {
+            if (found[i]) {
+                logger::logger()->debug("Found: "
+                                        + utility::hex_string(entries[i]));
+
+                if (delete_results) {
+                    edb_.remove(tokens[i]);
+                }
+
+                callback(leaves[i], xor_mask(entries[i], masks[i]));
+            } else {
+                /* LCOV_EXCL_START */
+                logger::logger()->error(
+                    "We were supposed to find an entry. Accessed key: "
+                    + utility::hex_string(tokens[i]));
+                /* LCOV_EXCL_STOP */
+            }
+        }
     }
+}
 
-    return found;
+template<typename T, class EDB>
+std::list<typename DianaServer<T, EDB>::index_type>
+DianaServer<T, EDB>::search(const SearchRequest& req, bool delete_results)
+{
+    std::vector<index_type> results;
+    search(req, results, delete_results);
+
+    return std::list<index_type>(results.begin(), results.end());
 }
 
-template<typename T>
-std::list<typename DianaServer<T>::index_type> DianaServer<T>::search(
-    const SearchRequest& req,
-    bool                 delete_results)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::search(const SearchRequest&     req,
+                                 std::vector<index_type>& results,
+                                 bool                     delete_results)
 {
-    std::list<index_type> results;
+    results.reserve(results.size() + req.add_count);
 
     auto callback = [&results](index_type i) { results.push_back(i); };
 
     search(req, callback, delete_results);
-
-    return results;
 }
 
-template<typename T>
-void DianaServer<T>::search(const SearchRequest&       req,
-                            const basic_callback_type& post_callback,
-                            bool                       delete_results)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::search(const SearchRequest&       req,
+                                 const basic_callback_type& post_callback,
+                                 bool                       delete_results)
 {
     logger::logger()->debug("Search: {} expected matches.", req.add_count);
 
@@ -169,24 +260,19 @@ void DianaServer<T>::search(const SearchRequest&       req,
         return;
     }
 
-    auto eval_callback
-        // cppcheck-suppress variableScope
-        = [this, &post_callback, delete_results](uint64_t /*leaf_index*/,
-                                                 search_token_key_type st) {
-              index_type index;
-              if (get_unmask(st.data(), index, delete_results)) {
-                  post_callback(index);
-              }
-          };
-    req.constrained_rcprf.eval_range(
-        0, req.constrained_rcprf.max_leaf(), eval_callback);
+    auto callback = [&post_callback](uint64_t /*leaf_index*/,
+                                     index_type index) {
+        post_callback(index);
+    };
+    lookup_range(
+        req, 0, req.constrained_rcprf.max_leaf(), delete_results, callback);
 }
 
-template<typename T>
-std::list<typename DianaServer<T>::index_type> DianaServer<T>::search_parallel(
-    const SearchRequest& req,
-    uint8_t              threads_count,
-    bool                 delete_results)
+template<typename T, class EDB>
+std::list<typename DianaServer<T, EDB>::index_type>
+DianaServer<T, EDB>::search_parallel(const SearchRequest& req,
+                                     uint8_t              threads_count,
+                                     bool                 delete_results)
 {
     assert(threads_count > 0);
 
@@ -195,33 +281,26 @@ std::list<typename DianaServer<T>::index_type> DianaServer<T>::search_parallel(
         return {};
     }
 
-    // use one result list per thread so to avoid using locks
-    std::list<index_type>* result_lists
-        = new std::list<index_type>[threads_count];
+    // every thread fills its own buffer, which avoids using locks
+    ResultCollector<index_type> collector;
 
-    auto callback
-        = [&result_lists](size_t /*i*/, index_type res, uint8_t thread_id) {
-              result_lists[thread_id].push_back(res);
-          };
+    auto callback = [&collector](size_t /*i*/, index_type res, uint8_t
+                                 /*thread_id*/) { collector.push(res); };
 
     search_parallel(req, callback, threads_count, delete_results);
 
-    // merge the result lists
-    std::list<index_type> results(std::move(result_lists[0]));
-    for (uint8_t i = 1; i < threads_count; i++) {
-        results.splice(results.end(), result_lists[i]);
-    }
-
-    delete[] result_lists;
+    std::list<index_type> results;
+    collector.drain(std::back_inserter(results));
 
     return results;
 }
 
-template<typename T>
-void DianaServer<T>::search_parallel(const SearchRequest&     req,
-                                     uint8_t                  threads_count,
-                                     std::vector<index_type>& results,
-                                     bool                     delete_results)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::search_parallel(
+    const SearchRequest&     req,
+    uint8_t                  threads_count,
+    std::vector<index_type>& results,
+    bool                     delete_results)
 {
     if (results.size() < req.add_count) {
         // resize the vector if needed
@@ -239,11 +318,12 @@ void DianaServer<T>::search_parallel(const SearchRequest&     req,
     search_parallel(req, callback, threads_count, delete_results);
 }
 
-template<typename T>
-void DianaServer<T>::search_parallel(const SearchRequest&       req,
-                                     const basic_callback_type& post_callback,
-                                     uint8_t                    threads_count,
-                                     bool                       delete_results)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::search_parallel(
+    const SearchRequest&       req,
+    const basic_callback_type& post_callback,
+    uint8_t                    threads_count,
+    bool                       delete_results)
 {
     auto aux
         = [&post_callback](size_t /*i*/, index_type ind, uint8_t /*t_id*/) {
@@ -252,11 +332,12 @@ void DianaServer<T>::search_parallel(const SearchRequest&       req,
     search_parallel(req, aux, threads_count, delete_results);
 }
 
-template<typename T>
-void DianaServer<T>::search_parallel(const SearchRequest&    req,
-                                     const tl_callback_type& post_callback,
-                                     uint8_t                 threads_count,
-                                     bool                    delete_results)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::search_parallel(
+    const SearchRequest&    req,
+    const tl_callback_type& post_callback,
+    uint8_t                 threads_count,
+    bool                    delete_results)
 {
     assert(threads_count > 0);
     if (req.add_count == 0) {
@@ -268,19 +349,13 @@ void DianaServer<T>::search_parallel(const SearchRequest&    req,
                    const uint8_t t_id,
                    const size_t  min_index,
                    const size_t  max_index) {
-        auto eval_callback
-            // cppcheck does not like nested lambda
-            // cppcheck-suppress shadowVar
-            // Silence issues with cppcheck on lambda's variable scope
-            // cppcheck-suppress variableScope
-            = [this, &post_callback, delete_results, t_id](
-                  uint64_t leaf_index, search_token_key_type st) {
-                  index_type index;
-                  if (get_unmask(st.data(), index, delete_results)) {
-                      post_callback(leaf_index, index, t_id);
-                  }
-              };
-        req.constrained_rcprf.eval_range(min_index, max_index, eval_callback);
+        // cppcheck does not like nested lambda
+        // cppcheck-suppress shadowVar
+        auto callback = [&post_callback, t_id](uint64_t   leaf_index,
+                                               index_type index) {
+            post_callback(leaf_index, index, t_id);
+        };
+        lookup_range(req, min_index, max_index, delete_results, callback);
     };
 
     std::vector<std::thread> threads;
@@ -312,8 +387,8 @@ void DianaServer<T>::search_parallel(const SearchRequest&    req,
     }
 }
 
-template<typename T>
-void DianaServer<T>::insert(const UpdateRequest<T>& req)
+template<typename T, class EDB>
+void DianaServer<T, EDB>::insert(const UpdateRequest<T>& req)
 {
     logger::logger()->debug("Received update: ("
                             + utility::hex_string(req.token) + ", "
@@ -322,10 +397,58 @@ void DianaServer<T>::insert(const UpdateRequest<T>& req)
     edb_.put(req.token, req.index);
 }
 
-template<typename T>
-void DianaServer<T>::flush_edb()
+template<typename T, class EDB>
+void DianaServer<T, EDB>::insert_batch(const UpdateRequest<T>* reqs,
+                                       size_t                  count,
+                                       bool                    disable_wal)
+{
+    logger::logger()->debug("Received a batch of {} updates", count);
+
+    edb_.put_batch(reqs,
+                   count,
+                   &UpdateRequest<T>::token,
+                   &UpdateRequest<T>::index,
+                   disable_wal);
+}
+
+template<typename T, class EDB>
+void DianaServer<T, EDB>::flush_edb()
 {
     edb_.flush();
 }
+
+template<typename T, class EDB>
+void DianaServer<T, EDB>::finish_bulk_load()
+{
+    edb_.finish_bulk_load();
+}
+
+template<typename T, class EDB>
+template<class Iterator>
+void DianaServer<T, EDB>::build_edb(const std::string& db_path,
+                                    Iterator           first,
+                                    Iterator           last)
+{
+    EDB              edb(db_path);
+    edb_builder_type builder(db_path + ".build_tmp");
+
+    for (; first != last; ++first) {
+        builder.add(first->token, first->index);
+    }
+    builder.ingest(edb);
+    edb.finish_bulk_load();
+}
+
+template<typename T, class EDB>
+void DianaServer<T, EDB>::build_edb(const std::string& db_path,
+                                    std::istream&      update_stream)
+{
+    EDB              edb(db_path);
+    edb_builder_type builder(db_path + ".build_tmp");
+
+    builder.add_stream(update_stream);
+    builder.ingest(edb);
+    edb.finish_bulk_load();
+}
 } // namespace diana
 } // namespace sse
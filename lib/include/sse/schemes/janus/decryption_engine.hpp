@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sse/schemes/janus/types.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
+
+#include <sse/crypto/puncturable_enc.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace sse {
+namespace janus {
+
+/// Batched decryption of the insertion ciphertexts of a Janus search.
+///
+/// The punctured key is parsed once, when the engine is constructed, into a
+/// single decryption context, which is then only read by the decryption
+/// tasks. The ciphertexts of a batch are split in chunks of kChunkSize,
+/// taken in turn by threads_count() tasks running on a thread pool. The
+/// pool is long-lived and shared by the engines (e.g. the one of
+/// JanusServer): constructing an engine does not start any thread.
+class DecryptionEngine
+{
+public:
+    static constexpr size_t kChunkSize = 64;
+
+    /// Called for every ciphertext that could be decrypted. Calls can be
+    /// concurrent, but never with the same thread id.
+    using callback_type
+        = std::function<void(const crypto::punct::ciphertext_type& ct,
+                             index_type                            index,
+                             uint8_t                               thread_id)>;
+
+    /// pool must outlive the engine. It must not be the pool of the thread
+    /// calling decrypt(), which waits for the tasks.
+    DecryptionEngine(crypto::punct::punctured_key_type punctured_key,
+                     ThreadPool&                       pool,
+                     uint8_t                           threads_count);
+
+    DecryptionEngine(const DecryptionEngine&) = delete;
+    DecryptionEngine& operator=(const DecryptionEngine&) = delete;
+
+    /// Number of hardware threads, capped to fit in a thread id
+    static uint8_t default_threads_count();
+
+    uint8_t threads_count() const
+    {
+        return threads_count_;
+    }
+
+    /// Decrypt the count ciphertexts of cts, and wait for all of them. A
+    /// batch of at most one chunk is decrypted by the calling thread (with
+    /// thread id 0). The exceptions thrown by the callback are rethrown.
+    void decrypt(const crypto::punct::ciphertext_type* cts,
+                 size_t                                count,
+                 const callback_type&                  callback);
+    void decrypt(const std::vector<crypto::punct::ciphertext_type>& cts,
+                 const callback_type&                               callback)
+    {
+        decrypt(cts.data(), cts.size(), callback);
+    }
+
+private:
+    const uint8_t threads_count_;
+
+    crypto::PuncturableDecryption decryptor_;
+    ThreadPool&                   pool_;
+};
+
+} // namespace janus
+} // namespace sse
@@ -9,11 +9,16 @@
 #pragma once
 
 #include <sse/schemes/diana/diana_server.hpp>
+#include <sse/schemes/janus/tag_set.hpp>
 #include <sse/schemes/janus/types.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
 
 #include <sse/crypto/prf.hpp>
 
+#include <mutex>
+#include <vector>
+
 namespace sse {
 namespace janus {
 
@@ -30,9 +35,20 @@ public:
     bool get(const uint8_t* key, index_type& index) const;
 
 
+    // The std::list versions of the search functions are built on top of
+    // the std::vector ones, which append the results to the vector.
     std::list<index_type> search(SearchRequest& req);
+    void search(SearchRequest& req, std::vector<index_type>& results);
+    // The parallel searches fetch the key shares, the cached results and the
+    // insertion ciphertexts concurrently, and then decrypt the ciphertexts
+    // with diana_threads_count tasks. The callbacks are called concurrently,
+    // and two concurrent calls never have the same thread id (the id of the
+    // cached results is diana_threads_count).
     std::list<index_type> search_parallel(SearchRequest& req,
                                           uint8_t        diana_threads_count);
+    void                  search_parallel(SearchRequest&           req,
+                                          uint8_t                  diana_threads_count,
+                                          std::vector<index_type>& results);
     void                  search_parallel(SearchRequest& req,
                                           uint8_t        diana_threads_count,
                                           const std::function<void(index_type)>& post_callback);
@@ -47,10 +63,56 @@ public:
     void flush_edb();
 
 private:
+    // The cached results are kept in logs (see RockDBListLogStore): a search
+    // appends its new results, and a tombstone for every cached result it
+    // removed, instead of rewriting the whole list. The logs of a keyword
+    // are compacted in the background once they have too many segments, or
+    // too many tombstones.
+    struct CachedResults
+    {
+        std::vector<cached_result_type> results;
+        TagSet                          tombstones;
+        size_t                          segments_count{0};
+        size_t                          stored_results_count{0};
+    };
+
+    void read_cache(const keyword_token_type& keyword_token,
+                    CachedResults&            cache);
+
+    // Remove the cached results whose tag has a tombstone or is in
+    // removed_tags, and return the tags of the latter. Large caches are cut
+    // in (at most threads_count) ranges, filtered in place concurrently on
+    // the search pool, and then moved back together.
+    std::vector<crypto::punct::tag_type> filter_cache(
+        CachedResults& cache,
+        const TagSet&  removed_tags,
+        uint8_t        threads_count);
+
+    // Append the tombstones and the new results of a search to the logs of
+    // the keyword, and schedule a compaction if needed
+    void update_cache(const keyword_token_type&                   keyword_token,
+                      const CachedResults&                        cache,
+                      const std::vector<crypto::punct::tag_type>& tombstones,
+                      const std::vector<cached_result_type>&      new_results);
+    void compact_cache(const keyword_token_type& keyword_token);
+
     diana::DianaServer<crypto::punct::ciphertext_type> insertion_server_;
     diana::DianaServer<crypto::punct::key_share_type>  deletion_server_;
 
-    sophos::RockDBListStore<cached_result_type> cached_results_edb_;
+    sophos::RockDBListLogStore<cached_result_type>      cached_results_edb_;
+    sophos::RockDBListLogStore<crypto::punct::tag_type> tombstones_edb_;
+
+    // the reads, appends and compactions of the logs are serialized, so
+    // that a compaction never sees a tombstone without its result
+    std::mutex cache_mtx_;
+
+    // runs the decryptions, the cache filtering and the concurrent fetches
+    // of the searches, so that a search does not start any thread
+    ThreadPool search_pool_;
+
+    // declared last: the pending compactions are done before the logs are
+    // closed
+    ThreadPool compaction_pool_;
 };
 
 } // namespace janus
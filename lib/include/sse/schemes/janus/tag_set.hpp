@@ -0,0 +1,198 @@
+#pragma once
+
+#include <sse/crypto/puncturable_enc.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace sse {
+namespace janus {
+
+/// Set of puncturable encryption tags, used to filter the cached results.
+///
+/// The tags are stored in a flat open addressing table with linear probing,
+/// kept at most half full. The tags are pseudo-random, so their first 8
+/// bytes are used as the hash of the table, and their next 8 bytes as the
+/// hashes of an optional Bloom filter, checked before the table. Most
+/// cached results are not removed: the Bloom filter, about 12 times smaller
+/// than the table, answers for most of them.
+class TagSet
+{
+public:
+    using tag_type = crypto::punct::tag_type;
+
+    explicit TagSet(size_t expected_count = 0, bool bloom_prefilter = true);
+
+    void insert(const tag_type& tag);
+    bool contains(const tag_type& tag) const;
+
+    size_t size() const
+    {
+        return size_;
+    }
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+private:
+    static constexpr size_t kBloomBitsPerSlot = 10;
+    static constexpr size_t kBloomHashCount   = 3;
+
+    static uint64_t table_hash(const tag_type& tag);
+    static uint64_t bloom_hash(const tag_type& tag);
+    static bool     is_zero(const tag_type& tag);
+
+    void   rehash(size_t capacity);
+    void   bloom_insert(const tag_type& tag);
+    bool   bloom_contains(const tag_type& tag) const;
+    size_t find_slot(const tag_type& tag) const;
+
+    // the zero tag marks the empty slots: it is stored aside
+    std::vector<tag_type> slots_;
+    size_t                mask_{0};
+    size_t                size_{0};
+    bool                  has_zero_{false};
+
+    bool                  bloom_prefilter_;
+    std::vector<uint64_t> bloom_;
+    uint64_t              bloom_bits_mask_{0};
+};
+
+inline TagSet::TagSet(size_t expected_count, bool bloom_prefilter)
+    : bloom_prefilter_(bloom_prefilter)
+{
+    size_t capacity = 16;
+    while (capacity < 2 * expected_count) {
+        capacity <<= 1;
+    }
+    rehash(capacity);
+}
+
+inline uint64_t TagSet::table_hash(const tag_type& tag)
+{
+    uint64_t h;
+    std::memcpy(&h, tag.data(), sizeof(h));
+    return h;
+}
+
+inline uint64_t TagSet::bloom_hash(const tag_type& tag)
+{
+    uint64_t h;
+    std::memcpy(&h, tag.data() + sizeof(h), sizeof(h));
+    return h;
+}
+
+inline bool TagSet::is_zero(const tag_type& tag)
+{
+    for (uint8_t b : tag) {
+        if (b != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline size_t TagSet::find_slot(const tag_type& tag) const
+{
+    // the table is never full, so the probing stops on an empty slot
+    size_t i = table_hash(tag) & mask_;
+    while (!is_zero(slots_[i]) && slots_[i] != tag) {
+        i = (i + 1) & mask_;
+    }
+    return i;
+}
+
+inline void TagSet::rehash(size_t capacity)
+{
+    std::vector<tag_type> old_slots(capacity, tag_type{});
+    old_slots.swap(slots_);
+    mask_ = capacity - 1;
+
+    if (bloom_prefilter_) {
+        // the number of bits is a power of 2 too
+        bloom_.assign(capacity * kBloomBitsPerSlot / 64 + 1, 0);
+        size_t bits = 64;
+        while (2 * bits <= 64 * bloom_.size()) {
+            bits <<= 1;
+        }
+        bloom_bits_mask_ = bits - 1;
+    }
+
+    for (const tag_type& tag : old_slots) {
+        if (!is_zero(tag)) {
+            slots_[find_slot(tag)] = tag;
+            if (bloom_prefilter_) {
+                bloom_insert(tag);
+            }
+        }
+    }
+}
+
+inline void TagSet::bloom_insert(const tag_type& tag)
+{
+    const uint64_t h  = bloom_hash(tag);
+    const uint64_t h1 = h & 0xFFFFFFFF;
+    const uint64_t h2 = (h >> 32) | 1;
+
+    for (size_t i = 0; i < kBloomHashCount; i++) {
+        const uint64_t bit = (h1 + i * h2) & bloom_bits_mask_;
+        bloom_[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+}
+
+inline bool TagSet::bloom_contains(const tag_type& tag) const
+{
+    const uint64_t h  = bloom_hash(tag);
+    const uint64_t h1 = h & 0xFFFFFFFF;
+    const uint64_t h2 = (h >> 32) | 1;
+
+    for (size_t i = 0; i < kBloomHashCount; i++) {
+        const uint64_t bit = (h1 + i * h2) & bloom_bits_mask_;
+        if ((bloom_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void TagSet::insert(const tag_type& tag)
+{
+    if (is_zero(tag)) {
+        size_ += has_zero_ ? 0 : 1;
+        has_zero_ = true;
+        return;
+    }
+
+    if (2 * (size_ + 1) > slots_.size()) {
+        rehash(2 * slots_.size());
+    }
+
+    const size_t i = find_slot(tag);
+    if (is_zero(slots_[i])) {
+        slots_[i] = tag;
+        size_++;
+
+        if (bloom_prefilter_) {
+            bloom_insert(tag);
+        }
+    }
+}
+
+inline bool TagSet::contains(const tag_type& tag) const
+{
+    if (size_ == 0) {
+        return false;
+    }
+    if (is_zero(tag)) {
+        return has_zero_;
+    }
+    if (bloom_prefilter_ && !bloom_contains(tag)) {
+        return false;
+    }
+    return !is_zero(slots_[find_slot(tag)]);
+}
+
+} // namespace janus
+} // namespace sse
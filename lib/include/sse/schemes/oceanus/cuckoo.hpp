@@ -121,6 +121,7 @@ CuckooBuilder<PAGE_SIZE, Key, T, KeySerializer, ValueSerializer, CuckooHasher>::
       data(params.value_file_path), n_elements(0)
 {
     data.reserve(params.max_n_elements);
+    data.enable_buffered_writes();
 }
 
 template<size_t PAGE_SIZE,
@@ -197,6 +198,7 @@ void CuckooBuilder<PAGE_SIZE,
     is_committed = true;
 
     // commit the data file
+    data.flush_writes();
     data.commit();
 
     // create two new files: one per table
@@ -209,6 +211,7 @@ void CuckooBuilder<PAGE_SIZE,
 
     cuckoo_table.reserve(2 * allocator.get_cuckoo_table_size());
     // table_1.reserve(allocator.get_cuckoo_table_size());
+    cuckoo_table.enable_buffered_writes();
 
     payload_type empty_content;
 
@@ -236,6 +239,7 @@ void CuckooBuilder<PAGE_SIZE,
             cuckoo_table.push_back(pl);
         }
     }
+    cuckoo_table.flush_writes();
     cuckoo_table.commit();
 
     // delete the data file
@@ -278,8 +282,13 @@ public:
                                                 ValueSerializer,
                                                 CuckooHasher>::payload_type;
 
+    using payload_lease_type = abstractio::BufferLease<const payload_type>;
+
     using get_callback_type
         = std::function<void(std::experimental::optional<T>)>;
+    /// The second argument is false if the lookup failed with an IO error
+    using lookup_callback_type
+        = std::function<void(std::experimental::optional<T>, bool)>;
 
 
     using param_type = std::string;
@@ -289,10 +298,31 @@ public:
 
     T    get(const Key& key);
     void async_get(const Key& key, get_callback_type callback);
+    /// Same as async_get, but tells the IO errors from the misses
+    void async_lookup(const Key& key, lookup_callback_type callback);
 
 
     void use_direct_IO(bool flag);
 
+    /// Serve the reads from a memory mapping of the table if flag is true,
+    /// or with file IOs (direct or buffered, see use_direct_IO) otherwise.
+    void use_memory_map(bool                                flag,
+                        const abstractio::MemoryMapOptions& options
+                        = abstractio::MemoryMapOptions());
+
+    /// Keep up to byte_budget bytes of buckets in an in-memory cache (see
+    /// abstractio::PageCache). A budget of 0 disables the cache.
+    void set_page_cache_budget(size_t byte_budget);
+
+    /// Load the buckets of the given keys in the page cache
+    void prewarm_page_cache(const std::vector<Key>& keys);
+
+    /// The page cache of the table, or nullptr if it is disabled
+    const abstractio::PageCache* page_cache() const noexcept
+    {
+        return table.page_cache();
+    }
+
 private:
     using table_type = abstractio::awonvm_vector<payload_type, PAGE_SIZE>;
     table_type table;
@@ -351,14 +381,17 @@ T CuckooHashTable<PAGE_SIZE,
     std::array<uint8_t, kKeySize> ser_key;
     KeySerializer().serialize(key, ser_key.data());
 
-    payload_type val_0 = table.get(loc);
+    // if the table is memory mapped, the values are not copied in buffer
+    payload_type buffer;
+
+    const payload_type& val_0 = table.get(loc, buffer);
     if (details::match_key<PAGE_SIZE>(val_0, ser_key)) {
         return ValueSerializer().deserialize(val_0.data() + kKeySize);
     }
 
     loc = search_key.h[1] % table_size;
 
-    payload_type val_1 = table.get(loc + table_size);
+    const payload_type& val_1 = table.get(loc + table_size, buffer);
 
     if (details::match_key<PAGE_SIZE>(val_1, ser_key)) {
         return ValueSerializer().deserialize(val_1.data() + kKeySize);
@@ -380,11 +413,31 @@ void CuckooHashTable<PAGE_SIZE,
                      ValueSerializer,
                      CuckooHasher>::async_get(const Key&        key,
                                               get_callback_type callback)
+{
+    async_lookup(key,
+                 [callback](std::experimental::optional<T> value,
+                            bool /*ok*/) { callback(std::move(value)); });
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::async_lookup(const Key&           key,
+                                                 lookup_callback_type callback)
 {
     struct CallBackState
     {
-        std::unique_ptr<payload_type> result{nullptr};
-        std::atomic<uint8_t>          completion_counter{0};
+        payload_lease_type   result{nullptr};
+        std::atomic<uint8_t> completion_counter{0};
+        std::atomic<bool>    failed{false};
     };
 
     CuckooKey search_key = CuckooHasher()(key);
@@ -399,8 +452,10 @@ void CuckooHashTable<PAGE_SIZE,
     CallBackState* state = new CallBackState();
 
     auto inner_callback =
-        [state, ser_key, callback](std::unique_ptr<payload_type> read_value) {
-            if (read_value) {
+        [state, ser_key, callback](payload_lease_type read_value) {
+            if (!read_value) {
+                state->failed = true;
+            } else {
                 // check whether we are a match on the key
                 if (details::match_key<PAGE_SIZE>(*read_value.get(), ser_key)) {
                     // only one of the two callback should access this
@@ -430,15 +485,17 @@ void CuckooHashTable<PAGE_SIZE,
                 // using a unique_ptr (eg. using the completion counter as an
                 // additional flag), this is its role for the moment.
 
-                std::unique_ptr<payload_type> data = std::move(state->result);
+                payload_lease_type data   = std::move(state->result);
+                const bool         failed = state->failed;
 
                 delete state;
 
                 if (data) {
                     callback(
-                        ValueSerializer().deserialize(data->data() + kKeySize));
+                        ValueSerializer().deserialize(data->data() + kKeySize),
+                        true);
                 } else {
-                    callback(std::experimental::nullopt);
+                    callback(std::experimental::nullopt, !failed);
                 }
             }
         };
@@ -468,6 +525,74 @@ void CuckooHashTable<PAGE_SIZE,
     table.set_use_direct_access(flag);
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::
+    use_memory_map(bool flag, const abstractio::MemoryMapOptions& options)
+{
+    if (flag) {
+        table.memory_map(options);
+    } else {
+        table.unmap();
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::set_page_cache_budget(size_t byte_budget)
+{
+    if (byte_budget == 0) {
+        table.disable_page_cache();
+    } else {
+        table.enable_page_cache(byte_budget);
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::
+    prewarm_page_cache(const std::vector<Key>& keys)
+{
+    std::vector<size_t> indices;
+    indices.reserve(2 * keys.size());
+
+    for (const Key& key : keys) {
+        CuckooKey search_key = CuckooHasher()(key);
+
+        indices.push_back(search_key.h[0] % table_size);
+        indices.push_back(search_key.h[1] % table_size + table_size);
+    }
+
+    table.prewarm_page_cache(indices);
+}
+
 
 } // namespace oceanus
 } // namespace sse
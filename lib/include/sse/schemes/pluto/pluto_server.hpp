@@ -4,8 +4,17 @@
 #include <sse/schemes/tethys/details/tethys_utils.hpp>
 #include <sse/schemes/tethys/tethys_store.hpp>
 #include <sse/schemes/tethys/types.hpp>
+#include <sse/schemes/utils/optional.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
 
+#include <algorithm>
 #include <array>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace sse {
 namespace pluto {
@@ -27,53 +36,368 @@ public:
 
     static constexpr size_t kMasterPrfKeySize = tethys::kMasterPrfKeySize;
 
+    // Number of hash table probes issued at the start of a search
+    static constexpr uint32_t kInitialProbeWindow = 4;
+    // Maximum number of hash table probes in flight for a search
+    static constexpr uint32_t kMaxProbeWindow = 16;
+    // Number of threads issuing the probes opened by the IO completions. The
+    // completion threads never submit IOs themselves: they would block
+    // waiting for room in the queue of the scheduler, i.e. for themselves.
+    static constexpr uint32_t kProbeThreadsCount = 2;
+
+    using ht_value_type = typename Params::ht_value_type;
+    using bucket_pair_type = tethys::KeyedBucketPair<Params::kPageSize>;
+
+    /// Called for every complete list found in the hash table, with the index
+    /// of the list's block (starting at 1). The lists are not necessarily
+    /// returned in order, but the calls are serialized.
+    using list_callback_type
+        = std::function<void(uint32_t block_index, const ht_value_type&)>;
+    /// Called with the Tethys bucket pair of the keyword
+    using buckets_callback_type = std::function<void(bucket_pair_type)>;
+    /// Called once all the other callbacks returned. The argument is false
+    /// if an IO error happened during the search.
+    using search_done_callback_type = std::function<void(bool)>;
+
     PlutoServer(const std::string& tethys_path, const ht_param_type& ht_param);
 
 
     SearchResponse<Params::kPageSize> search(
         const SearchRequest& search_request);
 
+    /// Keep the most recently used pages of the Tethys table and of the hash
+    /// table in memory, with the given budgets in bytes (0 disables the
+    /// cache).
+    void set_page_cache_budget(size_t tethys_byte_budget,
+                               size_t ht_byte_budget);
+
+    /// Load the Tethys buckets and the first hash table block of the given
+    /// search tokens in the page caches
+    void prewarm_page_cache(
+        const std::vector<tethys::search_token_type>& search_tokens);
+
+    const abstractio::PageCache* tethys_page_cache() const noexcept
+    {
+        return tethys_store.page_cache();
+    }
+
+    /// Asynchronous search. The Tethys buckets read is issued together with
+    /// a window of speculative hash table probes. The complete lists of a
+    /// keyword are stored at consecutive block indices: the window is
+    /// widened as probes hit, and no probe is issued after the first miss.
+    /// The server must outlive the search.
+    void async_search(const SearchRequest&      search_request,
+                      list_callback_type        list_callback,
+                      buckets_callback_type     buckets_callback,
+                      search_done_callback_type done_callback);
+
 
 private:
+    struct AsyncSearchState
+    {
+        tethys::search_token_type search_token;
+        list_callback_type        list_callback;
+        buckets_callback_type     buckets_callback;
+        search_done_callback_type done_callback;
+
+        std::mutex lock;
+
+        // index of the next block to probe in the hash table
+        uint32_t next_block{1};
+        // number of probes to issue
+        uint32_t probes_to_issue{kInitialProbeWindow};
+        uint32_t probes_in_flight{0};
+        // set while a thread is issuing probes
+        bool issuing{false};
+        // set once a probe missed: no more probe is issued
+        bool missed{false};
+
+        bucket_pair_type tethys_buckets;
+        uint8_t          tethys_buckets_count{0};
+
+        bool failed{false};
+        bool completed{false};
+    };
+
+    using state_ptr = std::shared_ptr<AsyncSearchState>;
+
+    void issue_probes(const state_ptr& state);
+    void on_probe(const state_ptr&                             state,
+                  uint32_t                                     block,
+                  std::experimental::optional<ht_value_type>&& list,
+                  bool                                         ok);
+    void on_tethys_bucket(
+        const state_ptr&                               state,
+        typename tethys_store_type::payload_lease_type bucket,
+        size_t                                         index);
+    // Must be called with the state's lock held. If the search is
+    // complete, release the lock and run the completion callback.
+    static void check_completion(const state_ptr&              state,
+                                 std::unique_lock<std::mutex>& lock);
+
     tethys_store_type tethys_store;
     ht_type           hash_table;
+
+    // declared last: stopped before the tables are destroyed
+    ThreadPool probe_pool;
 };
 
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kInitialProbeWindow;
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kMaxProbeWindow;
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kProbeThreadsCount;
+
 
 template<class Params>
 PlutoServer<Params>::PlutoServer(const std::string&   tethys_path,
                                  const ht_param_type& ht_param)
-    : tethys_store(tethys_path, ""), hash_table(ht_param)
+    : tethys_store(tethys_path, ""), hash_table(ht_param),
+      probe_pool(kProbeThreadsCount)
 {
 }
 
+template<class Params>
+void PlutoServer<Params>::set_page_cache_budget(size_t tethys_byte_budget,
+                                                size_t ht_byte_budget)
+{
+    tethys_store.set_page_cache_budget(tethys_byte_budget);
+    hash_table.set_page_cache_budget(ht_byte_budget);
+}
+
+template<class Params>
+void PlutoServer<Params>::prewarm_page_cache(
+    const std::vector<tethys::search_token_type>& search_tokens)
+{
+    std::vector<tethys::tethys_core_key_type> tethys_keys;
+    std::vector<tethys::tethys_core_key_type> ht_keys;
+    tethys_keys.reserve(search_tokens.size());
+    ht_keys.reserve(search_tokens.size());
+
+    for (const auto& token : search_tokens) {
+        tethys_keys.push_back(tethys::details::derive_core_key(token, 0));
+        ht_keys.push_back(tethys::details::derive_core_key(token, 1));
+    }
+
+    tethys_store.prewarm_page_cache(tethys_keys);
+    hash_table.prewarm_page_cache(ht_keys);
+}
+
 template<class Params>
 auto PlutoServer<Params>::search(const SearchRequest& search_request)
     -> SearchResponse<Params::kPageSize>
 {
     SearchResponse<Params::kPageSize> res;
 
-    for (uint32_t i = 1;; i++) { // the first key for the hash table has index 1
+    // the lists are not received in order
+    std::map<uint32_t, ht_value_type> lists;
+
+    std::mutex              done_lock;
+    std::condition_variable done_cv;
+    bool                    done{false};
+    bool                    success{false};
+
+    async_search(
+        search_request,
+        [&lists](uint32_t block_index, const ht_value_type& list) {
+            lists.emplace(block_index, list);
+        },
+        [&res](bucket_pair_type buckets) {
+            res.tethys_bucket_pair = std::move(buckets);
+        },
+        [&](bool ok) {
+            std::lock_guard<std::mutex> lock(done_lock);
+            success = ok;
+            done    = true;
+            done_cv.notify_one();
+        });
+
+    std::unique_lock<std::mutex> lock(done_lock);
+    done_cv.wait(lock, [&done] { return done; });
+
+    if (!success) {
+        throw std::runtime_error("IO error during the Pluto search");
+    }
+
+    for (const auto& list : lists) {
+        res.complete_lists.insert(
+            res.complete_lists.end(), list.second.begin(), list.second.end());
+    }
+
+    return res;
+}
+
+template<class Params>
+void PlutoServer<Params>::async_search(
+    const SearchRequest&      search_request,
+    list_callback_type        list_callback,
+    buckets_callback_type     buckets_callback,
+    search_done_callback_type done_callback)
+{
+    state_ptr state = std::make_shared<AsyncSearchState>();
+
+    state->search_token     = search_request.search_token;
+    state->list_callback    = std::move(list_callback);
+    state->buckets_callback = std::move(buckets_callback);
+    state->done_callback    = std::move(done_callback);
+
+    // the Tethys buckets are stored at block index 0
+    state->tethys_buckets.key
+        = tethys::details::derive_core_key(state->search_token, 0);
+    tethys_store.async_get_buckets(
+        state->tethys_buckets.key,
+        [this, state](typename tethys_store_type::payload_lease_type bucket,
+                      size_t                                         index) {
+            on_tethys_bucket(state, std::move(bucket), index);
+        });
+
+    issue_probes(state);
+}
+
+template<class Params>
+void PlutoServer<Params>::issue_probes(const state_ptr& state)
+{
+    std::unique_lock<std::mutex> lock(state->lock);
+
+    // Only one thread issues probes at a time. In particular, if the hash
+    // table calls the callback synchronously, the callback only updates
+    // probes_to_issue, and this loop issues the new probes: there is no
+    // recursion.
+    if (state->issuing) {
+        return;
+    }
+    state->issuing = true;
+
+    while (state->probes_to_issue > 0 && !state->missed) {
+        uint32_t block = state->next_block++;
+        state->probes_to_issue--;
+        state->probes_in_flight++;
+
+        lock.unlock();
+
         tethys::tethys_core_key_type key
-            = tethys::details::derive_core_key(search_request.search_token, i);
+            = tethys::details::derive_core_key(state->search_token, block);
 
-        try {
-            typename Params::ht_value_type v = hash_table.get(key);
+        hash_table.async_lookup(
+            key,
+            [this, state, block](
+                std::experimental::optional<ht_value_type> list, bool ok) {
+                on_probe(state, block, std::move(list), ok);
+            });
 
-            res.complete_lists.reserve(res.complete_lists.size() + v.size());
-            res.complete_lists.insert(
-                res.complete_lists.end(), v.begin(), v.end());
-        } catch (const std::out_of_range& e) {
-            break;
+        lock.lock();
+    }
+
+    state->issuing         = false;
+    state->probes_to_issue = 0;
+
+    check_completion(state, lock);
+}
+
+template<class Params>
+void PlutoServer<Params>::on_probe(
+    const state_ptr&                             state,
+    uint32_t                                     block,
+    std::experimental::optional<ht_value_type>&& list,
+    bool                                         ok)
+{
+    std::unique_lock<std::mutex> lock(state->lock);
+
+    state->probes_in_flight--;
+
+    if (!ok) {
+        // the list might be incomplete: stop the search there
+        state->failed = true;
+        state->missed = true;
+    } else if (list) {
+        state->list_callback(block, *list);
+
+        // widen the window: every hit allows two new probes
+        if (!state->missed) {
+            uint32_t window = state->probes_in_flight + state->probes_to_issue;
+            if (window < kMaxProbeWindow) {
+                state->probes_to_issue
+                    += std::min<uint32_t>(2, kMaxProbeWindow - window);
+            }
         }
+    } else {
+        // the lists are stored in consecutive blocks: the probes for the
+        // following blocks would miss too
+        state->missed = true;
     }
 
-    // get the bucket pair from the Tethys store
-    tethys::tethys_core_key_type key
-        = tethys::details::derive_core_key(search_request.search_token, 0);
-    res.tethys_bucket_pair = {key, tethys_store.get_buckets(key)};
+    bool issue = (state->probes_to_issue > 0 && !state->missed);
 
-    return res;
+    if (!issue) {
+        check_completion(state, lock);
+        return;
+    }
+    if (state->issuing) {
+        // called synchronously by issue_probes, which issues the new probes
+        return;
+    }
+
+    // we might be running on an IO completion thread: issue the probes from
+    // the pool
+    lock.unlock();
+    probe_pool.post([this, state]() { issue_probes(state); });
+}
+
+template<class Params>
+void PlutoServer<Params>::on_tethys_bucket(
+    const state_ptr&                               state,
+    typename tethys_store_type::payload_lease_type bucket,
+    size_t                                         index)
+{
+    std::unique_lock<std::mutex> lock(state->lock);
+
+    // the first bucket is in the first half of the table
+    bool first = (state->tethys_buckets_count == 0)
+                     ? true
+                     : (index < state->tethys_buckets.buckets.index_0);
+
+    if (first) {
+        // move the already received bucket to the second position
+        if (state->tethys_buckets_count == 1) {
+            state->tethys_buckets.buckets.index_1
+                = state->tethys_buckets.buckets.index_0;
+            state->tethys_buckets.buckets.payload_1
+                = state->tethys_buckets.buckets.payload_0;
+        }
+        state->tethys_buckets.buckets.index_0 = index;
+        if (bucket) {
+            state->tethys_buckets.buckets.payload_0 = *bucket;
+        }
+    } else {
+        state->tethys_buckets.buckets.index_1 = index;
+        if (bucket) {
+            state->tethys_buckets.buckets.payload_1 = *bucket;
+        }
+    }
+    state->failed |= !bucket;
+    state->tethys_buckets_count++;
+
+    if (state->tethys_buckets_count == 2) {
+        state->buckets_callback(std::move(state->tethys_buckets));
+    }
+
+    check_completion(state, lock);
+}
+
+template<class Params>
+void PlutoServer<Params>::check_completion(const state_ptr&              state,
+                                           std::unique_lock<std::mutex>& lock)
+{
+    if (state->completed || state->issuing || state->probes_in_flight > 0
+        || (state->probes_to_issue > 0 && !state->missed)
+        || state->tethys_buckets_count < 2) {
+        return;
+    }
+    state->completed = true;
+
+    lock.unlock();
+    state->done_callback(!state->failed);
 }
 } // namespace pluto
 } // namespace sse
\ No newline at end of file
@@ -2,13 +2,17 @@
 
 #include <sse/schemes/pluto/types.hpp>
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/optional.hpp>
+#include <sse/schemes/utils/rocksdb_profile.hpp>
 
 #include <rocksdb/db.h>
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/options.h>
 #include <rocksdb/table.h>
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 namespace sse {
 namespace pluto {
@@ -20,6 +24,11 @@ struct GenericRocksDBStoreParams
 
     static rocksdb::Options make_rocksdb_cuckoo_options();
     static rocksdb::Options make_rocksdb_regular_table_options();
+
+    // Options of a tuning profile (see utility::RocksDBProfile)
+    static rocksdb::Options make_rocksdb_profile_options(
+        const utility::RocksDBProfile& profile
+        = utility::default_rocksdb_profile());
 };
 
 class GenericRocksDBStore
@@ -36,6 +45,12 @@ public:
     template<size_t N>
     std::array<index_type, N> get(const tethys::tethys_core_key_type& key);
 
+    /// Exception-free lookup: returns a NotFound status if the key is not in
+    /// the database, and another non-ok status on a read error
+    template<size_t N>
+    rocksdb::Status try_get(const tethys::tethys_core_key_type& key,
+                            std::array<index_type, N>&          value);
+
 private:
     std::unique_ptr<rocksdb::DB> db;
 };
@@ -65,22 +80,33 @@ void GenericRocksDBStore::insert(const tethys::tethys_core_key_type& key,
 template<size_t N>
 std::array<index_type, N> GenericRocksDBStore::get(
     const tethys::tethys_core_key_type& key)
+{
+    std::array<index_type, N> content;
+
+    if (!try_get(key, content).ok()) {
+        throw std::out_of_range("Key not found");
+    }
+
+    return content;
+}
+
+template<size_t N>
+rocksdb::Status GenericRocksDBStore::try_get(
+    const tethys::tethys_core_key_type& key,
+    std::array<index_type, N>&          value)
 {
     rocksdb::Slice k_s(reinterpret_cast<const char*>(key.data()),
                        tethys::kTethysCoreKeySize);
 
-    std::string     value;
-    rocksdb::Status s = db->Get(rocksdb::ReadOptions(false, true), k_s, &value);
-
-    std::array<index_type, N> content;
+    std::string     content;
+    rocksdb::Status s
+        = db->Get(rocksdb::ReadOptions(false, true), k_s, &content);
 
     if (s.ok()) {
-        ::memcpy(content.data(), value.data(), N * sizeof(index_type));
-    } else {
-        throw std::out_of_range("Key not found");
+        ::memcpy(value.data(), content.data(), N * sizeof(index_type));
     }
 
-    return content;
+    return s;
 }
 
 
@@ -88,7 +114,14 @@ template<size_t N>
 class RocksDBStoreBuilder
 {
 public:
+    using value_type = std::array<index_type, N>;
     using param_type = GenericRocksDBStoreParams;
+    using get_callback_type
+        = std::function<void(std::experimental::optional<value_type>)>;
+    /// The second argument is false if the lookup failed with an error
+    using lookup_callback_type = std::function<
+        void(std::experimental::optional<value_type>, bool)>;
+
     explicit RocksDBStoreBuilder(const param_type& params) : store(params)
     {
     }
@@ -108,6 +141,48 @@ public:
         return store.get<N>(key);
     }
 
+    /// RocksDB caches the blocks of the database itself (see the block cache
+    /// options of the table): there is no additional page cache.
+    void set_page_cache_budget(size_t byte_budget)
+    {
+        if (byte_budget != 0) {
+            logger::logger()->info(
+                "The RocksDB store relies on RocksDB's block cache. The page "
+                "cache budget is ignored.");
+        }
+    }
+
+    void prewarm_page_cache(const std::vector<tethys::tethys_core_key_type>&)
+    {
+    }
+
+    /// RocksDB has no asynchronous point lookup: the callback is called
+    /// before the function returns.
+    void async_get(const tethys::tethys_core_key_type& key,
+                   get_callback_type                   callback)
+    {
+        async_lookup(key,
+                     [&callback](std::experimental::optional<value_type> v,
+                                 bool /*ok*/) { callback(std::move(v)); });
+    }
+
+    /// Same as async_get, but tells the read errors from the misses
+    void async_lookup(const tethys::tethys_core_key_type& key,
+                      lookup_callback_type                callback)
+    {
+        value_type            value;
+        const rocksdb::Status s = store.try_get<N>(key, value);
+        if (s.ok()) {
+            callback(value, true);
+        } else {
+            if (!s.IsNotFound()) {
+                logger::logger()->error("Unable to read the database: "
+                                        + s.ToString());
+            }
+            callback(std::experimental::nullopt, s.IsNotFound());
+        }
+    }
+
 private:
     GenericRocksDBStore store;
 };
@@ -22,6 +22,9 @@
 #pragma once
 
 #include <sse/schemes/sophos/sophos_common.hpp>
+#include <sse/schemes/sophos/tdp_checkpoints.hpp>
+#include <sse/schemes/utils/mmap_hash_table.hpp>
+#include <sse/schemes/utils/rocksdb_sst_builder.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 
 #include <sse/crypto/prf.hpp>
@@ -30,28 +33,53 @@
 #include <array>
 #include <fstream>
 #include <functional>
+#include <list>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace sse {
 namespace sophos {
 
 
-class SophosServer
+/// Server of the Sophos scheme. EDB is the store of the encrypted database:
+/// either RockDBWrapper (SophosServer) or MMapHashTable (SophosMMapServer).
+template<class EDB>
+class BasicSophosServer
 {
 public:
-    SophosServer(const std::string& db_path, const std::string& tdp_pk);
+    // Offline builder of the encrypted database. Its static write_record()
+    // function writes the (token, index) records of an update stream.
+    using edb_builder_type =
+        typename EDB::template builder_type<kUpdateTokenSize, index_type>;
+
+    BasicSophosServer(const std::string& db_path, const std::string& tdp_pk);
 
     std::string public_key() const;
 
+    // The std::list versions of the search functions are built on top of
+    // the std::vector ones, which append the results to the vector, and avoid
+    // allocating a node per result.
     std::list<index_type> search(SearchRequest& req);
+    void search(SearchRequest& req, std::vector<index_type>& results);
     void                  search_callback(SearchRequest&                         req,
                                           const std::function<void(index_type)>& post_callback);
 
     std::list<index_type> search_parallel(SearchRequest& req,
                                           uint8_t        access_threads);
+    void                  search_parallel(SearchRequest&           req,
+                                          uint8_t                  access_threads,
+                                          std::vector<index_type>& results);
     std::list<index_type> search_parallel_light(SearchRequest& req,
                                                 uint8_t        thread_count);
-
+    void                  search_parallel_light(SearchRequest&           req,
+                                                uint8_t                  thread_count,
+                                                std::vector<index_type>& results);
+
+    // The results are passed to post_callback by post_thread_count threads.
+    // If post_thread_count is 0, post_callback is called by the access
+    // threads, concurrently: no thread is created besides the RSA and access
+    // ones.
     void search_parallel_callback(SearchRequest&                  req,
                                   std::function<void(index_type)> post_callback,
                                   uint8_t rsa_thread_count,
@@ -64,11 +92,97 @@ public:
 
     void insert(const UpdateRequest& req);
 
+    // Insert count update requests with a single database write. If
+    // disable_wal is true, the updates are only durable once flush_edb() has
+    // been called.
+    void insert_batch(const UpdateRequest* reqs,
+                      size_t               count,
+                      bool                 disable_wal = false);
+
+    void flush_edb();
+
+    // Flush the database and, with the bulk-load RocksDB profile, compact
+    // it. To be called once, at the end of a bulk load: this can take a long
+    // time.
+    void finish_bulk_load();
+
+    // Keep checkpoints of the TDP chains of the searched keywords, every
+    // interval tokens (see TdpCheckpointIndex). search_parallel and
+    // search_parallel_callback then walk the chains of the keywords that
+    // were already searched by segments, in parallel, instead of walking
+    // them from the search token. Must not be called concurrently with a
+    // search.
+    void enable_checkpoints(
+        uint32_t interval = TdpCheckpointIndex::kDefaultInterval);
+    void disable_checkpoints();
+
+    // nullptr if the checkpoints are disabled
+    const TdpCheckpointIndex* checkpoints() const
+    {
+        return checkpoints_.get();
+    }
+
+    // Build a new encrypted database in db_path, with the updates of
+    // [first, last) or of an update stream, with edb_builder_type. With
+    // RocksDB, the updates are sorted externally and ingested as SST files
+    // (see RockDBSSTBuilder), which is much faster than inserting them one by
+    // one. The database must then be opened by constructing a server.
+    template<class Iterator>
+    static void build_edb(const std::string& db_path,
+                          Iterator           first,
+                          Iterator           last);
+    static void build_edb(const std::string& db_path,
+                          std::istream&      update_stream);
+
 private:
-    RockDBWrapper edb_;
+    // Callback taking a block of (unmasked) results as input
+    using results_block_type
+        = std::function<void(const index_type* results, size_t count)>;
+
+    // Derive the update tokens of req with rsa_thread_count threads, which
+    // hand them by blocks to access_thread_count threads through bounded
+    // single-producer single-consumer queues. Each block is resolved with a
+    // single batched lookup, and its results are passed to results_callback,
+    // which can be called concurrently by the access threads. The segments
+    // of the chain with a checkpoint are walked from it, and the checkpoints
+    // found on the way are stored.
+    void pipelined_lookup(SearchRequest&            req,
+                          uint8_t                   rsa_thread_count,
+                          uint8_t                   access_thread_count,
+                          const results_block_type& results_callback);
+
+    EDB edb_;
 
     sse::crypto::TdpMultPool public_tdp_;
+
+    std::unique_ptr<TdpCheckpointIndex> checkpoints_;
 };
 
+using SophosServer = BasicSophosServer<RockDBWrapper>;
+
+using SophosMMapServer
+    = BasicSophosServer<MMapHashTable<kUpdateTokenSize, index_type>>;
+
+// Both servers are instantiated in sophos_server.cpp
+extern template class BasicSophosServer<RockDBWrapper>;
+extern template class BasicSophosServer<
+    MMapHashTable<kUpdateTokenSize, index_type>>;
+
+template<class EDB>
+template<class Iterator>
+void BasicSophosServer<EDB>::build_edb(const std::string& db_path,
+                                       Iterator           first,
+                                       Iterator           last)
+{
+    EDB              edb(db_path);
+    edb_builder_type builder(db_path + ".build_tmp");
+
+    for (; first != last; ++first) {
+        builder.add(first->token, first->index);
+    }
+    builder.ingest(edb);
+    edb.finish_bulk_load();
+}
+
 } // namespace sophos
 } // namespace sse
@@ -0,0 +1,108 @@
+//
+// Sophos - Forward Private Searchable Encryption
+// Copyright (C) 2016 Raphael Bost
+//
+// This file is part of Sophos.
+//
+// Sophos is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// Sophos is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Sophos.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <sse/schemes/sophos/sophos_common.hpp>
+
+#include <sse/crypto/prf.hpp>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace sse {
+namespace sophos {
+
+/// Server-side cache of checkpoints in the TDP chains of the keywords.
+///
+/// The search tokens of a keyword form a chain: the token of the (c-1)-th
+/// update of the keyword is the evaluation of the TDP on the token of its
+/// c-th update. The chain is cut in segments of interval() tokens, and once
+/// a search went through the m-th segment, the index stores its top token,
+/// i.e. the token of the ((m+1)*interval()-1)-th update. A later search on
+/// the same keyword can then walk the complete segments independently
+/// (in parallel), instead of walking the whole chain from its search token.
+///
+/// The checkpoints of a keyword are stored under a pseudo-random identifier,
+/// and encrypted with a pad, both derived from the derivation key of the
+/// keyword. The pad of a segment is only used for its top token, which never
+/// changes. Without a search request on the keyword, the index can neither
+/// be linked to the keyword nor decrypted.
+class TdpCheckpointIndex
+{
+public:
+    static constexpr uint32_t kDefaultInterval = 64;
+
+    /// Keys of a keyword, derived from the derivation key of a search
+    /// request. The derivation key is passed by value because constructing a
+    /// crypto::Key erases its buffer.
+    class KeywordKeys
+    {
+    public:
+        explicit KeywordKeys(
+            std::array<uint8_t, kDerivationKeySize> derivation_key);
+
+    private:
+        friend class TdpCheckpointIndex;
+
+        search_token_type pad(size_t segment) const;
+
+        crypto::Prf<kSearchTokenSize> prf_;
+        std::array<uint8_t, 16>       id_;
+    };
+
+    explicit TdpCheckpointIndex(uint32_t interval = kDefaultInterval);
+
+    uint32_t interval() const
+    {
+        return interval_;
+    }
+
+    /// Decrypt the checkpoints of the first (at most max_count) segments of
+    /// the keyword.
+    std::vector<search_token_type> get(const KeywordKeys& keys,
+                                       size_t             max_count) const;
+
+    /// Store the checkpoints of the segments starting from first_segment.
+    /// The checkpoints that are already known are ignored, as are the ones
+    /// that would leave a gap.
+    void put(const KeywordKeys&                    keys,
+             size_t                                first_segment,
+             const std::vector<search_token_type>& checkpoints);
+
+    /// Number of keywords with checkpoints
+    size_t keyword_count() const;
+
+    void clear();
+
+private:
+    const uint32_t interval_;
+
+    std::map<std::array<uint8_t, 16>, std::vector<search_token_type>>
+                       checkpoints_;
+    mutable std::mutex mtx_;
+};
+
+} // namespace sophos
+} // namespace sse
@@ -51,22 +51,26 @@ std::vector<typename TethysServer<Store>::keyed_bucket_pair_type> TethysServer<
 // auto TethysServer<Store>::search(const search_token_type& search_token)
 // -> std::vector<keyed_bucket_pair_type>
 {
-    std::vector<keyed_bucket_pair_type> bucket_pairs;
+    std::vector<tethys_core_key_type> keys;
+    keys.reserve(search_request.block_count);
 
     for (uint32_t i = 0; i < search_request.block_count; i++) {
         // derive the key from the search token in counter mode
-        tethys_core_key_type key
-            = details::derive_core_key(search_request.search_token, i);
-
+        keys.push_back(
+            details::derive_core_key(search_request.search_token, i));
+    }
 
-        BucketPair<kServerBucketSize> buckets = tethys_store.get_buckets(key);
+    // fetch all the buckets in a single batch of reads
+    std::vector<BucketPair<kServerBucketSize>> buckets
+        = tethys_store.get_buckets_batch(keys);
 
-        keyed_bucket_pair_type keyed_buckets{key, buckets};
+    std::vector<keyed_bucket_pair_type> bucket_pairs;
+    bucket_pairs.reserve(keys.size());
 
-        bucket_pairs.push_back(keyed_buckets);
+    for (size_t i = 0; i < keys.size(); i++) {
+        bucket_pairs.push_back(keyed_bucket_pair_type{keys[i], buckets[i]});
     }
 
-
     return bucket_pairs;
 }
 
@@ -8,8 +8,11 @@
 #include <cstdint>
 
 #include <array>
+#include <condition_variable>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -32,12 +35,14 @@ public:
     static constexpr size_t kPayloadSize = PAGE_SIZE;
     using payload_type                   = std::array<uint8_t, kPayloadSize>;
 
+    using payload_lease_type = abstractio::BufferLease<const payload_type>;
+
     using key_type     = Key;
     using value_type   = T;
     using decoder_type = ValueDecoder;
 
     using get_buckets_callback_type
-        = std::function<void(std::unique_ptr<payload_type>, size_t)>;
+        = std::function<void(payload_lease_type, size_t)>;
 
     using get_list_callback_type = std::function<void(std::vector<T>)>;
 
@@ -66,6 +71,25 @@ public:
 
     void use_direct_IO(bool flag);
 
+    /// Serve the reads from a memory mapping of the table if flag is true,
+    /// or with file IOs (direct or buffered, see use_direct_IO) otherwise.
+    void use_memory_map(bool                                flag,
+                        const abstractio::MemoryMapOptions& options
+                        = abstractio::MemoryMapOptions());
+
+    /// Keep up to byte_budget bytes of buckets in an in-memory cache (see
+    /// abstractio::PageCache). A budget of 0 disables the cache.
+    void set_page_cache_budget(size_t byte_budget);
+
+    /// Load the buckets of the given keys in the page cache
+    void prewarm_page_cache(const std::vector<Key>& keys);
+
+    /// The page cache of the table, or nullptr if it is disabled
+    const abstractio::PageCache* page_cache() const noexcept
+    {
+        return table.page_cache();
+    }
+
     static std::vector<T> decode_list(const Key&          key,
                                       ValueDecoder&       decoder,
                                       const payload_type& bucket_0,
@@ -80,6 +104,12 @@ public:
 
     BucketPair<PAGE_SIZE> get_buckets(const Key& key);
 
+    /// Fetch the buckets of all the keys at once: the 2*keys.size() reads
+    /// are submitted in a single batch, and the function returns when they
+    /// all completed. The i-th bucket pair corresponds to keys[i].
+    std::vector<BucketPair<PAGE_SIZE>> get_buckets_batch(
+        const std::vector<Key>& keys);
+
     std::vector<T> get_list(const Key& key, ValueDecoder& decoder);
 
     std::vector<T> get_list(const Key& key);
@@ -106,6 +136,11 @@ private:
     void async_get_list_helper(get_list_callback_type callback,
                                CallbackState*         state);
 
+    // compute the position of the buckets of key in the table
+    void bucket_indices(const Key& key,
+                        size_t&    bucket_0_index,
+                        size_t&    bucket_1_index) const;
+
     using table_type = abstractio::awonvm_vector<payload_type, PAGE_SIZE>;
     table_type table;
 
@@ -183,6 +218,60 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::use_direct_IO(
     table.set_use_direct_access(flag);
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::use_memory_map(
+    bool                                flag,
+    const abstractio::MemoryMapOptions& options)
+{
+    if (flag) {
+        table.memory_map(options);
+    } else {
+        table.unmap();
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    set_page_cache_budget(size_t byte_budget)
+{
+    if (byte_budget == 0) {
+        table.disable_page_cache();
+    } else {
+        table.enable_page_cache(byte_budget);
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    prewarm_page_cache(const std::vector<Key>& keys)
+{
+    std::vector<size_t> indices;
+    indices.reserve(2 * keys.size());
+
+    for (const Key& key : keys) {
+        size_t bucket_0_index;
+        size_t bucket_1_index;
+
+        bucket_indices(key, bucket_0_index, bucket_1_index);
+        indices.push_back(bucket_0_index);
+        indices.push_back(bucket_1_index);
+    }
+
+    table.prewarm_page_cache(indices);
+}
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -229,16 +318,9 @@ BucketPair<PAGE_SIZE> TethysStore<PAGE_SIZE,
                                   TethysHasher,
                                   ValueDecoder>::get_buckets(const Key& key)
 {
-    details::TethysAllocatorKey tethys_key = TethysHasher()(key);
-
     BucketPair<PAGE_SIZE> bucket_pair;
 
-    size_t half_graph_size       = table_size / 2;
-    size_t remaining_graphs_size = table_size - half_graph_size;
-
-    bucket_pair.index_0 = tethys_key.h[0] % half_graph_size;
-    bucket_pair.index_1
-        = half_graph_size + tethys_key.h[1] % remaining_graphs_size;
+    bucket_indices(key, bucket_pair.index_0, bucket_pair.index_1);
 
     bucket_pair.payload_0 = table.get(bucket_pair.index_0);
     bucket_pair.payload_1 = table.get(bucket_pair.index_1);
@@ -246,6 +328,102 @@ BucketPair<PAGE_SIZE> TethysStore<PAGE_SIZE,
     return bucket_pair;
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+std::vector<BucketPair<PAGE_SIZE>> TethysStore<PAGE_SIZE,
+                                               Key,
+                                               T,
+                                               TethysHasher,
+                                               ValueDecoder>::
+    get_buckets_batch(const std::vector<Key>& keys)
+{
+    struct BatchState
+    {
+        std::mutex              lock;
+        std::condition_variable cv;
+        size_t                  remaining;
+        bool                    failed{false};
+
+        std::vector<BucketPair<PAGE_SIZE>> bucket_pairs;
+
+        explicit BatchState(size_t n) : remaining(2 * n), bucket_pairs(n){};
+    };
+
+    if (keys.empty()) {
+        return {};
+    }
+
+    // The state, including the buckets destination, is shared with the
+    // callbacks: if async_gets throws after having submitted some of the
+    // reads, these complete after the function has returned.
+    auto state = std::make_shared<BatchState>(keys.size());
+
+    auto make_callback = [&state](payload_type* destination) {
+        return [state, destination](payload_lease_type bucket) {
+            bool failed = !bucket;
+            if (bucket) {
+                *destination = *bucket;
+                // give the buffer back as soon as possible
+                bucket.reset();
+            }
+
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->failed |= failed;
+            if (--state->remaining == 0) {
+                state->cv.notify_one();
+            }
+        };
+    };
+
+    using GetRequest = typename table_type::GetRequest;
+
+    std::vector<GetRequest> requests;
+    requests.reserve(2 * keys.size());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        BucketPair<PAGE_SIZE>& pair = state->bucket_pairs[i];
+
+        bucket_indices(keys[i], pair.index_0, pair.index_1);
+
+        requests.emplace_back(pair.index_0, make_callback(&pair.payload_0));
+        requests.emplace_back(pair.index_1, make_callback(&pair.payload_1));
+    }
+
+    table.async_gets(requests);
+
+    std::unique_lock<std::mutex> lock(state->lock);
+    state->cv.wait(lock, [&state] { return state->remaining == 0; });
+
+    if (state->failed) {
+        throw std::runtime_error("Error when reading the Tethys buckets");
+    }
+
+    // every callback has run
+    return std::move(state->bucket_pairs);
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    bucket_indices(const Key& key,
+                   size_t&    bucket_0_index,
+                   size_t&    bucket_1_index) const
+{
+    details::TethysAllocatorKey tethys_key = TethysHasher()(key);
+
+    size_t half_graph_size       = table_size / 2;
+    size_t remaining_graphs_size = table_size - half_graph_size;
+
+    bucket_0_index = tethys_key.h[0] % half_graph_size;
+    bucket_1_index = half_graph_size + tethys_key.h[1] % remaining_graphs_size;
+}
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -297,25 +475,18 @@ template<size_t PAGE_SIZE,
 void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
     async_get_buckets(const Key& key, get_buckets_callback_type callback)
 {
-    details::TethysAllocatorKey tethys_key = TethysHasher()(key);
+    size_t bucket_0_index;
+    size_t bucket_1_index;
 
-    size_t half_graph_size       = table_size / 2;
-    size_t remaining_graphs_size = table_size - half_graph_size;
-
-    size_t bucket_0_index = tethys_key.h[0] % half_graph_size;
-    size_t bucket_1_index
-        = half_graph_size + tethys_key.h[1] % remaining_graphs_size;
+    bucket_indices(key, bucket_0_index, bucket_1_index);
 
+    auto bucket_0_cb = [bucket_0_index, callback](payload_lease_type bucket) {
+        callback(std::move(bucket), bucket_0_index);
+    };
 
-    auto bucket_0_cb
-        = [bucket_0_index, callback](std::unique_ptr<payload_type> bucket) {
-              callback(std::move(bucket), bucket_0_index);
-          };
-
-    auto bucket_1_cb
-        = [bucket_1_index, callback](std::unique_ptr<payload_type> bucket) {
-              callback(std::move(bucket), bucket_1_index);
-          };
+    auto bucket_1_cb = [bucket_1_index, callback](payload_lease_type bucket) {
+        callback(std::move(bucket), bucket_1_index);
+    };
 
 
     using GetRequest = typename table_type::GetRequest;
@@ -332,8 +503,8 @@ template<class CallbackState>
 void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
     async_get_list_helper(get_list_callback_type callback, CallbackState* state)
 {
-    auto bucket_cb = [this, callback, state](
-                         std::unique_ptr<payload_type> bucket, size_t index) {
+    auto bucket_cb = [this, callback, state](payload_lease_type bucket,
+                                             size_t             index) {
         uint8_t completed = state->completion_counter.fetch_add(1) + 1;
 
         if (completed == 1) {
@@ -383,13 +554,13 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::async_get_list(
 {
     struct CallBackState
     {
-        Key                           key;
-        std::unique_ptr<payload_type> bucket_0;
-        std::unique_ptr<payload_type> bucket_1;
-        size_t                        index_0{SIZE_MAX};
-        size_t                        index_1{SIZE_MAX};
-        std::atomic<uint8_t>          completion_counter{0};
-        ValueDecoder                  decoder;
+        Key                  key;
+        payload_lease_type   bucket_0;
+        payload_lease_type   bucket_1;
+        size_t               index_0{SIZE_MAX};
+        size_t               index_1{SIZE_MAX};
+        std::atomic<uint8_t> completion_counter{0};
+        ValueDecoder         decoder;
 
         explicit CallBackState(const Key& k) : key(k){};
 
@@ -416,13 +587,13 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::async_get_list(
 {
     struct CallBackState
     {
-        Key                           key;
-        std::unique_ptr<payload_type> bucket_0;
-        std::unique_ptr<payload_type> bucket_1;
-        size_t                        index_0{SIZE_MAX};
-        size_t                        index_1{SIZE_MAX};
-        std::atomic<uint8_t>          completion_counter{0};
-        ValueDecoder*                 decoder;
+        Key                  key;
+        payload_lease_type   bucket_0;
+        payload_lease_type   bucket_1;
+        size_t               index_0{SIZE_MAX};
+        size_t               index_1{SIZE_MAX};
+        std::atomic<uint8_t> completion_counter{0};
+        ValueDecoder*        decoder;
 
         CallBackState(const Key& k, ValueDecoder& dec)
             : key(k), decoder(&dec){};
@@ -181,6 +181,8 @@ void TethysStoreBuilder<PAGE_SIZE,
     abstractio::awonvm_vector<payload_type, PAGE_SIZE> tethys_table(
         params.tethys_table_path);
     tethys_table.reserve(params.graph_size(kBucketSize));
+    // the table is written sequentially: stage the buckets in large buffers
+    tethys_table.enable_buffered_writes();
 
     // run the allocation algorithm
     allocator.allocate();
@@ -271,6 +273,7 @@ void TethysStoreBuilder<PAGE_SIZE,
     encoder.finish_tethys_table_encoding();
 
     // commit the table
+    tethys_table.flush_writes();
     tethys_table.commit();
 
 
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace sse {
+namespace utility {
+
+/// Bulk binary encoding of lists.
+///
+/// An encoded list starts with a header: 3 magic bytes, the format of the
+/// payload, and the varint-encoded number of elements. The payload of a list
+/// of trivially copyable elements in the raw format is their memory
+/// representation, copied with a single memcpy. Sorted lists of unsigned
+/// integers can instead be encoded as the varints of the differences between
+/// consecutive elements.
+///
+/// The decoding functions never read past the end of the buffer, and fail
+/// (returning false) on a truncated or malformed list: the stores use this
+/// to fall back to the legacy element by element serialization.
+enum class ListFormat : uint8_t
+{
+    Raw         = 0,
+    DeltaVarint = 1,
+    // user-defined payloads, e.g. one array per field of a structure
+    Columns = 2,
+};
+
+constexpr size_t kListHeaderMagicSize = 3;
+constexpr size_t kMaxVarintSize       = 10;
+
+void append_list_header(std::string& out, ListFormat format, size_t count);
+
+// On success, begin points to the payload
+bool read_list_header(const char*& begin,
+                      const char*  end,
+                      ListFormat&  format,
+                      size_t&      count);
+
+void append_varint(std::string& out, uint64_t v);
+bool read_varint(const char*& begin, const char* end, uint64_t& v);
+
+template<class T>
+void append_raw(std::string& out, const T* data, size_t count);
+template<class T>
+bool read_raw(const char*& begin, const char* end, size_t count, T* out);
+
+// data must be sorted
+template<class T>
+void append_delta_varint(std::string& out, const T* data, size_t count);
+template<class T>
+bool read_delta_varint(const char*& begin,
+                       const char*  end,
+                       size_t       count,
+                       T*           out);
+
+// Encode the elements of data, sorted unsigned integers as deltas
+template<class T>
+std::string encode_list(const T* data, size_t count);
+
+// Append the elements of a list encoded by encode_list to out. out is left
+// unchanged when the decoding fails.
+template<class T>
+bool decode_list(const char* data, size_t size, std::vector<T>& out);
+
+
+template<class T>
+void append_raw(std::string& out, const T* data, size_t count)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The elements must be trivially copyable");
+
+    out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template<class T>
+bool read_raw(const char*& begin, const char* end, size_t count, T* out)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The elements must be trivially copyable");
+
+    if (count > static_cast<size_t>(end - begin) / sizeof(T)) {
+        return false;
+    }
+    std::memcpy(out, begin, count * sizeof(T));
+    begin += count * sizeof(T);
+
+    return true;
+}
+
+template<class T>
+void append_delta_varint(std::string& out, const T* data, size_t count)
+{
+    static_assert(std::is_unsigned<T>::value,
+                  "The elements must be unsigned integers");
+
+    T prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        append_varint(out, data[i] - prev);
+        prev = data[i];
+    }
+}
+
+template<class T>
+bool read_delta_varint(const char*& begin,
+                       const char*  end,
+                       size_t       count,
+                       T*           out)
+{
+    static_assert(std::is_unsigned<T>::value,
+                  "The elements must be unsigned integers");
+
+    T prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t delta;
+        if (!read_varint(begin, end, delta)
+            || delta > std::numeric_limits<T>::max() - prev) {
+            return false;
+        }
+        prev += static_cast<T>(delta);
+        out[i] = prev;
+    }
+    return true;
+}
+
+namespace details {
+// The delta encoding is only available for unsigned integers
+template<class T>
+bool append_sorted_list(std::string& out,
+                        const T*     data,
+                        size_t       count,
+                        std::true_type /*is_unsigned*/)
+{
+    if (!std::is_sorted(data, data + count)) {
+        return false;
+    }
+    append_list_header(out, ListFormat::DeltaVarint, count);
+    append_delta_varint(out, data, count);
+    return true;
+}
+
+template<class T>
+bool append_sorted_list(std::string& /*out*/,
+                        const T* /*data*/,
+                        size_t /*count*/,
+                        std::false_type /*is_unsigned*/)
+{
+    return false;
+}
+
+template<class T>
+bool read_sorted_list(const char*& begin,
+                      const char*  end,
+                      size_t       count,
+                      T*           out,
+                      std::true_type /*is_unsigned*/)
+{
+    return read_delta_varint(begin, end, count, out);
+}
+
+template<class T>
+bool read_sorted_list(const char*& /*begin*/,
+                      const char* /*end*/,
+                      size_t /*count*/,
+                      T* /*out*/,
+                      std::false_type /*is_unsigned*/)
+{
+    return false;
+}
+} // namespace details
+
+template<class T>
+std::string encode_list(const T* data, size_t count)
+{
+    std::string out;
+
+    if (count > 1
+        && details::append_sorted_list(
+            out, data, count, std::is_unsigned<T>())) {
+        return out;
+    }
+
+    out.reserve(kListHeaderMagicSize + 1 + kMaxVarintSize
+                + count * sizeof(T));
+    append_list_header(out, ListFormat::Raw, count);
+    append_raw(out, data, count);
+
+    return out;
+}
+
+template<class T>
+bool decode_list(const char* data, size_t size, std::vector<T>& out)
+{
+    const char* begin = data;
+    const char* end   = data + size;
+    ListFormat  format;
+    size_t      count;
+
+    if (!read_list_header(begin, end, format, count)) {
+        return false;
+    }
+
+    // every element takes at least one byte: this bounds the allocation
+    if (count > static_cast<size_t>(end - begin)) {
+        return false;
+    }
+
+    const size_t old_size = out.size();
+    out.resize(old_size + count);
+
+    bool success = false;
+    switch (format) {
+    case ListFormat::Raw:
+        success = read_raw(begin, end, count, out.data() + old_size);
+        break;
+    case ListFormat::DeltaVarint:
+        success = details::read_sorted_list(
+            begin, end, count, out.data() + old_size, std::is_unsigned<T>());
+        break;
+    default:
+        break;
+    }
+
+    // the whole buffer must have been read
+    if (!success || begin != end) {
+        out.resize(old_size);
+        return false;
+    }
+    return true;
+}
+
+} // namespace utility
+} // namespace sse
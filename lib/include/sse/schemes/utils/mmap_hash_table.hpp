@@ -0,0 +1,683 @@
+#pragma once
+
+#include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/utils.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace sse {
+namespace sophos {
+
+template<size_t N, typename V>
+class MMapHashTableBuilder;
+
+/// Key-value store with fixed-size keys and values, kept in an open-addressing
+/// hash table (with linear probing) stored in a memory-mapped file.
+///
+/// It is an alternative to RockDBWrapper for the encrypted databases, whose
+/// keys are pseudo-random tokens: a lookup costs one or two cache misses, and
+/// reopening a database only maps the file, the pages being loaded on demand.
+///
+/// The table is stored in the table file of the path directory. Its capacity
+/// is doubled (by rehashing the entries in a new file) when its load factor
+/// reaches 3/4. The modifications are written in the file by the kernel: they
+/// are only guaranteed to be durable once flush() has been called.
+///
+/// Lookups can be run concurrently, and are serialized with the
+/// modifications.
+template<size_t N, typename V>
+class MMapHashTable
+{
+public:
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "The values must be trivially copyable");
+
+    using key_type = std::array<uint8_t, N>;
+
+    // Offline builder of a table, with the same interface as
+    // RockDBSSTBuilder
+    template<size_t M, typename W>
+    using builder_type = MMapHashTableBuilder<M, W>;
+
+    static constexpr size_t kDefaultCapacity = 1UL << 16;
+    static constexpr size_t kMinCapacity     = 8;
+
+    /// Open the table stored in the path directory, or create it (with room
+    /// for initial_capacity entries) if it does not exist. Throws
+    /// std::runtime_error if the file cannot be mapped, or if it was created
+    /// with different key or value sizes.
+    explicit MMapHashTable(const std::string& path,
+                           size_t             initial_capacity
+                           = kDefaultCapacity);
+    ~MMapHashTable();
+
+    MMapHashTable(const MMapHashTable&) = delete;
+    MMapHashTable& operator=(const MMapHashTable&) = delete;
+
+    bool get(const key_type& key, V& data) const;
+
+    // Batched lookup, with the same semantics as RockDBWrapper::multi_get
+    size_t multi_get(const key_type* keys,
+                     size_t          count,
+                     V*              values,
+                     bool*           found) const;
+
+    bool put(const key_type& key, const V& data);
+
+    // Insert the (e.*key, e.*value) pairs of the count elements e of the
+    // array, growing the table at most once. disable_wal is ignored (the
+    // table has no log), and is only there for compatibility with
+    // RockDBWrapper.
+    template<class E>
+    bool put_batch(const E*      elements,
+                   size_t        count,
+                   key_type E::*key,
+                   V E::*        value,
+                   bool          disable_wal = false);
+
+    bool remove(const key_type& key);
+
+    /// Grow the table so that count entries can be stored without rehashing.
+    void reserve(size_t count);
+
+    /// Write the modified pages to the file. If blocking is false, the
+    /// writes are only scheduled.
+    void flush(bool blocking = true);
+
+    /// Same as flush(): the table never needs to be compacted. The name is
+    /// the one of RockDBWrapper.
+    void finish_bulk_load()
+    {
+        flush(true);
+    }
+
+    // The number of entries is exact, but the name is the one of
+    // RockDBWrapper
+    uint64_t approximate_size() const;
+
+    size_t capacity() const;
+
+private:
+    struct alignas(64) Header
+    {
+        uint64_t magic;
+        uint64_t key_size;
+        uint64_t value_size;
+        uint64_t slot_size;
+        uint64_t capacity;
+        uint64_t size;
+    };
+
+    struct Slot
+    {
+        key_type key;
+        V        value;
+        uint8_t  used;
+    };
+
+    struct Mapping
+    {
+        int     fd{-1};
+        size_t  length{0};
+        Header* header{nullptr};
+        Slot*   slots{nullptr};
+    };
+
+    // "SSEMHT01"
+    static constexpr uint64_t kMagic = 0x313054484d455353ULL;
+
+    static Mapping map_file(const std::string& path, size_t capacity);
+    static void    unmap(Mapping& m);
+
+    static size_t capacity_for(size_t count);
+
+    // Initial position of the key in a table of the given capacity (a power
+    // of 2). The keys are the outputs of a PRF: their first bytes are mixed
+    // with a multiplicative hash, which is enough to spread them evenly.
+    static size_t bucket(const key_type& key, size_t capacity);
+
+    // Position of key in the table, or capacity if it is not in the table
+    size_t find(const key_type& key) const;
+
+    // Insert or overwrite, without growing the table. Returns true if the
+    // key was not in the table.
+    bool insert(const key_type& key, const V& data);
+
+    void grow_for(size_t count);
+    void rehash(size_t new_capacity);
+
+    std::string file_path() const;
+
+    const std::string path_;
+    Mapping           mapping_;
+
+    mutable std::shared_timed_mutex mtx_;
+
+    friend class MMapHashTableBuilder<N, V>;
+};
+
+template<size_t N, typename V>
+constexpr size_t MMapHashTable<N, V>::kDefaultCapacity;
+
+template<size_t N, typename V>
+constexpr size_t MMapHashTable<N, V>::kMinCapacity;
+
+template<size_t N, typename V>
+constexpr uint64_t MMapHashTable<N, V>::kMagic;
+
+template<size_t N, typename V>
+MMapHashTable<N, V>::MMapHashTable(const std::string& path,
+                                   size_t             initial_capacity)
+    : path_(path)
+{
+    if (!utility::is_directory(path_)
+        && !utility::create_directory(path_, static_cast<mode_t>(0700))) {
+        throw std::runtime_error("Unable to create the directory " + path_);
+    }
+
+    mapping_ = map_file(file_path(), capacity_for(initial_capacity));
+}
+
+template<size_t N, typename V>
+MMapHashTable<N, V>::~MMapHashTable()
+{
+    unmap(mapping_);
+}
+
+template<size_t N, typename V>
+std::string MMapHashTable<N, V>::file_path() const
+{
+    return path_ + "/table";
+}
+
+template<size_t N, typename V>
+typename MMapHashTable<N, V>::Mapping MMapHashTable<N, V>::map_file(
+    const std::string& path,
+    size_t             capacity)
+{
+    Mapping m;
+
+    m.fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    /* LCOV_EXCL_START */
+    if (m.fd < 0) {
+        throw std::runtime_error("Unable to open the hash table " + path
+                                 + ": " + strerror(errno));
+    }
+    /* LCOV_EXCL_STOP */
+
+    ssize_t file_size = utility::file_size(m.fd);
+    bool    created   = (file_size == 0);
+
+    if (created) {
+        m.length = sizeof(Header) + capacity * sizeof(Slot);
+
+        // the file is sparse: the empty slots are zeros
+        /* LCOV_EXCL_START */
+        if (ftruncate(m.fd, static_cast<off_t>(m.length)) != 0) {
+            int err = errno;
+            ::close(m.fd);
+            throw std::runtime_error("Unable to resize the hash table " + path
+                                     + ": " + strerror(err));
+        }
+        /* LCOV_EXCL_STOP */
+    } else {
+        m.length = static_cast<size_t>(file_size);
+    }
+
+    if (m.length < sizeof(Header)) {
+        ::close(m.fd);
+        throw std::runtime_error("Invalid hash table file " + path);
+    }
+
+    void* base
+        = mmap(nullptr, m.length, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+    /* LCOV_EXCL_START */
+    if (base == MAP_FAILED) {
+        int err = errno;
+        ::close(m.fd);
+        throw std::runtime_error("Unable to map the hash table " + path + ": "
+                                 + strerror(err));
+    }
+    /* LCOV_EXCL_STOP */
+
+    // the lookups hit random pages: do not read ahead
+    if (madvise(base, m.length, MADV_RANDOM) != 0) {
+        logger::logger()->warn(
+            "madvise failed on the hash table {}: {}", path, strerror(errno));
+    }
+
+    m.header = reinterpret_cast<Header*>(base);
+    m.slots  = reinterpret_cast<Slot*>(reinterpret_cast<uint8_t*>(base)
+                                      + sizeof(Header));
+
+    if (created) {
+        m.header->magic      = kMagic;
+        m.header->key_size   = N;
+        m.header->value_size = sizeof(V);
+        m.header->slot_size  = sizeof(Slot);
+        m.header->capacity   = capacity;
+        m.header->size       = 0;
+    } else if (m.header->magic != kMagic || m.header->key_size != N
+               || m.header->value_size != sizeof(V)
+               || m.header->slot_size != sizeof(Slot)
+               || m.length
+                      != sizeof(Header) + m.header->capacity * sizeof(Slot)) {
+        unmap(m);
+        throw std::runtime_error("Invalid hash table file " + path);
+    }
+
+    return m;
+}
+
+template<size_t N, typename V>
+void MMapHashTable<N, V>::unmap(Mapping& m)
+{
+    if (m.header != nullptr) {
+        munmap(m.header, m.length);
+    }
+    if (m.fd >= 0) {
+        ::close(m.fd);
+    }
+    m = Mapping();
+}
+
+template<size_t N, typename V>
+size_t MMapHashTable<N, V>::capacity_for(size_t count)
+{
+    size_t capacity = kMinCapacity;
+    while (4 * count > 3 * capacity) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+template<size_t N, typename V>
+size_t MMapHashTable<N, V>::bucket(const key_type& key, size_t capacity)
+{
+    uint64_t h = 0;
+    memcpy(&h, key.data(), std::min<size_t>(N, sizeof(h)));
+
+    h *= 0x9e3779b97f4a7c15ULL;
+    return static_cast<size_t>(h ^ (h >> 32)) & (capacity - 1);
+}
+
+template<size_t N, typename V>
+size_t MMapHashTable<N, V>::find(const key_type& key) const
+{
+    const size_t capacity = mapping_.header->capacity;
+    const Slot*  slots    = mapping_.slots;
+
+    // the load factor is at most 3/4: there is always an empty slot
+    for (size_t i = bucket(key, capacity);; i = (i + 1) & (capacity - 1)) {
+        if (!slots[i].used) {
+            return capacity;
+        }
+        if (slots[i].key == key) {
+            return i;
+        }
+    }
+}
+
+template<size_t N, typename V>
+bool MMapHashTable<N, V>::insert(const key_type& key, const V& data)
+{
+    const size_t capacity = mapping_.header->capacity;
+    Slot*        slots    = mapping_.slots;
+
+    size_t i = bucket(key, capacity);
+    for (; slots[i].used; i = (i + 1) & (capacity - 1)) {
+        if (slots[i].key == key) {
+            slots[i].value = data;
+            return false;
+        }
+    }
+
+    slots[i].key   = key;
+    slots[i].value = data;
+    slots[i].used  = 1;
+    mapping_.header->size++;
+
+    return true;
+}
+
+template<size_t N, typename V>
+void MMapHashTable<N, V>::grow_for(size_t count)
+{
+    size_t new_capacity = capacity_for(count);
+
+    if (new_capacity > mapping_.header->capacity) {
+        rehash(new_capacity);
+    }
+}
+
+template<size_t N, typename V>
+void MMapHashTable<N, V>::rehash(size_t new_capacity)
+{
+    const std::string tmp_path = file_path() + ".tmp";
+    utility::remove_file(tmp_path);
+
+    Mapping old = mapping_;
+    mapping_    = map_file(tmp_path, new_capacity);
+
+    for (size_t i = 0; i < old.header->capacity; i++) {
+        if (old.slots[i].used) {
+            insert(old.slots[i].key, old.slots[i].value);
+        }
+    }
+
+    /* LCOV_EXCL_START */
+    if (rename(tmp_path.c_str(), file_path().c_str()) != 0) {
+        int err = errno;
+        unmap(mapping_);
+        mapping_ = old;
+        throw std::runtime_error("Unable to replace the hash table "
+                                 + file_path() + ": " + strerror(err));
+    }
+    /* LCOV_EXCL_STOP */
+
+    unmap(old);
+}
+
+template<size_t N, typename V>
+bool MMapHashTable<N, V>::get(const key_type& key, V& data) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    size_t i = find(key);
+    if (i == mapping_.header->capacity) {
+        return false;
+    }
+    data = mapping_.slots[i].value;
+    return true;
+}
+
+template<size_t N, typename V>
+size_t MMapHashTable<N, V>::multi_get(const key_type* keys,
+                                      size_t          count,
+                                      V*              values,
+                                      bool*           found) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    const size_t capacity = mapping_.header->capacity;
+    size_t       n_found  = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t pos = find(keys[i]);
+
+        found[i] = (pos != capacity);
+        if (found[i]) {
+            values[i] = mapping_.slots[pos].value;
+            n_found++;
+        }
+    }
+    return n_found;
+}
+
+template<size_t N, typename V>
+bool MMapHashTable<N, V>::put(const key_type& key, const V& data)
+{
+    std::lock_guard<std::shared_timed_mutex> lock(mtx_);
+
+    grow_for(mapping_.header->size + 1);
+    insert(key, data);
+
+    return true;
+}
+
+template<size_t N, typename V>
+template<class E>
+bool MMapHashTable<N, V>::put_batch(const E*      elements,
+                                    size_t        count,
+                                    key_type E::*key,
+                                    V E::*        value,
+                                    bool /*disable_wal*/)
+{
+    std::lock_guard<std::shared_timed_mutex> lock(mtx_);
+
+    grow_for(mapping_.header->size + count);
+    for (size_t i = 0; i < count; i++) {
+        insert(elements[i].*key, elements[i].*value);
+    }
+
+    return true;
+}
+
+template<size_t N, typename V>
+bool MMapHashTable<N, V>::remove(const key_type& key)
+{
+    std::lock_guard<std::shared_timed_mutex> lock(mtx_);
+
+    const size_t capacity = mapping_.header->capacity;
+    Slot*        slots    = mapping_.slots;
+
+    size_t hole = find(key);
+    if (hole == capacity) {
+        return false;
+    }
+
+    // backward shift deletion: move back the following entries of the
+    // cluster which can fill the hole, so that no tombstone is needed
+    for (size_t j = (hole + 1) & (capacity - 1); slots[j].used;
+         j        = (j + 1) & (capacity - 1)) {
+        size_t b = bucket(slots[j].key, capacity);
+
+        // the entry stays if its bucket is cyclically in (hole, j]
+        bool stays = (hole <= j) ? (hole < b && b <= j) : (hole < b || b <= j);
+        if (!stays) {
+            slots[hole] = slots[j];
+            hole        = j;
+        }
+    }
+
+    memset(&slots[hole], 0, sizeof(Slot));
+    mapping_.header->size--;
+
+    return true;
+}
+
+template<size_t N, typename V>
+void MMapHashTable<N, V>::reserve(size_t count)
+{
+    std::lock_guard<std::shared_timed_mutex> lock(mtx_);
+
+    grow_for(count);
+}
+
+template<size_t N, typename V>
+void MMapHashTable<N, V>::flush(bool blocking)
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    /* LCOV_EXCL_START */
+    if (msync(mapping_.header, mapping_.length, blocking ? MS_SYNC : MS_ASYNC)
+        != 0) {
+        logger::logger()->error("Unable to flush the hash table {}: {}",
+                                file_path(),
+                                strerror(errno));
+    }
+    /* LCOV_EXCL_STOP */
+}
+
+template<size_t N, typename V>
+uint64_t MMapHashTable<N, V>::approximate_size() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    return mapping_.header->size;
+}
+
+template<size_t N, typename V>
+size_t MMapHashTable<N, V>::capacity() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    return mapping_.header->capacity;
+}
+
+
+/// Offline construction of an MMapHashTable, with the same interface as
+/// RockDBSSTBuilder. The pairs are appended to a temporary file, and ingest()
+/// inserts them after having sized the table once for all of them.
+template<size_t N, typename V>
+class MMapHashTableBuilder
+{
+public:
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "The values must be trivially copyable");
+
+    using key_type = std::array<uint8_t, N>;
+
+    static constexpr size_t kRecordSize = N + sizeof(V);
+
+    /// Create a builder whose temporary file is stored in tmp_dir. The
+    /// directory must not exist, and is removed when the builder is
+    /// destroyed. The second argument is ignored.
+    explicit MMapHashTableBuilder(std::string tmp_dir, size_t = 0);
+    ~MMapHashTableBuilder();
+
+    MMapHashTableBuilder(const MMapHashTableBuilder&) = delete;
+    MMapHashTableBuilder& operator=(const MMapHashTableBuilder&) = delete;
+
+    void add(const key_type& key, const V& value);
+
+    /// Add all the records of an update stream. Throws std::runtime_error if
+    /// the stream ends with a truncated record.
+    void add_stream(std::istream& in);
+
+    static void write_record(std::ostream&   out,
+                             const key_type& key,
+                             const V&        value);
+
+    /// Insert the added pairs in db. Returns the number of keys which were
+    /// not already in db.
+    size_t ingest(MMapHashTable<N, V>& db);
+
+private:
+    const std::string tmp_dir_;
+    const std::string records_path_;
+
+    std::ofstream records_;
+    size_t        count_{0};
+};
+
+template<size_t N, typename V>
+MMapHashTableBuilder<N, V>::MMapHashTableBuilder(std::string tmp_dir, size_t)
+    : tmp_dir_(std::move(tmp_dir)), records_path_(tmp_dir_ + "/records")
+{
+    if (utility::exists(tmp_dir_)) {
+        throw std::runtime_error("The temporary directory " + tmp_dir_
+                                 + " already exists");
+    }
+    if (!utility::create_directory(tmp_dir_, static_cast<mode_t>(0700))) {
+        throw std::runtime_error("Unable to create the temporary directory "
+                                 + tmp_dir_);
+    }
+
+    records_.open(records_path_, std::ios::binary | std::ios::trunc);
+}
+
+template<size_t N, typename V>
+MMapHashTableBuilder<N, V>::~MMapHashTableBuilder()
+{
+    records_.close();
+    try {
+        utility::remove_directory(tmp_dir_);
+    } catch (const std::exception& e) {
+        logger::logger()->error(
+            "Unable to remove the temporary directory {}: {}",
+            tmp_dir_,
+            e.what());
+    }
+}
+
+template<size_t N, typename V>
+void MMapHashTableBuilder<N, V>::add(const key_type& key, const V& value)
+{
+    write_record(records_, key, value);
+    count_++;
+}
+
+template<size_t N, typename V>
+void MMapHashTableBuilder<N, V>::add_stream(std::istream& in)
+{
+    std::array<char, kRecordSize> buffer;
+
+    while (in.read(buffer.data(), kRecordSize)) {
+        records_.write(buffer.data(), kRecordSize);
+        count_++;
+    }
+
+    if (in.gcount() != 0) {
+        throw std::runtime_error("Truncated record in the update stream");
+    }
+}
+
+template<size_t N, typename V>
+void MMapHashTableBuilder<N, V>::write_record(std::ostream&   out,
+                                              const key_type& key,
+                                              const V&        value)
+{
+    out.write(reinterpret_cast<const char*>(key.data()), N);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(V));
+}
+
+template<size_t N, typename V>
+size_t MMapHashTableBuilder<N, V>::ingest(MMapHashTable<N, V>& db)
+{
+    records_.close();
+    if (!records_) {
+        throw std::runtime_error("Unable to write the records file "
+                                 + records_path_);
+    }
+
+    std::ifstream in(records_path_, std::ios::binary);
+
+    std::array<char, kRecordSize> buffer;
+    key_type                      key;
+    V                             value;
+    size_t                        total = 0;
+
+    {
+        std::lock_guard<std::shared_timed_mutex> lock(db.mtx_);
+
+        db.grow_for(db.mapping_.header->size + count_);
+
+        while (in.read(buffer.data(), kRecordSize)) {
+            memcpy(key.data(), buffer.data(), N);
+            memcpy(&value, buffer.data() + N, sizeof(V));
+
+            if (db.insert(key, value)) {
+                total++;
+            }
+        }
+    }
+
+    logger::logger()->info("Ingested {} entries in the hash table", total);
+
+    in.close();
+    utility::remove_file(records_path_);
+    count_ = 0;
+
+    return total;
+}
+
+} // namespace sophos
+} // namespace sse
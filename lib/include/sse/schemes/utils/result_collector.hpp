@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sse {
+
+/// Collector of the results of a parallel search.
+///
+/// Every producing thread appends its results to its own buffer, made of
+/// chunks of chunk_size results, so push() does not take any lock (except
+/// the first time a thread pushes a result). The results are either:
+///  - kept until the search is done, and then moved out with drain() or
+///    to_vector(), or
+///  - passed to a sink by batches: every time a chunk is full, it is given
+///    to the sink, and the chunk is reused. The sink is never called
+///    concurrently, so one lock is taken per chunk instead of per result.
+///
+/// The order of the results is unspecified.
+template<typename T>
+class ResultCollector
+{
+public:
+    static constexpr size_t kDefaultChunkSize = 256;
+
+    using sink_type = std::function<void(const T* results, size_t count)>;
+
+    explicit ResultCollector(size_t chunk_size = kDefaultChunkSize);
+    explicit ResultCollector(sink_type sink,
+                             size_t    chunk_size = kDefaultChunkSize);
+
+    ResultCollector(const ResultCollector&) = delete;
+    ResultCollector& operator=(const ResultCollector&) = delete;
+
+    /// Add a result. Can be called concurrently by several threads.
+    void push(const T& result);
+
+    /// Give the partially filled chunks to the sink (if there is one). Must
+    /// only be called once the producers are done.
+    void flush();
+
+    /// Number of results pushed so far. Must only be called once the
+    /// producers are done.
+    size_t size() const;
+
+    /// Move the results to out, and return the end of the output range. Must
+    /// only be called once the producers are done, and only without a sink.
+    template<class OutputIt>
+    OutputIt drain(OutputIt out);
+
+    std::vector<T> to_vector();
+
+private:
+    struct Buffer
+    {
+        std::thread::id             owner;
+        std::vector<std::vector<T>> full_chunks;
+        std::vector<T>              chunk;
+        size_t                      count{0};
+    };
+
+    static uint64_t next_id();
+
+    Buffer& local_buffer();
+    void    chunk_full(Buffer& buffer);
+
+    const uint64_t id_;
+    const size_t   chunk_size_;
+    sink_type      sink_;
+
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+    std::mutex                           buffers_mtx_;
+    std::mutex                           sink_mtx_;
+};
+
+template<typename T>
+constexpr size_t ResultCollector<T>::kDefaultChunkSize;
+
+template<typename T>
+ResultCollector<T>::ResultCollector(size_t chunk_size)
+    : id_(next_id()), chunk_size_(chunk_size > 0 ? chunk_size : 1)
+{
+}
+
+template<typename T>
+ResultCollector<T>::ResultCollector(sink_type sink, size_t chunk_size)
+    : id_(next_id()), chunk_size_(chunk_size > 0 ? chunk_size : 1),
+      sink_(std::move(sink))
+{
+}
+
+template<typename T>
+uint64_t ResultCollector<T>::next_id()
+{
+    // 0 is never used, so that it can mark an empty thread-local cache
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+}
+
+template<typename T>
+typename ResultCollector<T>::Buffer& ResultCollector<T>::local_buffer()
+{
+    // every thread caches the buffer of the last collector it pushed to.
+    // The collectors are identified by a unique id rather than by their
+    // address, which can be reused.
+    struct Cache
+    {
+        uint64_t id{0};
+        Buffer*  buffer{nullptr};
+    };
+    static thread_local Cache cache;
+
+    if (cache.id != id_) {
+        std::lock_guard<std::mutex> lock(buffers_mtx_);
+
+        const std::thread::id self = std::this_thread::get_id();
+
+        Buffer* buffer = nullptr;
+        for (const auto& b : buffers_) {
+            if (b->owner == self) {
+                buffer = b.get();
+                break;
+            }
+        }
+        if (buffer == nullptr) {
+            buffers_.emplace_back(new Buffer());
+            buffer        = buffers_.back().get();
+            buffer->owner = self;
+            buffer->chunk.reserve(chunk_size_);
+        }
+
+        cache.id     = id_;
+        cache.buffer = buffer;
+    }
+    return *cache.buffer;
+}
+
+template<typename T>
+void ResultCollector<T>::push(const T& result)
+{
+    Buffer& buffer = local_buffer();
+
+    buffer.chunk.push_back(result);
+    buffer.count++;
+
+    if (buffer.chunk.size() == chunk_size_) {
+        chunk_full(buffer);
+    }
+}
+
+template<typename T>
+void ResultCollector<T>::chunk_full(Buffer& buffer)
+{
+    if (sink_) {
+        {
+            std::lock_guard<std::mutex> lock(sink_mtx_);
+            sink_(buffer.chunk.data(), buffer.chunk.size());
+        }
+        buffer.chunk.clear();
+    } else {
+        buffer.full_chunks.push_back(std::move(buffer.chunk));
+        buffer.chunk = std::vector<T>();
+        buffer.chunk.reserve(chunk_size_);
+    }
+}
+
+template<typename T>
+void ResultCollector<T>::flush()
+{
+    if (!sink_) {
+        return;
+    }
+    for (const auto& b : buffers_) {
+        if (!b->chunk.empty()) {
+            sink_(b->chunk.data(), b->chunk.size());
+            b->chunk.clear();
+        }
+    }
+}
+
+template<typename T>
+size_t ResultCollector<T>::size() const
+{
+    size_t count = 0;
+    for (const auto& b : buffers_) {
+        count += b->count;
+    }
+    return count;
+}
+
+template<typename T>
+template<class OutputIt>
+OutputIt ResultCollector<T>::drain(OutputIt out)
+{
+    for (const auto& b : buffers_) {
+        for (auto& chunk : b->full_chunks) {
+            out = std::move(chunk.begin(), chunk.end(), out);
+        }
+        out = std::move(b->chunk.begin(), b->chunk.end(), out);
+
+        b->full_chunks.clear();
+        b->chunk.clear();
+    }
+    return out;
+}
+
+template<typename T>
+std::vector<T> ResultCollector<T>::to_vector()
+{
+    std::vector<T> results;
+    results.reserve(size());
+    drain(std::back_inserter(results));
+
+    return results;
+}
+
+} // namespace sse
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <rocksdb/db.h>
+#include <rocksdb/options.h>
+
+#include <cstdint>
+
+#include <string>
+
+namespace sse {
+namespace utility {
+
+/// Tuning profile of the RocksDB databases.
+///
+/// A profile gathers the options that depend on the workload and on the
+/// resources of the machine. Four named profiles are predefined:
+///  - "cuckoo-point-lookup": cuckoo tables and large memtables, for point
+///    lookups on fixed-size entries. This is the default, and the historical
+///    configuration of the stores.
+///  - "bulk-load": large memtables and no automatic compactions, to build a
+///    database as fast as possible. The database is compacted once, by
+///    finish_rocksdb_bulk_load() at the end of the load.
+///  - "read-mostly": block-based tables with a block cache and (partitioned)
+///    bloom filters.
+///  - "memory-constrained": small memtables and block cache.
+///
+/// Profiles can also be loaded from a file of "key = value" lines (see
+/// from_file()).
+struct RocksDBProfile
+{
+    enum class TableFormat
+    {
+        Cuckoo,
+        BlockBased,
+    };
+
+    std::string name;
+
+    TableFormat table_format{TableFormat::Cuckoo};
+
+    // Memtables
+    bool   vector_memtable{true};
+    size_t write_buffer_size{1073741824}; // 1GB
+    int    max_write_buffer_number{2};
+    size_t arena_block_size{134217728}; // 128 MB
+
+    // Compactions
+    int      max_background_compactions{20};
+    bool     disable_auto_compactions{false};
+    uint64_t max_bytes_for_level_base{4294967296}; // 4 GB
+    uint64_t target_file_size_base{201327616};
+    int      level0_file_num_compaction_trigger{10};
+    int      level0_slowdown_writes_trigger{16};
+    uint64_t hard_pending_compaction_bytes_limit{137438953472}; // 128 GB
+
+    // Block-based tables only
+    size_t block_cache_size{0}; // 0: RocksDB's default cache
+    int    bloom_bits_per_key{0}; // 0: no bloom filter
+    bool   partition_filters{false};
+
+    bool allow_mmap_reads{true};
+
+    static RocksDBProfile cuckoo_point_lookup();
+    static RocksDBProfile bulk_load();
+    static RocksDBProfile read_mostly();
+    static RocksDBProfile memory_constrained();
+
+    /// Predefined profile with the given name. Throws std::invalid_argument
+    /// if there is no such profile.
+    static RocksDBProfile named(const std::string& name);
+
+    /// Load a profile from a file. Every non-empty line is either a comment
+    /// (starting with '#') or a "key = value" pair, where key is the name of
+    /// one of the fields above. An optional "profile = <name>" line selects
+    /// the predefined profile the other values are applied on (by default,
+    /// cuckoo-point-lookup). Sizes accept the K, M and G suffixes.
+    /// Throws std::invalid_argument if the file cannot be parsed.
+    static RocksDBProfile from_file(const std::string& path);
+
+    /// Load a predefined profile if name_or_path is the name of one, and a
+    /// profile file otherwise.
+    static RocksDBProfile load(const std::string& name_or_path);
+
+    /// Create the options of a database. Cuckoo tables only support
+    /// fixed-size entries: for the other databases (e.g. counters or lists),
+    /// block-based tables and skip-list memtables are used instead.
+    rocksdb::Options to_options(bool fixed_size_entries = true) const;
+};
+
+/// Profile used by the stores which are not given one explicitly. It must be
+/// set before any store is created (typically when parsing the command line).
+const RocksDBProfile& default_rocksdb_profile();
+void set_default_rocksdb_profile(const RocksDBProfile& profile);
+
+/// Flush the memtables of db
+rocksdb::Status flush_rocksdb(rocksdb::DB& db, bool blocking);
+
+/// Flush the memtables of db and, if it was opened without automatic
+/// compactions (e.g. with the bulk-load profile), compact the whole database:
+/// its L0 files would never be merged otherwise. This rewrites the database
+/// and can take a long time: it must only be called once the load is over
+/// (see the finish_bulk_load() functions of the stores).
+rocksdb::Status finish_rocksdb_bulk_load(rocksdb::DB& db);
+
+} // namespace utility
+} // namespace sse
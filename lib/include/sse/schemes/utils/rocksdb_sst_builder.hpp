@@ -0,0 +1,326 @@
+#pragma once
+
+#include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/rocksdb_wrapper.hpp>
+#include <sse/schemes/utils/utils.hpp>
+
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/table.h>
+
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace sse {
+namespace sophos {
+
+/// Offline construction of a RockDBWrapper database.
+///
+/// The (key, value) pairs are sorted with an external merge sort: they are
+/// accumulated in memory, and every run of run_size pairs is sorted and
+/// spilled to a temporary file. ingest() then merges the runs into sorted
+/// SST files, which are moved in the database at once, skipping the memtable,
+/// the write-ahead log and the compactions.
+///
+/// As with RockDBWrapper::put, if a key is added several times, the last
+/// value wins.
+///
+/// The pairs can also be read from an update stream: a file made of
+/// consecutive raw (key, value) records, as written by write_record().
+template<size_t N, typename V>
+class RockDBSSTBuilder
+{
+public:
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "The values must be trivially copyable");
+
+    using key_type = std::array<uint8_t, N>;
+
+    static constexpr size_t kRecordSize = N + sizeof(V);
+
+    // Number of pairs sorted in memory (i.e. 64MB of 16+8 bytes pairs)
+    static constexpr size_t kDefaultRunSize = 1UL << 22;
+
+    // Maximum number of pairs in an SST file
+    static constexpr size_t kMaxSSTEntries = 1UL << 24;
+
+    /// Create a builder whose temporary files are stored in tmp_dir. The
+    /// directory must not exist, and is removed when the builder is
+    /// destroyed.
+    explicit RockDBSSTBuilder(std::string tmp_dir,
+                              size_t      run_size = kDefaultRunSize);
+    ~RockDBSSTBuilder();
+
+    RockDBSSTBuilder(const RockDBSSTBuilder&) = delete;
+    RockDBSSTBuilder& operator=(const RockDBSSTBuilder&) = delete;
+
+    void add(const key_type& key, const V& value);
+
+    /// Add all the records of an update stream. Throws std::runtime_error if
+    /// the stream ends with a truncated record.
+    void add_stream(std::istream& in);
+
+    static void write_record(std::ostream&   out,
+                             const key_type& key,
+                             const V&        value);
+
+    /// Merge the added pairs in SST files, written with the options of db,
+    /// and ingest them in db. Returns the number of distinct keys ingested.
+    size_t ingest(RockDBWrapper& db);
+
+private:
+    struct Record
+    {
+        key_type key;
+        V        value;
+    };
+
+    static bool read_record(std::istream& in, Record& r);
+
+    // Sort the current run and write it in a new temporary file
+    void spill_run();
+
+    std::string next_file_path(const std::string& prefix);
+
+    const std::string tmp_dir_;
+    const size_t      run_size_;
+
+    std::vector<Record>      run_;
+    std::vector<std::string> run_files_;
+
+    size_t files_count_{0};
+};
+
+template<size_t N, typename V>
+RockDBSSTBuilder<N, V>::RockDBSSTBuilder(std::string tmp_dir,
+                                         size_t      run_size)
+    : tmp_dir_(std::move(tmp_dir)), run_size_(std::max<size_t>(run_size, 1))
+{
+    if (utility::exists(tmp_dir_)) {
+        throw std::runtime_error("The temporary directory " + tmp_dir_
+                                 + " already exists");
+    }
+    if (!utility::create_directory(tmp_dir_, static_cast<mode_t>(0700))) {
+        throw std::runtime_error("Unable to create the temporary directory "
+                                 + tmp_dir_);
+    }
+
+    run_.reserve(run_size_);
+}
+
+template<size_t N, typename V>
+RockDBSSTBuilder<N, V>::~RockDBSSTBuilder()
+{
+    try {
+        utility::remove_directory(tmp_dir_);
+    } catch (const std::exception& e) {
+        logger::logger()->error(
+            "Unable to remove the temporary directory {}: {}",
+            tmp_dir_,
+            e.what());
+    }
+}
+
+template<size_t N, typename V>
+void RockDBSSTBuilder<N, V>::add(const key_type& key, const V& value)
+{
+    run_.push_back(Record{key, value});
+
+    if (run_.size() >= run_size_) {
+        spill_run();
+    }
+}
+
+template<size_t N, typename V>
+void RockDBSSTBuilder<N, V>::add_stream(std::istream& in)
+{
+    Record r;
+    while (read_record(in, r)) {
+        add(r.key, r.value);
+    }
+
+    if (in.gcount() != 0) {
+        throw std::runtime_error("Truncated record in the update stream");
+    }
+}
+
+template<size_t N, typename V>
+void RockDBSSTBuilder<N, V>::write_record(std::ostream&   out,
+                                          const key_type& key,
+                                          const V&        value)
+{
+    out.write(reinterpret_cast<const char*>(key.data()), N);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(V));
+}
+
+template<size_t N, typename V>
+bool RockDBSSTBuilder<N, V>::read_record(std::istream& in, Record& r)
+{
+    std::array<char, kRecordSize> buffer;
+
+    if (!in.read(buffer.data(), kRecordSize)) {
+        return false;
+    }
+    memcpy(r.key.data(), buffer.data(), N);
+    memcpy(&r.value, buffer.data() + N, sizeof(V));
+
+    return true;
+}
+
+template<size_t N, typename V>
+std::string RockDBSSTBuilder<N, V>::next_file_path(const std::string& prefix)
+{
+    return tmp_dir_ + "/" + prefix + std::to_string(files_count_++);
+}
+
+template<size_t N, typename V>
+void RockDBSSTBuilder<N, V>::spill_run()
+{
+    if (run_.empty()) {
+        return;
+    }
+
+    // the sort is stable so that, among the pairs with the same key, the
+    // last one added is the last one of the sorted run
+    std::stable_sort(
+        run_.begin(), run_.end(), [](const Record& a, const Record& b) {
+            return a.key < b.key;
+        });
+
+    std::string   path = next_file_path("run_");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    for (size_t i = 0; i < run_.size(); i++) {
+        if (i + 1 < run_.size() && run_[i].key == run_[i + 1].key) {
+            // overwritten by a later pair
+            continue;
+        }
+        write_record(out, run_[i].key, run_[i].value);
+    }
+
+    if (!out) {
+        throw std::runtime_error("Unable to write the sorted run " + path);
+    }
+
+    run_files_.push_back(std::move(path));
+    run_.clear();
+}
+
+template<size_t N, typename V>
+size_t RockDBSSTBuilder<N, V>::ingest(RockDBWrapper& db)
+{
+    spill_run();
+
+    struct Head
+    {
+        Record record;
+        size_t run;
+    };
+
+    // min-heap on the keys. For equal keys, the most recent run comes
+    // first, and the others are skipped.
+    auto greater = [](const Head& a, const Head& b) {
+        if (a.record.key != b.record.key) {
+            return a.record.key > b.record.key;
+        }
+        return a.run < b.run;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(
+        greater);
+
+    std::vector<std::unique_ptr<std::ifstream>> runs;
+    for (size_t i = 0; i < run_files_.size(); i++) {
+        runs.emplace_back(new std::ifstream(run_files_[i], std::ios::binary));
+
+        Head h{Record(), i};
+        if (read_record(*runs[i], h.record)) {
+            heads.push(h);
+        }
+    }
+
+    // The cuckoo table builder does not run the table property collectors
+    // IngestExternalFile relies on: the files are then written as
+    // block-based tables, which the databases can read whatever their own
+    // table format (see utility::RocksDBProfile::to_options).
+    rocksdb::Options sst_options = db.options();
+    if (std::string(sst_options.table_factory->Name()) != "BlockBasedTable") {
+        sst_options.table_factory.reset(rocksdb::NewBlockBasedTableFactory());
+    }
+
+    rocksdb::SstFileWriter   writer(rocksdb::EnvOptions(), sst_options);
+    std::vector<std::string> sst_files;
+    size_t                   file_entries = 0;
+    size_t                   total        = 0;
+
+    auto check = [](const rocksdb::Status& s, const std::string& what) {
+        if (!s.ok()) {
+            throw std::runtime_error("Unable to " + what + ": "
+                                     + s.ToString());
+        }
+    };
+
+    bool     has_last = false;
+    key_type last_key;
+
+    while (!heads.empty()) {
+        Head h = heads.top();
+        heads.pop();
+
+        if (!has_last || h.record.key != last_key) {
+            if (file_entries == 0) {
+                sst_files.push_back(next_file_path("table_") + ".sst");
+                check(writer.Open(sst_files.back()), "open an SST file");
+            }
+
+            check(writer.Put(
+                      rocksdb::Slice(
+                          reinterpret_cast<const char*>(h.record.key.data()),
+                          N),
+                      rocksdb::Slice(
+                          reinterpret_cast<const char*>(&h.record.value),
+                          sizeof(V))),
+                  "write in an SST file");
+
+            last_key = h.record.key;
+            has_last = true;
+            total++;
+
+            if (++file_entries == kMaxSSTEntries) {
+                check(writer.Finish(), "finish an SST file");
+                file_entries = 0;
+            }
+        }
+
+        if (read_record(*runs[h.run], h.record)) {
+            heads.push(h);
+        }
+    }
+
+    if (file_entries != 0) {
+        check(writer.Finish(), "finish an SST file");
+    }
+
+    runs.clear();
+    for (const auto& path : run_files_) {
+        utility::remove_file(path);
+    }
+    run_files_.clear();
+
+    logger::logger()->info(
+        "Ingesting {} entries from {} SST files", total, sst_files.size());
+
+    db.ingest_external_files(sst_files);
+
+    return total;
+}
+
+} // namespace sophos
+} // namespace sse
@@ -20,29 +20,56 @@
 
 #pragma once
 
+#include <sse/schemes/utils/list_codec.hpp>
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/rocksdb_profile.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <rocksdb/db.h>
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/options.h>
 #include <rocksdb/table.h>
+#include <rocksdb/write_batch.h>
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace sse {
 namespace sophos {
 
+template<size_t N, typename V>
+class RockDBSSTBuilder;
+
 class RockDBWrapper
 {
 public:
+    // Offline builder of a database (see rocksdb_sst_builder.hpp)
+    template<size_t N, typename V>
+    using builder_type = RockDBSSTBuilder<N, V>;
+
     RockDBWrapper() = delete;
-    inline explicit RockDBWrapper(const std::string& path);
+    inline explicit RockDBWrapper(const std::string&             path,
+                                  const utility::RocksDBProfile& profile
+                                  = utility::default_rocksdb_profile());
     inline ~RockDBWrapper();
 
     inline bool get(const std::string& key, std::string& data) const;
+
+    // Read the value without copying it in a temporary string: when possible,
+    // the value is pinned in the block cache (or in the mmapped table) until
+    // the PinnableSlice is reset or destroyed
+    inline bool get_pinned(const uint8_t*          key,
+                           const uint8_t           key_length,
+                           rocksdb::PinnableSlice& value) const;
+
     template<size_t N, typename V>
     inline bool get(const std::array<uint8_t, N>& key, V& data) const;
 
@@ -51,9 +78,29 @@ public:
                     const uint8_t  key_length,
                     V&             data) const;
 
+    // Batched lookup of count keys. found[i] is set to true iff keys[i] is in
+    // the database, in which case its value is copied in values[i]. Returns
+    // the number of keys found.
+    template<size_t N, typename V>
+    inline size_t multi_get(const std::array<uint8_t, N>* keys,
+                            size_t                        count,
+                            V*                            values,
+                            bool*                         found) const;
+
     template<size_t N, typename V>
     inline bool put(const std::array<uint8_t, N>& key, const V& data);
 
+    // Insert the (e.*key, e.*value) pairs of the count elements e of the
+    // array with a single write batch. If disable_wal is true, the batch is
+    // not written to the write-ahead log: it is lost in case of a crash,
+    // unless the database has been flushed in the meantime.
+    template<class E, size_t N, typename V>
+    inline bool put_batch(const E*                    elements,
+                          size_t                      count,
+                          std::array<uint8_t, N> E::*key,
+                          V E::*                      value,
+                          bool                        disable_wal = false);
+
     template<size_t N>
     inline bool remove(const std::array<uint8_t, N>& key);
 
@@ -61,64 +108,34 @@ public:
 
     inline void flush(bool blocking = true);
 
+    // Flush the database and, if it was opened without automatic
+    // compactions, compact it (see utility::finish_rocksdb_bulk_load). Only
+    // call this once, at the end of a load.
+    inline void finish_bulk_load();
+
+    // Move the SST files in the database, without going through the memtable
+    // and the write-ahead log. The files must be readable with the options
+    // returned by options(). Throws std::runtime_error on failure.
+    inline void ingest_external_files(const std::vector<std::string>& paths);
+
     inline uint64_t approximate_size() const;
 
+    // Options used to open the database
+    inline rocksdb::Options options() const
+    {
+        return db_->GetOptions();
+    }
+
 private:
     rocksdb::DB* db_;
 };
 
-RockDBWrapper::RockDBWrapper(const std::string& path) : db_(nullptr)
+RockDBWrapper::RockDBWrapper(const std::string&             path,
+                             const utility::RocksDBProfile& profile)
+    : db_(nullptr)
 {
-    rocksdb::Options options;
-    options.create_if_missing = true;
-
-
-    rocksdb::CuckooTableOptions cuckoo_options;
-    cuckoo_options.identity_as_first_hash = false;
-    cuckoo_options.hash_table_ratio       = 0.9;
-
-
-    //        cuckoo_options.use_module_hash = false;
-    //        cuckoo_options.identity_as_first_hash = true;
-
-    options.table_cache_numshardbits = 4;
-    options.max_open_files           = -1;
-
-
-    options.table_factory.reset(rocksdb::NewCuckooTableFactory(cuckoo_options));
-
-    options.memtable_factory = std::make_shared<rocksdb::VectorRepFactory>();
-
-    options.compression            = rocksdb::kNoCompression;
-    options.bottommost_compression = rocksdb::kDisableCompressionOption;
-
-    options.compaction_style = rocksdb::kCompactionStyleLevel;
-    options.info_log_level   = rocksdb::InfoLogLevel::INFO_LEVEL;
-
-
-    //        options.max_grandparent_overlap_factor = 10;
-
-    options.delayed_write_rate         = 8388608;
-    options.max_background_compactions = 20;
-
-    //        options.disableDataSync = true;
-    options.allow_mmap_reads                       = true;
-
-    options.allow_concurrent_memtable_write
-        = options.memtable_factory->IsInsertConcurrentlySupported();
-
-    options.max_bytes_for_level_base            = 4294967296; // 4 GB
-    options.arena_block_size                    = 134217728;  // 128 MB
-    options.level0_file_num_compaction_trigger  = 10;
-    options.level0_slowdown_writes_trigger      = 16;
-    options.hard_pending_compaction_bytes_limit = 137438953472; // 128 GB
-    options.target_file_size_base               = 201327616;
-    options.write_buffer_size                   = 1073741824; // 1GB
-
-    //        options.optimize_filters_for_hits = true;
-
-
-    rocksdb::Status status = rocksdb::DB::Open(options, path, &db_);
+    rocksdb::Status status
+        = rocksdb::DB::Open(profile.to_options(), path, &db_);
 
     /* LCOV_EXCL_START */
     if (!status.ok()) {
@@ -132,6 +149,7 @@ RockDBWrapper::RockDBWrapper(const std::string& path) : db_(nullptr)
     /* LCOV_EXCL_STOP */
 }
 
+
 RockDBWrapper::~RockDBWrapper()
 {
     delete db_;
@@ -144,40 +162,82 @@ bool RockDBWrapper::get(const std::string& key, std::string& data) const
     return s.ok();
 }
 
-template<size_t N, typename V>
-bool RockDBWrapper::get(const std::array<uint8_t, N>& key, V& data) const
+bool RockDBWrapper::get_pinned(const uint8_t*          key,
+                               const uint8_t           key_length,
+                               rocksdb::PinnableSlice& value) const
 {
-    rocksdb::Slice k_s(reinterpret_cast<const char*>(key.data()), N);
-    std::string    value;
+    rocksdb::Slice k_s(reinterpret_cast<const char*>(key), key_length);
 
-    rocksdb::Status s
-        = db_->Get(rocksdb::ReadOptions(false, true), k_s, &value);
-
-    if (s.ok()) {
-        ::memcpy(&data, value.data(), sizeof(V));
-    }
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(false, true),
+                                 db_->DefaultColumnFamily(),
+                                 k_s,
+                                 &value);
 
     return s.ok();
 }
 
+template<size_t N, typename V>
+bool RockDBWrapper::get(const std::array<uint8_t, N>& key, V& data) const
+{
+    return get(key.data(), N, data);
+}
+
 template<typename V>
 bool RockDBWrapper::get(const uint8_t* key,
                         const uint8_t  key_length,
                         V&             data) const
 {
-    rocksdb::Slice k_s(reinterpret_cast<const char*>(key), key_length);
-    std::string    value;
+    rocksdb::PinnableSlice value;
 
-    rocksdb::Status s
-        = db_->Get(rocksdb::ReadOptions(false, true), k_s, &value);
+    bool found = get_pinned(key, key_length, value);
 
-    if (s.ok()) {
+    if (found) {
         ::memcpy(&data, value.data(), sizeof(V));
     }
 
-    return s.ok();
+    return found;
 }
 
+template<size_t N, typename V>
+size_t RockDBWrapper::multi_get(const std::array<uint8_t, N>* keys,
+                                size_t                        count,
+                                V*                            values,
+                                bool*                         found) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    std::vector<rocksdb::Slice> k_s;
+    k_s.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        k_s.emplace_back(reinterpret_cast<const char*>(keys[i].data()), N);
+    }
+
+    // the values are pinned in the block cache (or in the mmapped tables)
+    // instead of being copied in temporary strings
+    std::vector<rocksdb::PinnableSlice> v_s(count);
+    std::vector<rocksdb::Status>        statuses(count);
+
+    db_->MultiGet(rocksdb::ReadOptions(false, true),
+                  db_->DefaultColumnFamily(),
+                  count,
+                  k_s.data(),
+                  v_s.data(),
+                  statuses.data());
+
+    size_t found_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        found[i] = statuses[i].ok();
+
+        if (found[i]) {
+            ::memcpy(&values[i], v_s[i].data(), sizeof(V));
+            found_count++;
+        }
+    }
+
+    return found_count;
+}
 
 template<size_t N, typename V>
 bool RockDBWrapper::put(const std::array<uint8_t, N>& key, const V& data)
@@ -199,6 +259,44 @@ bool RockDBWrapper::put(const std::array<uint8_t, N>& key, const V& data)
     return s.ok();
 }
 
+template<class E, size_t N, typename V>
+bool RockDBWrapper::put_batch(const E*                    elements,
+                              size_t                      count,
+                              std::array<uint8_t, N> E::*key,
+                              V E::*                      value,
+                              bool                        disable_wal)
+{
+    if (count == 0) {
+        return true;
+    }
+
+    rocksdb::WriteBatch batch(count * (N + sizeof(V) + 16));
+
+    for (size_t i = 0; i < count; i++) {
+        const auto& k = elements[i].*key;
+        const auto& v = elements[i].*value;
+
+        batch.Put(rocksdb::Slice(reinterpret_cast<const char*>(k.data()), N),
+                  rocksdb::Slice(reinterpret_cast<const char*>(&v), sizeof(V)));
+    }
+
+    rocksdb::WriteOptions options;
+    options.disableWAL = disable_wal;
+
+    rocksdb::Status s = db_->Write(options, &batch);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("Unable to insert a batch of "
+                                + std::to_string(count)
+                                + " pairs in the database\nRocksdb status: "
+                                + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
 template<size_t N>
 bool RockDBWrapper::remove(const std::array<uint8_t, N>& key)
 {
@@ -220,19 +318,44 @@ bool RockDBWrapper::remove(const uint8_t* key, const uint8_t key_length)
 
 void RockDBWrapper::flush(bool blocking)
 {
-    rocksdb::FlushOptions options;
+    rocksdb::Status s = utility::flush_rocksdb(*db_, blocking);
 
-    options.wait = blocking;
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB Flush failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+}
 
-    rocksdb::Status s = db_->Flush(options);
+void RockDBWrapper::finish_bulk_load()
+{
+    rocksdb::Status s = utility::finish_rocksdb_bulk_load(*db_);
 
     /* LCOV_EXCL_START */
     if (!s.ok()) {
-        logger::logger()->error("DB Flush failed: " + s.ToString());
+        logger::logger()->error("DB compaction failed: " + s.ToString());
     }
     /* LCOV_EXCL_STOP */
 }
 
+void RockDBWrapper::ingest_external_files(
+    const std::vector<std::string>& paths)
+{
+    if (paths.empty()) {
+        return;
+    }
+
+    rocksdb::IngestExternalFileOptions options;
+    options.move_files = true;
+
+    rocksdb::Status s = db_->IngestExternalFile(paths, options);
+
+    if (!s.ok()) {
+        throw std::runtime_error("Unable to ingest the SST files: "
+                                 + s.ToString());
+    }
+}
+
 uint64_t RockDBWrapper::approximate_size() const
 {
     uint64_t v;
@@ -250,7 +373,9 @@ class RocksDBCounter
 {
 public:
     RocksDBCounter() = delete;
-    explicit RocksDBCounter(const std::string& path);
+    explicit RocksDBCounter(const std::string&             path,
+                            const utility::RocksDBProfile& profile
+                            = utility::default_rocksdb_profile());
     inline ~RocksDBCounter()
     {
         delete db_;
@@ -290,6 +415,174 @@ struct serialization
                             T&                           out);
 };
 
+/// Serializer of lists of trivially copyable elements. The lists are written
+/// in bulk (see utility::encode_list), but the legacy serialization, the raw
+/// elements one after the other, can still be read.
+///
+/// A serializer whose lists can be written in bulk defines serialize_list()
+/// and deserialize_list(), which returns false when the list was not written
+/// by serialize_list(). The element by element functions are then only used
+/// to read the legacy lists.
+template<class T>
+struct binary_serialization
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The elements must be trivially copyable");
+
+    std::string serialize(const T& elt)
+    {
+        return std::string(reinterpret_cast<const char*>(&elt), sizeof(T));
+    }
+    bool deserialize(std::string::iterator&       begin,
+                     const std::string::iterator& end,
+                     T&                           out)
+    {
+        if (end < begin + sizeof(T)) {
+            if (end != begin) {
+                logger::logger()->error("Error when deserializing");
+            }
+
+            return false;
+        }
+        std::memcpy(&out, &(*begin), sizeof(T));
+        begin += sizeof(T);
+
+        return true;
+    }
+
+    std::string serialize_list(const T* data, size_t count)
+    {
+        return utility::encode_list(data, count);
+    }
+    bool deserialize_list(const char* data, size_t size, std::vector<T>& out)
+    {
+        return utility::decode_list(data, size, out);
+    }
+};
+
+namespace details {
+template<class S, class T, class = void>
+struct has_list_serialization : std::false_type
+{
+};
+
+template<class S, class T>
+struct has_list_serialization<
+    S,
+    T,
+    decltype(void(std::declval<S&>().serialize_list(std::declval<const T*>(),
+                                                    size_t(0))))>
+    : std::true_type
+{
+};
+
+template<class S, class Container>
+std::string serialize_list(S& ser, const Container& data, std::false_type)
+{
+    std::string serialized_list;
+
+    for (const auto& elt : data) {
+        serialized_list += ser.serialize(elt);
+    }
+    return serialized_list;
+}
+
+template<class S, class T>
+std::string serialize_list(S& ser, const std::vector<T>& data, std::true_type)
+{
+    return ser.serialize_list(data.data(), data.size());
+}
+
+template<class S, class T>
+std::string serialize_list(S& ser, const std::list<T>& data, std::true_type)
+{
+    const std::vector<T> v(data.begin(), data.end());
+    return ser.serialize_list(v.data(), v.size());
+}
+
+template<class S, class Container>
+void deserialize_elements(S& deser, std::string& raw, Container& data)
+{
+    auto       it  = raw.begin();
+    const auto end = raw.end();
+
+    typename Container::value_type elt;
+    while (deser.deserialize(it, end, elt)) {
+        data.push_back(std::move(elt));
+    }
+}
+
+template<class S, class Container>
+void deserialize_list(S&           deser,
+                      std::string& raw,
+                      Container&   data,
+                      std::false_type)
+{
+    deserialize_elements(deser, raw, data);
+}
+
+template<class S, class T>
+void deserialize_list(S&              deser,
+                      std::string&    raw,
+                      std::vector<T>& data,
+                      std::true_type)
+{
+    if (!deser.deserialize_list(raw.data(), raw.size(), data)) {
+        deserialize_elements(deser, raw, data);
+    }
+}
+
+template<class S, class T>
+void deserialize_list(S&            deser,
+                      std::string&  raw,
+                      std::list<T>& data,
+                      std::true_type)
+{
+    std::vector<T> v;
+    if (deser.deserialize_list(raw.data(), raw.size(), v)) {
+        data.insert(data.end(),
+                    std::make_move_iterator(v.begin()),
+                    std::make_move_iterator(v.end()));
+    } else {
+        deserialize_elements(deser, raw, data);
+    }
+}
+
+// Serialize a list in bulk if the serializer supports it, and element by
+// element otherwise
+template<class S, class Container>
+std::string serialize_list(S& ser, const Container& data)
+{
+    return serialize_list(
+        ser,
+        data,
+        has_list_serialization<S, typename Container::value_type>());
+}
+
+// Append the elements of a serialized list to data
+template<class S, class Container>
+void deserialize_list(S& deser, std::string& raw, Container& data)
+{
+    deserialize_list(
+        deser,
+        raw,
+        data,
+        has_list_serialization<S, typename Container::value_type>());
+}
+
+// Largest capacity kept by the per-thread read buffers
+constexpr size_t kMaxRetainedReadBufferSize = 1 << 20;
+
+// Free the memory of a per-thread read buffer after an exceptionally long
+// list, instead of keeping it for the lifetime of the thread
+inline void trim_read_buffer(std::string& buffer)
+{
+    if (buffer.capacity() > kMaxRetainedReadBufferSize) {
+        std::string().swap(buffer);
+    }
+}
+} // namespace details
+
 template<typename T, class Serializer = serialization<T>>
 class RockDBListStore
 {
@@ -297,7 +590,9 @@ public:
     using serializer = Serializer;
 
     RockDBListStore() = delete;
-    inline explicit RockDBListStore(const std::string& path);
+    inline explicit RockDBListStore(const std::string&             path,
+                                    const utility::RocksDBProfile& profile
+                                    = utility::default_rocksdb_profile());
     inline ~RockDBListStore();
 
     // find the list associated to key and append elements to data
@@ -352,48 +647,87 @@ public:
 
     void flush(bool blocking = true);
 
+    // See RockDBWrapper::finish_bulk_load
+    void finish_bulk_load();
+
 private:
     rocksdb::DB* db_;
 };
 
-template<typename T, class Serializer>
-// cppcheck (on Xenial) can be annoying with lineskips
-// cppcheck-suppress uninitMemberVar
-RockDBListStore<T, Serializer>::RockDBListStore(const std::string& path)
-    : db_(nullptr)
+/// Store of lists kept as logs of segments. The segments of the list of a
+/// key are stored under the key followed by their (big endian) sequence
+/// number, so that appending elements to a list writes a new segment instead
+/// of rewriting the whole list. compact() merges the segments of a list in a
+/// single one.
+///
+/// A list written under the bare key by RockDBListStore, with the same
+/// serializer, is read as the first segment of the list.
+template<typename T, class Serializer = serialization<T>>
+class RockDBListLogStore
 {
-    rocksdb::Options options;
-    options.create_if_missing = true;
+public:
+    using serializer = Serializer;
+    using seq_type   = uint64_t;
 
+    RockDBListLogStore() = delete;
+    inline explicit RockDBListLogStore(const std::string&             path,
+                                       const utility::RocksDBProfile& profile
+                                       = utility::default_rocksdb_profile());
+    inline ~RockDBListLogStore();
 
-    rocksdb::CuckooTableOptions cuckoo_options;
-    cuckoo_options.identity_as_first_hash = false;
-    cuckoo_options.hash_table_ratio       = 0.9;
+    // Append the elements of the segments of the list of key to data, in
+    // the order of the segments. Return the number of segments, and set
+    // last_seq to the sequence number of the last one (0 if there is none).
+    template<size_t N>
+    size_t get(const std::array<uint8_t, N>& key,
+               std::vector<T>&               data,
+               seq_type&                     last_seq) const;
 
-    options.table_cache_numshardbits = 4;
-    options.max_open_files           = -1;
+    // Write the elements of data in a new segment, after the last one of the
+    // list of key. Nothing is written if data is empty.
+    template<size_t N>
+    bool append(const std::array<uint8_t, N>& key, const std::vector<T>& data);
 
-    options.compression            = rocksdb::kNoCompression;
-    options.bottommost_compression = rocksdb::kDisableCompressionOption;
+    // Atomically replace the segments of the list of key up to last_seq
+    // (included) by a single segment with the elements of data. The segments
+    // appended after last_seq are kept. Two compactions of the same list
+    // must not run concurrently.
+    template<size_t N>
+    bool compact(const std::array<uint8_t, N>& key,
+                 seq_type                      last_seq,
+                 const std::vector<T>&         data);
 
-    options.compaction_style = rocksdb::kCompactionStyleLevel;
-    options.info_log_level   = rocksdb::InfoLogLevel::INFO_LEVEL;
+    void flush(bool blocking = true);
 
-    options.delayed_write_rate         = 8388608;
-    options.max_background_compactions = 20;
+    // See RockDBWrapper::finish_bulk_load
+    void finish_bulk_load();
 
-    options.allow_mmap_reads                       = true;
+private:
+    static constexpr size_t kSeqSize = sizeof(seq_type);
 
-    options.allow_concurrent_memtable_write
-        = options.memtable_factory->IsInsertConcurrentlySupported();
+    template<size_t N>
+    static std::string segment_key(const std::array<uint8_t, N>& key,
+                                   seq_type                      seq);
+    static seq_type    segment_seq(const rocksdb::Slice& segment_key);
 
-    options.max_bytes_for_level_base            = 4294967296; // 4 GB
-    options.arena_block_size                    = 134217728;  // 128 MB
-    options.level0_file_num_compaction_trigger  = 10;
-    options.level0_slowdown_writes_trigger      = 16;
-    options.hard_pending_compaction_bytes_limit = 137438953472; // 128 GB
-    options.target_file_size_base               = 201327616;
-    options.write_buffer_size                   = 1073741824; // 1GB
+    std::string serialize(const std::vector<T>& data) const;
+
+    rocksdb::DB* db_;
+
+    // the sequence number of a new segment is computed from the last one
+    std::mutex append_mtx_;
+};
+
+template<typename T, class Serializer>
+// cppcheck (on Xenial) can be annoying with lineskips
+// cppcheck-suppress uninitMemberVar
+RockDBListStore<T, Serializer>::RockDBListStore(
+    const std::string&             path,
+    const utility::RocksDBProfile& profile)
+    : db_(nullptr)
+{
+    // the lists have a variable size
+    rocksdb::Options options = profile.to_options(false);
 
     rocksdb::Status status = rocksdb::DB::Open(options, path, &db_);
 
@@ -423,18 +757,17 @@ bool RockDBListStore<T, Serializer>::get(const std::string& key,
     // empty the list first
     data.clear();
 
-    std::string     raw_string;
+    // the serialized list is read in a per-thread buffer, whose capacity is
+    // reused from one lookup to the next (up to a limit)
+    static thread_local std::string raw_string;
+
     rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &raw_string);
 
     if (s.ok()) {
-        auto       it  = raw_string.begin();
-        const auto end = raw_string.end();
-        T          elt;
-
-        while (deser.deserialize(it, end, elt)) {
-            data.emplace_back(std::move(elt));
-        }
+        details::deserialize_list(deser, raw_string, data);
     }
+    details::trim_read_buffer(raw_string);
+
     return s.ok();
 }
 
@@ -445,7 +778,9 @@ bool RockDBListStore<T, Serializer>::get(const uint8_t* key,
                                          serializer&    deser) const
 {
     rocksdb::Slice k_s(reinterpret_cast<const char*>(key), key_length);
-    std::string    raw_string;
+
+    // see above
+    static thread_local std::string raw_string;
 
     // empty the list first
     data.clear();
@@ -454,15 +789,10 @@ bool RockDBListStore<T, Serializer>::get(const uint8_t* key,
         = db_->Get(rocksdb::ReadOptions(false, true), k_s, &raw_string);
 
     if (s.ok()) {
-        auto       it  = raw_string.begin();
-        const auto end = raw_string.end();
-        T          elt;
-
-        while (deser.deserialize(it, end, elt)) {
-            //                data.push_back(std::move<T>(elt));
-            data.push_back(elt);
-        }
+        details::deserialize_list(deser, raw_string, data);
     }
+    details::trim_read_buffer(raw_string);
+
     return s.ok();
 }
 
@@ -473,11 +803,7 @@ bool RockDBListStore<T, Serializer>::put(const std::array<uint8_t, N>& key,
                                          const std::list<T>&           data,
                                          serializer&                   ser)
 {
-    std::string serialized_list;
-
-    for (T elt : data) {
-        serialized_list += ser.serialize(elt);
-    }
+    const std::string serialized_list = details::serialize_list(ser, data);
 
     rocksdb::Slice k_s(reinterpret_cast<const char*>(key.data()), N);
     //        rocksdb::Slice k_v(reinterpret_cast<const
@@ -503,11 +829,235 @@ bool RockDBListStore<T, Serializer>::put(const std::array<uint8_t, N>& key,
 template<typename T, class Serializer>
 void RockDBListStore<T, Serializer>::flush(bool blocking)
 {
-    rocksdb::FlushOptions options;
+    rocksdb::Status s = utility::flush_rocksdb(*db_, blocking);
 
-    options.wait = blocking;
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB Flush failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+}
 
-    rocksdb::Status s = db_->Flush(options);
+template<typename T, class Serializer>
+void RockDBListStore<T, Serializer>::finish_bulk_load()
+{
+    rocksdb::Status s = utility::finish_rocksdb_bulk_load(*db_);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB compaction failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+}
+
+template<typename T, class Serializer>
+constexpr size_t RockDBListLogStore<T, Serializer>::kSeqSize;
+
+template<typename T, class Serializer>
+// cppcheck-suppress uninitMemberVar
+RockDBListLogStore<T, Serializer>::RockDBListLogStore(
+    const std::string&             path,
+    const utility::RocksDBProfile& profile)
+    : db_(nullptr)
+{
+    // the segments have a variable size
+    rocksdb::Options options = profile.to_options(false);
+
+    rocksdb::Status status = rocksdb::DB::Open(options, path, &db_);
+
+    /* LCOV_EXCL_START */
+    if (!status.ok()) {
+        logger::logger()->critical("Unable to open the database:\n "
+                                   + status.ToString());
+        db_ = nullptr;
+
+        throw std::runtime_error("Unable to open the database located at "
+                                 + path);
+    }
+    /* LCOV_EXCL_STOP */
+}
+
+template<typename T, class Serializer>
+RockDBListLogStore<T, Serializer>::~RockDBListLogStore()
+{
+    delete db_;
+}
+
+template<typename T, class Serializer>
+template<size_t N>
+std::string RockDBListLogStore<T, Serializer>::segment_key(
+    const std::array<uint8_t, N>& key,
+    seq_type                      seq)
+{
+    std::string k(reinterpret_cast<const char*>(key.data()), N);
+
+    // big endian, so that the segments are sorted by sequence number
+    for (size_t i = 0; i < kSeqSize; i++) {
+        k.push_back(static_cast<char>(seq >> (8 * (kSeqSize - 1 - i))));
+    }
+    return k;
+}
+
+template<typename T, class Serializer>
+typename RockDBListLogStore<T, Serializer>::seq_type RockDBListLogStore<
+    T,
+    Serializer>::segment_seq(const rocksdb::Slice& segment_key)
+{
+    const uint8_t* seq_bytes = reinterpret_cast<const uint8_t*>(
+        segment_key.data() + segment_key.size() - kSeqSize);
+
+    seq_type seq = 0;
+    for (size_t i = 0; i < kSeqSize; i++) {
+        seq = (seq << 8) | seq_bytes[i];
+    }
+    return seq;
+}
+
+template<typename T, class Serializer>
+std::string RockDBListLogStore<T, Serializer>::serialize(
+    const std::vector<T>& data) const
+{
+    serializer ser = serializer();
+    return details::serialize_list(ser, data);
+}
+
+template<typename T, class Serializer>
+template<size_t N>
+size_t RockDBListLogStore<T, Serializer>::get(
+    const std::array<uint8_t, N>& key,
+    std::vector<T>&               data,
+    seq_type&                     last_seq) const
+{
+    serializer deser = serializer();
+    size_t     count = 0;
+
+    last_seq = 0;
+
+    auto read_segment = [&data, &deser](std::string& raw_string) {
+        details::deserialize_list(deser, raw_string, data);
+    };
+
+    const rocksdb::Slice prefix(reinterpret_cast<const char*>(key.data()), N);
+
+    std::string     raw_string;
+    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), prefix, &raw_string);
+    if (s.ok()) {
+        read_segment(raw_string);
+        count++;
+    }
+
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions()));
+
+    for (it->Seek(segment_key(key, 0));
+         it->Valid() && it->key().size() == N + kSeqSize
+         && it->key().starts_with(prefix);
+         it->Next()) {
+        raw_string = it->value().ToString();
+        read_segment(raw_string);
+
+        last_seq = segment_seq(it->key());
+        count++;
+    }
+
+    /* LCOV_EXCL_START */
+    if (!it->status().ok()) {
+        logger::logger()->error(
+            "Unable to read the segments of list " + utility::hex_string(key)
+            + "\nRocksdb status: " + it->status().ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return count;
+}
+
+template<typename T, class Serializer>
+template<size_t N>
+bool RockDBListLogStore<T, Serializer>::append(
+    const std::array<uint8_t, N>& key,
+    const std::vector<T>&         data)
+{
+    if (data.empty()) {
+        return true;
+    }
+
+    const std::string serialized_list = serialize(data);
+
+    std::lock_guard<std::mutex> lock(append_mtx_);
+
+    const rocksdb::Slice prefix(reinterpret_cast<const char*>(key.data()), N);
+
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions()));
+    it->SeekForPrev(segment_key(key, UINT64_MAX));
+
+    seq_type seq = 1;
+    if (it->Valid() && it->key().size() == N + kSeqSize
+        && it->key().starts_with(prefix)) {
+        seq = segment_seq(it->key()) + 1;
+    }
+
+    rocksdb::Status s = db_->Put(
+        rocksdb::WriteOptions(), segment_key(key, seq), serialized_list);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error(
+            std::string("Unable to append a segment to the list ")
+            + utility::hex_string(key) + "\nRocksdb status: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
+template<typename T, class Serializer>
+template<size_t N>
+bool RockDBListLogStore<T, Serializer>::compact(
+    const std::array<uint8_t, N>& key,
+    seq_type                      last_seq,
+    const std::vector<T>&         data)
+{
+    const rocksdb::Slice prefix(reinterpret_cast<const char*>(key.data()), N);
+
+    rocksdb::WriteBatch batch;
+
+    // the legacy list, and the segments up to last_seq
+    batch.Delete(prefix);
+
+    std::unique_ptr<rocksdb::Iterator> it(
+        db_->NewIterator(rocksdb::ReadOptions()));
+
+    for (it->Seek(segment_key(key, 0));
+         it->Valid() && it->key().size() == N + kSeqSize
+         && it->key().starts_with(prefix) && segment_seq(it->key()) <= last_seq;
+         it->Next()) {
+        batch.Delete(it->key());
+    }
+
+    // the merged segment replaces the last one, so that it stays before the
+    // segments appended since
+    if (!data.empty()) {
+        batch.Put(segment_key(key, last_seq), serialize(data));
+    }
+
+    rocksdb::Status s = db_->Write(rocksdb::WriteOptions(), &batch);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error(std::string("Unable to compact the list ")
+                                + utility::hex_string(key)
+                                + "\nRocksdb status: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
+template<typename T, class Serializer>
+void RockDBListLogStore<T, Serializer>::flush(bool blocking)
+{
+    rocksdb::Status s = utility::flush_rocksdb(*db_, blocking);
 
     /* LCOV_EXCL_START */
     if (!s.ok()) {
@@ -516,5 +1066,17 @@ void RockDBListStore<T, Serializer>::flush(bool blocking)
     /* LCOV_EXCL_STOP */
 }
 
+template<typename T, class Serializer>
+void RockDBListLogStore<T, Serializer>::finish_bulk_load()
+{
+    rocksdb::Status s = utility::finish_rocksdb_bulk_load(*db_);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB compaction failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+}
+
 } // namespace sophos
 } // namespace sse
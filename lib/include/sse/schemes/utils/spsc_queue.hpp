@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sse {
+
+/// Bounded lock-free queue with a single producer and a single consumer.
+///
+/// The elements are stored in a ring buffer allocated once, whose capacity
+/// is rounded up to a power of 2. The producer calls close() once it is done,
+/// and the consumer stops once done() returns true.
+template<typename T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(size_t capacity);
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    /// Producer side. Returns false if the queue is full, in which case value
+    /// is left untouched.
+    bool try_push(T&& value);
+
+    /// Producer side. Yields until there is room in the queue.
+    void push(T&& value);
+
+    /// Producer side: no element will be pushed anymore.
+    void close();
+
+    /// Consumer side. Returns false if the queue is empty.
+    bool try_pop(T& value);
+
+    /// Consumer side. The queue is closed, and all its elements were popped.
+    bool done() const;
+
+private:
+    // keep the positions of the producer and of the consumer in different
+    // cache lines
+    static constexpr size_t kCacheLineSize = 64;
+
+    std::vector<T> buffer_;
+    const size_t   mask_;
+
+    std::atomic<size_t> head_{0}; // next element to pop
+    char                head_padding_[kCacheLineSize - sizeof(size_t)];
+    std::atomic<size_t> tail_{0}; // next element to push
+    char                tail_padding_[kCacheLineSize - sizeof(size_t)];
+    std::atomic<bool>   closed_{false};
+};
+
+template<typename T>
+constexpr size_t SPSCQueue<T>::kCacheLineSize;
+
+namespace detail {
+inline size_t next_power_of_2(size_t n)
+{
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+} // namespace detail
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(size_t capacity)
+    : buffer_(detail::next_power_of_2(capacity)), mask_(buffer_.size() - 1)
+{
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_push(T&& value)
+{
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+
+    if (tail - head_.load(std::memory_order_acquire) == buffer_.size()) {
+        return false;
+    }
+
+    buffer_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+template<typename T>
+void SPSCQueue<T>::push(T&& value)
+{
+    while (!try_push(std::move(value))) {
+        std::this_thread::yield();
+    }
+}
+
+template<typename T>
+void SPSCQueue<T>::close()
+{
+    closed_.store(true, std::memory_order_release);
+}
+
+template<typename T>
+bool SPSCQueue<T>::try_pop(T& value)
+{
+    const size_t head = head_.load(std::memory_order_relaxed);
+
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    value = std::move(buffer_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+template<typename T>
+bool SPSCQueue<T>::done() const
+{
+    // closed_ must be read first: once it is set, no element can be pushed
+    return closed_.load(std::memory_order_acquire)
+           && head_.load(std::memory_order_relaxed)
+                  == tail_.load(std::memory_order_acquire);
+}
+
+} // namespace sse
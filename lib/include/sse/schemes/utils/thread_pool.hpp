@@ -18,51 +18,356 @@
 //
 //    3. This notice may not be removed or altered from any source
 //    distribution.
+//
+//    This is an altered version of the original software: the single shared
+//    task queue has been replaced by per-worker queues with work stealing,
+//    and tasks are stored in a small-buffer container.
 
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <functional>
 #include <future>
-#include <iostream>
+#include <iterator>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <stdexcept>
 #include <thread>
-#include <unordered_map>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+/// Thread pool with work stealing.
+///
+/// Every worker has its own task queue. Tasks posted by a worker go to its
+/// own queue, tasks posted from other threads are spread over the queues in
+/// a round-robin fashion. A worker runs the tasks of its queue in order, and
+/// when it runs out of tasks, steals tasks from the other queues. Hence the
+/// threads posting tasks and the workers rarely contend on the same lock.
+///
+/// Tasks are stored in a move-only container with an inline buffer: posting
+/// a small callable does not allocate (besides the growth of the queues).
+/// `post` and `post_batch` are fire-and-forget, while `enqueue` returns a
+/// future for the result of the task.
 class ThreadPool
 {
 public:
+    /// Move-only type-erased callable, stored inline when small enough
+    class Task
+    {
+    public:
+        // large enough for a std::function and a few scalars
+        static constexpr size_t kInlineSize = 10 * sizeof(void*);
+
+        Task() noexcept = default;
+
+        template<class F,
+                 class = typename std::enable_if<!std::is_same<
+                     typename std::decay<F>::type,
+                     Task>::value>::type>
+        // cppcheck-suppress noExplicitConstructor
+        Task(F&& f); // NOLINT(bugprone-forwarding-reference-overload)
+
+        Task(Task&& t) noexcept;
+        Task& operator=(Task&& t) noexcept;
+        ~Task();
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        void operator()()
+        {
+            m_ops->invoke(&m_storage);
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_ops != nullptr;
+        }
+
+    private:
+        struct Ops
+        {
+            void (*invoke)(void*);
+            // move the callable from src to dst, and destroy the source
+            void (*relocate)(void* dst, void* src);
+            void (*destroy)(void*);
+        };
+
+        template<class F>
+        struct InlineOps;
+        template<class F>
+        struct HeapOps;
+
+        template<class F>
+        void emplace(F&& f, std::true_type /*fits_inline*/);
+        template<class F>
+        void emplace(F&& f, std::false_type /*fits_inline*/);
+
+        void reset() noexcept;
+
+        using storage_type =
+            typename std::aligned_storage<kInlineSize,
+                                          alignof(std::max_align_t)>::type;
+
+        const Ops*   m_ops{nullptr};
+        storage_type m_storage;
+    };
+
     explicit ThreadPool(uint32_t /*threads*/);
+
+    /// Run f(args...) asynchronously, and return a future for the result
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
 
+    /// Run f asynchronously, without any way to wait for its completion.
+    /// Exceptions thrown by f terminate the program.
+    template<class F>
+    void post(F&& f);
+
+    /// Post the tasks of [first, last) at once. The tasks are split in
+    /// contiguous chunks, one per worker.
+    template<class InputIt>
+    void post_batch(InputIt first, InputIt last);
+
+    size_t size() const noexcept
+    {
+        return workers.size();
+    }
+
+    /// Wait for all the posted tasks, and stop the workers
     void join();
     ~ThreadPool();
 
     static ThreadPool& global_thread_pool();
 
 private:
-    void register_thread(uint32_t id_pool);
+    class WorkerQueue
+    {
+    public:
+        // Must be called with lock held
+        void push(Task&& t);
+        bool pop_front(Task& t);
+        bool pop_back(Task& t);
+
+        std::mutex lock;
+
+    private:
+        void grow();
+
+        // ring buffer of tasks, whose size is a power of 2
+        std::vector<Task> ring;
+        size_t            head{0};
+        size_t            count{0};
+    };
+
+    void worker_loop(uint32_t index);
+
+    // find a task for the index-th worker: first in its own queue, then in
+    // the other ones
+    bool next_task(uint32_t index, Task& task);
+
+    void push_task(Task&& task);
+    void notify_workers(size_t n_tasks);
+
+    // index of the queue in which the calling thread should push its tasks
+    size_t submission_queue();
+
+    void check_running();
+
+    // pool and index of the worker running on the current thread
+    static ThreadPool*& current_pool();
+    static size_t&      current_worker();
 
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
-    // the task queue
-    std::queue<std::function<void()>> tasks;
 
-    size_t max_tasks_size_;
+    std::unique_ptr<WorkerQueue[]> queues;
+    size_t                         queues_count;
 
-    // synchronization
-    std::mutex              queue_mutex;
+    std::atomic<size_t> next_queue{0};
+
+    // number of posted tasks not yet picked by a worker
+    std::atomic<size_t> pending_tasks{0};
+    std::atomic<size_t> idle_workers{0};
+
+    // synchronization of the idle workers
+    std::mutex              sleep_mutex;
     std::condition_variable condition;
-    bool                    stop;
+    std::atomic<bool>       stop{false};
 };
 
+// --- Task ---
+
+template<class F>
+struct ThreadPool::Task::InlineOps
+{
+    static void invoke(void* s)
+    {
+        (*static_cast<F*>(s))();
+    }
+    static void relocate(void* dst, void* src)
+    {
+        new (dst) F(std::move(*static_cast<F*>(src)));
+        static_cast<F*>(src)->~F();
+    }
+    static void destroy(void* s)
+    {
+        static_cast<F*>(s)->~F();
+    }
+
+    static constexpr Ops ops{&invoke, &relocate, &destroy};
+};
+
+template<class F>
+constexpr ThreadPool::Task::Ops ThreadPool::Task::InlineOps<F>::ops;
+
+template<class F>
+struct ThreadPool::Task::HeapOps
+{
+    static F*& ptr(void* s)
+    {
+        return *static_cast<F**>(s);
+    }
+
+    static void invoke(void* s)
+    {
+        (*ptr(s))();
+    }
+    static void relocate(void* dst, void* src)
+    {
+        new (dst) F*(ptr(src));
+    }
+    static void destroy(void* s)
+    {
+        delete ptr(s);
+    }
+
+    static constexpr Ops ops{&invoke, &relocate, &destroy};
+};
+
+template<class F>
+constexpr ThreadPool::Task::Ops ThreadPool::Task::HeapOps<F>::ops;
+
+template<class F, class>
+ThreadPool::Task::Task(F&& f)
+{
+    using callable_type = typename std::decay<F>::type;
+
+    using fits_inline = std::integral_constant<
+        bool,
+        sizeof(callable_type) <= kInlineSize
+            && alignof(storage_type) % alignof(callable_type) == 0
+            && std::is_nothrow_move_constructible<callable_type>::value>;
+
+    emplace(std::forward<F>(f), fits_inline());
+}
+
+template<class F>
+void ThreadPool::Task::emplace(F&& f, std::true_type /*fits_inline*/)
+{
+    using callable_type = typename std::decay<F>::type;
+
+    new (&m_storage) callable_type(std::forward<F>(f));
+    m_ops = &InlineOps<callable_type>::ops;
+}
+
+template<class F>
+void ThreadPool::Task::emplace(F&& f, std::false_type /*fits_inline*/)
+{
+    using callable_type = typename std::decay<F>::type;
+
+    new (&m_storage) callable_type*(new callable_type(std::forward<F>(f)));
+    m_ops = &HeapOps<callable_type>::ops;
+}
+
+inline ThreadPool::Task::Task(Task&& t) noexcept : m_ops(t.m_ops)
+{
+    if (m_ops != nullptr) {
+        m_ops->relocate(&m_storage, &t.m_storage);
+        t.m_ops = nullptr;
+    }
+}
+
+inline ThreadPool::Task& ThreadPool::Task::operator=(Task&& t) noexcept
+{
+    if (this != &t) {
+        reset();
+        m_ops = t.m_ops;
+        if (m_ops != nullptr) {
+            m_ops->relocate(&m_storage, &t.m_storage);
+            t.m_ops = nullptr;
+        }
+    }
+    return *this;
+}
+
+inline ThreadPool::Task::~Task()
+{
+    reset();
+}
+
+inline void ThreadPool::Task::reset() noexcept
+{
+    if (m_ops != nullptr) {
+        m_ops->destroy(&m_storage);
+        m_ops = nullptr;
+    }
+}
+
+// --- WorkerQueue ---
+
+inline void ThreadPool::WorkerQueue::grow()
+{
+    constexpr size_t kInitialCapacity = 64;
+
+    std::vector<Task> new_ring(ring.empty() ? kInitialCapacity
+                                            : 2 * ring.size());
+    for (size_t i = 0; i < count; i++) {
+        new_ring[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+    }
+    ring.swap(new_ring);
+    head = 0;
+}
+
+inline void ThreadPool::WorkerQueue::push(Task&& t)
+{
+    if (count == ring.size()) {
+        grow();
+    }
+    ring[(head + count) & (ring.size() - 1)] = std::move(t);
+    count++;
+}
+
+inline bool ThreadPool::WorkerQueue::pop_front(Task& t)
+{
+    if (count == 0) {
+        return false;
+    }
+    t    = std::move(ring[head]);
+    head = (head + 1) & (ring.size() - 1);
+    count--;
+    return true;
+}
+
+inline bool ThreadPool::WorkerQueue::pop_back(Task& t)
+{
+    if (count == 0) {
+        return false;
+    }
+    count--;
+    t = std::move(ring[(head + count) & (ring.size() - 1)]);
+    return true;
+}
+
+// --- ThreadPool ---
+
 inline ThreadPool& ThreadPool::global_thread_pool()
 {
     static ThreadPool pool(std::thread::hardware_concurrency());
@@ -70,38 +375,163 @@ inline ThreadPool& ThreadPool::global_thread_pool()
     return pool;
 }
 
+inline ThreadPool*& ThreadPool::current_pool()
+{
+    static thread_local ThreadPool* pool = nullptr;
+    return pool;
+}
+
+inline size_t& ThreadPool::current_worker()
+{
+    static thread_local size_t index = 0;
+    return index;
+}
+
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(uint32_t threads)
-    : max_tasks_size_(0), stop(false)
+    : queues(new WorkerQueue[std::max<uint32_t>(threads, 1)]),
+      queues_count(std::max<uint32_t>(threads, 1))
 {
     for (uint32_t i = 0; i < threads; ++i) {
-        workers.emplace_back([this, i] {
-            this->register_thread(i);
-            for (;;) {
-                std::function<void()> task;
-
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock, [this] {
-                        return this->stop || !this->tasks.empty();
-                    });
-                    if (this->stop && this->tasks.empty()) {
-                        return;
-                    }
-
-                    max_tasks_size_ = std::max(max_tasks_size_, tasks.size());
-                    task            = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
-
-                task();
-            }
+        workers.emplace_back([this, i] { this->worker_loop(i); });
+    }
+}
+
+inline void ThreadPool::worker_loop(uint32_t index)
+{
+    current_pool()   = this;
+    current_worker() = index;
+
+    Task task;
+
+    for (;;) {
+        if (next_task(index, task)) {
+            task();
+            // destroy the task (and what it captured) before waiting
+            task = Task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        idle_workers++;
+        condition.wait(lock, [this] {
+            return this->stop.load() || this->pending_tasks.load() > 0;
         });
+        idle_workers--;
+
+        if (stop.load() && pending_tasks.load() == 0) {
+            return;
+        }
+    }
+}
+
+inline bool ThreadPool::next_task(uint32_t index, Task& task)
+{
+    if (pending_tasks.load() == 0) {
+        return false;
+    }
+
+    {
+        WorkerQueue&                q = queues[index];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.pop_front(task)) {
+            pending_tasks--;
+            return true;
+        }
+    }
+
+    // steal from the back of the other queues
+    for (size_t i = 1; i < queues_count; i++) {
+        WorkerQueue&                q = queues[(index + i) % queues_count];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.pop_back(task)) {
+            pending_tasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline size_t ThreadPool::submission_queue()
+{
+    if (current_pool() == this) {
+        return current_worker();
+    }
+    return next_queue.fetch_add(1) % queues_count;
+}
+
+inline void ThreadPool::check_running()
+{
+    // don't allow enqueueing after stopping the pool
+    if (stop.load()) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+}
+
+inline void ThreadPool::notify_workers(size_t n_tasks)
+{
+    // If no worker is idle, the workers will find the tasks before going to
+    // sleep: idle_workers is incremented before pending_tasks is checked.
+    if (idle_workers.load() == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(sleep_mutex);
+    if (n_tasks == 1) {
+        condition.notify_one();
+    } else {
+        condition.notify_all();
     }
 }
 
-inline void ThreadPool::register_thread(uint32_t /*id_pool*/)
+inline void ThreadPool::push_task(Task&& task)
+{
+    check_running();
+
+    // count the task before pushing it, so that the counter never goes below
+    // the number of queued tasks
+    pending_tasks++;
+
+    WorkerQueue& q = queues[submission_queue()];
+    {
+        std::lock_guard<std::mutex> guard(q.lock);
+        q.push(std::move(task));
+    }
+
+    notify_workers(1);
+}
+
+template<class F>
+void ThreadPool::post(F&& f)
+{
+    push_task(Task(std::forward<F>(f)));
+}
+
+template<class InputIt>
+void ThreadPool::post_batch(InputIt first, InputIt last)
 {
+    check_running();
+
+    const size_t n_tasks = std::distance(first, last);
+    if (n_tasks == 0) {
+        return;
+    }
+
+    const size_t chunk_size = (n_tasks + queues_count - 1) / queues_count;
+    const size_t start      = next_queue.fetch_add(1);
+
+    pending_tasks += n_tasks;
+
+    for (size_t c = 0; first != last; c++) {
+        WorkerQueue& q = queues[(start + c) % queues_count];
+
+        std::lock_guard<std::mutex> guard(q.lock);
+        for (size_t i = 0; i < chunk_size && first != last; i++, ++first) {
+            q.push(Task(*first));
+        }
+    }
+
+    notify_workers(n_tasks);
 }
 
 // add new work item to the pool
@@ -111,31 +541,22 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
 {
     using return_type = typename std::result_of<F(Args...)>::type;
 
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
+    // the task is move-only: the packaged_task can be stored directly in it
+    std::packaged_task<return_type()> task(
         // NOLINTNEXTLINE(modernize-avoid-bind)
         std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+    std::future<return_type> res = task.get_future();
 
-        // don't allow enqueueing after stopping the pool
-        if (stop) {
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-        }
+    push_task(Task(std::move(task)));
 
-        tasks.emplace([task]() { (*task)(); });
-    }
-    condition.notify_one();
     return res;
 }
 
 inline void ThreadPool::join()
 {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        //        std::cout << "Current queue size: " << tasks.size() <<
-        //        std::endl;
+        std::lock_guard<std::mutex> guard(sleep_mutex);
         stop = true;
     }
     condition.notify_all();
@@ -144,26 +565,11 @@ inline void ThreadPool::join()
             worker.join();
         }
     }
-
-    //    std::cout << "Maximum queue size: " << max_tasks_size_ << std::endl;
 }
 
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        //        std::cout << "Current queue size: " << tasks.size() <<
-        //        std::endl;
-        stop = true;
-    }
-    condition.notify_all();
-    for (std::thread& worker : workers) {
-        if (worker.joinable()) {
-            worker.join();
-        }
-    }
-
-    std::cout << "Maximum queue size: " << max_tasks_size_ << std::endl;
+    join();
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,81 @@
+#include <sse/schemes/janus/decryption_engine.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <utility>
+
+namespace sse {
+namespace janus {
+
+constexpr size_t DecryptionEngine::kChunkSize;
+
+DecryptionEngine::DecryptionEngine(
+    crypto::punct::punctured_key_type punctured_key,
+    ThreadPool&                       pool,
+    uint8_t                           threads_count)
+    : threads_count_(std::max<uint8_t>(threads_count, 1)),
+      decryptor_(std::move(punctured_key)), pool_(pool)
+{
+}
+
+uint8_t DecryptionEngine::default_threads_count()
+{
+    return static_cast<uint8_t>(std::min<unsigned>(
+        std::max<unsigned>(std::thread::hardware_concurrency(), 1),
+        UINT8_MAX));
+}
+
+void DecryptionEngine::decrypt(const crypto::punct::ciphertext_type* cts,
+                               size_t                                count,
+                               const callback_type&                  callback)
+{
+    auto decrypt_range = [this, cts, &callback](
+                             size_t begin, size_t end, uint8_t t_id) {
+        for (size_t i = begin; i < end; i++) {
+            index_type r;
+            if (decryptor_.decrypt(cts[i], r)) {
+                callback(cts[i], r, t_id);
+            }
+        }
+    };
+
+    if (count <= kChunkSize) {
+        decrypt_range(0, count, 0);
+        return;
+    }
+
+    // the chunks are taken in turn by the tasks, so that a task whose
+    // decryptions are slower does not delay the others
+    std::atomic<size_t> next_chunk{0};
+
+    auto job = [&next_chunk, count, &decrypt_range](uint8_t t_id) {
+        for (size_t begin = next_chunk.fetch_add(kChunkSize);
+             begin < count;
+             begin = next_chunk.fetch_add(kChunkSize)) {
+            decrypt_range(begin, std::min(begin + kChunkSize, count), t_id);
+        }
+    };
+
+    const size_t n_tasks = std::min<size_t>(
+        threads_count_, (count + kChunkSize - 1) / kChunkSize);
+
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(n_tasks);
+    for (size_t t = 0; t < n_tasks; t++) {
+        tasks.push_back(pool_.enqueue(job, static_cast<uint8_t>(t)));
+    }
+
+    // wait for all the tasks before rethrowing an exception: they use
+    // variables of this frame
+    for (auto& task : tasks) {
+        task.wait();
+    }
+    for (auto& task : tasks) {
+        task.get();
+    }
+}
+
+} // namespace janus
+} // namespace sse
@@ -6,9 +6,16 @@
 //  Copyright © 2017 Raphael Bost. All rights reserved.
 //
 
+#include <sse/schemes/janus/decryption_engine.hpp>
 #include <sse/schemes/janus/janus_server.hpp>
+#include <sse/schemes/utils/result_collector.hpp>
 
-#include <set>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <list>
+#include <vector>
 
 namespace sse {
 namespace sophos {
@@ -65,6 +72,77 @@ struct serialization<janus::JanusServer::cached_result_type>
 
         return true;
     }
+
+    // The lists are written in bulk, as the array of the indices followed
+    // by the array of the tags
+    std::string serialize_list(
+        const janus::JanusServer::cached_result_type* data,
+        size_t                                        count)
+    {
+        std::string out;
+        out.reserve(utility::kListHeaderMagicSize + 1 + utility::kMaxVarintSize
+                    + count * kElementSize);
+        utility::append_list_header(out, utility::ListFormat::Columns, count);
+
+        const size_t indices_begin = out.size();
+        out.resize(indices_begin + count * kElementSize);
+
+        char* indices = &out[indices_begin];
+        char* tags    = indices + count * sizeof(janus::index_type);
+        for (size_t i = 0; i < count; i++) {
+            std::memcpy(indices + i * sizeof(janus::index_type),
+                        &data[i].first,
+                        sizeof(janus::index_type));
+            std::memcpy(tags + i * crypto::punct::kTagSize,
+                        data[i].second.data(),
+                        crypto::punct::kTagSize);
+        }
+        return out;
+    }
+    bool deserialize_list(
+        const char*                                          data,
+        size_t                                               size,
+        std::vector<janus::JanusServer::cached_result_type>& out)
+    {
+        const char*         begin = data;
+        const char*         end   = data + size;
+        utility::ListFormat format;
+        size_t              count;
+
+        if (!utility::read_list_header(begin, end, format, count)
+            || format != utility::ListFormat::Columns
+            || count != static_cast<size_t>(end - begin) / kElementSize
+            || static_cast<size_t>(end - begin) % kElementSize != 0) {
+            return false;
+        }
+
+        const char*  indices  = begin;
+        const char*  tags     = indices + count * sizeof(janus::index_type);
+        const size_t old_size = out.size();
+        out.resize(old_size + count);
+
+        for (size_t i = 0; i < count; i++) {
+            auto& res = out[old_size + i];
+            std::memcpy(&res.first,
+                        indices + i * sizeof(janus::index_type),
+                        sizeof(janus::index_type));
+            std::memcpy(res.second.data(),
+                        tags + i * crypto::punct::kTagSize,
+                        crypto::punct::kTagSize);
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t kElementSize
+        = sizeof(janus::index_type) + crypto::punct::kTagSize;
+};
+
+// the legacy serialization of the tags is their raw bytes
+template<>
+struct serialization<crypto::punct::tag_type>
+    : public binary_serialization<crypto::punct::tag_type>
+{
 };
 
 } // namespace sophos
@@ -72,6 +150,15 @@ struct serialization<janus::JanusServer::cached_result_type>
 namespace sse {
 namespace janus {
 
+// The logs of cached results of a keyword are compacted once they have more
+// than kMaxCacheSegments segments, or when more than 1/kTombstoneRatio of
+// their results have a tombstone.
+constexpr size_t kMaxCacheSegments = 32;
+constexpr size_t kTombstoneRatio   = 4;
+
+// Minimum number of cached results filtered by each thread
+constexpr size_t kMinFilterRangeSize = 1 << 14;
+
 
 //        static inline std::string insertion_db_path(const std::string &path)
 //        {
@@ -87,18 +174,31 @@ JanusServer::JanusServer(const std::string& db_add_path,
                          const std::string& db_del_path,
                          const std::string& db_cache_path)
     : insertion_server_(db_add_path), deletion_server_(db_del_path),
-      cached_results_edb_(db_cache_path)
+      cached_results_edb_(db_cache_path),
+      tombstones_edb_(db_cache_path + ".tombstones"),
+      search_pool_(DecryptionEngine::default_threads_count()),
+      compaction_pool_(1)
 {
 }
 
 
 std::list<index_type> JanusServer::search(SearchRequest& req)
 {
-    std::list<crypto::punct::ciphertext_type> insertions
-        = insertion_server_.search(req.insertion_search_request, true);
+    std::vector<index_type> results;
+    search(req, results);
 
-    std::list<crypto::punct::key_share_type> key_shares
-        = deletion_server_.search(req.deletion_search_request, true);
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void JanusServer::search(SearchRequest& req, std::vector<index_type>& results)
+{
+    std::vector<crypto::punct::ciphertext_type> insertions;
+    insertion_server_.search(req.insertion_search_request, insertions, true);
+
+    // the first key share must be the first element of the punctured key
+    std::vector<crypto::punct::key_share_type> key_shares;
+    key_shares.push_back(req.first_key_share);
+    deletion_server_.search(req.deletion_search_request, key_shares, true);
 
     // std::list<crypto::punct::ciphertext_type> insertions
     //     = insertion_server_.search_parallel(
@@ -108,11 +208,9 @@ std::list<index_type> JanusServer::search(SearchRequest& req)
     //     = deletion_server_.search_parallel(
     //         req.deletion_search_request, 8, true);
 
-    key_shares.push_front(req.first_key_share);
-
     // construct a set of newly removed tags
-    std::set<crypto::punct::tag_type> removed_tags;
-    auto                              sk_it = key_shares.begin();
+    TagSet removed_tags(key_shares.size());
+    auto   sk_it = key_shares.begin();
     ++sk_it; // skip the first element
     for (; sk_it != key_shares.end(); ++sk_it) {
         auto tag = crypto::punct::extract_tag(*sk_it);
@@ -120,65 +218,67 @@ std::list<index_type> JanusServer::search(SearchRequest& req)
         removed_tags.insert(tag);
     }
 
-    crypto::PuncturableDecryption decryptor(crypto::punct::punctured_key_type{
-        std::make_move_iterator(std::begin(key_shares)),
-        std::make_move_iterator(std::end(key_shares))});
-
-
-    std::list<index_type>         results;
-    std::list<cached_result_type> cached_res_list;
-
-    // get previously cached elements
-    cached_results_edb_.get(req.keyword_token, cached_res_list);
-
-
-    // filter the previously cached elements to remove newly removed entries
-    auto it = cached_res_list.begin();
-
-    while (it != cached_res_list.end()) {
-        if (removed_tags.count(it->second) > 0) {
-            it = cached_res_list.erase(it);
-        } else {
-            results.push_back(it->first);
-            ++it;
-        }
+    // decrypt the insertions on all the cores
+    DecryptionEngine decryption_engine(
+        crypto::punct::punctured_key_type{
+            std::make_move_iterator(std::begin(key_shares)),
+            std::make_move_iterator(std::end(key_shares))},
+        search_pool_,
+        DecryptionEngine::default_threads_count());
+
+    ResultCollector<cached_result_type> new_results;
+    decryption_engine.decrypt(
+        insertions,
+        [&new_results](const crypto::punct::ciphertext_type& ct,
+                       index_type                            r,
+                       uint8_t /*thread_id*/) {
+            new_results.push(
+                cached_result_type(r, crypto::punct::extract_tag(ct)));
+        });
+
+    CachedResults cache;
+    read_cache(req.keyword_token, cache);
+
+    const std::vector<crypto::punct::tag_type> tombstones = filter_cache(
+        cache, removed_tags, DecryptionEngine::default_threads_count());
+
+    const std::vector<cached_result_type> new_cache = new_results.to_vector();
+
+    results.reserve(results.size() + cache.results.size() + new_cache.size());
+    for (const auto& res : cache.results) {
+        results.push_back(res.first);
     }
-
-
-    for (auto ct : insertions) {
-        index_type r;
-        if (decryptor.decrypt(ct, r)) {
-            results.push_back(r);
-            cached_res_list.emplace_back(r, crypto::punct::extract_tag(ct));
-        }
+    for (const auto& res : new_cache) {
+        results.push_back(res.first);
     }
 
-    // store results in the cache
-    cached_results_edb_.put(req.keyword_token, cached_res_list);
-
-
-    return results;
+    update_cache(req.keyword_token, cache, tombstones, new_cache);
 }
 
 std::list<index_type> JanusServer::search_parallel(SearchRequest& req,
                                                    uint8_t diana_threads_count)
 {
-    // use one result list per thread so to avoid using locks
-    std::vector<std::list<index_type>> result_lists(diana_threads_count + 1);
+    std::vector<index_type> results;
+    search_parallel(req, diana_threads_count, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void JanusServer::search_parallel(SearchRequest&           req,
+                                  uint8_t                  diana_threads_count,
+                                  std::vector<index_type>& results)
+{
+    // every thread fills its own buffer, which avoids using locks
+    ResultCollector<index_type> collector;
 
-    auto callback = [&result_lists](index_type i, uint8_t thread_id) {
-        result_lists[thread_id].push_back(i);
+    auto callback = [&collector](index_type i, uint8_t /*thread_id*/) {
+        collector.push(i);
     };
 
     search_parallel(req, diana_threads_count, callback);
 
-    // merge the result lists
-    std::list<index_type> results(std::move(result_lists[0]));
-    for (size_t i = 1; i < result_lists.size(); i++) {
-        results.splice(results.end(), result_lists[i]);
-    }
-
-    return results;
+    results.reserve(results.size() + collector.size());
+    collector.drain(std::back_inserter(results));
 }
 
 void JanusServer::search_parallel(
@@ -197,98 +297,233 @@ void JanusServer::search_parallel(
     uint8_t                                         diana_threads_count,
     const std::function<void(index_type, uint8_t)>& post_callback)
 {
-    // start by retrieving the key shares
-    std::list<crypto::punct::key_share_type> key_shares
-        = deletion_server_.search_parallel(
-            req.deletion_search_request, diana_threads_count, true);
+    diana_threads_count = std::max<uint8_t>(diana_threads_count, 1);
+
+    // fetch concurrently the key shares, the cached results and the
+    // insertion ciphertexts, the latter in this thread
+    std::list<crypto::punct::key_share_type> key_shares;
+    std::future<void> deletion_task = search_pool_.enqueue(
+        [this, &req, &key_shares, diana_threads_count]() {
+            key_shares = deletion_server_.search_parallel(
+                req.deletion_search_request, diana_threads_count, true);
+        });
+
+    CachedResults cache;
+
+    std::future<void> cache_task = search_pool_.enqueue(
+        [this, &req, &cache]() { read_cache(req.keyword_token, cache); });
+
+    ResultCollector<crypto::punct::ciphertext_type> insertions_collector;
+    insertion_server_.search_parallel(
+        req.insertion_search_request,
+        [&insertions_collector](size_t /*i*/,
+                                crypto::punct::ciphertext_type ct,
+                                uint8_t /*thread_id*/) {
+            insertions_collector.push(ct);
+        },
+        diana_threads_count,
+        true);
+    const std::vector<crypto::punct::ciphertext_type> insertions
+        = insertions_collector.to_vector();
+
+    // wait for both tasks before rethrowing an exception: they use
+    // variables of this frame
+    deletion_task.wait();
+    cache_task.wait();
+    deletion_task.get();
+    cache_task.get();
 
     key_shares.push_front(req.first_key_share);
 
+    // construct a set of newly removed tags
+    TagSet removed_tags(key_shares.size());
+    auto   sk_it = key_shares.begin();
+    ++sk_it; // skip the first element
+    for (; sk_it != key_shares.end(); ++sk_it) {
+        auto tag = crypto::punct::extract_tag(*sk_it);
+        logger::logger()->debug("Tag " + utility::hex_string(tag) + " removed");
+        removed_tags.insert(tag);
+    }
+
+    // filter the previously cached elements to remove newly removed entries.
+    // This job has id diana_threads_count
+    const std::vector<crypto::punct::tag_type> tombstones
+        = filter_cache(cache, removed_tags, diana_threads_count);
 
-    crypto::PuncturableDecryption decryptor(crypto::punct::punctured_key_type{
-        std::make_move_iterator(std::begin(key_shares)),
-        std::make_move_iterator(std::end(key_shares))});
-
-    std::list<cached_result_type> new_cache;
-    std::list<cached_result_type> filtered_cache;
-    std::mutex                    cache_mtx;
-
-    auto decryption_callback
-        = [&decryptor, &post_callback, &new_cache, &cache_mtx](
-              crypto::punct::ciphertext_type ct, uint8_t i) {
-              index_type r;
-              if (decryptor.decrypt(ct, r)) {
-                  post_callback(r, i);
-
-                  cache_mtx.lock();
-                  new_cache.emplace_back(r, crypto::punct::extract_tag(ct));
-                  cache_mtx.unlock();
-              }
-          };
-
-    auto decryption_callback_unique
-        = [&decryption_callback](crypto::punct::ciphertext_type ct) {
-              decryption_callback(ct, 0);
-          };
-
-    // this job will be used to retrieve cached results and filter them
-    auto cached_res_job = [this,
-                           &req,
-                           &key_shares,
-                           &post_callback,
-                           &diana_threads_count,
-                           &filtered_cache]() {
-        // construct a set of newly removed tags
-        std::set<crypto::punct::tag_type> removed_tags;
-        auto                              sk_it = key_shares.begin();
-        ++sk_it; // skip the first element
-        for (; sk_it != key_shares.end(); ++sk_it) {
-            auto tag = crypto::punct::extract_tag(*sk_it);
-            logger::logger()->debug("Tag " + utility::hex_string(tag)
-                                    + " removed");
-            removed_tags.insert(tag);
-        }
+    for (const auto& res : cache.results) {
+        post_callback(res.first, diana_threads_count);
+    }
+
+    DecryptionEngine decryption_engine(
+        crypto::punct::punctured_key_type{
+            std::make_move_iterator(std::begin(key_shares)),
+            std::make_move_iterator(std::end(key_shares))},
+        search_pool_,
+        diana_threads_count);
+
+    ResultCollector<cached_result_type> new_results;
+    decryption_engine.decrypt(
+        insertions,
+        [&post_callback, &new_results](const crypto::punct::ciphertext_type& ct,
+                                       index_type                            r,
+                                       uint8_t t_id) {
+            post_callback(r, t_id);
+
+            new_results.push(
+                cached_result_type(r, crypto::punct::extract_tag(ct)));
+        });
+
+    update_cache(req.keyword_token, cache, tombstones, new_results.to_vector());
+}
 
+void JanusServer::read_cache(const keyword_token_type& keyword_token,
+                             CachedResults&            cache)
+{
+    std::vector<crypto::punct::tag_type> tombstones;
+    sophos::RockDBListLogStore<cached_result_type>::seq_type last_seq;
 
-        // get previously cached elements
-        cached_results_edb_.get(req.keyword_token, filtered_cache);
+    std::lock_guard<std::mutex> lock(cache_mtx_);
 
-        // filter the previously cached elements to remove newly removed entries
-        auto it = filtered_cache.begin();
+    cache.segments_count
+        = cached_results_edb_.get(keyword_token, cache.results, last_seq)
+          + tombstones_edb_.get(keyword_token, tombstones, last_seq);
 
-        while (it != filtered_cache.end()) {
-            if (removed_tags.count(it->second) > 0) {
-                it = filtered_cache.erase(it);
-            } else {
-                post_callback(
-                    it->first,
-                    diana_threads_count); // this job has id diana_threads_count
-                ++it;
-            }
-        }
+    cache.stored_results_count = cache.results.size();
+    cache.tombstones           = TagSet(tombstones.size());
+    for (const auto& tag : tombstones) {
+        cache.tombstones.insert(tag);
+    }
+}
+
+std::vector<crypto::punct::tag_type> JanusServer::filter_cache(
+    CachedResults& cache,
+    const TagSet&  removed_tags,
+    uint8_t        threads_count)
+{
+    std::vector<cached_result_type>& results = cache.results;
+
+    const size_t ranges_count = std::max<size_t>(
+        std::min<size_t>(threads_count, results.size() / kMinFilterRangeSize),
+        1);
+    const size_t range_size
+        = (results.size() + ranges_count - 1) / ranges_count;
+
+    std::vector<size_t> range_ends(ranges_count);
+    std::vector<std::vector<crypto::punct::tag_type>> range_tombstones(
+        ranges_count);
+
+    auto filter_range = [&](size_t r) {
+        const size_t begin = std::min(r * range_size, results.size());
+        const size_t end   = std::min(begin + range_size, results.size());
+        std::vector<crypto::punct::tag_type>& new_tombstones
+            = range_tombstones[r];
+
+        auto new_end = std::remove_if(
+            results.begin() + begin,
+            results.begin() + end,
+            [&cache, &removed_tags, &new_tombstones](
+                const cached_result_type& res) {
+                if (cache.tombstones.contains(res.second)) {
+                    return true;
+                }
+                if (removed_tags.contains(res.second)) {
+                    new_tombstones.push_back(res.second);
+                    return true;
+                }
+                return false;
+            });
+        range_ends[r] = static_cast<size_t>(new_end - results.begin());
     };
 
+    std::vector<std::future<void>> tasks;
+    for (size_t r = 1; r < ranges_count; r++) {
+        tasks.push_back(search_pool_.enqueue(filter_range, r));
+    }
+    filter_range(0);
+    for (auto& task : tasks) {
+        task.wait();
+    }
+    for (auto& task : tasks) {
+        task.get();
+    }
 
-    // start the cached result job
-    std::thread cache_thread = std::thread(cached_res_job);
+    // move the remaining results of every range after the ones of the
+    // previous ranges
+    auto out = results.begin() + range_ends[0];
+    for (size_t r = 1; r < ranges_count; r++) {
+        auto begin = results.begin() + std::min(r * range_size, results.size());
+        out        = std::move(begin, results.begin() + range_ends[r], out);
+    }
+    results.erase(out, results.end());
+
+    std::vector<crypto::punct::tag_type> new_tombstones
+        = std::move(range_tombstones[0]);
+    for (size_t r = 1; r < ranges_count; r++) {
+        new_tombstones.insert(new_tombstones.end(),
+                              range_tombstones[r].begin(),
+                              range_tombstones[r].end());
+    }
 
+    return new_tombstones;
+}
 
-    // wait for the cache thread to finish
-    cache_thread.join();
+void JanusServer::update_cache(
+    const keyword_token_type&                   keyword_token,
+    const CachedResults&                        cache,
+    const std::vector<crypto::punct::tag_type>& tombstones,
+    const std::vector<cached_result_type>&      new_results)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache_mtx_);
 
-    // run the search on the insertion SE with the decryption_callback
-    // we have to start the cache_thread first because the next call is blocking
-    //            insertion_server_.search_parallel(req.insertion_search_request,
-    //            decryption_callback, threads_count-1); // one thread is
-    //            already in use
-    insertion_server_.search(req.insertion_search_request,
-                             decryption_callback_unique);
+        // the tombstones first: the removed key shares are not in the
+        // deletion database anymore
+        tombstones_edb_.append(keyword_token, tombstones);
+        cached_results_edb_.append(keyword_token, new_results);
+    }
 
-    // merge the new result list with the filtered cache
-    new_cache.splice(new_cache.end(), filtered_cache);
+    const size_t segments_count = cache.segments_count
+                                  + (tombstones.empty() ? 0 : 1)
+                                  + (new_results.empty() ? 0 : 1);
+    const size_t tombstones_count
+        = cache.tombstones.size() + tombstones.size();
+    const size_t results_count
+        = cache.stored_results_count + new_results.size();
+
+    if (segments_count > kMaxCacheSegments
+        || kTombstoneRatio * tombstones_count > results_count) {
+        keyword_token_type kw = keyword_token;
+        compaction_pool_.post([this, kw]() { compact_cache(kw); });
+    }
+}
 
-    // store results in the cache
-    cached_results_edb_.put(req.keyword_token, new_cache);
+void JanusServer::compact_cache(const keyword_token_type& keyword_token)
+{
+    CachedResults cache;
+    sophos::RockDBListLogStore<cached_result_type>::seq_type results_seq;
+    sophos::RockDBListLogStore<cached_result_type>::seq_type tombstones_seq;
+    std::vector<crypto::punct::tag_type>                     tombstones;
+
+    std::lock_guard<std::mutex> lock(cache_mtx_);
+
+    cached_results_edb_.get(keyword_token, cache.results, results_seq);
+    tombstones_edb_.get(keyword_token, tombstones, tombstones_seq);
+    cache.tombstones = TagSet(tombstones.size());
+    for (const auto& tag : tombstones) {
+        cache.tombstones.insert(tag);
+    }
+
+    // in the background: a single thread is enough
+    filter_cache(cache, TagSet(), 1);
+
+    logger::logger()->debug("Compacting the cache of keyword "
+                            + utility::hex_string(keyword_token));
+
+    // the dead results first, and then their tombstones
+    if (cached_results_edb_.compact(
+            keyword_token, results_seq, cache.results)) {
+        tombstones_edb_.compact(keyword_token, tombstones_seq, {});
+    }
 }
 
 
@@ -75,6 +75,13 @@ rocksdb::Options GenericRocksDBStoreParams::make_rocksdb_regular_table_options()
     return options;
 }
 
+rocksdb::Options GenericRocksDBStoreParams::make_rocksdb_profile_options(
+    const utility::RocksDBProfile& profile)
+{
+    // the stored values are fixed-size arrays
+    return profile.to_options(true);
+}
+
 GenericRocksDBStore::GenericRocksDBStore(
     const GenericRocksDBStoreParams& params)
     : db(nullptr)
@@ -100,11 +107,7 @@ GenericRocksDBStore::GenericRocksDBStore(
 
 void GenericRocksDBStore::commit()
 {
-    rocksdb::FlushOptions options;
-
-    options.wait = true;
-
-    rocksdb::Status s = db->Flush(options);
+    rocksdb::Status s = utility::flush_rocksdb(*db, true);
 
     /* LCOV_EXCL_START */
     if (!s.ok()) {
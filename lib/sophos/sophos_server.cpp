@@ -21,31 +21,100 @@
 
 #include <sse/schemes/sophos/sophos_server.hpp>
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/result_collector.hpp>
+#include <sse/schemes/utils/spsc_queue.hpp>
 #include <sse/schemes/utils/thread_pool.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace sse {
 namespace sophos {
 
+namespace {
+// Number of update tokens derived by an RSA thread before they are handed to
+// the access threads
+constexpr size_t kTokenBlockSize = 32;
 
-SophosServer::SophosServer(const std::string& db_path,
-                           const std::string& tdp_pk)
+// Number of blocks an RSA thread can derive ahead of the access threads
+constexpr size_t kTokenQueueCapacity = 16;
+
+struct TokenBlock
+{
+    std::array<update_token_type, kTokenBlockSize>                     tokens;
+    std::array<std::array<uint8_t, kUpdateTokenSize>, kTokenBlockSize> masks;
+    size_t                                                             count{0};
+};
+
+// Wakes up an access thread once one of its queues has a new block or is
+// closed. The access thread only sleeps after a pass over its queues popped
+// nothing, and rings tells it whether a block arrived in the meantime.
+struct Doorbell
+{
+    std::mutex              mtx;
+    std::condition_variable cv;
+    uint64_t                rings{0};
+
+    void ring()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            rings++;
+        }
+        cv.notify_one();
+    }
+
+    uint64_t rings_count()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return rings;
+    }
+
+    // wait until the bell rang more than seen times
+    void wait(uint64_t seen)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this, seen]() { return rings != seen; });
+    }
+};
+} // namespace
+
+template<class EDB>
+BasicSophosServer<EDB>::BasicSophosServer(const std::string& db_path,
+                                          const std::string& tdp_pk)
     : edb_(db_path),
       public_tdp_(tdp_pk, 2 * std::thread::hardware_concurrency())
 {
 }
 
-std::string SophosServer::public_key() const
+template<class EDB>
+std::string BasicSophosServer<EDB>::public_key() const
 {
     return public_tdp_.public_key();
 }
 
-std::list<index_type> SophosServer::search(SearchRequest& req)
+template<class EDB>
+std::list<index_type> BasicSophosServer<EDB>::search(SearchRequest& req)
 {
-    std::list<index_type> results;
+    std::vector<index_type> results;
+    search(req, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::search(SearchRequest&           req,
+                                    std::vector<index_type>& results)
+{
+    results.reserve(results.size() + req.add_count);
 
     search_token_type st = req.token;
 
@@ -85,10 +154,10 @@ std::list<index_type> SophosServer::search(SearchRequest& req)
         st = public_tdp_.eval(st);
     }
 
-    return results;
-} // namespace sophos
+}
 
-void SophosServer::search_callback(
+template<class EDB>
+void BasicSophosServer<EDB>::search_callback(
     SearchRequest&                         req,
     const std::function<void(index_type)>& post_callback)
 {
@@ -126,108 +195,66 @@ void SophosServer::search_callback(
     }
 }
 
-std::list<index_type> SophosServer::search_parallel(SearchRequest& req,
-                                                    uint8_t access_threads)
+template<class EDB>
+std::list<index_type> BasicSophosServer<EDB>::search_parallel(
+    SearchRequest& req,
+    uint8_t        access_threads)
 {
-    std::list<index_type> results;
-    std::mutex            res_mutex;
+    std::vector<index_type> results;
+    search_parallel(req, access_threads, results);
 
-    search_token_type st = req.token;
+    return std::list<index_type>(results.begin(), results.end());
+}
 
+template<class EDB>
+void BasicSophosServer<EDB>::search_parallel(
+    SearchRequest&           req,
+    uint8_t                  access_threads,
+    std::vector<index_type>& results)
+{
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
                             + utility::hex_string(req.derivation_key));
 
+    ResultCollector<index_type> collector;
 
-    crypto::Prf<kUpdateTokenSize> derivation_prf(
-        crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
-
-    ThreadPool access_pool(access_threads);
-
-    auto access_job = [&derivation_prf, this, &results, &res_mutex](
-                          const std::string& st_string) {
-        update_token_type                     token;
-        std::array<uint8_t, kUpdateTokenSize> mask;
-        gen_update_token_masks(
-            derivation_prf,
-            reinterpret_cast<const uint8_t*>(st_string.data()),
-            token,
-            mask);
-
-        index_type r;
-
-        logger::logger()->debug("Derived token: " + utility::hex_string(token));
-
-        bool found = edb_.get(token, r);
-
-        if (found) {
-            logger::logger()->debug("Found: " + utility::hex_string(r));
-        } else {
-            /* LCOV_EXCL_START */
-            logger::logger()->error("We were supposed to find something!");
-            return;
-            /* LCOV_EXCL_STOP */
-        }
-
-        index_type v = utility::xor_mask(r, mask);
-
-        res_mutex.lock();
-        results.push_back(v);
-        res_mutex.unlock();
-    };
-
-
-    // the rsa job launched with input index,max computes all the RSA tokens of
-    // order i + kN up to max
-    auto rsa_job = [this, &st, &access_job, &access_pool](
-                       const uint8_t index, const size_t max, const uint8_t N) {
-        search_token_type local_st = st;
-        if (index != 0) {
-            local_st = public_tdp_.eval(local_st, index);
-        }
-
-        if (index < max) {
-            // this is a valid search token, we have to derive it and do a
-            // lookup
-            std::string st_string(reinterpret_cast<char*>(local_st.data()),
-                                  local_st.size());
-            access_pool.enqueue(access_job, st_string);
-        }
-
-        for (size_t i = index + N; i < max; i += N) {
-            local_st = public_tdp_.eval(local_st, N);
-
-            std::string st_string(reinterpret_cast<char*>(local_st.data()),
-                                  local_st.size());
-            access_pool.enqueue(access_job, st_string);
+    auto results_callback = [&collector](const index_type* r, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            collector.push(r[i]);
         }
     };
 
-    std::vector<std::thread> rsa_threads;
-
     // use at least two threads to make the RSA computations
-    unsigned n_rsa_threads
-        = std::max<unsigned>(std::thread::hardware_concurrency(), 2);
+    uint8_t n_rsa_threads = static_cast<uint8_t>(
+        std::min<unsigned>(std::max<unsigned>(
+                               std::thread::hardware_concurrency(), 2),
+                           UINT8_MAX));
 
-    for (unsigned t = 0; t < n_rsa_threads; t++) {
-        rsa_threads.emplace_back(rsa_job, t, req.add_count, n_rsa_threads);
-    }
+    pipelined_lookup(req, n_rsa_threads, access_threads, results_callback);
 
-    for (unsigned t = 0; t < n_rsa_threads; t++) {
-        rsa_threads[t].join();
-    }
+    results.reserve(results.size() + collector.size());
+    collector.drain(std::back_inserter(results));
+}
 
-    access_pool.join();
+template<class EDB>
+std::list<index_type> BasicSophosServer<EDB>::search_parallel_light(
+    SearchRequest& req,
+    uint8_t        thread_count)
+{
+    std::vector<index_type> results;
+    search_parallel_light(req, thread_count, results);
 
-    return results;
+    return std::list<index_type>(results.begin(), results.end());
 }
 
-std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
-                                                          uint8_t thread_count)
+template<class EDB>
+void BasicSophosServer<EDB>::search_parallel_light(
+    SearchRequest&           req,
+    uint8_t                  thread_count,
+    std::vector<index_type>& results)
 {
-    search_token_type     st = req.token;
-    std::list<index_type> results;
-    std::mutex            res_mutex;
+    search_token_type           st = req.token;
+    ResultCollector<index_type> collector;
 
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
@@ -236,7 +263,7 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
     crypto::Prf<kUpdateTokenSize> derivation_prf(
         crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
 
-    auto derive_access = [&derivation_prf, this, &results, &res_mutex](
+    auto derive_access = [&derivation_prf, this, &collector](
                              const search_token_type st, size_t i) {
         update_token_type                     token;
         std::array<uint8_t, kUpdateTokenSize> mask;
@@ -252,12 +279,7 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
         if (found) {
             logger::logger()->debug("Found: " + utility::hex_string(r));
 
-            index_type v = utility::xor_mask(r, mask);
-
-            res_mutex.lock();
-            results.push_back(v);
-            res_mutex.unlock();
-
+            collector.push(utility::xor_mask(r, mask));
         } else {
             /* LCOV_EXCL_START */
             logger::logger()->error(
@@ -306,100 +328,256 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
         rsa_threads[t].join();
     }
 
-    return results;
+    results.reserve(results.size() + collector.size());
+    collector.drain(std::back_inserter(results));
 }
 
-void SophosServer::search_parallel_callback(
+template<class EDB>
+void BasicSophosServer<EDB>::search_parallel_callback(
     SearchRequest&                  req,
     std::function<void(index_type)> post_callback,
     uint8_t                         rsa_thread_count,
     uint8_t                         access_thread_count,
     uint8_t                         post_thread_count)
 {
-    search_token_type st = req.token;
-
-
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
                             + utility::hex_string(req.derivation_key));
 
-    crypto::Prf<kUpdateTokenSize> derivation_prf(
-        crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
+    if (post_thread_count == 0) {
+        auto results_callback
+            = [&post_callback](const index_type* r, size_t count) {
+                  for (size_t i = 0; i < count; i++) {
+                      post_callback(r[i]);
+                  }
+              };
+
+        pipelined_lookup(
+            req, rsa_thread_count, access_thread_count, results_callback);
+        return;
+    }
 
-    ThreadPool access_pool(access_thread_count);
     ThreadPool post_pool(post_thread_count);
 
-    auto access_job = [&derivation_prf, this, &post_pool, &post_callback](
-                          const search_token_type st, size_t i) {
-        update_token_type                     token;
-        std::array<uint8_t, kUpdateTokenSize> mask;
-        gen_update_token_masks(derivation_prf, st.data(), token, mask);
+    // the results of a block are passed to the post callback by a single task
+    auto results_callback
+        = [&post_pool, &post_callback](const index_type* r, size_t count) {
+              std::vector<index_type> block(r, r + count);
 
-        index_type r;
+              post_pool.post([&post_callback, block = std::move(block)]() {
+                  for (index_type v : block) {
+                      post_callback(v);
+                  }
+              });
+          };
 
-        logger::logger()->debug("Derived token: " + utility::hex_string(token));
+    pipelined_lookup(
+        req, rsa_thread_count, access_thread_count, results_callback);
 
-        bool found = edb_.get(token, r);
+    post_pool.join();
+}
 
-        if (found) {
-            logger::logger()->debug("Found: " + utility::hex_string(r));
+template<class EDB>
+void BasicSophosServer<EDB>::pipelined_lookup(
+    SearchRequest&            req,
+    uint8_t                   rsa_thread_count,
+    uint8_t                   access_thread_count,
+    const results_block_type& results_callback)
+{
+    if (req.add_count == 0) {
+        return;
+    }
 
-            index_type v = utility::xor_mask(r, mask);
+    rsa_thread_count    = std::max<uint8_t>(rsa_thread_count, 1);
+    access_thread_count = std::min(std::max<uint8_t>(access_thread_count, 1),
+                                   rsa_thread_count);
 
-            post_pool.enqueue(post_callback, v);
+    const size_t add_count = req.add_count;
 
-        } else {
-            /* LCOV_EXCL_START */
-            logger::logger()->error(
-                "We were supposed to find a value mapped to key "
-                + utility::hex_string(token) + " (" + std::to_string(i)
-                + "-th derived key from search token " + utility::hex_string(st)
-                + ")");
-            /* LCOV_EXCL_STOP */
-        }
-    };
+    // the keys of the checkpoints must be derived before the derivation PRF
+    // is constructed, as it erases the derivation key
+    std::unique_ptr<TdpCheckpointIndex::KeywordKeys> checkpoint_keys;
+    std::vector<search_token_type>                   checkpoints;
+    std::vector<search_token_type>                   new_checkpoints;
+    size_t                                           interval = 0;
 
+    if (checkpoints_) {
+        checkpoint_keys.reset(
+            new TdpCheckpointIndex::KeywordKeys(req.derivation_key));
 
-    // the rsa job launched with input index,max computes all the RSA tokens of
-    // order i + kN up to max
-    auto rsa_job = [this, &st, &access_job, &access_pool](
-                       const uint8_t index, const size_t max, const uint8_t N) {
-        search_token_type local_st = st;
-        if (index != 0) {
+        interval                   = checkpoints_->interval();
+        const size_t segment_count = add_count / interval;
+
+        checkpoints = checkpoints_->get(*checkpoint_keys, segment_count);
+        new_checkpoints.resize(segment_count - checkpoints.size());
+    }
+
+    // number of tokens at the head of the chain (i.e. the most recent ones),
+    // which are not covered by a checkpoint
+    const size_t head_count = add_count - checkpoints.size() * interval;
+
+    crypto::Prf<kUpdateTokenSize> derivation_prf(
+        crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
+
+    // one queue per RSA thread, and one doorbell per access thread
+    std::vector<std::unique_ptr<SPSCQueue<TokenBlock>>> queues;
+    for (uint8_t t = 0; t < rsa_thread_count; t++) {
+        queues.emplace_back(new SPSCQueue<TokenBlock>(kTokenQueueCapacity));
+    }
+    std::vector<std::unique_ptr<Doorbell>> doorbells;
+    for (uint8_t t = 0; t < access_thread_count; t++) {
+        doorbells.emplace_back(new Doorbell());
+    }
+
+    // the RSA thread index computes the search tokens of the head of order
+    // index + kN, and walks the segments of order index + kN from their
+    // checkpoints. It derives their update tokens and masks, and hands them
+    // by blocks to the access threads
+    auto rsa_job = [this,
+                    &req,
+                    &derivation_prf,
+                    &queues,
+                    &doorbells,
+                    add_count,
+                    head_count,
+                    interval,
+                    &checkpoints,
+                    &new_checkpoints](const uint8_t index, const uint8_t N) {
+        SPSCQueue<TokenBlock>& queue = *queues[index];
+        // the queue is consumed by the access thread index % doorbells.size()
+        Doorbell&  doorbell = *doorbells[index % doorbells.size()];
+        TokenBlock block;
+
+        auto derive = [&derivation_prf, &queue, &doorbell, &block](
+                          const search_token_type& st) {
+            gen_update_token_masks(derivation_prf,
+                                   st.data(),
+                                   block.tokens[block.count],
+                                   block.masks[block.count]);
+
+            if (++block.count == kTokenBlockSize) {
+                queue.push(std::move(block));
+                doorbell.ring();
+                block.count = 0;
+            }
+        };
+
+        search_token_type local_st = req.token;
+        if (index != 0 && index < head_count) {
             local_st = public_tdp_.eval(local_st, index);
         }
 
-        if (index < max) {
-            // this is a valid search token, we have to derive it and do a
-            // lookup
-            access_pool.enqueue(access_job, local_st, index);
+        for (size_t i = index; i < head_count; i += N) {
+            if (i != index) {
+                local_st = public_tdp_.eval(local_st, N);
+            }
+            derive(local_st);
+
+            // is this the top of a segment?
+            const size_t counter = add_count - 1 - i;
+            if (interval != 0 && (counter + 1) % interval == 0) {
+                new_checkpoints[(counter + 1) / interval - 1
+                                - checkpoints.size()]
+                    = local_st;
+            }
         }
 
-        for (size_t i = index + N; i < max; i += N) {
-            local_st = public_tdp_.eval(local_st, N);
+        for (size_t m = index; m < checkpoints.size(); m += N) {
+            local_st = checkpoints[m];
+            for (size_t j = 0; j < interval; j++) {
+                if (j != 0) {
+                    local_st = public_tdp_.eval(local_st);
+                }
+                derive(local_st);
+            }
+        }
 
-            access_pool.enqueue(access_job, local_st, i);
+        if (block.count != 0) {
+            queue.push(std::move(block));
         }
+        queue.close();
+        doorbell.ring();
     };
 
-    std::vector<std::thread> rsa_threads;
+    // the access thread index consumes the queues of the RSA threads of
+    // order index + kN, and looks every block up with a single batched lookup
+    auto access_job = [this, &queues, &doorbells, &results_callback](
+                          const uint8_t index, const uint8_t N) {
+        Doorbell&                           doorbell = *doorbells[index];
+        std::vector<SPSCQueue<TokenBlock>*> own_queues;
+        for (size_t q = index; q < queues.size(); q += N) {
+            own_queues.push_back(queues[q].get());
+        }
 
-    //    unsigned n_threads =
-    //    std::thread::hardware_concurrency()-access_threads;
+        TokenBlock                              block;
+        std::array<index_type, kTokenBlockSize> values;
+        std::array<bool, kTokenBlockSize>       found;
+
+        while (!own_queues.empty()) {
+            // read before the pass: a block pushed during the pass rings
+            // the bell again, and the wait below returns immediately
+            const uint64_t rings  = doorbell.rings_count();
+            bool           popped = false;
+
+            for (auto it = own_queues.begin(); it != own_queues.end();) {
+                if ((*it)->try_pop(block)) {
+                    popped = true;
+
+                    edb_.multi_get(block.tokens.data(),
+                                   block.count,
+                                   values.data(),
+                                   found.data());
+
+                    size_t n_found = 0;
+                    for (size_t i = 0; i < block.count; i++) {
+                        if (found[i]) {
+                            values[n_found++]
+                                = utility::xor_mask(values[i], block.masks[i]);
+                        } else {
+                            /* LCOV_EXCL_START */
+                            logger::logger()->error(
+                                "We were supposed to find a value mapped to "
+                                "key "
+                                + utility::hex_string(block.tokens[i]));
+                            /* LCOV_EXCL_STOP */
+                        }
+                    }
+                    results_callback(values.data(), n_found);
+                    ++it;
+                } else if ((*it)->done()) {
+                    it = own_queues.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            if (!popped && !own_queues.empty()) {
+                doorbell.wait(rings);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
 
     for (uint8_t t = 0; t < rsa_thread_count; t++) {
-        rsa_threads.emplace_back(rsa_job, t, req.add_count, rsa_thread_count);
+        threads.emplace_back(rsa_job, t, rsa_thread_count);
+    }
+    for (uint8_t t = 0; t < access_thread_count; t++) {
+        threads.emplace_back(access_job, t, access_thread_count);
     }
 
-    for (uint8_t t = 0; t < rsa_thread_count; t++) {
-        rsa_threads[t].join();
+    for (auto& t : threads) {
+        t.join();
     }
 
-    access_pool.join();
-    post_pool.join();
+    if (!new_checkpoints.empty()) {
+        checkpoints_->put(
+            *checkpoint_keys, checkpoints.size(), new_checkpoints);
+    }
 }
 
-void SophosServer::search_parallel_light_callback(
+template<class EDB>
+void BasicSophosServer<EDB>::search_parallel_light_callback(
     SearchRequest&                  req,
     std::function<void(index_type)> post_callback,
     uint8_t                         thread_count)
@@ -481,7 +659,8 @@ void SophosServer::search_parallel_light_callback(
     }
 }
 
-void SophosServer::insert(const UpdateRequest& req)
+template<class EDB>
+void BasicSophosServer<EDB>::insert(const UpdateRequest& req)
 {
     logger::logger()->debug("Update: (" + utility::hex_string(req.token) + ", "
                             + utility::hex_string(req.index) + ")");
@@ -489,5 +668,58 @@ void SophosServer::insert(const UpdateRequest& req)
     //    edb_.add(req.token, req.index);
     edb_.put(req.token, req.index);
 }
+
+template<class EDB>
+void BasicSophosServer<EDB>::insert_batch(const UpdateRequest* reqs,
+                                          size_t               count,
+                                          bool                 disable_wal)
+{
+    logger::logger()->debug("Update: batch of {} updates", count);
+
+    edb_.put_batch(reqs,
+                   count,
+                   &UpdateRequest::token,
+                   &UpdateRequest::index,
+                   disable_wal);
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::flush_edb()
+{
+    edb_.flush();
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::finish_bulk_load()
+{
+    edb_.finish_bulk_load();
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::enable_checkpoints(uint32_t interval)
+{
+    checkpoints_.reset(new TdpCheckpointIndex(interval));
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::disable_checkpoints()
+{
+    checkpoints_.reset();
+}
+
+template<class EDB>
+void BasicSophosServer<EDB>::build_edb(const std::string& db_path,
+                                       std::istream&      update_stream)
+{
+    EDB              edb(db_path);
+    edb_builder_type builder(db_path + ".build_tmp");
+
+    builder.add_stream(update_stream);
+    builder.ingest(edb);
+}
+
+template class BasicSophosServer<RockDBWrapper>;
+template class BasicSophosServer<MMapHashTable<kUpdateTokenSize, index_type>>;
+
 } // namespace sophos
 } // namespace sse
@@ -23,15 +23,18 @@
 #include "sophos/sophos_server_runner_private.hpp"
 
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/result_collector.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <grpc/grpc.h>
 
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <thread>
+#include <vector>
 
 
 namespace sse {
@@ -41,7 +44,10 @@ const char* SophosImpl::pk_file        = "tdp_pk.key";
 const char* SophosImpl::pairs_map_file = "pairs.dat";
 
 SophosImpl::SophosImpl(std::string path)
-    : storage_path_(std::move(path)), async_search_(true)
+    : storage_path_(std::move(path)), async_search_(true),
+      search_threads_count_(kDefaultSearchThreadsCount),
+      bulk_insert_batch_size_(kDefaultBulkInsertBatchSize),
+      bulk_insert_wal_(true)
 {
     if (utility::is_directory(storage_path_)) {
         // try to initialize everything from this directory
@@ -148,20 +154,17 @@ grpc::Status SophosImpl::setup(__attribute__((unused))
     return grpc::Status::OK;
 }
 
-grpc::Status SophosImpl::search(grpc::ServerContext*                context,
-                                const sophos::SearchRequestMessage* mes,
-                                grpc::ServerWriter<sophos::SearchReply>* writer)
+grpc::Status SophosImpl::run_search(const sophos::SearchRequestMessage* mes,
+                                    const results_writer_type& write_results)
 {
     if (async_search_) {
-        return async_search(context, mes, writer);
+        return async_search(mes, write_results);
     }
-    return sync_search(context, mes, writer);
+    return sync_search(mes, write_results);
 }
 
-grpc::Status SophosImpl::sync_search(
-    __attribute__((unused)) grpc::ServerContext* context,
-    const sophos::SearchRequestMessage*          mes,
-    grpc::ServerWriter<sophos::SearchReply>*     writer)
+grpc::Status SophosImpl::sync_search(const sophos::SearchRequestMessage* mes,
+                                     const results_writer_type& write_results)
 {
     if (!server_) {
         // problem, the server is already set up
@@ -170,23 +173,25 @@ grpc::Status SophosImpl::sync_search(
     }
 
     logger::logger()->trace("Start synchronous search...");
-    std::list<uint64_t> res_list;
+    std::vector<index_type> res_list;
 
     auto req = message_to_request(mes);
 
     {
         SearchBenchmark bench("Sophos synchronous search");
 
-        res_list = server_->search_parallel(req, 2);
+        // as for the asynchronous searches, a search uses at most
+        // search_threads_count_ threads
+        if (mes->add_count() >= 2 && search_threads_count_ > 1) {
+            server_->search_parallel_light(
+                req, search_threads_count_, res_list);
+        } else {
+            server_->search(req, res_list);
+        }
         bench.set_count(res_list.size());
     }
 
-    for (auto& i : res_list) {
-        sophos::SearchReply reply;
-        reply.set_result(static_cast<uint64_t>(i));
-
-        writer->Write(reply);
-    }
+    write_results(res_list.data(), res_list.size());
 
     logger::logger()->trace("Synchronous search done");
 
@@ -194,10 +199,8 @@ grpc::Status SophosImpl::sync_search(
 }
 
 
-grpc::Status SophosImpl::async_search(
-    __attribute__((unused)) grpc::ServerContext* context,
-    const sophos::SearchRequestMessage*          mes,
-    grpc::ServerWriter<sophos::SearchReply>*     writer)
+grpc::Status SophosImpl::async_search(const sophos::SearchRequestMessage* mes,
+                                      const results_writer_type& write_results)
 {
     if (!server_) {
         // problem, the server is already set up
@@ -208,35 +211,34 @@ grpc::Status SophosImpl::async_search(
     logger::logger()->trace("Start asynchronous search...");
     auto req = message_to_request(mes);
 
-    std::atomic_uint res_size(0);
-
-    std::mutex writer_lock;
+    // the results are written by batches: the collector never calls
+    // write_results concurrently
+    ResultCollector<index_type> collector(write_results);
 
-    auto post_callback = [&writer, &res_size, &writer_lock](index_type i) {
-        sophos::SearchReply reply;
-        reply.set_result(static_cast<uint64_t>(i));
-
-        writer_lock.lock();
-        writer->Write(reply);
-        writer_lock.unlock();
-
-        res_size++;
-    };
+    auto post_callback = [&collector](index_type i) { collector.push(i); };
 
     {
         SearchBenchmark bench("Sophos asynchronous search");
 
-        if (mes->add_count() >= 40) { // run the search algorithm in parallel
-                                      // only if there are more than 2 results
+        // run the search algorithm in parallel only if there are enough
+        // results, and several threads per search. The search_threads_count_
+        // threads of the pipeline are split between the RSA computations and
+        // the database accesses, and the access threads collect the results.
+        if (mes->add_count() >= 40 && search_threads_count_ > 1) {
+            const uint8_t access_threads
+                = std::max(1, search_threads_count_ / 4);
+            const uint8_t rsa_threads = search_threads_count_ - access_threads;
+
             server_->search_parallel_callback(
-                req, post_callback, std::thread::hardware_concurrency(), 8, 1);
-        } else if (mes->add_count() >= 2) {
+                req, post_callback, rsa_threads, access_threads, 0);
+        } else if (mes->add_count() >= 2 && search_threads_count_ > 1) {
             server_->search_parallel_light_callback(
-                req, post_callback, std::thread::hardware_concurrency());
+                req, post_callback, search_threads_count_);
         } else {
             server_->search_callback(req, post_callback);
         }
-        bench.set_count(res_size);
+        collector.flush();
+        bench.set_count(collector.size());
     }
 
     logger::logger()->trace("Asynchronous search done");
@@ -283,12 +285,26 @@ grpc::Status SophosImpl::bulk_insert(
 
     sophos::UpdateRequestMessage mes;
 
+    std::vector<UpdateRequest> batch;
+    batch.reserve(bulk_insert_batch_size_);
+
     while (reader->Read(&mes)) {
-        server_->insert(message_to_request(&mes));
+        batch.push_back(message_to_request(&mes));
+
+        if (batch.size() >= bulk_insert_batch_size_) {
+            server_->insert_batch(
+                batch.data(), batch.size(), !bulk_insert_wal_);
+            batch.clear();
+        }
     }
+    server_->insert_batch(batch.data(), batch.size(), !bulk_insert_wal_);
 
     logger::logger()->trace("Updating (bulk)... done");
 
+    if (!bulk_insert_wal_) {
+        // the updates are not durable until the database is flushed
+        server_->flush_edb();
+    }
 
     return grpc::Status::OK;
 }
@@ -303,6 +319,45 @@ void SophosImpl::set_search_asynchronously(bool flag)
     async_search_ = flag;
 }
 
+uint8_t SophosImpl::search_threads_count() const
+{
+    return search_threads_count_;
+}
+
+void SophosImpl::set_search_threads_count(uint8_t count)
+{
+    search_threads_count_ = std::max<uint8_t>(count, 1);
+}
+
+size_t SophosImpl::bulk_insert_batch_size() const
+{
+    return bulk_insert_batch_size_;
+}
+
+void SophosImpl::set_bulk_insert_batch_size(size_t size)
+{
+    bulk_insert_batch_size_ = std::max<size_t>(size, 1);
+}
+
+bool SophosImpl::bulk_insert_wal() const
+{
+    return bulk_insert_wal_;
+}
+
+void SophosImpl::set_bulk_insert_wal(bool flag)
+{
+    bulk_insert_wal_ = flag;
+}
+
+void SophosImpl::finish_bulk_load()
+{
+    std::lock_guard<std::mutex> lock(update_mtx_);
+
+    if (server_) {
+        server_->finish_bulk_load();
+    }
+}
+
 SearchRequest message_to_request(const SearchRequestMessage* mes)
 {
     SearchRequest req;
@@ -333,36 +388,78 @@ UpdateRequest message_to_request(const UpdateRequestMessage* mes)
 }
 
 SophosServerRunner::SophosServerRunner(grpc::ServerBuilder& builder,
-                                       const std::string&   server_db_path)
+                                       const std::string&   server_db_path,
+                                       uint32_t search_workers_count)
 {
-    service_.reset(new SophosImpl(server_db_path));
-
-    builder.RegisterService(service_.get());
-    server_ = builder.BuildAndStart();
+    build_and_start(builder, server_db_path, search_workers_count);
 }
 
 
 SophosServerRunner::SophosServerRunner(const std::string& server_address,
-                                       const std::string& server_db_path)
+                                       const std::string& server_db_path,
+                                       uint32_t           search_workers_count)
 {
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
 
+    build_and_start(builder, server_db_path, search_workers_count);
+}
+
+SophosServerRunner::~SophosServerRunner()
+{
+    // the calls in progress reference the service
+    shutdown();
+}
+
+void SophosServerRunner::build_and_start(grpc::ServerBuilder& builder,
+                                         const std::string&   server_db_path,
+                                         uint32_t search_workers_count)
+{
+    if (search_workers_count == 0) {
+        search_workers_count
+            = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+    }
+
     service_.reset(new SophosImpl(server_db_path));
 
     builder.RegisterService(service_.get());
+
+    SophosImpl* service = service_.get();
+    search_server_.reset(new SophosSearchServer(
+        builder,
+        [service](const SearchRequestMessage*            mes,
+                  const SophosImpl::results_writer_type& write_results) {
+            return service->run_search(mes, write_results);
+        },
+        search_workers_count));
+
     server_ = builder.BuildAndStart();
+    search_server_->start(service);
 }
 
-// as we forward-declare SophosImpl, we cannot use the default destructor
-// NOLINTNEXTLINE(modernize-use-equals-default)
-SophosServerRunner::~SophosServerRunner()
+void SophosServerRunner::set_async_search(bool flag)
 {
+    service_->set_search_asynchronously(flag);
 }
 
-void SophosServerRunner::set_async_search(bool flag)
+void SophosServerRunner::set_search_threads_count(uint8_t count)
 {
-    service_->set_search_asynchronously(flag);
+    service_->set_search_threads_count(count);
+}
+
+void SophosServerRunner::set_bulk_insert_batch_size(size_t size)
+{
+    service_->set_bulk_insert_batch_size(size);
+}
+
+void SophosServerRunner::set_bulk_insert_wal(bool flag)
+{
+    service_->set_bulk_insert_wal(flag);
+}
+
+void SophosServerRunner::finish_bulk_load()
+{
+    service_->finish_bulk_load();
 }
 
 void SophosServerRunner::wait()
@@ -372,7 +469,12 @@ void SophosServerRunner::wait()
 
 void SophosServerRunner::shutdown()
 {
-    server_->Shutdown();
+    if (server_) {
+        server_->Shutdown();
+    }
+    if (search_server_) {
+        search_server_->shutdown();
+    }
 }
 
 } // namespace sophos
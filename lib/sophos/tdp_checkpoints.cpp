@@ -0,0 +1,139 @@
+//
+// Sophos - Forward Private Searchable Encryption
+// Copyright (C) 2016 Raphael Bost
+//
+// This file is part of Sophos.
+//
+// Sophos is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// Sophos is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with Sophos.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <sse/schemes/sophos/tdp_checkpoints.hpp>
+
+#include <sse/crypto/key.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace sse {
+namespace sophos {
+
+namespace {
+// The inputs of the checkpoints PRF are shorter than the ones of the
+// derivation PRF (search token || '0' or '1'), which uses the same key
+const std::string kIdPrefix  = "checkpoints_id";
+const std::string kPadPrefix = "checkpoint_pad";
+
+search_token_type xor_pad(const search_token_type& in,
+                          const search_token_type& pad)
+{
+    search_token_type out;
+    for (size_t i = 0; i < kSearchTokenSize; i++) {
+        out[i] = in[i] ^ pad[i];
+    }
+    return out;
+}
+} // namespace
+
+constexpr uint32_t TdpCheckpointIndex::kDefaultInterval;
+
+TdpCheckpointIndex::KeywordKeys::KeywordKeys(
+    std::array<uint8_t, kDerivationKeySize> derivation_key)
+    : prf_(crypto::Key<kDerivationKeySize>(derivation_key.data()))
+{
+    search_token_type id = prf_.prf(kIdPrefix);
+    std::copy(id.begin(), id.begin() + id_.size(), id_.begin());
+}
+
+search_token_type TdpCheckpointIndex::KeywordKeys::pad(size_t segment) const
+{
+    return prf_.prf(kPadPrefix + std::to_string(segment));
+}
+
+TdpCheckpointIndex::TdpCheckpointIndex(uint32_t interval) : interval_(interval)
+{
+    if (interval_ == 0) {
+        throw std::invalid_argument("The checkpoint interval must be positive");
+    }
+}
+
+std::vector<search_token_type> TdpCheckpointIndex::get(
+    const KeywordKeys& keys,
+    size_t             max_count) const
+{
+    std::vector<search_token_type> encrypted;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+
+        auto it = checkpoints_.find(keys.id_);
+        if (it == checkpoints_.end()) {
+            return {};
+        }
+        const size_t count = std::min(max_count, it->second.size());
+        encrypted.assign(it->second.begin(), it->second.begin() + count);
+    }
+
+    // decrypt outside of the critical section
+    std::vector<search_token_type> checkpoints;
+    checkpoints.reserve(encrypted.size());
+    for (size_t m = 0; m < encrypted.size(); m++) {
+        checkpoints.push_back(xor_pad(encrypted[m], keys.pad(m)));
+    }
+    return checkpoints;
+}
+
+void TdpCheckpointIndex::put(
+    const KeywordKeys&                    keys,
+    size_t                                first_segment,
+    const std::vector<search_token_type>& checkpoints)
+{
+    std::vector<search_token_type> encrypted;
+    encrypted.reserve(checkpoints.size());
+    for (size_t m = 0; m < checkpoints.size(); m++) {
+        encrypted.push_back(
+            xor_pad(checkpoints[m], keys.pad(first_segment + m)));
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    std::vector<search_token_type>& stored = checkpoints_[keys.id_];
+
+    // another search on the same keyword might have stored some of them
+    // concurrently
+    const size_t end = first_segment + encrypted.size();
+    if (first_segment <= stored.size() && stored.size() < end) {
+        stored.insert(stored.end(),
+                      encrypted.begin() + (stored.size() - first_segment),
+                      encrypted.end());
+    }
+    if (stored.empty()) {
+        checkpoints_.erase(keys.id_);
+    }
+}
+
+size_t TdpCheckpointIndex::keyword_count() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return checkpoints_.size();
+}
+
+void TdpCheckpointIndex::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    checkpoints_.clear();
+}
+
+} // namespace sophos
+} // namespace sse
@@ -0,0 +1,78 @@
+#include <sse/schemes/utils/list_codec.hpp>
+
+namespace sse {
+namespace utility {
+
+namespace {
+// The legacy serializations have no header: the magic bytes make it unlikely
+// that a legacy list is mistaken for an encoded one, and such a list would
+// still have to be decoded without any byte left.
+const char kListHeaderMagic[kListHeaderMagicSize] = {'\xE5', 'L', 'C'};
+} // namespace
+
+void append_list_header(std::string& out, ListFormat format, size_t count)
+{
+    out.append(kListHeaderMagic, kListHeaderMagicSize);
+    out.push_back(static_cast<char>(format));
+    append_varint(out, count);
+}
+
+bool read_list_header(const char*& begin,
+                      const char*  end,
+                      ListFormat&  format,
+                      size_t&      count)
+{
+    const char* it = begin;
+
+    if (static_cast<size_t>(end - it) < kListHeaderMagicSize + 1
+        || std::memcmp(it, kListHeaderMagic, kListHeaderMagicSize) != 0) {
+        return false;
+    }
+    it += kListHeaderMagicSize;
+
+    const uint8_t f = static_cast<uint8_t>(*it++);
+    if (f > static_cast<uint8_t>(ListFormat::Columns)) {
+        return false;
+    }
+
+    uint64_t c;
+    if (!read_varint(it, end, c) || c > std::numeric_limits<size_t>::max()) {
+        return false;
+    }
+
+    format = static_cast<ListFormat>(f);
+    count  = static_cast<size_t>(c);
+    begin  = it;
+
+    return true;
+}
+
+void append_varint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool read_varint(const char*& begin, const char* end, uint64_t& v)
+{
+    uint64_t result = 0;
+    unsigned shift  = 0;
+
+    for (const char* it = begin; it != end && shift < 64; shift += 7) {
+        const uint8_t byte = static_cast<uint8_t>(*it++);
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            v     = result;
+            begin = it;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace utility
+} // namespace sse
@@ -0,0 +1,420 @@
+#include <sse/schemes/utils/rocksdb_profile.hpp>
+
+#include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/utils.hpp>
+
+#include <rocksdb/cache.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/memtablerep.h>
+#include <rocksdb/table.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace sse {
+namespace utility {
+
+RocksDBProfile RocksDBProfile::cuckoo_point_lookup()
+{
+    // the default values of the fields
+    RocksDBProfile profile;
+    profile.name = "cuckoo-point-lookup";
+
+    return profile;
+}
+
+RocksDBProfile RocksDBProfile::bulk_load()
+{
+    RocksDBProfile profile;
+    profile.name = "bulk-load";
+
+    profile.max_write_buffer_number  = 4;
+    profile.disable_auto_compactions = true;
+
+    // the L0 files are only compacted at the end of the load (see
+    // finish_rocksdb_bulk_load)
+    profile.level0_file_num_compaction_trigger  = 1 << 30;
+    profile.level0_slowdown_writes_trigger      = 1 << 30;
+    profile.hard_pending_compaction_bytes_limit = 0; // no limit
+
+    return profile;
+}
+
+RocksDBProfile RocksDBProfile::read_mostly()
+{
+    RocksDBProfile profile;
+    profile.name = "read-mostly";
+
+    profile.table_format       = TableFormat::BlockBased;
+    profile.vector_memtable    = false;
+    profile.write_buffer_size  = 67108864; // 64 MB
+    profile.arena_block_size   = 8388608;  // 8 MB
+    profile.block_cache_size   = 1073741824; // 1 GB
+    profile.bloom_bits_per_key = 10;
+    profile.partition_filters  = true;
+    profile.allow_mmap_reads   = false;
+
+    profile.max_background_compactions         = 4;
+    profile.target_file_size_base              = 67108864; // 64 MB
+    profile.max_bytes_for_level_base           = 536870912; // 512 MB
+    profile.level0_file_num_compaction_trigger = 4;
+    profile.level0_slowdown_writes_trigger     = 20;
+
+    return profile;
+}
+
+RocksDBProfile RocksDBProfile::memory_constrained()
+{
+    RocksDBProfile profile;
+    profile.name = "memory-constrained";
+
+    profile.table_format            = TableFormat::BlockBased;
+    profile.vector_memtable         = false;
+    profile.write_buffer_size       = 16777216; // 16 MB
+    profile.max_write_buffer_number = 2;
+    profile.arena_block_size        = 1048576; // 1 MB
+    profile.block_cache_size        = 33554432; // 32 MB
+    profile.bloom_bits_per_key      = 10;
+    profile.allow_mmap_reads        = false;
+
+    profile.max_background_compactions         = 2;
+    profile.target_file_size_base              = 16777216; // 16 MB
+    profile.max_bytes_for_level_base           = 134217728; // 128 MB
+    profile.level0_file_num_compaction_trigger = 4;
+    profile.level0_slowdown_writes_trigger     = 20;
+
+    return profile;
+}
+
+RocksDBProfile RocksDBProfile::named(const std::string& name)
+{
+    static const std::map<std::string, std::function<RocksDBProfile()>>
+        profiles = {
+            {"cuckoo-point-lookup", &RocksDBProfile::cuckoo_point_lookup},
+            {"bulk-load", &RocksDBProfile::bulk_load},
+            {"read-mostly", &RocksDBProfile::read_mostly},
+            {"memory-constrained", &RocksDBProfile::memory_constrained},
+        };
+
+    auto it = profiles.find(name);
+    if (it == profiles.end()) {
+        throw std::invalid_argument("Unknown RocksDB profile: " + name);
+    }
+    return it->second();
+}
+
+static std::string trim(const std::string& s)
+{
+    const char* whitespaces = " \t\r\n";
+
+    size_t begin = s.find_first_not_of(whitespaces);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(whitespaces);
+
+    return s.substr(begin, end - begin + 1);
+}
+
+static uint64_t parse_size(const std::string& value)
+{
+    size_t   pos;
+    uint64_t v = std::stoull(value, &pos);
+
+    const std::string suffix = value.substr(pos);
+    if (suffix == "K") {
+        v <<= 10;
+    } else if (suffix == "M") {
+        v <<= 20;
+    } else if (suffix == "G") {
+        v <<= 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("Invalid size suffix: " + suffix);
+    }
+    return v;
+}
+
+static bool parse_bool(const std::string& value)
+{
+    if (value == "true" || value == "1") {
+        return true;
+    }
+    if (value == "false" || value == "0") {
+        return false;
+    }
+    throw std::invalid_argument("Invalid boolean: " + value);
+}
+
+RocksDBProfile RocksDBProfile::from_file(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        throw std::invalid_argument("Unable to open the RocksDB profile file "
+                                    + path);
+    }
+
+    std::map<std::string, std::string> values;
+    std::string                        line;
+    size_t                             line_number = 0;
+
+    while (std::getline(in, line)) {
+        line_number++;
+        line = trim(line);
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument(path + ":" + std::to_string(line_number)
+                                        + ": expected 'key = value'");
+        }
+        values[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+
+    RocksDBProfile profile;
+
+    auto base = values.find("profile");
+    if (base != values.end()) {
+        profile = named(base->second);
+        values.erase(base);
+    } else {
+        profile = cuckoo_point_lookup();
+    }
+    profile.name = path;
+
+    using setter_type
+        = std::function<void(RocksDBProfile&, const std::string&)>;
+
+    static const std::map<std::string, setter_type> setters = {
+        {"table_format",
+         [](RocksDBProfile& p, const std::string& v) {
+             if (v == "cuckoo") {
+                 p.table_format = TableFormat::Cuckoo;
+             } else if (v == "block_based") {
+                 p.table_format = TableFormat::BlockBased;
+             } else {
+                 throw std::invalid_argument("Invalid table format: " + v);
+             }
+         }},
+        {"vector_memtable",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.vector_memtable = parse_bool(v);
+         }},
+        {"write_buffer_size",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.write_buffer_size = parse_size(v);
+         }},
+        {"max_write_buffer_number",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.max_write_buffer_number = std::stoi(v);
+         }},
+        {"arena_block_size",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.arena_block_size = parse_size(v);
+         }},
+        {"max_background_compactions",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.max_background_compactions = std::stoi(v);
+         }},
+        {"disable_auto_compactions",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.disable_auto_compactions = parse_bool(v);
+         }},
+        {"max_bytes_for_level_base",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.max_bytes_for_level_base = parse_size(v);
+         }},
+        {"target_file_size_base",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.target_file_size_base = parse_size(v);
+         }},
+        {"level0_file_num_compaction_trigger",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.level0_file_num_compaction_trigger = std::stoi(v);
+         }},
+        {"level0_slowdown_writes_trigger",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.level0_slowdown_writes_trigger = std::stoi(v);
+         }},
+        {"hard_pending_compaction_bytes_limit",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.hard_pending_compaction_bytes_limit = parse_size(v);
+         }},
+        {"block_cache_size",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.block_cache_size = parse_size(v);
+         }},
+        {"bloom_bits_per_key",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.bloom_bits_per_key = std::stoi(v);
+         }},
+        {"partition_filters",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.partition_filters = parse_bool(v);
+         }},
+        {"allow_mmap_reads",
+         [](RocksDBProfile& p, const std::string& v) {
+             p.allow_mmap_reads = parse_bool(v);
+         }},
+    };
+
+    for (const auto& kv : values) {
+        auto setter = setters.find(kv.first);
+        if (setter == setters.end()) {
+            throw std::invalid_argument(path + ": unknown key " + kv.first);
+        }
+
+        try {
+            setter->second(profile, kv.second);
+        } catch (const std::logic_error& e) {
+            // std::invalid_argument and std::out_of_range (from std::stoi)
+            throw std::invalid_argument(path + ": invalid value for "
+                                        + kv.first + " (" + e.what() + ")");
+        }
+    }
+
+    return profile;
+}
+
+RocksDBProfile RocksDBProfile::load(const std::string& name_or_path)
+{
+    try {
+        return named(name_or_path);
+    } catch (const std::invalid_argument&) {
+        if (!utility::is_file(name_or_path)) {
+            throw;
+        }
+    }
+    return from_file(name_or_path);
+}
+
+rocksdb::Options RocksDBProfile::to_options(bool fixed_size_entries) const
+{
+    rocksdb::Options options;
+    options.create_if_missing = true;
+
+    options.table_cache_numshardbits = 4;
+    options.max_open_files           = -1;
+
+    if (table_format == TableFormat::Cuckoo && fixed_size_entries) {
+        rocksdb::CuckooTableOptions cuckoo_options;
+        cuckoo_options.identity_as_first_hash = false;
+        cuckoo_options.hash_table_ratio       = 0.9;
+
+        // The cuckoo tables are written by the flushes and compactions, but
+        // the block-based tables of the offline builds (see
+        // sophos::RockDBSSTBuilder) have to be readable too
+        std::shared_ptr<rocksdb::TableFactory> cuckoo_factory(
+            rocksdb::NewCuckooTableFactory(cuckoo_options));
+        options.table_factory.reset(rocksdb::NewAdaptiveTableFactory(
+            cuckoo_factory, nullptr, nullptr, cuckoo_factory));
+    } else if (table_format == TableFormat::BlockBased) {
+        rocksdb::BlockBasedTableOptions table_options;
+
+        if (block_cache_size > 0) {
+            table_options.block_cache = rocksdb::NewLRUCache(block_cache_size);
+        }
+        if (bloom_bits_per_key > 0) {
+            table_options.filter_policy.reset(
+                rocksdb::NewBloomFilterPolicy(bloom_bits_per_key));
+        }
+        if (partition_filters && bloom_bits_per_key > 0) {
+            table_options.partition_filters = true;
+            table_options.index_type
+                = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+            table_options.cache_index_and_filter_blocks = true;
+        }
+
+        options.table_factory.reset(
+            rocksdb::NewBlockBasedTableFactory(table_options));
+    }
+    // otherwise, use RocksDB's default (block-based) tables
+
+    if (vector_memtable && fixed_size_entries) {
+        options.memtable_factory
+            = std::make_shared<rocksdb::VectorRepFactory>();
+    }
+
+    options.compression            = rocksdb::kNoCompression;
+    options.bottommost_compression = rocksdb::kDisableCompressionOption;
+
+    options.compaction_style = rocksdb::kCompactionStyleLevel;
+    options.info_log_level   = rocksdb::InfoLogLevel::INFO_LEVEL;
+
+    options.delayed_write_rate         = 8388608;
+    options.max_background_compactions = max_background_compactions;
+    options.disable_auto_compactions   = disable_auto_compactions;
+
+    options.allow_mmap_reads = allow_mmap_reads;
+
+    options.allow_concurrent_memtable_write
+        = options.memtable_factory->IsInsertConcurrentlySupported();
+
+    options.max_bytes_for_level_base = max_bytes_for_level_base;
+    options.arena_block_size         = arena_block_size;
+    options.target_file_size_base    = target_file_size_base;
+    options.write_buffer_size        = write_buffer_size;
+    options.max_write_buffer_number  = max_write_buffer_number;
+
+    options.level0_file_num_compaction_trigger
+        = level0_file_num_compaction_trigger;
+    options.level0_slowdown_writes_trigger = level0_slowdown_writes_trigger;
+    options.level0_stop_writes_trigger     = std::max(
+        options.level0_stop_writes_trigger, level0_slowdown_writes_trigger);
+    options.hard_pending_compaction_bytes_limit
+        = hard_pending_compaction_bytes_limit;
+
+    return options;
+}
+
+static RocksDBProfile& default_profile_ref()
+{
+    static RocksDBProfile profile = RocksDBProfile::cuckoo_point_lookup();
+    return profile;
+}
+
+const RocksDBProfile& default_rocksdb_profile()
+{
+    return default_profile_ref();
+}
+
+void set_default_rocksdb_profile(const RocksDBProfile& profile)
+{
+    logger::logger()->info("Using the RocksDB profile " + profile.name);
+
+    default_profile_ref() = profile;
+}
+
+rocksdb::Status flush_rocksdb(rocksdb::DB& db, bool blocking)
+{
+    rocksdb::FlushOptions options;
+    options.wait = blocking;
+
+    return db.Flush(options);
+}
+
+rocksdb::Status finish_rocksdb_bulk_load(rocksdb::DB& db)
+{
+    rocksdb::Status s = flush_rocksdb(db, true);
+
+    if (s.ok() && db.GetOptions().disable_auto_compactions) {
+        logger::logger()->info("Compacting the database after the load");
+
+        rocksdb::CompactRangeOptions compact_options;
+        compact_options.bottommost_level_compaction
+            = rocksdb::BottommostLevelCompaction::kForce;
+
+        s = db.CompactRange(compact_options, nullptr, nullptr);
+    }
+    return s;
+}
+
+} // namespace utility
+} // namespace sse
@@ -24,49 +24,13 @@ namespace sse {
 namespace sophos {
 
 
-RocksDBCounter::RocksDBCounter(const std::string& path) : db_(nullptr)
+RocksDBCounter::RocksDBCounter(const std::string&             path,
+                               const utility::RocksDBProfile& profile)
+    : db_(nullptr)
 {
-    rocksdb::Options options;
-    options.create_if_missing = true;
-
-
-    rocksdb::CuckooTableOptions cuckoo_options;
-    cuckoo_options.identity_as_first_hash = false;
-    cuckoo_options.hash_table_ratio       = 0.9;
-
-    options.table_cache_numshardbits = 4;
-    options.max_open_files           = -1;
-
-
-    //            options.table_factory.reset(rocksdb::NewCuckooTableFactory(cuckoo_options));
-
-    options.compression            = rocksdb::kNoCompression;
-    options.bottommost_compression = rocksdb::kDisableCompressionOption;
-
-    options.compaction_style = rocksdb::kCompactionStyleLevel;
-    options.info_log_level   = rocksdb::InfoLogLevel::INFO_LEVEL;
-
-
-    //        options.max_grandparent_overlap_factor = 10;
-
-    options.delayed_write_rate         = 8388608;
-    options.max_background_compactions = 20;
-
-    options.allow_mmap_reads                       = true;
-
-    options.allow_concurrent_memtable_write
-        = options.memtable_factory->IsInsertConcurrentlySupported();
-
-    options.max_bytes_for_level_base            = 4294967296; // 4 GB
-    options.arena_block_size                    = 134217728;  // 128 MB
-    options.level0_file_num_compaction_trigger  = 10;
-    options.level0_slowdown_writes_trigger      = 16;
-    options.hard_pending_compaction_bytes_limit = 137438953472; // 128 GB
-    options.target_file_size_base               = 201327616;
-    options.write_buffer_size                   = 1073741824; // 1GB
-
-    //        options.optimize_filters_for_hits = true;
-
+    // the counters are read and updated in place: the cuckoo tables and the
+    // vector memtables are not suited
+    rocksdb::Options options = profile.to_options(false);
 
     rocksdb::Status status = rocksdb::DB::Open(options, path, &db_);
     /* LCOV_EXCL_START */
@@ -83,9 +47,10 @@ RocksDBCounter::RocksDBCounter(const std::string& path) : db_(nullptr)
 
 bool RocksDBCounter::get(const std::string& key, uint32_t& val) const
 {
-    std::string data;
+    rocksdb::PinnableSlice data;
 
-    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
+    rocksdb::Status s = db_->Get(
+        rocksdb::ReadOptions(), db_->DefaultColumnFamily(), key, &data);
 
     logger::logger()->debug("Get: " + utility::hex_string(key)
                             + "\nStatus: " + s.ToString());
@@ -99,9 +64,10 @@ bool RocksDBCounter::get(const std::string& key, uint32_t& val) const
 
 bool RocksDBCounter::get_and_increment(const std::string& key, uint32_t& val)
 {
-    std::string data;
+    rocksdb::PinnableSlice data;
 
-    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
+    rocksdb::Status s = db_->Get(
+        rocksdb::ReadOptions(), db_->DefaultColumnFamily(), key, &data);
 
     logger::logger()->debug("Get and increment: " + utility::hex_string(key)
                             + "\nStatus: " + s.ToString());
@@ -132,10 +98,11 @@ bool RocksDBCounter::get_and_increment(const std::string& key, uint32_t& val)
 
 bool RocksDBCounter::increment(const std::string& key, uint32_t default_value)
 {
-    std::string data;
-    uint32_t    val;
+    rocksdb::PinnableSlice data;
+    uint32_t               val;
 
-    rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
+    rocksdb::Status s = db_->Get(
+        rocksdb::ReadOptions(), db_->DefaultColumnFamily(), key, &data);
 
     if (s.ok()) {
         // the key has been found
@@ -8,13 +8,18 @@
 
 #include <sse/runners/sophos/sophos_server_runner.hpp>
 #include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/rocksdb_profile.hpp>
 
 #include <sse/crypto/utils.hpp>
 
 #include <csignal>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <unistd.h>
 
+#include <stdexcept>
+
 sse::sophos::SophosServerRunner* g_sophos_server_ptr_ = nullptr;
 
 void exit_handler(__attribute__((unused)) int signal)
@@ -27,6 +32,19 @@ void exit_handler(__attribute__((unused)) int signal)
 };
 
 
+// Parse a decimal count no larger than max
+static bool parse_count(const char* arg, unsigned long max, uint32_t& count)
+{
+    char*               end = nullptr;
+    const unsigned long v   = std::strtoul(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || v > max) {
+        return false;
+    }
+    count = static_cast<uint32_t>(v);
+    return true;
+}
+
 int main(int argc, char** argv)
 {
     sse::logger::set_logging_level(spdlog::level::info);
@@ -42,9 +60,15 @@ int main(int argc, char** argv)
     int c;
 
     bool async_search = true;
+    // compact the database loaded by a previous run before serving
+    bool finish_bulk_load = false;
+    // 0: one search worker per hardware thread
+    uint32_t search_workers_count = 0;
+    // 0: keep the runner's default
+    uint32_t search_threads_count = 0;
 
     std::string server_db;
-    while ((c = getopt(argc, argv, "b:s")) != -1) {
+    while ((c = getopt(argc, argv, "b:scp:w:t:")) != -1) {
         switch (c) {
         case 'b':
             server_db = std::string(optarg);
@@ -52,6 +76,38 @@ int main(int argc, char** argv)
         case 's':
             async_search = false;
             break;
+        case 'c':
+            finish_bulk_load = true;
+            break;
+        case 'p':
+            // RocksDB tuning profile: predefined profile name or profile file
+            try {
+                sse::utility::set_default_rocksdb_profile(
+                    sse::utility::RocksDBProfile::load(std::string(optarg)));
+            } catch (const std::invalid_argument& e) {
+                fprintf(stderr, "Invalid RocksDB profile: %s\n", e.what());
+                return 1;
+            }
+            break;
+        case 'w':
+            // number of searches served concurrently
+            if (!parse_count(optarg, UINT32_MAX, search_workers_count)) {
+                fprintf(stderr,
+                        "Invalid number of search workers: %s\n",
+                        optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            // number of threads used by a single search
+            if (!parse_count(optarg, UINT8_MAX, search_threads_count)
+                || search_threads_count == 0) {
+                fprintf(stderr,
+                        "Invalid number of search threads: %s\n",
+                        optarg);
+                return 1;
+            }
+            break;
 
         case '?':
             if (optopt == 'i') {
@@ -83,8 +139,18 @@ int main(int argc, char** argv)
     }
 
     g_sophos_server_ptr_
-        = new sse::sophos::SophosServerRunner("0.0.0.0:4240", server_db);
+        = new sse::sophos::SophosServerRunner("0.0.0.0:4240",
+                                             server_db,
+                                             search_workers_count);
     g_sophos_server_ptr_->set_async_search(async_search);
+    if (finish_bulk_load) {
+        sse::logger::logger()->info("Finish the bulk load of the database");
+        g_sophos_server_ptr_->finish_bulk_load();
+    }
+    if (search_threads_count != 0) {
+        g_sophos_server_ptr_->set_search_threads_count(
+            static_cast<uint8_t>(search_threads_count));
+    }
     //    sse::sophos::run_sophos_server("0.0.0.0:4242",
     //    "/Users/raphaelbost/Code/sse/sophos/test.ssdb",
     //    &g_sophos_server_ptr_);
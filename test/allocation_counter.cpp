@@ -0,0 +1,43 @@
+#include "allocation_counter.hpp"
+
+#include <cstdlib>
+
+#include <atomic>
+#include <new>
+
+namespace sse {
+namespace test {
+
+static std::atomic<size_t> global_allocation_count{0};
+
+size_t allocation_count()
+{
+    return global_allocation_count.load();
+}
+
+} // namespace test
+} // namespace sse
+
+// Replacements of the global allocation functions. The array and nothrow
+// versions of the default library implementation forward to these ones.
+
+void* operator new(std::size_t size)
+{
+    sse::test::global_allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
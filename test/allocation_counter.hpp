@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace sse {
+namespace test {
+
+/// Number of calls to the global operator new since the start of the
+/// program.
+///
+/// The test binary replaces the global allocation functions to count the
+/// allocations. This is used by the microbenchmarks measuring the number of
+/// allocations of the hot paths.
+size_t allocation_count();
+
+/// Counts the allocations made by the calling thread and the other threads
+/// between the construction of the object and the call to `count()`.
+class AllocationCounter
+{
+public:
+    AllocationCounter() : start_(allocation_count())
+    {
+    }
+
+    size_t count() const
+    {
+        return allocation_count() - start_;
+    }
+
+private:
+    size_t start_;
+};
+
+} // namespace test
+} // namespace sse
@@ -1,7 +1,18 @@
+#include "allocation_counter.hpp"
+
 #include <sse/schemes/abstractio/awonvm_vector.hpp>
 #include <sse/schemes/abstractio/scheduler.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace sse {
@@ -52,7 +63,9 @@ enum AWONVMVectorTestScheduler
 {
     LinuxAIOScheduler = 1,
     ThreadPoolSchedulerCached,
-    ThreadPoolSchedulerDirect
+    ThreadPoolSchedulerDirect,
+    IoUringScheduler,
+    LinuxAIOSchedulerMultiThreaded
 };
 
 class AWONVMVectorTest
@@ -60,10 +73,18 @@ class AWONVMVectorTest
 {
     void SetUp() override
     {
+#ifdef HAS_LIBURING
+        if (GetParam() == IoUringScheduler && !io_uring_is_supported()) {
+            GTEST_SKIP() << "io_uring is not supported by the kernel";
+        }
+#endif
         silent_cleanup();
     }
     void TearDown() override
     {
+        if (IsSkipped()) {
+            return;
+        }
         cleanup();
     }
 
@@ -77,6 +98,20 @@ public:
                 make_linux_aio_scheduler(kPageSize, 128));
 #else
             return std::unique_ptr<Scheduler>(nullptr);
+#endif
+        case LinuxAIOSchedulerMultiThreaded:
+#ifdef HAS_LIBAIO
+            return std::unique_ptr<Scheduler>(
+                make_linux_aio_scheduler(kPageSize, 128, 4, {0}));
+#else
+            return std::unique_ptr<Scheduler>(nullptr);
+#endif
+        case IoUringScheduler:
+#ifdef HAS_LIBURING
+            return std::unique_ptr<Scheduler>(
+                make_io_uring_scheduler(kPageSize, 128));
+#else
+            return std::unique_ptr<Scheduler>(nullptr);
 #endif
         case ThreadPoolSchedulerCached:
         case ThreadPoolSchedulerDirect:
@@ -149,7 +184,7 @@ TEST_P(AWONVMVectorTest, async_build_and_get)
         ASSERT_TRUE(vec.is_committed());
 
         for (uint64_t i = 0; i < kTestVecSize; i++) {
-            vec.async_get(i, [i](std::unique_ptr<test_payload> value) {
+            vec.async_get(i, [i](BufferLease<const test_payload> value) {
                 (void)i;
                 (void)value;
                 ASSERT_TRUE(value);
@@ -159,6 +194,498 @@ TEST_P(AWONVMVectorTest, async_build_and_get)
     }
 }
 
+// Microbenchmark of the number of allocations per asynchronous lookup, with
+// and without buffer pooling. The allocations counted are the calls to the
+// global operator new and the buffers allocations of the vector.
+TEST_P(AWONVMVectorTest, async_get_allocations)
+{
+    constexpr size_t kRounds = 4;
+
+    bool direct_io = (GetParam() == ThreadPoolSchedulerCached) ? false : true;
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            __attribute__((aligned(kPageSize))) test_payload payload(i);
+            vec.push_back(payload);
+        }
+        vec.commit();
+    }
+
+    struct Completion
+    {
+        std::mutex              lock;
+        std::condition_variable cv;
+        size_t                  count{0};
+    } completion;
+
+    // only capture a reference, so that the callback does not allocate
+    auto callback = [&completion](BufferLease<const test_payload> value) {
+        ASSERT_TRUE(value);
+        // give the buffer back before signaling the completion
+        value.reset();
+
+        std::lock_guard<std::mutex> lock(completion.lock);
+        completion.count++;
+        completion.cv.notify_one();
+    };
+
+    auto lookups_allocations
+        = [&](awonvm_vector<test_payload, kPageSize>& vec) -> size_t {
+        completion.count = 0;
+
+        test::AllocationCounter counter;
+        size_t buffers_allocations = vec.buffers_system_allocations();
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            vec.async_get(i, callback);
+        }
+
+        std::unique_lock<std::mutex> lock(completion.lock);
+        completion.cv.wait(lock,
+                           [&] { return completion.count == kTestVecSize; });
+
+        return counter.count()
+               + (vec.buffers_system_allocations() - buffers_allocations);
+    };
+
+    size_t allocations[2];
+    size_t steady_buffers_allocations = 0;
+
+    for (bool pooling : {false, true}) {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+        vec.set_buffer_pooling(pooling);
+
+        // At most kTestVecSize reads are in flight: once the pools hold as
+        // many buffers, they never have to allocate. The warm up round fills
+        // the other caches (e.g. the request pools of the schedulers).
+        vec.reserve_buffers(kTestVecSize);
+        lookups_allocations(vec);
+
+        size_t total = 0;
+        for (size_t r = 0; r < kRounds; r++) {
+            size_t buffers_allocations = vec.buffers_system_allocations();
+            total += lookups_allocations(vec);
+            steady_buffers_allocations
+                = vec.buffers_system_allocations() - buffers_allocations;
+        }
+        allocations[pooling] = total;
+
+        std::cout << "Buffer pooling " << (pooling ? "on" : "off") << ": "
+                  << static_cast<double>(total) / (kRounds * kTestVecSize)
+                  << " allocations per lookup\n";
+    }
+
+    // in steady state, the pooled buffers are only recycled
+    ASSERT_EQ(steady_buffers_allocations, 0);
+    ASSERT_LT(allocations[true], allocations[false]);
+}
+
+TEST_P(AWONVMVectorTest, page_cache)
+{
+    constexpr size_t kCachedPages = kTestVecSize / 4;
+    constexpr size_t kPrewarmed   = 100;
+
+    bool direct_io = (GetParam() == ThreadPoolSchedulerCached) ? false : true;
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            __attribute__((aligned(kPageSize))) test_payload payload(i);
+            vec.push_back(payload);
+        }
+        vec.commit();
+    }
+
+    awonvm_vector<test_payload, kPageSize> vec(
+        test_file, get_scheduler(), direct_io);
+    ASSERT_EQ(vec.page_cache(), nullptr);
+    ASSERT_THROW(vec.prewarm_page_cache({0}), std::runtime_error);
+
+    vec.enable_page_cache(kCachedPages * sizeof(test_payload));
+    const PageCache* cache = vec.page_cache();
+    ASSERT_NE(cache, nullptr);
+    ASSERT_EQ(cache->capacity(), kCachedPages);
+
+    std::vector<size_t> prewarmed;
+    for (size_t i = 0; i < kPrewarmed; i++) {
+        prewarmed.push_back(i);
+    }
+    vec.prewarm_page_cache(prewarmed);
+    ASSERT_EQ(cache->size(), kPrewarmed);
+    ASSERT_EQ(cache->hits(), 0);
+    ASSERT_EQ(cache->misses(), 0);
+
+    for (size_t i = 0; i < kPrewarmed; i++) {
+        ASSERT_EQ(vec.get(i), test_payload(i));
+    }
+    ASSERT_EQ(cache->hits(), kPrewarmed);
+    ASSERT_EQ(cache->misses(), 0);
+
+    // read the whole vector, twice, with the async calls: the cache is
+    // smaller than the vector, so pages get evicted
+    std::mutex              lock;
+    std::condition_variable cv;
+    size_t                  completed_count = 0;
+
+    for (size_t round = 0; round < 2; round++) {
+        std::vector<awonvm_vector<test_payload, kPageSize>::GetRequest> reqs;
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            reqs.emplace_back(
+                i, [i, &lock, &cv, &completed_count](
+                       BufferLease<const test_payload> value) {
+                    ASSERT_TRUE(value);
+                    ASSERT_EQ(*value, test_payload(i));
+
+                    std::lock_guard<std::mutex> guard(lock);
+                    completed_count++;
+                    cv.notify_one();
+                });
+        }
+        vec.async_gets(reqs);
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [&] { return completed_count == 2 * kTestVecSize; });
+    }
+
+    ASSERT_EQ(cache->hits() + cache->misses(),
+              kPrewarmed + 2 * kTestVecSize);
+    ASSERT_GE(cache->misses(), kTestVecSize - kCachedPages);
+    ASSERT_EQ(cache->size(), kCachedPages);
+
+    // the values read synchronously are still correct, from the cache or not
+    for (uint64_t i = 0; i < kTestVecSize; i++) {
+        ASSERT_EQ(vec.get(i), test_payload(i));
+    }
+
+    vec.disable_page_cache();
+    ASSERT_EQ(vec.page_cache(), nullptr);
+    ASSERT_EQ(vec.get(1), test_payload(1));
+}
+
+TEST(page_cache, clock_eviction)
+{
+    constexpr size_t kCachePageSize = 8;
+
+    ASSERT_THROW(PageCache(kCachePageSize, kCachePageSize - 1),
+                 std::invalid_argument);
+
+    // a single shard of 4 pages
+    PageCache cache(kCachePageSize, 4 * kCachePageSize, 1);
+    ASSERT_EQ(cache.capacity(), 4);
+
+    std::array<uint8_t, kCachePageSize> page;
+    for (size_t i = 0; i < 4; i++) {
+        page.fill(i);
+        cache.insert(i, page.data());
+    }
+    ASSERT_EQ(cache.size(), 4);
+
+    // reference pages 0 and 1
+    ASSERT_TRUE(cache.lookup(0, page.data()));
+    ASSERT_EQ(page[0], 0);
+    ASSERT_TRUE(cache.lookup(1, page.data()));
+    ASSERT_EQ(page[0], 1);
+    ASSERT_FALSE(cache.lookup(5, page.data()));
+
+    ASSERT_EQ(cache.hits(), 2);
+    ASSERT_EQ(cache.misses(), 1);
+
+    // pages 0 and 1 get a second chance: page 2 is evicted
+    page.fill(4);
+    cache.insert(4, page.data());
+
+    ASSERT_TRUE(cache.contains(0));
+    ASSERT_TRUE(cache.contains(1));
+    ASSERT_FALSE(cache.contains(2));
+    ASSERT_TRUE(cache.contains(3));
+    ASSERT_TRUE(cache.contains(4));
+
+    // the reference bits of 0 and 1 were cleared by the previous sweep
+    page.fill(5);
+    cache.insert(5, page.data());
+    ASSERT_FALSE(cache.contains(3));
+
+    // overwrite a cached page
+    page.fill(42);
+    cache.insert(4, page.data());
+    ASSERT_TRUE(cache.lookup(4, page.data()));
+    ASSERT_EQ(page[kCachePageSize - 1], 42);
+    ASSERT_EQ(cache.size(), 4);
+
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_FALSE(cache.contains(0));
+
+    cache.reset_stats();
+    ASSERT_EQ(cache.hits(), 0);
+    ASSERT_EQ(cache.misses(), 0);
+}
+
+TEST(awonvm_vector, buffered_writes)
+{
+    silent_cleanup();
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, false);
+
+        // a few values per buffer, so that the buffers get flushed several
+        // times, and the last one is partially filled
+        vec.enable_buffered_writes(3 * sizeof(test_payload));
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            // values do not need to be aligned
+            test_payload payload(i);
+            ASSERT_EQ(vec.push_back(payload), i);
+        }
+
+        ASSERT_THROW(vec.async_push_back(test_payload(0)),
+                     std::runtime_error);
+
+        vec.flush_writes();
+        vec.commit();
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            ASSERT_EQ(vec.get(i), test_payload(i));
+        }
+    }
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, true);
+
+        ASSERT_TRUE(vec.is_committed());
+        ASSERT_EQ(vec.size(), kTestVecSize);
+        ASSERT_THROW(vec.enable_buffered_writes(), std::runtime_error);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            ASSERT_EQ(vec.get(i), test_payload(i));
+        }
+    }
+
+    cleanup();
+
+    // the size of the file is not a multiple of the page size
+    {
+        awonvm_vector<uint64_t> vec(test_file, false);
+        vec.enable_buffered_writes(kPageSize);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            vec.push_back(i);
+        }
+        vec.commit();
+    }
+    {
+        awonvm_vector<uint64_t> vec(test_file, false);
+
+        ASSERT_EQ(vec.size(), kTestVecSize);
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            ASSERT_EQ(vec.get(i), i);
+        }
+    }
+
+    cleanup();
+}
+
+TEST(awonvm_vector, memory_map)
+{
+    silent_cleanup();
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, false);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            __attribute__((aligned(kPageSize))) test_payload payload(i);
+            vec.push_back(payload);
+        }
+        // the vector must be committed before being mapped
+        EXPECT_THROW(vec.memory_map(), std::runtime_error);
+
+        vec.commit();
+    }
+
+    MemoryMapOptions populate_options;
+    populate_options.populate = true;
+
+    MemoryMapOptions hugepages_options;
+    hugepages_options.advice     = MemoryMapAdvice::WillNeed;
+    hugepages_options.huge_pages = true;
+
+    for (const auto& options : {MemoryMapOptions(),
+                                populate_options,
+                                hugepages_options}) {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, false);
+
+        ASSERT_FALSE(vec.is_memory_mapped());
+        vec.memory_map(options);
+        ASSERT_TRUE(vec.is_memory_mapped());
+
+        size_t completed_count = 0;
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            ASSERT_EQ(vec.get(i), test_payload(i));
+
+            // the returned reference points to the mapping
+            test_payload        buffer;
+            const test_payload& value = vec.get(i, buffer);
+            ASSERT_NE(&value, &buffer);
+            ASSERT_EQ(value, test_payload(i));
+
+            // the callback is run synchronously
+            vec.async_get(i, [i, &completed_count](
+                                 BufferLease<const test_payload> lease) {
+                ASSERT_TRUE(lease);
+                ASSERT_EQ(*lease, test_payload(i));
+                completed_count++;
+            });
+            ASSERT_EQ(completed_count, i + 1);
+        }
+        ASSERT_THROW(vec.get(kTestVecSize), std::invalid_argument);
+
+        // back to reading the file
+        vec.unmap();
+        ASSERT_FALSE(vec.is_memory_mapped());
+
+        test_payload buffer;
+        ASSERT_EQ(&vec.get(1, buffer), &buffer);
+        ASSERT_EQ(buffer, test_payload(1));
+    }
+
+    // the mapping is read-only, and so are the leased values
+    using lease_type = awonvm_vector<test_payload, kPageSize>::value_lease_type;
+    static_assert(std::is_const<lease_type::element_type>::value,
+                  "The leased values must be read-only");
+
+    cleanup();
+
+    // an empty vector can be mapped too
+    {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, false);
+        vec.commit();
+
+        vec.memory_map();
+        ASSERT_TRUE(vec.is_memory_mapped());
+        ASSERT_THROW(vec.get(0), std::invalid_argument);
+
+        vec.unmap();
+        ASSERT_FALSE(vec.is_memory_mapped());
+    }
+
+    cleanup();
+}
+
+
+// Scheduler only submitting the first half of the batches of reads
+class HalfBatchScheduler : public Scheduler
+{
+public:
+    HalfBatchScheduler() : m_inner(make_thread_pool_aio_scheduler())
+    {
+    }
+
+    void wait_completions() override
+    {
+        m_inner->wait_completions();
+    }
+
+    int submit_pread(int                     fd,
+                     void*                   buf,
+                     size_t                  len,
+                     off_t                   offset,
+                     void*                   data,
+                     scheduler_callback_type callback) override
+    {
+        return m_inner->submit_pread(
+            fd, buf, len, offset, data, std::move(callback));
+    }
+
+    int submit_preads(const std::vector<PReadSumission>& subs) override
+    {
+        std::vector<PReadSumission> half(subs.begin(),
+                                         subs.begin() + subs.size() / 2);
+        return m_inner->submit_preads(half);
+    }
+
+    int submit_pwrite(int                     fd,
+                      void*                   buf,
+                      size_t                  len,
+                      off_t                   offset,
+                      void*                   data,
+                      scheduler_callback_type callback) override
+    {
+        return m_inner->submit_pwrite(
+            fd, buf, len, offset, data, std::move(callback));
+    }
+
+    Scheduler* duplicate() const override
+    {
+        return new HalfBatchScheduler();
+    }
+
+private:
+    std::unique_ptr<Scheduler> m_inner;
+};
+
+TEST(awonvm_vector, partial_batch_submission)
+{
+    constexpr size_t kBatchSize = 10;
+
+    silent_cleanup();
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(test_file, false);
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            vec.push_back(test_payload(i));
+        }
+        vec.commit();
+    }
+
+    std::mutex            lock;
+    std::vector<uint64_t> completed;
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file,
+            std::unique_ptr<Scheduler>(new HalfBatchScheduler()),
+            false);
+
+        std::vector<awonvm_vector<test_payload, kPageSize>::GetRequest> reqs;
+        for (uint64_t i = 0; i < kBatchSize; i++) {
+            reqs.emplace_back(i, [i, &lock, &completed](
+                                     BufferLease<const test_payload> value) {
+                ASSERT_TRUE(value);
+                ASSERT_EQ(*value, test_payload(i));
+
+                std::lock_guard<std::mutex> guard(lock);
+                completed.push_back(i);
+            });
+        }
+
+        ASSERT_THROW(vec.async_gets(reqs), std::runtime_error);
+
+        // the buffers are recycled by the next reads
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            vec.async_get(i, [i](BufferLease<const test_payload> value) {
+                ASSERT_TRUE(value);
+                ASSERT_EQ(*value, test_payload(i));
+            });
+        }
+    }
+
+    // only the accepted reads, i.e. the first half of the batch, complete
+    std::sort(completed.begin(), completed.end());
+    std::vector<uint64_t> expected(kBatchSize / 2);
+    std::iota(expected.begin(), expected.end(), 0);
+    ASSERT_EQ(completed, expected);
+
+    cleanup();
+}
 
 INSTANTIATE_TEST_SUITE_P(AWONVMVectorTest,
                          AWONVMVectorTest,
@@ -166,7 +693,12 @@ INSTANTIATE_TEST_SUITE_P(AWONVMVectorTest,
                                          ThreadPoolSchedulerDirect
 #ifdef HAS_LIBAIO
                                          ,
-                                         LinuxAIOScheduler
+                                         LinuxAIOScheduler,
+                                         LinuxAIOSchedulerMultiThreaded
+#endif
+#ifdef HAS_LIBURING
+                                         ,
+                                         IoUringScheduler
 #endif
                                          ));
 
@@ -24,6 +24,7 @@ namespace test {
 
 using TestDianaClient = sse::diana::DianaClient<uint64_t>;
 using TestDianaServer = sse::diana::DianaServer<uint64_t>;
+using TestDianaMMapServer = sse::diana::DianaMMapServer<uint64_t>;
 
 const unsigned concurrency_level
     = std::max<unsigned>(3, std::thread::hardware_concurrency());
@@ -40,8 +41,9 @@ constexpr auto diana_test_dir   = SSE_DIANA_TEST_DIR;
 constexpr auto client_data_path = SSE_DIANA_TEST_DIR "/client.dat";
 constexpr auto server_data_path = SSE_DIANA_TEST_DIR "/server.dat";
 
+template<class Server>
 void create_client_server(std::unique_ptr<TestDianaClient>& client,
-                          std::unique_ptr<TestDianaServer>& server)
+                          std::unique_ptr<Server>&          server)
 {
     // check that the key files do not already exist
     ASSERT_FALSE(utility::exists(client_master_key_path));
@@ -73,7 +75,7 @@ void create_client_server(std::unique_ptr<TestDianaClient>& client,
         sse::crypto::Key<TestDianaClient::kKeySize>(master_key.data()),
         sse::crypto::Key<TestDianaClient::kKeySize>(token_master_key.data())));
 
-    server.reset(new TestDianaServer(server_data_path));
+    server.reset(new Server(server_data_path));
 }
 
 void restart_client_server(std::unique_ptr<TestDianaClient>& client,
@@ -162,6 +164,75 @@ TEST(diana, insertion_search)
     sse::test::test_search_correctness(client, server, test_db);
 }
 
+template<class Server>
+static void test_build_edb()
+{
+    std::unique_ptr<TestDianaClient> client;
+    std::unique_ptr<Server>          server;
+
+    sse::test::cleanup_directory(diana_test_dir);
+
+    create_client_server(client, server);
+    // the database is built offline (with the default RocksDB profile for
+    // the RocksDB server)
+    server.reset(nullptr);
+
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1, 2, 3, 4}}, {"kw_2", {0}}, {"kw_3", {5, 7}}};
+
+    std::list<std::pair<std::string, uint64_t>> update_list;
+    for (const auto& kw_list : test_db) {
+        for (uint64_t index : kw_list.second) {
+            update_list.emplace_back(kw_list.first, index);
+        }
+    }
+    const auto requests = client->bulk_insertion_request(update_list);
+
+    Server::build_edb(server_data_path, requests.begin(), requests.end());
+    ASSERT_FALSE(utility::exists(std::string(server_data_path) + ".build_tmp"));
+
+    server.reset(new Server(server_data_path));
+    sse::test::test_search_correctness(client, server, test_db);
+
+    // the database can still be updated after the ingestion
+    sse::test::insert_entry(client, server, "kw_2", 8);
+    const auto res = sse::test::search_keyword(client, server, "kw_2");
+    ASSERT_EQ(std::set<uint64_t>(res.begin(), res.end()),
+              std::set<uint64_t>({0, 8}));
+}
+
+TEST(diana, build_edb)
+{
+    test_build_edb<TestDianaServer>();
+}
+
+TEST(diana, mmap_build_edb)
+{
+    test_build_edb<TestDianaMMapServer>();
+}
+
+TEST(diana, mmap_insertion_search)
+{
+    std::unique_ptr<TestDianaClient>     client;
+    std::unique_ptr<TestDianaMMapServer> server;
+
+    sse::test::cleanup_directory(diana_test_dir);
+    create_client_server(client, server);
+
+    std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1}}, {"kw_2", {0}}, {"kw_3", {0}}};
+
+    sse::test::insert_database(client, server, test_db);
+    sse::test::test_search_correctness(client, server, test_db);
+
+    // reopen the table
+    server.reset(new TestDianaMMapServer(server_data_path));
+
+    sse::test::insert_entry(client, server, "kw_2", 1);
+    test_db["kw_2"].push_back(1);
+    sse::test::test_search_correctness(client, server, test_db);
+}
+
 template<class U, class V>
 inline void check_same_results(const U& l1, const V& l2)
 {
@@ -173,11 +244,11 @@ inline void check_same_results(const U& l1, const V& l2)
 
 
 // To test all the different search algorithms
-template<class SearchFun>
+template<class Server = TestDianaServer, class SearchFun>
 static void test_search_function(SearchFun search_fun)
 {
     std::unique_ptr<TestDianaClient> client;
-    std::unique_ptr<TestDianaServer> server;
+    std::unique_ptr<Server>          server;
 
     // start by cleaning up the test directory
     sse::test::cleanup_directory(diana_test_dir);
@@ -212,6 +283,18 @@ TEST(diana, search)
     test_search_function(search_fun);
 }
 
+TEST(diana, search_vec)
+{
+    auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search(req, res_vec);
+
+        return std::list<uint64_t>(res_vec.begin(), res_vec.end());
+    };
+    test_search_function(search_fun);
+}
+
 TEST(diana, search_parallel)
 {
     auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
@@ -286,6 +369,22 @@ TEST(diana, search_parallel_thread_local_callback)
     };
     test_search_function(search_fun);
 }
+
+TEST(diana, mmap_search)
+{
+    auto search_fun = [](TestDianaMMapServer& server, SearchRequest& req) {
+        return server.search(req);
+    };
+    test_search_function<TestDianaMMapServer>(search_fun);
+}
+
+TEST(diana, mmap_search_parallel)
+{
+    auto search_fun = [](TestDianaMMapServer& server, SearchRequest& req) {
+        return server.search_parallel(req, concurrency_level);
+    };
+    test_search_function<TestDianaMMapServer>(search_fun);
+}
 } // namespace test
 } // namespace diana
 } // namespace sse
\ No newline at end of file
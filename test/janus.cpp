@@ -1,7 +1,9 @@
 #include "utility.hpp"
 
+#include <sse/schemes/janus/decryption_engine.hpp>
 #include <sse/schemes/janus/janus_client.hpp>
 #include <sse/schemes/janus/janus_server.hpp>
+#include <sse/schemes/janus/tag_set.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <sse/crypto/utils.hpp>
@@ -13,7 +15,10 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <random>
+#include <set>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -214,6 +219,18 @@ TEST(janus, insertion_removal_search)
     test_search_removal(search_fun);
 }
 
+TEST(janus, insertion_removal_search_vec)
+{
+    auto search_fun = [](Server& server, janus::SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search(req, res_vec);
+
+        return std::list<uint64_t>(res_vec.begin(), res_vec.end());
+    };
+    test_search_removal(search_fun);
+}
+
 TEST(janus, insertion_removal_parallel_search)
 {
     auto search_fun = [](Server& server, janus::SearchRequest& req) {
@@ -222,6 +239,108 @@ TEST(janus, insertion_removal_parallel_search)
     test_search_removal(search_fun);
 }
 
+TEST(janus, insertion_removal_parallel_search_threads)
+{
+    auto search_fun = [](Server& server, janus::SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search_parallel(req, 4, res_vec);
+
+        return std::list<uint64_t>(res_vec.begin(), res_vec.end());
+    };
+    test_search_removal(search_fun);
+}
+
+TEST(janus, search_many_insertions)
+{
+    std::unique_ptr<Client> client;
+    std::unique_ptr<Server> server;
+
+    sse::test::cleanup_directory(janus_test_dir);
+    create_client_server(client, server);
+
+    // more insertions than a decryption chunk, so that they are decrypted
+    // by several tasks
+    constexpr uint64_t kBatchSize = 3 * DecryptionEngine::kChunkSize;
+
+    auto search_req_fun = [](Client& client, const std::string& kw) {
+        return client.search_request(kw);
+    };
+    auto search_fun = [](Server& server, janus::SearchRequest& req) {
+        return server.search(req);
+    };
+    auto search_parallel_fun = [](Server& server, janus::SearchRequest& req) {
+        return server.search_parallel(req, 4);
+    };
+
+    std::map<std::string, std::list<uint64_t>> test_db;
+    for (uint64_t i = 0; i < kBatchSize; i++) {
+        test_db["kw_1"].push_back(i);
+    }
+    sse::test::insert_database(client, server, test_db);
+
+    for (uint64_t i = 0; i < kBatchSize; i += 50) {
+        server->remove(client->removal_request("kw_1", i));
+        test_db["kw_1"].remove(i);
+    }
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+
+    // a second batch, for the parallel search
+    for (uint64_t i = kBatchSize; i < 2 * kBatchSize; i++) {
+        sse::test::insert_entry(client, server, "kw_1", i);
+        test_db["kw_1"].push_back(i);
+    }
+    for (uint64_t i = 1; i < 2 * kBatchSize; i += 50) {
+        server->remove(client->removal_request("kw_1", i));
+        test_db["kw_1"].remove(i);
+    }
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_parallel_fun);
+}
+
+TEST(janus, tag_set)
+{
+    std::mt19937_64 rng(0x6a616e7573);
+
+    auto random_tag = [&rng]() {
+        crypto::punct::tag_type tag;
+        for (auto& b : tag) {
+            b = static_cast<uint8_t>(rng());
+        }
+        return tag;
+    };
+
+    for (bool bloom_prefilter : {true, false}) {
+        // start small, so that the table is rehashed several times
+        TagSet                            tag_set(0, bloom_prefilter);
+        std::set<crypto::punct::tag_type> reference;
+
+        ASSERT_TRUE(tag_set.empty());
+        ASSERT_FALSE(tag_set.contains(random_tag()));
+
+        for (size_t i = 0; i < 10000; i++) {
+            auto tag = random_tag();
+            tag_set.insert(tag);
+            reference.insert(tag);
+        }
+        // duplicates and the zero tag
+        tag_set.insert(*reference.begin());
+        tag_set.insert(crypto::punct::tag_type{});
+        tag_set.insert(crypto::punct::tag_type{});
+        reference.insert(crypto::punct::tag_type{});
+
+        ASSERT_EQ(tag_set.size(), reference.size());
+        for (const auto& tag : reference) {
+            ASSERT_TRUE(tag_set.contains(tag));
+        }
+        for (size_t i = 0; i < 10000; i++) {
+            auto tag = random_tag();
+            ASSERT_EQ(tag_set.contains(tag), reference.count(tag) > 0);
+        }
+    }
+}
+
 } // namespace test
 } // namespace janus
 } // namespace sse
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "utility.hpp"
+
+#include <sse/schemes/utils/mmap_hash_table.hpp>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+constexpr auto mmap_table_test_dir = "mmap_table_test";
+
+using table_type = sophos::MMapHashTable<16, uint64_t>;
+
+static table_type::key_type random_key(std::mt19937_64& rng)
+{
+    table_type::key_type key;
+    for (auto& b : key) {
+        b = static_cast<uint8_t>(rng());
+    }
+    return key;
+}
+
+TEST(mmap_hash_table, insert_remove)
+{
+    constexpr size_t kEntriesCount = 20000;
+
+    cleanup_directory(mmap_table_test_dir);
+
+    std::mt19937_64                          rng(42);
+    std::map<table_type::key_type, uint64_t> reference;
+
+    // start small, to go through several rehashes
+    std::unique_ptr<table_type> table(new table_type(mmap_table_test_dir, 8));
+
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        auto key = random_key(rng);
+        ASSERT_TRUE(table->put(key, i));
+        reference[key] = i;
+    }
+    ASSERT_EQ(table->approximate_size(), reference.size());
+    ASSERT_GE(4 * table->capacity(), 3 * reference.size());
+
+    // overwrite and remove some entries
+    size_t i = 0;
+    for (auto it = reference.begin(); it != reference.end(); i++) {
+        if (i % 3 == 0) {
+            ASSERT_TRUE(table->remove(it->first));
+            ASSERT_FALSE(table->remove(it->first));
+            it = reference.erase(it);
+        } else {
+            if (i % 3 == 1) {
+                it->second += kEntriesCount;
+                ASSERT_TRUE(table->put(it->first, it->second));
+            }
+            ++it;
+        }
+    }
+    ASSERT_EQ(table->approximate_size(), reference.size());
+
+    uint64_t v_get;
+    for (const auto& entry : reference) {
+        ASSERT_TRUE(table->get(entry.first, v_get));
+        ASSERT_EQ(v_get, entry.second);
+    }
+    for (size_t j = 0; j < 1000; j++) {
+        ASSERT_FALSE(table->get(random_key(rng), v_get));
+    }
+
+    // the table is reloaded from its file
+    table->flush();
+    table.reset(new table_type(mmap_table_test_dir));
+
+    ASSERT_EQ(table->approximate_size(), reference.size());
+    for (const auto& entry : reference) {
+        ASSERT_TRUE(table->get(entry.first, v_get));
+        ASSERT_EQ(v_get, entry.second);
+    }
+
+    table.reset();
+
+    // a table cannot be opened with other key or value sizes
+    ASSERT_THROW((sophos::MMapHashTable<16, uint32_t>(mmap_table_test_dir)),
+                 std::runtime_error);
+}
+
+TEST(mmap_hash_table, batches)
+{
+    constexpr size_t kEntriesCount = 1000;
+
+    struct Entry
+    {
+        table_type::key_type key;
+        uint64_t             value;
+    };
+
+    cleanup_directory(mmap_table_test_dir);
+
+    std::mt19937_64    rng(7);
+    std::vector<Entry> entries;
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        entries.push_back(Entry{random_key(rng), i});
+    }
+
+    table_type table(mmap_table_test_dir);
+    ASSERT_TRUE(table.put_batch(
+        entries.data(), 2 * kEntriesCount / 3, &Entry::key, &Entry::value));
+
+    std::vector<table_type::key_type> keys;
+    for (const auto& e : entries) {
+        keys.push_back(e.key);
+    }
+    std::vector<uint64_t>   values(kEntriesCount);
+    std::unique_ptr<bool[]> found(new bool[kEntriesCount]);
+
+    ASSERT_EQ(
+        table.multi_get(keys.data(), kEntriesCount, values.data(), found.get()),
+        2 * kEntriesCount / 3);
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        ASSERT_EQ(found[i], i < 2 * kEntriesCount / 3);
+        if (found[i]) {
+            ASSERT_EQ(values[i], i);
+        }
+    }
+}
+
+TEST(mmap_hash_table, builder)
+{
+    constexpr auto   tmp_dir       = "mmap_table_test_tmp";
+    constexpr size_t kEntriesCount = 1000;
+
+    cleanup_directory(mmap_table_test_dir);
+    utility::remove_directory(tmp_dir);
+
+    using builder_type = table_type::builder_type<16, uint64_t>;
+
+    std::mt19937_64                   rng(1);
+    std::vector<table_type::key_type> keys;
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        keys.push_back(random_key(rng));
+    }
+
+    table_type table(mmap_table_test_dir);
+    {
+        builder_type builder(tmp_dir);
+
+        std::stringstream stream;
+        for (size_t i = 0; i < kEntriesCount; i++) {
+            if (i < kEntriesCount / 2) {
+                builder.add(keys[i], i);
+            } else {
+                builder_type::write_record(stream, keys[i], i);
+            }
+        }
+        builder.add_stream(stream);
+        builder.add(keys[0], 4242);
+
+        ASSERT_EQ(builder.ingest(table), kEntriesCount);
+    }
+    ASSERT_FALSE(utility::exists(tmp_dir));
+
+    uint64_t v_get = 0;
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        ASSERT_TRUE(table.get(keys[i], v_get));
+        ASSERT_EQ(v_get, (i == 0) ? 4242 : i);
+    }
+
+    // truncated update stream
+    builder_type      builder(tmp_dir);
+    std::stringstream stream;
+    builder_type::write_record(stream, keys[0], 0);
+    stream.write("\x01\x02", 2);
+    ASSERT_THROW(builder.add_stream(stream), std::runtime_error);
+}
+
+} // namespace test
+} // namespace sse
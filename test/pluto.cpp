@@ -4,6 +4,11 @@
 #include <sse/schemes/pluto/pluto_client.hpp>
 #include <sse/schemes/pluto/pluto_server.hpp>
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace sse {
@@ -69,6 +74,60 @@ void test_pluto_builder(size_t n_elements, const std::string& json_path)
         ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
                   std::set<index_type>(long_list.begin(), long_list.end()));
 
+        // the asynchronous search must stream the same lists, at consecutive
+        // block indices
+        {
+            using ht_value_type = typename Params::ht_value_type;
+
+            std::map<uint32_t, ht_value_type>          lists;
+            tethys::KeyedBucketPair<Params::kPageSize> buckets;
+
+            std::mutex              lock;
+            std::condition_variable cv;
+            bool                    done    = false;
+            bool                    success = false;
+
+            server.async_search(
+                sr,
+                [&lists](uint32_t block, const ht_value_type& list) {
+                    ASSERT_TRUE(lists.emplace(block, list).second);
+                },
+                [&buckets](tethys::KeyedBucketPair<Params::kPageSize> b) {
+                    buckets = std::move(b);
+                },
+                [&](bool ok) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    success = ok;
+                    done    = true;
+                    cv.notify_one();
+                });
+
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&done] { return done; });
+
+            ASSERT_TRUE(success);
+
+            std::vector<index_type> complete_lists;
+            uint32_t                expected_block = 1;
+            for (const auto& list : lists) {
+                ASSERT_EQ(list.first, expected_block++);
+                complete_lists.insert(complete_lists.end(),
+                                      list.second.begin(),
+                                      list.second.end());
+            }
+            EXPECT_EQ(complete_lists, bl.complete_lists);
+
+            EXPECT_EQ(buckets.key, bl.tethys_bucket_pair.key);
+            EXPECT_EQ(buckets.buckets.index_0,
+                      bl.tethys_bucket_pair.buckets.index_0);
+            EXPECT_EQ(buckets.buckets.index_1,
+                      bl.tethys_bucket_pair.buckets.index_1);
+            EXPECT_EQ(buckets.buckets.payload_0,
+                      bl.tethys_bucket_pair.buckets.payload_0);
+            EXPECT_EQ(buckets.buckets.payload_1,
+                      bl.tethys_bucket_pair.buckets.payload_1);
+        }
+
         sr  = client.search_request("beta");
         bl  = server.search(sr);
         res = client.decode_search_results(sr, bl);
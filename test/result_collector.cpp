@@ -0,0 +1,110 @@
+#include <sse/schemes/utils/result_collector.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+constexpr uint32_t kCollectorThreadsCount = 4;
+constexpr size_t   kResultsCount          = 100000;
+
+TEST(result_collector, drain)
+{
+    ResultCollector<size_t> collector(64);
+
+    ThreadPool pool(kCollectorThreadsCount);
+    for (size_t i = 0; i < kResultsCount; i++) {
+        pool.post([&collector, i]() { collector.push(i); });
+    }
+    pool.join();
+
+    ASSERT_EQ(collector.size(), kResultsCount);
+
+    std::vector<size_t> results = collector.to_vector();
+    ASSERT_EQ(results.size(), kResultsCount);
+
+    std::sort(results.begin(), results.end());
+    for (size_t i = 0; i < kResultsCount; i++) {
+        ASSERT_EQ(results[i], i);
+    }
+}
+
+TEST(result_collector, sink)
+{
+    constexpr size_t kChunkSize = 100;
+
+    std::vector<size_t> results;
+    std::atomic<bool>   in_sink{false};
+    size_t              calls = 0;
+
+    auto sink = [&](const size_t* values, size_t count) {
+        // the sink is never called concurrently
+        ASSERT_FALSE(in_sink.exchange(true));
+        ASSERT_LE(count, kChunkSize);
+
+        results.insert(results.end(), values, values + count);
+        calls++;
+
+        in_sink = false;
+    };
+
+    ResultCollector<size_t> collector(sink, kChunkSize);
+
+    ThreadPool pool(kCollectorThreadsCount);
+    for (size_t i = 0; i < kResultsCount; i++) {
+        pool.post([&collector, i]() { collector.push(i); });
+    }
+    pool.join();
+
+    // the full chunks have already been given to the sink
+    ASSERT_LE(kResultsCount - results.size(),
+              kCollectorThreadsCount * kChunkSize);
+
+    collector.flush();
+    ASSERT_EQ(collector.size(), kResultsCount);
+    ASSERT_EQ(results.size(), kResultsCount);
+    ASSERT_LE(calls, kResultsCount / kChunkSize + kCollectorThreadsCount);
+
+    std::sort(results.begin(), results.end());
+    for (size_t i = 0; i < kResultsCount; i++) {
+        ASSERT_EQ(results[i], i);
+    }
+}
+
+TEST(result_collector, several_collectors)
+{
+    // a thread pushing alternately to two collectors keeps one buffer per
+    // collector
+    ResultCollector<int> even(4);
+    ResultCollector<int> odd(4);
+
+    for (int i = 0; i < 100; i++) {
+        ((i % 2 == 0) ? even : odd).push(i);
+    }
+
+    std::vector<int> even_results = even.to_vector();
+    std::vector<int> odd_results  = odd.to_vector();
+
+    ASSERT_EQ(even_results.size(), 50);
+    ASSERT_EQ(odd_results.size(), 50);
+    for (int i = 0; i < 50; i++) {
+        ASSERT_EQ(even_results[i], 2 * i);
+        ASSERT_EQ(odd_results[i], 2 * i + 1);
+    }
+
+    // a collector created at the address of a destroyed one does not reuse
+    // its buffers
+    for (int round = 0; round < 3; round++) {
+        ResultCollector<int> collector;
+        collector.push(round);
+        ASSERT_EQ(collector.to_vector(), std::vector<int>{round});
+    }
+}
+
+} // namespace test
+} // namespace sse
@@ -1,11 +1,19 @@
+#include "allocation_counter.hpp"
 #include "utility.hpp"
 
+#include <sse/schemes/utils/list_codec.hpp>
+#include <sse/schemes/utils/rocksdb_profile.hpp>
+#include <sse/schemes/utils/rocksdb_sst_builder.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 
 #include <cstring>
 
+#include <fstream>
+#include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -86,6 +94,197 @@ TEST(rocksdb, entry_removal)
     ASSERT_FALSE(db->get(key2, v_get));
 }
 
+TEST(rocksdb, multi_get)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RockDBWrapper> db(
+        new sophos::RockDBWrapper(rocksdb_test_dir));
+
+    constexpr size_t kKeysCount = 100;
+
+    std::vector<std::array<uint8_t, 2>> keys(kKeysCount);
+    for (size_t i = 0; i < kKeysCount; i++) {
+        keys[i] = {{static_cast<uint8_t>(i), 0x42}};
+
+        // only insert the even keys
+        if (i % 2 == 0) {
+            ASSERT_TRUE(db->put(keys[i], static_cast<uint64_t>(3 * i)));
+        }
+    }
+
+    std::vector<uint64_t> values(kKeysCount, 0);
+    bool                  found[kKeysCount];
+
+    ASSERT_EQ(db->multi_get(keys.data(), kKeysCount, values.data(), found),
+              kKeysCount / 2);
+
+    for (size_t i = 0; i < kKeysCount; i++) {
+        ASSERT_EQ(found[i], i % 2 == 0);
+        if (found[i]) {
+            ASSERT_EQ(values[i], 3 * i);
+        }
+    }
+
+    // empty batch
+    ASSERT_EQ(db->multi_get(keys.data(), 0, values.data(), found), 0);
+}
+
+TEST(rocksdb, get_allocations)
+{
+    constexpr size_t kEntriesCount = 1000;
+
+    // the values are larger than the small string buffer, so reading them in
+    // an std::string allocates
+    using value_type = std::array<uint8_t, 64>;
+
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RockDBWrapper> db(
+        new sophos::RockDBWrapper(rocksdb_test_dir));
+
+    std::vector<std::array<uint8_t, 8>> keys(kEntriesCount);
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        value_type v;
+        v.fill(static_cast<uint8_t>(i));
+        memcpy(keys[i].data(), &i, sizeof(i));
+
+        ASSERT_TRUE(db->put(keys[i], v));
+    }
+    // read from the tables instead of the memtable
+    db->flush(true);
+
+    value_type v_get;
+
+    size_t copied_allocations;
+    {
+        test::AllocationCounter counter;
+        for (const auto& k : keys) {
+            std::string value;
+            ASSERT_TRUE(db->get(std::string(k.begin(), k.end()), value));
+        }
+        copied_allocations = counter.count();
+    }
+
+    size_t pinned_allocations;
+    {
+        test::AllocationCounter counter;
+        for (size_t i = 0; i < kEntriesCount; i++) {
+            ASSERT_TRUE(db->get(keys[i], v_get));
+            ASSERT_EQ(v_get[0], static_cast<uint8_t>(i));
+        }
+        pinned_allocations = counter.count();
+    }
+
+    std::cout << "Copied gets: "
+              << static_cast<double>(copied_allocations) / kEntriesCount
+              << " allocations per get\n";
+    std::cout << "Pinned gets: "
+              << static_cast<double>(pinned_allocations) / kEntriesCount
+              << " allocations per get\n";
+
+    ASSERT_LT(pinned_allocations, copied_allocations);
+}
+
+TEST(rocksdb, batch_insertion)
+{
+    struct Entry
+    {
+        std::array<uint8_t, 2> key;
+        uint64_t               value;
+    };
+
+    for (bool disable_wal : {false, true}) {
+        cleanup_directory(rocksdb_test_dir);
+
+        std::unique_ptr<sophos::RockDBWrapper> db(
+            new sophos::RockDBWrapper(rocksdb_test_dir));
+
+        std::vector<Entry> entries(100);
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].key   = {{static_cast<uint8_t>(i), 0x01}};
+            entries[i].value = 7 * i;
+        }
+
+        ASSERT_TRUE(db->put_batch(entries.data(),
+                                  entries.size(),
+                                  &Entry::key,
+                                  &Entry::value,
+                                  disable_wal));
+        // empty batch
+        ASSERT_TRUE(
+            db->put_batch(entries.data(), 0, &Entry::key, &Entry::value));
+
+        db->flush(true);
+
+        // re-open the database
+        db.reset(new sophos::RockDBWrapper(rocksdb_test_dir));
+
+        uint64_t v_get = 0;
+        for (const auto& e : entries) {
+            ASSERT_TRUE(db->get(e.key, v_get));
+            ASSERT_EQ(e.value, v_get);
+        }
+    }
+}
+
+TEST(rocksdb, sst_ingestion)
+{
+    constexpr auto   sst_tmp_dir   = "rocksdb_test_sst";
+    constexpr size_t kEntriesCount = 1000;
+
+    cleanup_directory(rocksdb_test_dir);
+    utility::remove_directory(sst_tmp_dir);
+
+    using builder_type = sophos::RockDBSSTBuilder<2, uint64_t>;
+
+    auto key = [](size_t i) -> builder_type::key_type {
+        // insert the keys out of order
+        size_t k = (i * 7919) % kEntriesCount;
+        return {{static_cast<uint8_t>(k >> 8), static_cast<uint8_t>(k)}};
+    };
+
+    std::unique_ptr<sophos::RockDBWrapper> db(
+        new sophos::RockDBWrapper(rocksdb_test_dir));
+    {
+        // small runs, to test the merge
+        builder_type builder(sst_tmp_dir, 64);
+
+        // the first half of the entries is added directly, the other half
+        // from an update stream
+        std::stringstream stream;
+        for (size_t i = 0; i < kEntriesCount; i++) {
+            if (i < kEntriesCount / 2) {
+                builder.add(key(i), i);
+            } else {
+                builder_type::write_record(stream, key(i), i);
+            }
+        }
+        builder.add_stream(stream);
+
+        // overwrite a key added in a previous run
+        builder.add(key(0), 4242);
+
+        ASSERT_EQ(builder.ingest(*db), kEntriesCount);
+    }
+    ASSERT_FALSE(utility::exists(sst_tmp_dir));
+
+    uint64_t v_get = 0;
+    for (size_t i = 0; i < kEntriesCount; i++) {
+        ASSERT_TRUE(db->get(key(i), v_get));
+        ASSERT_EQ(v_get, (i == 0) ? 4242 : i);
+    }
+
+    // truncated update stream
+    {
+        builder_type      builder(sst_tmp_dir);
+        std::stringstream stream;
+        builder_type::write_record(stream, key(0), 0);
+        stream.write("abc", 3);
+
+        ASSERT_THROW(builder.add_stream(stream), std::runtime_error);
+    }
+}
 
 TEST(rocksdb, entry_persistence)
 {
@@ -212,6 +411,91 @@ TEST(rocksdb, counters_persistence)
     ASSERT_EQ(0, v_get);
 }
 
+TEST(rocksdb, profiles)
+{
+    using utility::RocksDBProfile;
+
+    for (const auto& name : {"cuckoo-point-lookup",
+                             "bulk-load",
+                             "read-mostly",
+                             "memory-constrained"}) {
+        RocksDBProfile profile = RocksDBProfile::named(name);
+        ASSERT_EQ(profile.name, name);
+
+        // all the stores can be opened with every profile
+        cleanup_directory(rocksdb_test_dir);
+        {
+            sophos::RockDBWrapper db(rocksdb_test_dir, profile);
+
+            std::array<uint8_t, 2> key{{0x01, 0x02}};
+            uint64_t               v_get = 0;
+
+            ASSERT_TRUE(db.put(key, uint64_t(1789)));
+            ASSERT_TRUE(db.get(key, v_get));
+            ASSERT_EQ(v_get, 1789);
+
+            // a flush does not compact the database
+            db.flush();
+            v_get = 0;
+            ASSERT_TRUE(db.get(key, v_get));
+            ASSERT_EQ(v_get, 1789);
+
+            // the bulk-load profile compacts the database at this point
+            db.finish_bulk_load();
+            v_get = 0;
+            ASSERT_TRUE(db.get(key, v_get));
+            ASSERT_EQ(v_get, 1789);
+        }
+
+        cleanup_directory(rocksdb_test_dir);
+        {
+            sophos::RocksDBCounter db(rocksdb_test_dir, profile);
+
+            uint32_t v_get = 0;
+            ASSERT_TRUE(db.set("key", 42));
+            ASSERT_TRUE(db.get("key", v_get));
+            ASSERT_EQ(v_get, 42);
+        }
+    }
+
+    ASSERT_THROW(RocksDBProfile::named("unknown"), std::invalid_argument);
+
+    // profile files
+    const std::string profile_path = "rocksdb_test_profile.conf";
+    {
+        std::ofstream out(profile_path);
+        out << "# small nodes\n"
+            << "profile = read-mostly\n"
+            << "\n"
+            << "write_buffer_size = 32M\n"
+            << "bloom_bits_per_key = 12\n"
+            << "partition_filters = false\n";
+    }
+
+    RocksDBProfile profile = RocksDBProfile::load(profile_path);
+    EXPECT_EQ(profile.table_format, RocksDBProfile::TableFormat::BlockBased);
+    EXPECT_EQ(profile.write_buffer_size, 32UL << 20);
+    EXPECT_EQ(profile.bloom_bits_per_key, 12);
+    EXPECT_FALSE(profile.partition_filters);
+    // unchanged value of the base profile
+    EXPECT_EQ(profile.block_cache_size,
+              RocksDBProfile::read_mostly().block_cache_size);
+
+    {
+        std::ofstream out(profile_path);
+        out << "write_buffer_size = 32X\n";
+    }
+    ASSERT_THROW(RocksDBProfile::load(profile_path), std::invalid_argument);
+    {
+        std::ofstream out(profile_path);
+        out << "unknown_key = 1\n";
+    }
+    ASSERT_THROW(RocksDBProfile::load(profile_path), std::invalid_argument);
+
+    utility::remove_file(profile_path);
+    ASSERT_THROW(RocksDBProfile::load(profile_path), std::invalid_argument);
+}
+
 class TestSerializer
 {
 public:
@@ -322,5 +606,150 @@ TEST(rocksdb, lists_persistence)
     ASSERT_EQ(l2, l_get);
 }
 
+
+TEST(rocksdb, list_logs)
+{
+    using log_store_type = sophos::RockDBListLogStore<uint64_t, TestSerializer>;
+
+    cleanup_directory(rocksdb_test_dir);
+
+    std::array<uint8_t, 2> key1 = {{0, 1}};
+    std::array<uint8_t, 2> key2 = {{0, 2}};
+    std::array<uint8_t, 2> key3 = {{0, 3}};
+
+    // a list written by RockDBListStore
+    {
+        sophos::RockDBListStore<uint64_t, TestSerializer> db(rocksdb_test_dir);
+        ASSERT_TRUE(db.put(key1, std::list<uint64_t>{{1, 2}}));
+    }
+
+    std::unique_ptr<log_store_type> db(new log_store_type(rocksdb_test_dir));
+
+    std::vector<uint64_t>    v_get;
+    log_store_type::seq_type last_seq;
+
+    ASSERT_EQ(db->get(key1, v_get, last_seq), 1);
+    ASSERT_EQ(v_get, (std::vector<uint64_t>{1, 2}));
+    ASSERT_EQ(last_seq, 0);
+
+    ASSERT_TRUE(db->append(key1, {3, 4}));
+    ASSERT_TRUE(db->append(key1, {}));
+    ASSERT_TRUE(db->append(key1, {5}));
+    ASSERT_TRUE(db->append(key2, {42}));
+
+    v_get.clear();
+    ASSERT_EQ(db->get(key1, v_get, last_seq), 3);
+    ASSERT_EQ(v_get, (std::vector<uint64_t>{1, 2, 3, 4, 5}));
+    ASSERT_EQ(last_seq, 2);
+
+    // the segments appended after the compaction point are kept
+    ASSERT_TRUE(db->append(key1, {6}));
+    ASSERT_TRUE(db->compact(key1, last_seq, {1, 3, 5}));
+
+    v_get.clear();
+    ASSERT_EQ(db->get(key1, v_get, last_seq), 2);
+    ASSERT_EQ(v_get, (std::vector<uint64_t>{1, 3, 5, 6}));
+    ASSERT_EQ(last_seq, 3);
+
+    ASSERT_TRUE(db->append(key1, {7}));
+    ASSERT_EQ(db->get(key1, v_get, last_seq), 3);
+    ASSERT_EQ(last_seq, 4);
+
+    // compacting to an empty list removes it
+    ASSERT_TRUE(db->compact(key2, 1, {}));
+    v_get.clear();
+    ASSERT_EQ(db->get(key2, v_get, last_seq), 0);
+    ASSERT_TRUE(v_get.empty());
+    ASSERT_EQ(last_seq, 0);
+    ASSERT_EQ(db->get(key3, v_get, last_seq), 0);
+
+    // the logs are persistent
+    db->flush(true);
+    db.reset(new log_store_type(rocksdb_test_dir));
+
+    v_get.clear();
+    ASSERT_EQ(db->get(key1, v_get, last_seq), 3);
+    ASSERT_EQ(v_get, (std::vector<uint64_t>{1, 3, 5, 6, 7}));
+}
+
+TEST(rocksdb, binary_lists)
+{
+    using utility::decode_list;
+    using utility::encode_list;
+
+    // sorted lists are delta encoded, the others are copied
+    const std::vector<uint64_t> sorted{{1, 2, 300, uint64_t(1) << 40, UINT64_MAX}};
+    const std::vector<uint64_t> unsorted{{31416, 1789, 8080}};
+
+    const std::string sorted_enc   = encode_list(sorted.data(), sorted.size());
+    const std::string unsorted_enc = encode_list(unsorted.data(), 3);
+    ASSERT_LT(sorted_enc.size(), sorted.size() * sizeof(uint64_t));
+
+    std::vector<uint64_t> v_get{{42}};
+    ASSERT_TRUE(decode_list(sorted_enc.data(), sorted_enc.size(), v_get));
+    ASSERT_TRUE(decode_list(unsorted_enc.data(), unsorted_enc.size(), v_get));
+    ASSERT_EQ(v_get,
+              (std::vector<uint64_t>{
+                  42, 1, 2, 300, uint64_t(1) << 40, UINT64_MAX, 31416, 1789, 8080}));
+
+    // truncated or extended lists are rejected, and out is left unchanged
+    v_get.clear();
+    for (const std::string& enc : {sorted_enc, unsorted_enc}) {
+        for (size_t size = 0; size < enc.size(); size++) {
+            ASSERT_FALSE(decode_list(enc.data(), size, v_get));
+        }
+        const std::string extended = enc + '\0';
+        ASSERT_FALSE(decode_list(extended.data(), extended.size(), v_get));
+    }
+    ASSERT_TRUE(v_get.empty());
+
+    const std::string empty_enc = encode_list<uint64_t>(nullptr, 0);
+    ASSERT_TRUE(decode_list(empty_enc.data(), empty_enc.size(), v_get));
+    ASSERT_TRUE(v_get.empty());
+
+    // the stores read the lists written by the legacy serializer
+    cleanup_directory(rocksdb_test_dir);
+
+    std::array<uint8_t, 2> key1 = {{0, 1}};
+    std::array<uint8_t, 2> key2 = {{0, 2}};
+
+    std::list<uint64_t> l1{{1, 2}};
+    std::list<uint64_t> l2{{1789, 31416, 8080}};
+    std::list<uint64_t> l_get;
+    {
+        sophos::RockDBListStore<uint64_t, TestSerializer> db(rocksdb_test_dir);
+        ASSERT_TRUE(db.put(key1, l1));
+    }
+
+    using binary_store_type
+        = sophos::RockDBListStore<uint64_t,
+                                  sophos::binary_serialization<uint64_t>>;
+    {
+        binary_store_type db(rocksdb_test_dir);
+        ASSERT_TRUE(db.get(key1, l_get));
+        ASSERT_EQ(l1, l_get);
+
+        ASSERT_TRUE(db.put(key2, l2));
+        ASSERT_TRUE(db.get(key2, l_get));
+        ASSERT_EQ(l2, l_get);
+    }
+
+    using log_store_type
+        = sophos::RockDBListLogStore<uint64_t,
+                                     sophos::binary_serialization<uint64_t>>;
+
+    log_store_type           db(rocksdb_test_dir);
+    log_store_type::seq_type last_seq;
+
+    ASSERT_TRUE(db.append(key1, sorted));
+    ASSERT_TRUE(db.append(key1, unsorted));
+
+    v_get.clear();
+    ASSERT_EQ(db.get(key1, v_get, last_seq), 3);
+    ASSERT_EQ(v_get,
+              (std::vector<uint64_t>{
+                  1, 2, 1, 2, 300, uint64_t(1) << 40, UINT64_MAX, 31416, 1789, 8080}));
+}
+
 } // namespace test
 } // namespace sse
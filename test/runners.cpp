@@ -11,6 +11,7 @@
 #include <grpcpp/grpcpp.h>
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <fstream>
 #include <functional>
@@ -131,6 +132,71 @@ TYPED_TEST(RunnerTest, search_async)
     sse::test::test_search_correctness(this->client_, test_db);
 }
 
+TYPED_TEST(RunnerTest, search_async_threads)
+{
+    this->server_->set_async_search(true);
+    this->server_->set_search_threads_count(4);
+
+    std::list<uint64_t> long_list;
+    for (size_t i = 0; i < 1000; i++) {
+        long_list.push_back(i);
+    }
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", long_list}, {"kw_2", {0}}};
+
+
+    sse::test::insert_database(this->client_, test_db);
+    sse::test::test_search_correctness(this->client_, test_db);
+}
+
+TYPED_TEST(RunnerTest, search_async_cancelled)
+{
+    using ClientRunner = typename TypeParam::ClientRunner;
+
+    this->server_->set_async_search(true);
+
+    std::list<uint64_t> long_list;
+    for (size_t i = 0; i < 4000; i++) {
+        long_list.push_back(i);
+    }
+    const std::string                                keyword = "kw_1";
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{keyword, long_list}};
+
+    sse::test::insert_database(this->client_, test_db);
+
+    // With a small flow control window, the server can only write a few
+    // results before the client reads them: the others fill its buffer, and
+    // the search blocks.
+    grpc::ChannelArguments args;
+    args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES, 1024);
+
+    this->client_.reset(nullptr);
+    this->client_.reset(new ClientRunner(
+        grpc::CreateCustomChannel(TypeParam::server_address,
+                                  grpc::InsecureChannelCredentials(),
+                                  args),
+        TypeParam::client_db_path));
+
+    // Stop reading after the first result, and cancel the call by leaving
+    // the search with an exception
+    struct Cancel
+    {
+    };
+    EXPECT_THROW(this->client_->search(keyword,
+                                       [](uint64_t) {
+                                           std::this_thread::sleep_for(
+                                               std::chrono::milliseconds(200));
+                                           throw Cancel();
+                                       }),
+                 Cancel);
+
+    // The cancelled search released its worker: the server still answers,
+    // and can be shut down
+    sse::test::test_search_correctness(this->client_, test_db);
+}
+
 TYPED_TEST(RunnerTest, insert_session)
 {
     this->client_->start_update_session();
@@ -14,6 +14,7 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -34,8 +35,9 @@ constexpr auto sophos_test_dir  = SSE_SOPHOS_TEST_DIR;
 constexpr auto client_data_path = SSE_SOPHOS_TEST_DIR "/client.dat";
 constexpr auto server_data_path = SSE_SOPHOS_TEST_DIR "/server.dat";
 
+template<class Server>
 void create_client_server(std::unique_ptr<sophos::SophosClient>& client,
-                          std::unique_ptr<sophos::SophosServer>& server)
+                          std::unique_ptr<Server>&               server)
 {
     // check that the key files do not already exist
     ASSERT_FALSE(utility::exists(client_sk_path));
@@ -80,7 +82,7 @@ void create_client_server(std::unique_ptr<sophos::SophosClient>& client,
         sse::crypto::Key<SophosClient::kKeySize>(derivation_master_key.data()),
         sse::crypto::Key<SophosClient::kKeySize>(rsa_prg_key.data())));
 
-    server.reset(new sophos::SophosServer(server_data_path, tdp.public_key()));
+    server.reset(new Server(server_data_path, tdp.public_key()));
 }
 
 void restart_client_server(std::unique_ptr<sophos::SophosClient>& client,
@@ -198,11 +200,11 @@ inline void check_same_results(const std::list<uint64_t>& l1,
 }
 
 // To test all the different search algorithms
-template<class SearchFun>
+template<class Server = SophosServer, class SearchFun>
 static void test_search_function(SearchFun search_fun)
 {
     std::unique_ptr<sophos::SophosClient> client;
-    std::unique_ptr<sophos::SophosServer> server;
+    std::unique_ptr<Server>               server;
 
     // start by cleaning up the test directory
     sse::test::cleanup_directory(sophos_test_dir);
@@ -254,6 +256,79 @@ TEST(sophos, search_parallel_light)
     test_search_function(search_fun);
 }
 
+TEST(sophos, search_vec)
+{
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search(req, res_vec);
+
+        return std::list<uint64_t>(res_vec.begin(), res_vec.end());
+    };
+    test_search_function(search_fun);
+}
+
+TEST(sophos, search_parallel_vec)
+{
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search_parallel(req, 2, res_vec);
+
+        return std::list<uint64_t>(res_vec.begin(), res_vec.end());
+    };
+    test_search_function(search_fun);
+}
+
+TEST(sophos, search_parallel_checkpoints)
+{
+    std::unique_ptr<sophos::SophosClient> client;
+    std::unique_ptr<sophos::SophosServer> server;
+
+    sse::test::cleanup_directory(sophos_test_dir);
+    create_client_server(client, server);
+
+    server->enable_checkpoints(16);
+
+    std::list<uint64_t> long_list;
+    for (size_t i = 0; i < 1000; i++) {
+        long_list.push_back(i);
+    }
+    std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", long_list}, {"kw_2", {0, 1, 2}}};
+
+    sse::test::insert_database(client, server, test_db);
+
+    auto search_req_fun = [](SophosClient& client, const std::string& kw) {
+        return client.search_request(kw);
+    };
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        return server.search_parallel(req, 2);
+    };
+
+    // the first search stores the checkpoints, and the second one uses them
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+    EXPECT_EQ(server->checkpoints()->keyword_count(), 1);
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+
+    // the head of the chain is not covered by the checkpoints
+    for (uint64_t i = 1000; i < 1100; i++) {
+        sse::test::insert_entry(client, server, "kw_1", i);
+        test_db["kw_1"].push_back(i);
+    }
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+
+    server->disable_checkpoints();
+    EXPECT_EQ(server->checkpoints(), nullptr);
+    sse::test::test_search_correctness(
+        client, server, test_db, search_req_fun, search_fun);
+}
+
 TEST(sophos, search_callback)
 {
     std::mutex          res_list_mutex;
@@ -310,6 +385,89 @@ TEST(sophos, search_parallel_light_callback)
     };
     test_search_function(search_fun);
 }
+
+TEST(sophos, mmap_insertion_search)
+{
+    std::unique_ptr<sophos::SophosClient>     client;
+    std::unique_ptr<sophos::SophosMMapServer> server;
+
+    sse::test::cleanup_directory(sophos_test_dir);
+    create_client_server(client, server);
+
+    std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1}}, {"kw_2", {0}}, {"kw_3", {0}}};
+
+    sse::test::insert_database(client, server, test_db);
+    sse::test::test_search_correctness(client, server, test_db);
+
+    // reopen the table
+    const std::string public_key = server->public_key();
+    server.reset(new sophos::SophosMMapServer(server_data_path, public_key));
+
+    sse::test::insert_entry(client, server, "kw_2", 1);
+    test_db["kw_2"].push_back(1);
+    sse::test::test_search_correctness(client, server, test_db);
+}
+
+TEST(sophos, mmap_search)
+{
+    auto search_fun = [](SophosMMapServer& server, SearchRequest& req) {
+        return server.search(req);
+    };
+    test_search_function<SophosMMapServer>(search_fun);
+}
+
+TEST(sophos, mmap_search_parallel)
+{
+    auto search_fun = [](SophosMMapServer& server, SearchRequest& req) {
+        return server.search_parallel(req, 2);
+    };
+    test_search_function<SophosMMapServer>(search_fun);
+}
+
+template<class Server>
+static void test_build_edb()
+{
+    std::unique_ptr<sophos::SophosClient> client;
+    std::unique_ptr<Server>               server;
+
+    sse::test::cleanup_directory(sophos_test_dir);
+    create_client_server(client, server);
+
+    // the database is built offline
+    const std::string public_key = server->public_key();
+    server.reset(nullptr);
+
+    std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1, 2, 3, 4}}, {"kw_2", {0}}, {"kw_3", {5, 7}}};
+
+    std::vector<UpdateRequest> requests;
+    for (const auto& kw_list : test_db) {
+        for (uint64_t index : kw_list.second) {
+            requests.push_back(client->insertion_request(kw_list.first, index));
+        }
+    }
+    Server::build_edb(server_data_path, requests.begin(), requests.end());
+    ASSERT_FALSE(utility::exists(std::string(server_data_path) + ".build_tmp"));
+
+    server.reset(new Server(server_data_path, public_key));
+    sse::test::test_search_correctness(client, server, test_db);
+
+    // the database can still be updated
+    sse::test::insert_entry(client, server, "kw_2", 8);
+    test_db["kw_2"].push_back(8);
+    sse::test::test_search_correctness(client, server, test_db);
+}
+
+TEST(sophos, build_edb)
+{
+    test_build_edb<SophosServer>();
+}
+
+TEST(sophos, mmap_build_edb)
+{
+    test_build_edb<SophosMMapServer>();
+}
 } // namespace test
 } // namespace sophos
 } // namespace sse
\ No newline at end of file
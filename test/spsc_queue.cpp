@@ -0,0 +1,65 @@
+#include <sse/schemes/utils/spsc_queue.hpp>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+TEST(spsc_queue, bounded)
+{
+    SPSCQueue<int> queue(3); // rounded up to 4
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(queue.try_push(int(i)));
+    }
+    ASSERT_FALSE(queue.try_push(4));
+
+    int v;
+    ASSERT_TRUE(queue.try_pop(v));
+    ASSERT_EQ(v, 0);
+    ASSERT_TRUE(queue.try_push(4));
+
+    queue.close();
+    for (int i = 1; i <= 4; i++) {
+        ASSERT_FALSE(queue.done());
+        ASSERT_TRUE(queue.try_pop(v));
+        ASSERT_EQ(v, i);
+    }
+    ASSERT_FALSE(queue.try_pop(v));
+    ASSERT_TRUE(queue.done());
+}
+
+TEST(spsc_queue, producer_consumer)
+{
+    constexpr size_t kElementsCount = 100000;
+
+    SPSCQueue<std::vector<size_t>> queue(16);
+
+    std::thread producer([&queue]() {
+        for (size_t i = 0; i < kElementsCount; i++) {
+            queue.push(std::vector<size_t>(1, i));
+        }
+        queue.close();
+    });
+
+    // the elements are received in order
+    size_t              expected = 0;
+    std::vector<size_t> v;
+    while (!queue.done()) {
+        if (queue.try_pop(v)) {
+            ASSERT_EQ(v.size(), 1);
+            ASSERT_EQ(v[0], expected++);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    ASSERT_EQ(expected, kElementsCount);
+}
+
+} // namespace test
+} // namespace sse
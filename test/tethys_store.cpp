@@ -172,6 +172,47 @@ void test_store(size_t v_size)
         ASSERT_EQ(std::set<size_t>(res.begin(), res.end()),
                   std::set<size_t>(kv.second.begin(), kv.second.end()));
     }
+
+    // the batched reads must return the same buckets as the single ones,
+    // with file IOs and with a memory mapped table
+    std::vector<key_type> keys;
+    for (const auto& kv : test_kv) {
+        keys.push_back(kv.first);
+    }
+
+    for (bool memory_map : {false, true}) {
+        store.use_memory_map(memory_map);
+
+        auto bucket_pairs = store.get_buckets_batch(keys);
+        ASSERT_EQ(bucket_pairs.size(), keys.size());
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto expected = store.get_buckets(keys[i]);
+
+            ASSERT_EQ(bucket_pairs[i].index_0, expected.index_0);
+            ASSERT_EQ(bucket_pairs[i].index_1, expected.index_1);
+            ASSERT_EQ(bucket_pairs[i].payload_0, expected.payload_0);
+            ASSERT_EQ(bucket_pairs[i].payload_1, expected.payload_1);
+        }
+    }
+    store.use_memory_map(false);
+
+    // with a prewarmed page cache, the lists are read without any miss
+    store.set_page_cache_budget(64 * keys.size() * kPageSize);
+    store.prewarm_page_cache(keys);
+    ASSERT_NE(store.page_cache(), nullptr);
+
+    for (const auto& kv : test_kv) {
+        std::vector<size_t> res = store.get_list(kv.first);
+
+        ASSERT_EQ(std::set<size_t>(res.begin(), res.end()),
+                  std::set<size_t>(kv.second.begin(), kv.second.end()));
+    }
+    ASSERT_EQ(store.page_cache()->misses(), 0);
+    ASSERT_EQ(store.page_cache()->hits(), 2 * keys.size());
+
+    store.set_page_cache_budget(0);
+    ASSERT_EQ(store.page_cache(), nullptr);
 }
 
 static void cleanup_store()
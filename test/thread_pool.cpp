@@ -0,0 +1,136 @@
+#include "allocation_counter.hpp"
+
+#include <sse/schemes/utils/thread_pool.hpp>
+
+#include <array>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+constexpr uint32_t kThreadsCount = 4;
+constexpr size_t   kTasksCount   = 100000;
+
+TEST(thread_pool, enqueue)
+{
+    ThreadPool pool(kThreadsCount);
+
+    std::vector<std::future<size_t>> futures;
+    for (size_t i = 0; i < 1000; i++) {
+        futures.push_back(pool.enqueue([](size_t a, size_t b) { return a * b; },
+                                       i,
+                                       size_t(3)));
+    }
+
+    for (size_t i = 0; i < futures.size(); i++) {
+        ASSERT_EQ(futures[i].get(), 3 * i);
+    }
+
+    // exceptions are passed through the future
+    auto fut = pool.enqueue([]() -> int { throw std::runtime_error("test"); });
+    ASSERT_THROW(fut.get(), std::runtime_error);
+}
+
+TEST(thread_pool, post)
+{
+    std::atomic<size_t> counter{0};
+    {
+        ThreadPool pool(kThreadsCount);
+
+        for (size_t i = 0; i < kTasksCount; i++) {
+            pool.post([&counter]() { counter++; });
+        }
+        // join waits for all the posted tasks
+        pool.join();
+
+        ASSERT_EQ(counter.load(), kTasksCount);
+        ASSERT_THROW(pool.post([]() {}), std::runtime_error);
+    }
+}
+
+TEST(thread_pool, post_batch)
+{
+    std::atomic<size_t> sum{0};
+
+    ThreadPool pool(kThreadsCount);
+
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < kTasksCount; i++) {
+        tasks.emplace_back([&sum, i]() { sum += i; });
+    }
+    pool.post_batch(tasks.begin(), tasks.end());
+
+    // empty batch
+    pool.post_batch(tasks.end(), tasks.end());
+
+    pool.join();
+
+    ASSERT_EQ(sum.load(), kTasksCount * (kTasksCount - 1) / 2);
+}
+
+TEST(thread_pool, nested_posts)
+{
+    // tasks posted by the workers go to their own queue, and are stolen by
+    // the idle workers
+    std::atomic<size_t> counter{0};
+
+    ThreadPool pool(kThreadsCount);
+
+    std::promise<void> done;
+
+    pool.post([&]() {
+        for (size_t i = 0; i < kTasksCount; i++) {
+            pool.post([&]() {
+                if (++counter == kTasksCount) {
+                    done.set_value();
+                }
+            });
+        }
+    });
+
+    done.get_future().wait();
+    ASSERT_EQ(counter.load(), kTasksCount);
+}
+
+TEST(thread_pool, task_storage)
+{
+    int value = 0;
+
+    // small callables are stored inline
+    {
+        AllocationCounter counter;
+
+        ThreadPool::Task task([&value]() { value++; });
+        ThreadPool::Task moved(std::move(task));
+
+        ASSERT_FALSE(task);
+        ASSERT_TRUE(moved);
+        moved();
+
+        ASSERT_EQ(counter.count(), 0);
+    }
+    ASSERT_EQ(value, 1);
+
+    // large and move-only callables are supported
+    std::array<uint64_t, 32>  large{{0}};
+    std::unique_ptr<uint64_t> ptr(new uint64_t(42));
+
+    ThreadPool::Task task(
+        [large, &value]() { value += static_cast<int>(large.size()); });
+    ThreadPool::Task move_only([p = std::move(ptr), &value]() { value += *p; });
+
+    ThreadPool::Task assigned;
+    assigned = std::move(task);
+    assigned();
+    move_only();
+
+    ASSERT_EQ(value, 1 + 32 + 42);
+}
+
+} // namespace test
+} // namespace sse